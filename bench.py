@@ -0,0 +1,523 @@
+#!/usr/bin/env python
+##
+# Copyright (c) 2026 Apple Inc. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+##
+
+"""
+Micro-benchmarks for the kerberos extension.
+
+Examples:
+
+    ./bench.py calls
+
+    ./bench.py -s HTTP@example.com -n 200000 calls > after.json
+
+    ./bench.py -s HTTP@example.com -t 2 threads
+
+    ./bench.py -s HTTP@example.com -t 2 batch
+
+    ./bench.py -s HTTP@example.com -t 2 pool
+
+    ./bench.py -s HTTP@example.com -t 2 loop
+
+    ./bench.py -s HTTP@example.com -t 2 acceptor
+
+    ./bench.py -s HTTP@example.com -t 2 rcache
+
+Each result is printed as one JSON object per line, so runs against two
+builds of the module can be compared with diff or loaded into a notebook.
+
+The calls benchmark measures the per-call cost of the bindings themselves:
+it only uses accessors that do no GSSAPI work, on contexts that need no
+credentials, so it runs without a KDC or keytab.
+
+The threads benchmark runs calls that wait on the keytab or KDC on 1, 2, 4,
+... threads, next to a pure Python thread that counts loop iterations. It
+reports the calls per second at each thread count and the share of its
+solo rate that the Python thread still achieved ("python_share"). The
+bindings release the GIL for the duration of such calls, so python_share
+should stay close to 1 however many threads are busy in Kerberos. Calls
+that fail, for instance for want of a keytab, are counted too: they take
+the same path through the bindings.
+
+The batch benchmark accepts the same list of Negotiate tokens once with a
+loop over authGSSServerAuthenticate and once with a single call to
+authGSSServerAuthenticateBatch, which spreads the accepts over a native
+thread pool, and reports the tokens per second for each. The tokens come
+from a client context for the service when a ticket for it is available,
+and are otherwise placeholders that the server rejects.
+
+The pool benchmark submits the same tokens to a
+concurrent.futures.ThreadPoolExecutor and to a kerberos.WorkerPool of the
+same size, waiting on the results in windows of 256, and reports the
+tokens per second for each.
+
+The loop benchmark keeps 64 requests in flight on an asyncio event loop
+while a ticker coroutine sleeps for 1 ms at a time, and reports how late
+the ticker woke (median, 99th percentile and worst, in milliseconds) and
+the requests completed per second. The requests call the blocking
+bindings directly, go through loop.run_in_executor, or await an
+AsyncWorkerPool with as many threads as the default executor.
+
+The acceptor benchmark creates and cleans server contexts for seconds with
+the acceptor credential cache turned off and then on, and then with the
+default keytab loaded into memory if that succeeds, and reports the
+contexts per second and the cache counters for each.
+
+The rcache benchmark accepts a fresh token for each request for seconds
+with each replay cache type (the library default, "file", "none",
+"memory" and "shared", on the segment "/pykerberos-bench"), and reports the
+accepts per second, timing only the accept and not the client call that
+made the token. For "memory" it also reports the mean lookup and insert
+times of the replay cache.
+"""
+
+import kerberos
+import getopt
+import json
+import os
+import sys
+import threading
+import time
+import timeit
+
+
+
+def main():
+    # Extract arguments
+    service = "HTTP@localhost"
+    number = 100000
+    repeat = 5
+    seconds = 1.0
+    allowedActions = ("calls", "threads", "batch", "pool", "loop", "acceptor",
+                      "rcache",)
+
+    options, args = getopt.getopt(sys.argv[1:], "s:n:r:t:")
+
+    for option, value in options:
+        if option == "-s":
+            service = value
+        elif option == "-n":
+            number = int(value)
+        elif option == "-r":
+            repeat = int(value)
+        elif option == "-t":
+            seconds = float(value)
+
+    actions = set()
+    for arg in args:
+        if arg in allowedActions:
+            actions.add(arg)
+        else:
+            print("Action not allowed: %s" % (arg,))
+            sys.exit(1)
+
+    if "calls" in actions:
+        benchCalls(service, number, repeat)
+
+    if "threads" in actions:
+        benchThreads(service, seconds)
+
+    if "batch" in actions:
+        benchBatch(service, seconds)
+
+    if "pool" in actions:
+        benchPool(service, seconds)
+
+    if "loop" in actions:
+        benchLoop(service, seconds)
+
+    if "acceptor" in actions:
+        benchAcceptor(service, seconds)
+
+    if "rcache" in actions:
+        benchReplayCache(service, seconds)
+
+
+
+def report(name, **values):
+    record = {"bench": name}
+    record.update(values)
+    print(json.dumps(record, sort_keys=True))
+    sys.stdout.flush()
+
+
+
+def benchCalls(service, number, repeat):
+    """
+    Time each binding call over number iterations and report the best of
+    repeat runs in nanoseconds per call.
+    """
+    _ignore_result, client = kerberos.authGSSClientInit(service)
+    _ignore_result, server = kerberos.authGSSServerInit("DELEGATE")
+
+    calls = [
+        ("authGSSClientResponse", kerberos.authGSSClientResponse, (client,)),
+        ("authGSSClientResponseConf", kerberos.authGSSClientResponseConf, (client,)),
+        ("authGSSClientUserName", kerberos.authGSSClientUserName, (client,)),
+        ("authGSSServerHasDelegated", kerberos.authGSSServerHasDelegated, (server,)),
+        ("authGSSServerUserName", kerberos.authGSSServerUserName, (server,)),
+    ]
+    if hasattr(kerberos, "Base64Encoder"):
+        calls.append(
+            ("Base64Encoder.update", kerberos.Base64Encoder().update, (b"abc",))
+        )
+
+    for name, function, arguments in calls:
+        timer = timeit.Timer(lambda: function(*arguments))
+        best = min(timer.repeat(repeat=repeat, number=number))
+        report("calls", call=name, ns=round(best * 1e9 / number, 1))
+
+    # An empty loop, for subtracting the cost of the harness itself
+    timer = timeit.Timer(lambda: None)
+    best = min(timer.repeat(repeat=repeat, number=number))
+    report("calls", call="baseline", ns=round(best * 1e9 / number, 1))
+
+    kerberos.authGSSClientClean(client)
+    kerberos.authGSSServerClean(server)
+
+
+
+def benchThreads(service, seconds):
+    """
+    Run each blocking call on an increasing number of threads for seconds
+    and report its rate alongside the progress of a pure Python thread.
+    """
+    serviceName, _ignore_sep, hostname = service.partition("@")
+
+    def principalDetails():
+        kerberos.getServerPrincipalDetails(serviceName, hostname)
+
+    def serverInit():
+        kerberos.GSSServerContext(service).clean()
+
+    calls = [
+        ("getServerPrincipalDetails", principalDetails),
+        ("GSSServerContext", serverInit),
+    ]
+
+    def ticker(stop, counts):
+        ticks = 0
+        while not stop.is_set():
+            ticks += 1
+        counts.append(ticks)
+
+    def worker(function, deadline, counts):
+        count = 0
+        while time.monotonic() < deadline:
+            try:
+                function()
+            except kerberos.KrbError:
+                pass
+            count += 1
+        counts.append(count)
+
+    def run(function, threads):
+        stop = threading.Event()
+        ticks = []
+        counts = []
+        deadline = time.monotonic() + seconds
+        workers = [
+            threading.Thread(target=worker, args=(function, deadline, counts))
+            for _ignore_i in range(threads)
+        ]
+        tick = threading.Thread(target=ticker, args=(stop, ticks))
+        tick.start()
+        for t in workers:
+            t.start()
+        if not workers:
+            time.sleep(seconds)
+        for t in workers:
+            t.join()
+        stop.set()
+        tick.join()
+        return sum(counts) / seconds, ticks[0]
+
+    _ignore_rate, solo = run(None, 0)
+
+    maximum = max(4, os.cpu_count() or 1)
+    for name, function in calls:
+        threads = 1
+        while threads <= maximum:
+            rate, ticks = run(function, threads)
+            report(
+                "threads", call=name, threads=threads,
+                calls_per_s=round(rate, 1),
+                python_share=round(float(ticks) / solo, 3) if solo else 0.0,
+            )
+            threads *= 2
+
+
+
+def benchToken(service):
+    """
+    A Negotiate token for service, and where it came from.
+    """
+    try:
+        token = kerberos.authGSSClientNegotiate(service).split(" ", 1)[1]
+        return token, "client"
+    except kerberos.KrbError:
+        return "YIIBdwYJKoZIhvcSAQICAQBuggFmMIIBYqADAgEFoQMCAQ4=", "placeholder"
+
+
+
+def benchBatch(service, seconds):
+    """
+    Accept batches of tokens for seconds, first one call per token and then
+    one call per batch, and report the tokens accepted per second.
+    """
+    token, tokens = benchToken(service)
+
+    def sequential(items):
+        for service, token in items:
+            try:
+                kerberos.authGSSServerAuthenticate(service, token)
+            except kerberos.KrbError:
+                pass
+
+    def batch(items):
+        kerberos.authGSSServerAuthenticateBatch(items)
+
+    for size in (16, 256):
+        items = [(service, token)] * size
+        for name, function in (("sequential", sequential), ("batch", batch)):
+            count = 0
+            start = time.monotonic()
+            deadline = start + seconds
+            while time.monotonic() < deadline:
+                function(items)
+                count += size
+            elapsed = time.monotonic() - start
+            report(
+                "batch", call=name, size=size, tokens=tokens,
+                tokens_per_s=round(count / elapsed, 1),
+            )
+
+
+
+def benchPool(service, seconds):
+    """
+    Accept tokens for seconds through a Python thread pool and through a
+    native worker pool, and report the tokens accepted per second.
+    """
+    from concurrent.futures import ThreadPoolExecutor
+
+    token, tokens = benchToken(service)
+    threads = os.cpu_count() or 1
+    window = 256
+
+    def result(future):
+        try:
+            future.result()
+        except kerberos.KrbError:
+            pass
+
+    def run(submit):
+        count = 0
+        start = time.monotonic()
+        deadline = start + seconds
+        while time.monotonic() < deadline:
+            futures = [submit() for _ignore_i in range(window)]
+            for future in futures:
+                result(future)
+            count += window
+        return count / (time.monotonic() - start)
+
+    with ThreadPoolExecutor(threads) as executor:
+        rate = run(
+            lambda: executor.submit(
+                kerberos.authGSSServerAuthenticate, service, token
+            )
+        )
+    report(
+        "pool", pool="ThreadPoolExecutor", threads=threads, tokens=tokens,
+        tokens_per_s=round(rate, 1),
+    )
+
+    with kerberos.WorkerPool(threads, max_queued=window) as pool:
+        rate = run(lambda: pool.authGSSServerAuthenticate(service, token))
+    report(
+        "pool", pool="WorkerPool", threads=threads, tokens=tokens,
+        tokens_per_s=round(rate, 1),
+    )
+
+
+
+def benchLoop(service, seconds):
+    """
+    Measure event loop latency for seconds while requests that wait on the
+    keytab or KDC run in three different ways.
+    """
+    import asyncio
+
+    token, tokens = benchToken(service)
+    concurrency = 64
+
+    def authenticate():
+        try:
+            kerberos.authGSSServerAuthenticate(service, token)
+        except kerberos.KrbError:
+            pass
+
+    async def blocking():
+        authenticate()
+
+    async def executor():
+        await asyncio.get_running_loop().run_in_executor(None, authenticate)
+
+    async def pooled(pool):
+        try:
+            await pool.authGSSServerAuthenticate(service, token)
+        except kerberos.KrbError:
+            pass
+
+    async def run(request):
+        deadline = time.monotonic() + seconds
+        lags = []
+        counts = []
+
+        async def ticker():
+            while time.monotonic() < deadline:
+                start = time.monotonic()
+                await asyncio.sleep(0.001)
+                lags.append(time.monotonic() - start - 0.001)
+
+        async def client():
+            count = 0
+            while time.monotonic() < deadline:
+                await request()
+                count += 1
+            counts.append(count)
+
+        await asyncio.gather(
+            ticker(), *[client() for _ignore_i in range(concurrency)]
+        )
+        lags.sort()
+        return lags, sum(counts) / seconds
+
+    async def runAll():
+        # As many threads as the default executor has
+        pool = kerberos.AsyncWorkerPool(
+            min(32, (os.cpu_count() or 1) + 4), max_queued=concurrency
+        )
+        requests = [
+            ("blocking", blocking),
+            ("run_in_executor", executor),
+            ("AsyncWorkerPool", lambda: pooled(pool)),
+        ]
+        for name, request in requests:
+            lags, rate = await run(request)
+            report(
+                "loop", call=name, tokens=tokens,
+                lag_p50_ms=round(lags[len(lags) // 2] * 1000, 3),
+                lag_p99_ms=round(lags[len(lags) * 99 // 100] * 1000, 3),
+                lag_max_ms=round(lags[-1] * 1000, 3),
+                calls_per_s=round(rate, 1),
+            )
+        pool.close()
+
+    asyncio.run(runAll())
+
+
+
+def benchAcceptor(service, seconds):
+    """
+    Create and clean server contexts for seconds without and with cached
+    acceptor credentials, and report the contexts per second.
+    """
+    ttl = kerberos.acceptorCacheStats()["ttl"]
+    runs = [("uncached", 0, False), ("cached", ttl or 300, False)]
+    if kerberos.acceptorCacheStats()["keytab"] is None:
+        runs.append(("loaded", 0, True))
+
+    for name, seconds_ttl, load in runs:
+        if load:
+            try:
+                kerberos.loadKeytab()
+            except kerberos.KrbError:
+                continue
+        kerberos.setAcceptorCacheTTL(seconds_ttl)
+        before = kerberos.acceptorCacheStats()
+        count = 0
+        start = time.monotonic()
+        deadline = start + seconds
+        while time.monotonic() < deadline:
+            try:
+                kerberos.GSSServerContext(service).clean()
+            except kerberos.KrbError:
+                pass
+            count += 1
+        elapsed = time.monotonic() - start
+        after = kerberos.acceptorCacheStats()
+        report(
+            "acceptor", call=name,
+            contexts_per_s=round(count / elapsed, 1),
+            hits=after["hits"] - before["hits"],
+            misses=after["misses"] - before["misses"],
+        )
+        if load:
+            kerberos.unloadKeytab()
+
+    kerberos.setAcceptorCacheTTL(ttl)
+
+
+
+def benchReplayCache(service, seconds):
+    """
+    Accept fresh tokens for seconds with each replay cache type, and report
+    the accepts per second.
+    """
+    token, tokens = benchToken(service)
+
+    kerberos.attachReplayCache("/pykerberos-bench")
+
+    for rcache in (None, "file", "none", "memory", "shared"):
+        before = kerberos.replayCacheStats()
+        count = 0
+        elapsed = 0.0
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            if tokens == "client":
+                token = benchToken(service)[0]
+            start = time.perf_counter()
+            try:
+                kerberos.authGSSServerAuthenticate(service, token, rcache)
+            except kerberos.KrbError:
+                pass
+            elapsed += time.perf_counter() - start
+            count += 1
+        after = kerberos.replayCacheStats()
+        values = {}
+        if rcache == "memory":
+            values["lookup_ns"] = round(after["lookup_ns"], 1)
+            values["insert_ns"] = round(after["insert_ns"], 1)
+            values["entries"] = after["entries"]
+            values["replays"] = after["replays"] - before["replays"]
+        elif rcache == "shared":
+            values["replays"] = (
+                after["shared_replays"] - before["shared_replays"]
+            )
+        report(
+            "rcache", call=rcache or "default", tokens=tokens,
+            accepts_per_s=round(count / elapsed, 1), **values
+        )
+
+    kerberos.detachReplayCache()
+
+
+
+if __name__ == "__main__":
+    main()
@@ -161,8 +161,37 @@ def authGSSClientInit(service, **kwargs):
     @param mech_oid: Optional GGS mech OID
 
     @return: A tuple of (result, context) where result is the result code (see
-        above) and context is an opaque value that will need to be passed to
-        subsequent functions.
+        above) and context is a L{GSSClientContext} that will need to be passed
+        to subsequent functions.
+    """
+
+
+
+def authGSSClientNegotiate(service, **kwargs):
+    """
+    Build the value of an HTTP C{Authorization} header for the given service
+    in one call, equivalent to L{authGSSClientInit}, L{authGSSClientStep}
+    with an empty challenge, L{authGSSClientResponse} and
+    L{authGSSClientClean}, but without creating a context object.
+
+    The server's reply is not checked, so mutual authentication is not
+    verified; use L{authGSSClientInit} where that matters. To send headers
+    for the same service repeatedly, a L{GSSClientTarget} saves importing
+    the name and acquiring credentials on every call.
+
+    @param service: A string containing the service principal in the form
+        C{"type@fqdn"}.
+
+    @param principal: Optional string containing the client principal in the
+        form C{"user@realm"}.
+
+    @param gssflags: Optional integer used to set GSS flags.
+
+    @param mech_oid: Optional GGS mech OID
+
+    @return: A string of the form C{"Negotiate <token>"}.
+
+    @raise GSSError: If no token could be produced.
     """
 
 
@@ -200,7 +229,8 @@ def authGSSClientStep(context, challenge):
     @param context: The context object returned from L{authGSSClientInit}.
 
     @param challenge: A string containing the base64-encoded server data (which
-        may be empty for the first step).
+        may be empty for the first step). L{KrbError} is raised if it is not
+        valid base64.
 
     @return: A result code (see above).
     """
@@ -238,7 +268,8 @@ def authGSSClientUserName(context):
     GSSAPI client-side operations, or the current user name obtained via
     authGSSClientInquireCred. This method must only be called after
     authGSSClientStep or authGSSClientInquireCred return a complete response
-    code.
+    code. The name is looked up from the context the first time it is asked
+    for, so an exchange that never asks does not pay for it.
 
     @param context: The context object returned from L{authGSSClientInit}.
 
@@ -251,7 +282,8 @@ def authGSSClientUnwrap(context, challenge):
     """
     Perform the client side GSSAPI unwrap step.
 
-    @param challenge: A string containing the base64-encoded server data.
+    @param challenge: A string or bytes-like object containing the
+        base64-encoded server data.
 
     @return: A result code (see above)
     """
@@ -263,7 +295,7 @@ def authGSSClientWrap(context, data, user=None, protect=0):
     Perform the client side GSSAPI wrap step.
 
     @param data: The result of the L{authGSSClientResponse} after the
-        L{authGSSClientUnwrap}.
+        L{authGSSClientUnwrap}, as a string or bytes-like object.
 
     @param user: The user to authorize.
 
@@ -275,7 +307,7 @@ def authGSSClientWrap(context, data, user=None, protect=0):
 
 
 
-def authGSSServerInit(service):
+def authGSSServerInit(service, rcache=None):
     """
     Initializes a context for GSSAPI server-side authentication with the given
     service principal.
@@ -286,9 +318,18 @@ def authGSSServerInit(service):
         C{"type@fqdn"}. To initialize the context for the purpose of accepting
         delegated credentials, pass the literal string C{"DELEGATE"}.
 
+    @param rcache: The replay cache to detect replayed tokens with:
+        C{"file"} for the Kerberos library's file cache, C{"none"} for no
+        replay detection, C{"memory"} for an in-process cache (see
+        L{replayCacheStats}), C{"shared"} for the cache shared between
+        processes (see L{attachReplayCache}), or C{None} for the library
+        default, which is normally the file cache. The in-process cache
+        avoids the file cache's lock and writes, but only catches replays
+        to this process.
+
     @return: A tuple of (result, context) where result is the result code (see
-        above) and context is an opaque value that will need to be passed to
-        subsequent functions.
+        above) and context is a L{GSSServerContext} that will need to be passed
+        to subsequent functions.
     """
 
 
@@ -312,8 +353,64 @@ def authGSSServerStep(context, challenge):
     @param context: The context object returned from L{authGSSClientInit}.
 
     @param challenge: A string containing the base64-encoded client data.
+        L{KrbError} is raised if it is not valid base64.
 
-    @return: A result code (see above).
+    @return: A result code (see above). C{AUTH_GSS_CONTINUE} means that the
+        mechanism (e.g. SPNEGO) needs another token from the client; the
+        user and target names are only available once the result is
+        C{AUTH_GSS_COMPLETE}.
+    """
+
+
+
+def authGSSServerAuthenticate(service, challenge, rcache=None):
+    """
+    Authenticate the token from a single-leg Negotiate request in one call.
+    This does what L{authGSSServerInit}, L{authGSSServerStep},
+    L{authGSSServerResponse}, L{authGSSServerUserName},
+    L{authGSSServerTargetName} and L{authGSSServerClean} would, without
+    creating a context object and releasing the GIL only once.
+
+    @param service: A string containing the service principal in the form
+        C{"type@fqdn"}, as for L{authGSSServerInit}.
+
+    @param challenge: A string containing the base64-encoded client data.
+
+    @param rcache: The replay cache, as for L{authGSSServerInit}.
+
+    @return: A tuple of (response, username, targetname, delegated), where
+        response is the base64-encoded token to send back to the client or
+        C{None}, and delegated is C{True} if the client delegated
+        credentials. The context, and so any delegated credentials, is
+        released before returning; use L{authGSSServerInit} to keep them.
+
+        If the mechanism needs another leg (multi-leg SPNEGO), username and
+        targetname are C{None} and the last item is instead the
+        L{GSSServerContext} to continue with: send the response to the
+        client and pass its next token to L{GSSServerContext.step}.
+
+    @raise GSSError: If authentication fails.
+    """
+
+
+
+def authGSSServerAuthenticateBatch(items):
+    """
+    Like L{authGSSServerAuthenticate} for many tokens at once, for instance
+    the queue of requests that piles up after a reconnect storm. The tokens
+    are accepted in parallel on a pool of native threads, one per CPU, with
+    the GIL released once for the whole batch.
+
+    @param items: A sequence of C{(service, challenge)} tuples, as passed to
+        L{authGSSServerAuthenticate}.
+
+    @return: A list with one entry per item, in the same order: the tuple
+        that L{authGSSServerAuthenticate} would have returned, or the
+        exception it would have raised (typically a L{GSSError}) if that
+        token was not accepted. One bad token does not affect the others.
+
+    @raise TypeError: If an item is not a C{(service, challenge)} tuple of
+        strings. No token is accepted in that case.
     """
 
 
@@ -345,7 +442,8 @@ def authGSSServerUserName(context):
     """
     Get the user name of the principal trying to authenticate to the server.
     This method must only be called after L{authGSSServerStep} returns a
-    complete or continue response code.
+    complete or continue response code. The name is looked up from the
+    context the first time it is asked for, and kept.
 
     @param context: The context object returned from L{authGSSClientInit}.
 
@@ -358,7 +456,8 @@ def authGSSServerTargetName(context):
     """
     Get the target name if the server did not supply its own credentials.
     This method must only be called after L{authGSSServerStep} returns a
-    complete or continue response code.
+    complete or continue response code. Like the user name, it is looked up
+    on first use.
 
     @param context: The context object returned from L{authGSSClientInit}.
 
@@ -390,3 +489,795 @@ def authGSSServerCacheName(context):
 
     @return: A string containing the cache name.
     """
+
+
+
+def contextStats():
+    """
+    Report the client and server contexts in this process that currently hold
+    GSSAPI state, i.e. that have been initialized and not yet cleaned or
+    garbage collected, across all interpreters. A count that keeps growing
+    under a steady load means contexts are being kept alive by mistake.
+
+    The byte counts cover the context objects and the tokens, responses and
+    names they hold; memory private to the GSSAPI library is not included.
+
+    C{buffer_allocations} counts the heap allocations made so far for the
+    responses, tokens and names held by contexts. These buffers are recycled
+    through a per-thread cache, so once a thread has warmed up the count
+    should stop growing however many handshakes it runs.
+
+    @return: A dict with the keys C{client_contexts}, C{client_bytes},
+        C{server_contexts}, C{server_bytes} and C{buffer_allocations}.
+    """
+
+
+
+def acceptorCacheStats():
+    """
+    Report on the process-wide cache of acceptor credentials.
+
+    L{authGSSServerInit}, L{authGSSServerAuthenticate} and the other server
+    entry points share the credentials for a service rather than acquiring
+    them from the keytab for each context. An entry is used for the cache
+    TTL (see L{setAcceptorCacheTTL}) and then acquired afresh, so keytab
+    changes are picked up within that time; a context keeps the
+    credentials it started with until it is cleaned. Contexts for the
+    special service C{"DELEGATE"} are not cached.
+
+    @return: A dict with the keys C{hits}, C{misses}, C{expirations},
+        C{invalidations}, C{entries} (the services currently cached),
+        C{ttl} (in seconds), C{keytab} (the keytab loaded by L{loadKeytab},
+        or C{None}), C{keytab_loads}, C{keytab_entries} and
+        C{keytab_retained} (the entries kept from the previous copy).
+    """
+
+
+
+def invalidateAcceptorCache(service=None):
+    """
+    Drop cached acceptor credentials, for instance after rotating the
+    keytab, so that the next context acquires them afresh. Contexts that
+    are already using the credentials are not affected.
+
+    @param service: A string containing the service principal in the form
+        C{"type@fqdn"}, or a principal name from L{Acceptor.spns}, or
+        C{None} to drop every service.
+    """
+
+
+
+def setAcceptorCacheTTL(seconds):
+    """
+    Set how long acceptor credentials are cached for, and drop the current
+    entries. The default is 300 seconds.
+
+    @param seconds: The time to live in seconds; 0 acquires credentials
+        for every context, as versions before the cache did.
+    """
+
+
+
+def replayCacheStats():
+    """
+    Report on the in-memory replay cache used by contexts created with
+    C{rcache="memory"}.
+
+    A token is recorded by a hash of its Kerberos authenticator once it has
+    been accepted, and rejected with L{GSSError} if it is seen again. The
+    cache is split into shards by that hash, each with its own lock, and
+    remembers authenticators for the window (see L{setReplayCacheWindow}).
+    A token with no Kerberos authenticator is refused.
+
+    @return: A dict with the keys C{lookups}, C{replays}, C{inserts},
+        C{expirations}, C{entries} (the authenticators held), C{lookup_ns}
+        and C{insert_ns} (the mean time of each, in nanoseconds, including
+        any wait for the shard) and C{window} (in seconds). The shared
+        cache adds C{shared} (its name or socket path, or C{None} when
+        there is none), C{shared_slots} (0 through a daemon) and the
+        C{shared_lookups}, C{shared_replays}, C{shared_inserts} and
+        C{shared_full} made by this process.
+    """
+
+
+
+def setReplayCacheWindow(seconds):
+    """
+    Set how long the in-memory replay cache remembers an authenticator.
+    Those it already holds are kept for the new window, so that a change
+    does not let them be replayed.
+
+    The window should be at least twice the clock skew the Kerberos library
+    allows, which is 300 seconds by default: an authenticator stamped up to
+    the skew ahead of the server's clock stays valid until up to twice the
+    skew after it was first accepted. The default is 600 seconds. A shorter
+    window lets a captured token be replayed once its entry has expired.
+
+    @param seconds: The window in seconds.
+    """
+
+
+
+def attachReplayCache(name="/pykerberos-rcache", slots=1048576):
+    """
+    Attach the replay cache used by contexts created with
+    C{rcache="shared"} to a POSIX shared memory segment, so that every
+    process of a server on this host that attaches to the same name
+    rejects a token accepted by any of them. The first process creates the
+    segment and the others map it.
+
+    The segment is a fixed table of hashes of authenticators, updated with
+    atomic operations rather than locks, so that a process that dies never
+    leaves it locked. An authenticator is remembered for the window of
+    L{setReplayCacheWindow} at the time the segment was created at least,
+    and for up to a seventh longer; the default of twice the clock skew
+    catches every replay across the processes, and a shorter window lets
+    some through, as for the in-memory cache. If all the slots an
+    authenticator can go in are taken by live entries, the token is
+    refused, so the table should hold several times the tokens accepted in
+    a window.
+
+    @param name: The name of the segment, starting with C{"/"}. It stays in
+        C{/dev/shm} until it is removed or the host restarts.
+
+    @param slots: The number of slots of the table, rounded up to a power
+        of two, of 8 bytes each. It only applies when the segment is
+        created.
+    """
+
+
+
+def connectReplayCache(path):
+    """
+    Send the checks of contexts created with C{rcache="shared"} to a
+    L{ReplayCacheDaemon} listening on a Unix socket, instead of a segment
+    of this host. Servers on several hosts can share a daemon by
+    forwarding the socket. A check that cannot reach the daemon refuses
+    the token.
+
+    @param path: The path of the daemon's socket.
+    """
+
+
+
+def detachReplayCache():
+    """
+    Detach from the shared replay cache or daemon. Contexts created with
+    C{rcache="shared"} then fail until another one is attached.
+    """
+
+
+
+class ReplayCacheDaemon(object):
+    """
+    Serve a shared replay cache on a Unix socket, for
+    L{connectReplayCache}. The daemon runs on a thread of this process, and
+    holds its table in its own memory. Starting it fails if another daemon
+    already answers on the path, or if the path exists and is not a
+    socket; a socket left behind by a daemon that is gone is replaced.
+
+    A daemon can be used as a context manager, which calls L{close} on
+    exit.
+    """
+
+    def __init__(self, path, slots=1048576, mode=0o600):
+        """
+        @param path: The path of the socket to listen on.
+
+        @param slots: The number of slots of the table, as for
+            L{attachReplayCache}.
+
+        @param mode: The permission bits of the socket, less the umask.
+            Whoever can connect can record authenticators, and so make the
+            workers refuse tokens, so only the server's own user can by
+            default.
+
+        @raise KrbError: If the socket cannot be created.
+        """
+
+
+    def close(self):
+        """
+        Stop the daemon and remove its socket.
+        """
+
+
+    def stats(self):
+        """
+        @return: A dict with the keys C{path}, C{slots}, C{lookups},
+            C{replays}, C{inserts} and C{full} for the daemon's table, or
+            C{None} once it is closed.
+        """
+
+
+
+def loadKeytab(keytab=None, lock=False, overlap=0):
+    """
+    Copy a keytab into memory and acquire acceptor credentials from the copy
+    from now on, so that accepting a token no longer reads the keytab on
+    disk. This helps where the keytab lives on slow or network storage.
+    Cached acceptor credentials are dropped, so the next context for each
+    service uses the copy.
+
+    The keytab is read once: later changes to the file are only seen after
+    L{reloadKeytab}. Needs MIT Kerberos 1.11 or later.
+
+    @param keytab: The name of the keytab, such as
+        C{"FILE:/etc/krb5.keytab"}, or C{None} for the default keytab.
+
+    @param lock: If true, lock the pages of the process in memory with
+        C{mlockall(MCL_CURRENT)}, so that the keys are never written to
+        swap. The Kerberos library keeps the keys in its own allocations,
+        so the whole process is locked, not only the keys, and stays
+        locked while a keytab loaded with lock set is in use. L{unloadKeytab}
+        or loading a keytab without lock calls C{munlockall()}, which also
+        unlocks pages the process locked for any other reason. This usually
+        needs CAP_IPC_LOCK or a large enough C{RLIMIT_MEMLOCK}.
+
+    @param overlap: When the keytab is loaded again, keys of the previous
+        copy that are no longer in the keytab (the same principal, kvno and
+        enctype) are kept for this many seconds after they were first found
+        missing, so that tickets issued under the old kvno are still
+        accepted after the keys are rotated. Set it to the longest ticket
+        lifetime of the realm.
+
+    @return: The number of keytab entries loaded.
+    """
+
+
+
+def reloadKeytab():
+    """
+    Load the keytab loaded by L{loadKeytab} again, with the same settings,
+    for instance after its keys have been rotated. Contexts that started
+    with the previous copy keep using it until they are cleaned.
+
+    @return: The number of keytab entries loaded.
+    """
+
+
+
+def unloadKeytab():
+    """
+    Drop the keytab loaded by L{loadKeytab}, and go back to acquiring
+    acceptor credentials from the keytab on disk. If it was loaded with
+    lock set, the pages of the process are unlocked again.
+    """
+
+
+
+class KeytabWatcher(object):
+    """
+    Load a keytab with L{loadKeytab} and load it again whenever the file
+    changes, so that rotated keys are picked up without restarting. The
+    file is watched with inotify on Linux and checked every second
+    elsewhere. A keytab reached through a symlink, such as a mounted
+    Kubernetes secret, is also reloaded when a link in its directory is
+    swapped. Changes that follow each other within 0.2 seconds are
+    loaded once.
+
+    Each reload swaps in a new copy in one step. Contexts that have
+    already started keep the credentials they have, and new ones use the
+    new copy. With an overlap, keys that disappear from the file stay
+    usable for that long. The keytab is loaded again when they expire, so
+    that they are dropped.
+
+    A watcher can be used as a context manager, which calls L{close} on
+    exit. Closing it, or loading a different keytab, leaves the last copy
+    in use. Watchers still running when the interpreter exits are closed
+    before it finalizes.
+
+    @ivar reloads: The number of successful reloads.
+
+    @ivar errors: The number of failed reloads. After a failure the
+        previous copy stays in use.
+    """
+
+    def __init__(self, keytab=None, callback=None, overlap=86400, lock=False):
+        """
+        @param keytab: The name of the keytab file, such as
+            C{"FILE:/etc/krb5.keytab"}, or C{None} for the default keytab.
+
+        @param callback: A callable run after every reload on the watcher's
+            own thread, as C{callback(entries, error)}: the number of keytab
+            entries now loaded and C{None}, or 0 and the L{KrbError} that
+            the reload failed with. Exceptions it raises are reported as
+            unraisable.
+
+        @param overlap: See L{loadKeytab}. The default suits tickets that
+            live for up to a day.
+
+        @param lock: See L{loadKeytab}.
+
+        @raise KrbError: If the keytab cannot be loaded or is not a file.
+        """
+
+
+    def close(self):
+        """
+        Stop watching. The loaded keytab stays in use.
+        """
+
+
+
+class Acceptor(object):
+    """
+    Accept Negotiate tokens for any of a fixed set of service principals,
+    such as the virtual hosts of a front that share one keytab.
+
+    L{authGSSServerInit} with an empty service leaves GSSAPI to search the
+    whole keytab for each ticket's key and to be asked afterwards which
+    principal was used. An acceptor instead reads the server principal
+    from the ticket in the token, finds it in a hash index built from
+    C{spns}, and accepts with the cached credentials of that principal
+    alone (see L{acceptorCacheStats}).
+
+    @ivar spns: A tuple of the principal names, normalized to the form
+        C{"service/host@REALM"} and interned.
+    """
+
+    def __init__(self, spns, rcache=None):
+        """
+        @param spns: A sequence of principal names such as
+            C{"HTTP/www.example.com@EXAMPLE.COM"}. Where the realm is left
+            out, the default realm is used.
+
+        @param rcache: The replay cache, as for L{authGSSServerInit}.
+
+        @raise KrbError: If a name cannot be parsed or two names are the
+            same principal.
+        """
+
+
+    def authenticate(self, challenge):
+        """
+        Authenticate the token from a Negotiate request, as
+        L{authGSSServerAuthenticate} does.
+
+        @param challenge: A string containing the base64-encoded client
+            data.
+
+        @return: A tuple of (response, username, spn, delegated, index),
+            where spn is the matched principal's name from L{spns} and
+            index its position there. Neither needs a GSSAPI call to find.
+
+            If the mechanism needs another leg, username and spn are
+            C{None} and delegated is instead the L{GSSServerContext} to
+            continue with, as for L{authGSSServerAuthenticate}.
+
+        @raise KrbError: If the token holds no Kerberos ticket, or one for a
+            principal not in L{spns}.
+
+        @raise GSSError: If authentication fails.
+        """
+
+
+    def route(self, token):
+        """
+        Find the principal a token is for, without accepting it.
+
+        @param token: A bytes-like object containing the decoded token.
+
+        @return: The position of the principal in L{spns}.
+
+        @raise KrbError: If the token holds no Kerberos ticket, or one for a
+            principal not in L{spns}.
+        """
+
+
+
+class GSSClientContext(object):
+    """
+    Client-side GSSAPI context. This is the object returned by
+    L{authGSSClientInit}, which may also be constructed directly with the same
+    arguments. The context is cleaned when it is garbage collected, so calling
+    L{clean} is optional.
+
+    Using a context after it has been cleaned raises L{KrbError}.
+
+    @ivar response: The base64 encoded response from the last step, wrap or
+        unwrap, or C{None}.
+
+    @ivar response_conf: 1 if confidentiality was set in the last unwrapped
+        buffer, 0 otherwise.
+
+    @ivar username: The user name of the principal, or C{None}.
+    """
+
+    def __init__(
+        self, service, principal=None, gssflags=GSS_C_MUTUAL_FLAG|GSS_C_SEQUENCE_FLAG,
+        delegated=None, mech_oid=None
+    ):
+        """
+        See L{authGSSClientInit}.
+
+        @raise GSSError: If the context could not be initialized.
+        """
+
+
+    def step(self, challenge):
+        """
+        See L{authGSSClientStep}.
+        """
+
+
+    def wrap(self, data, user=None, protect=0):
+        """
+        See L{authGSSClientWrap}.
+        """
+
+
+    def unwrap(self, challenge):
+        """
+        See L{authGSSClientUnwrap}.
+        """
+
+
+    def step_bytes(self, token):
+        """
+        Like L{step}, for protocols that carry GSSAPI tokens as binary data
+        (SASL, RFC 2228 FTP, custom RPC) rather than base64 text. No base64
+        conversion is done in either direction and L{response} is left as
+        C{None}.
+
+        @param token: A bytes-like object with the token from the server, or
+            C{b""} for the first step.
+
+        @return: A tuple of the result code and a bytes object with the token
+            to send to the server, which is empty if there is none.
+        """
+
+
+    def wrap_bytes(self, data, user=None, protect=0):
+        """
+        Like L{wrap}, taking a bytes-like object and returning raw bytes
+        instead of base64 text.
+
+        @return: A bytes object with the wrapped message.
+        """
+
+
+    def unwrap_bytes(self, data):
+        """
+        Like L{unwrap}, taking and returning raw bytes instead of base64 text.
+        L{response_conf} is updated as for L{unwrap}.
+
+        @param data: A bytes-like object with the wrapped message.
+
+        @return: A bytes object with the unwrapped data.
+        """
+
+
+    def wrap_into(self, data, buffer, user=None, protect=0):
+        """
+        Like L{wrap_bytes}, but write the wrapped message into a
+        caller-supplied buffer instead of allocating a new bytes object, so
+        that one C{bytearray} can be reused for every message on a
+        connection. The buffer should allow for the GSSAPI overhead on top
+        of C{len(data)}.
+
+        @param buffer: A writable bytes-like object.
+
+        @return: The number of bytes written to the start of C{buffer}.
+
+        @raise ValueError: If C{buffer} is too small. The message is lost, so
+            the security context should not be used further.
+        """
+
+
+    def unwrap_into(self, data, buffer):
+        """
+        Like L{unwrap_bytes}, but write the unwrapped data into a
+        caller-supplied buffer. The unwrapped data is never longer than
+        C{data}.
+
+        @param buffer: A writable bytes-like object.
+
+        @return: The number of bytes written to the start of C{buffer}.
+
+        @raise ValueError: If C{buffer} is too small.
+        """
+
+
+    def inquire_cred(self):
+        """
+        See L{authGSSClientInquireCred}.
+        """
+
+
+    def clean(self):
+        """
+        Release the GSSAPI resources held by the context.
+        """
+
+
+
+class GSSClientTarget(object):
+    """
+    The service name and client credentials for one service principal, kept
+    for sending many requests to the same backend. Each call to
+    L{negotiate} runs a new exchange with these, and may be made from
+    several threads at once. The target is cleaned when it is garbage
+    collected, so calling L{clean} is optional.
+    """
+
+    def __init__(
+        self, service, principal=None, gssflags=GSS_C_MUTUAL_FLAG|GSS_C_SEQUENCE_FLAG,
+        mech_oid=None
+    ):
+        """
+        See L{authGSSClientNegotiate}.
+
+        @raise GSSError: If the name or credentials could not be set up.
+        """
+
+
+    def negotiate(self):
+        """
+        See L{authGSSClientNegotiate}.
+
+        @return: A string of the form C{"Negotiate <token>"}.
+        """
+
+
+    def clean(self):
+        """
+        Release the GSSAPI resources held by the target.
+        """
+
+
+
+class GSSServerContext(object):
+    """
+    Server-side GSSAPI context. This is the object returned by
+    L{authGSSServerInit}, which may also be constructed directly. The context
+    is cleaned when it is garbage collected, so calling L{clean} is optional.
+
+    Using a context after it has been cleaned raises L{KrbError}.
+
+    @ivar response: The base64 encoded response from the last step, or
+        C{None}.
+
+    @ivar username: The user name of the authenticated principal, or C{None}.
+
+    @ivar targetname: The name of the target principal, or C{None}.
+
+    @ivar ccname: The location of the stored delegated credentials, or C{None}.
+
+    @ivar has_delegated: C{True} if the client delegated credentials.
+    """
+
+    def __init__(self, service, rcache=None):
+        """
+        See L{authGSSServerInit}.
+
+        @raise GSSError: If the context could not be initialized.
+        """
+
+
+    def step(self, challenge):
+        """
+        See L{authGSSServerStep}.
+        """
+
+
+    def step_bytes(self, token):
+        """
+        Like L{step}, taking the client token as raw bytes rather than base64
+        text. L{response} is left as C{None}.
+
+        @param token: A bytes-like object with the token from the client.
+
+        @return: A tuple of the result code and a bytes object with the token
+            to send to the client, which is empty if there is none.
+        """
+
+
+    def store_delegate(self):
+        """
+        See L{authGSSServerStoreDelegate}.
+        """
+
+
+    def clean(self):
+        """
+        Release the GSSAPI resources held by the context.
+        """
+
+
+
+class WorkerPool(object):
+    """
+    Native threads for running blocking Kerberos calls without a Python
+    thread per call. Each method takes the same arguments as the module
+    function of the same name, queues the call and returns a L{Future} for
+    its result at once. The calls run with no GIL held, and the result only
+    becomes a Python object when it is read.
+
+    Each thread has its own queue; an idle thread takes work from the
+    others, so one slow KDC round trip does not hold up the calls queued
+    behind it.
+
+    A pool can be used as a context manager, which calls L{close} on exit.
+    Calls queued after L{close} raise C{ValueError}.
+
+    A context stepped through a pool is kept alive by the step's future. If
+    the context has been cleaned by the time the step runs, the future
+    raises L{KrbError}.
+
+    @ivar threads: The number of threads, or 0 once the pool is closed.
+
+    @ivar queued: The number of calls waiting for a thread.
+    """
+
+    def __init__(self, threads=0, max_queued=1024, block=True):
+        """
+        @param threads: The number of threads, or 0 for one per CPU.
+
+        @param max_queued: The most calls that may wait for a thread.
+
+        @param block: What to do when C{max_queued} calls are waiting: wait
+            for room with the GIL released if C{True}, raise
+            C{BlockingIOError} if C{False}.
+        """
+
+
+    def checkPassword(self, user, pswd, service, default_realm):
+        """
+        See L{checkPassword}.
+        """
+
+
+    def changePassword(self, user, oldpswd, newpswd):
+        """
+        See L{changePassword}.
+        """
+
+
+    def getServerPrincipalDetails(self, service, hostname):
+        """
+        See L{getServerPrincipalDetails}.
+        """
+
+
+    def authGSSServerAuthenticate(self, service, challenge):
+        """
+        See L{authGSSServerAuthenticate}.
+        """
+
+
+    def authGSSServerStep(self, context, challenge):
+        """
+        See L{authGSSServerStep}.
+        """
+
+
+    def authGSSClientStep(self, context, challenge):
+        """
+        See L{authGSSClientStep}.
+        """
+
+
+    def close(self):
+        """
+        Wait for the queued calls to finish and stop the threads.
+        """
+
+
+
+class AsyncWorkerPool(WorkerPool):
+    """
+    A L{WorkerPool} for asyncio code: the same methods return awaitables
+    instead of L{Future}s, so that the event loop keeps running for the
+    whole KDC or keytab round trip, for example::
+
+        pool = kerberos.AsyncWorkerPool()
+        result = await pool.authGSSServerStep(context, challenge)
+
+    The pool binds to the event loop running at its first call, and must
+    only be used from that loop while it is open: a call from another loop
+    raises C{RuntimeError}. Once the loop has closed, as when
+    C{asyncio.run()} returns, the next call moves the pool to the loop it
+    is made from. The pool threads signal finished calls to
+    the loop through an eventfd (a pipe on systems without one), and the
+    results are delivered on the loop's own thread; no Python thread is
+    started. Cancelling an await does not stop the call itself.
+
+    C{block} defaults to C{False}, so that a full queue raises
+    C{BlockingIOError} rather than stopping the event loop. L{close}, which
+    delivers the results of the calls still queued, must be called from the
+    loop's thread.
+    """
+
+    def __init__(self, threads=0, max_queued=1024, block=False):
+        """
+        See L{WorkerPool.__init__}.
+        """
+
+
+
+class Future(object):
+    """
+    The pending result of a call queued on a L{WorkerPool}. A future that is
+    garbage collected before its call has finished waits for the call.
+    """
+
+    def done(self):
+        """
+        @return: C{True} if the call has finished.
+        """
+
+
+    def result(self, timeout=None):
+        """
+        Wait for the call to finish, with the GIL released.
+
+        @param timeout: The most seconds to wait, or C{None} to wait for as
+            long as it takes.
+
+        @return: What the module function would have returned.
+
+        @raise KrbError: What the module function would have raised.
+
+        @raise TimeoutError: If the call did not finish in time.
+        """
+
+
+
+class Base64Encoder(object):
+    """
+    Incremental base64 encoder for payloads too large to convert in one go,
+    such as data channels protected with L{authGSSClientWrap}. Memory use is
+    bounded by the chunk size rather than the message size.
+
+    Calls on one encoder from several threads are serialized, but the
+    chunks of a stream are only encoded in order if they are fed in order.
+    """
+
+    def update(self, data):
+        """
+        Encode the next chunk of data. Bytes that do not complete a 3-byte
+        group are held back until the next call.
+
+        @param data: A bytes-like object (or string) with the next chunk.
+
+        @return: A bytes object with the base64 characters produced so far.
+        """
+
+
+    def final(self):
+        """
+        Encode any held-back bytes, adding padding, and reset the encoder.
+
+        @return: A bytes object with the last base64 characters.
+        """
+
+
+
+class Base64Decoder(object):
+    """
+    Incremental base64 decoder, the counterpart of L{Base64Encoder}. Chunks
+    may be split at any character boundary. As for the encoder, calls from
+    several threads are serialized.
+    """
+
+    def update(self, data):
+        """
+        Decode the next chunk of base64 text.
+
+        @param data: A string or bytes-like object with the next chunk.
+
+        @return: A bytes object with the data decoded so far.
+
+        @raise ValueError: If the chunk contains invalid base64.
+        """
+
+
+    def final(self):
+        """
+        Finish decoding and reset the decoder.
+
+        @return: An empty bytes object.
+
+        @raise ValueError: If the stream ended part way through a group.
+        """
@@ -15,7 +15,8 @@
 ##
 
 from os.path import dirname, join as joinpath
-from setuptools import setup, Extension
+import sys
+from setuptools import setup, Command, Extension
 
 try:
     from subprocess import getoutput
@@ -42,8 +43,8 @@ classifiers = [
     "Intended Audience :: Developers",
     "License :: OSI Approved :: Apache Software License",
     "Operating System :: OS Independent",
-    "Programming Language :: Python :: 2",
     "Programming Language :: Python :: 3",
+    "Programming Language :: Python :: 3 :: Only",
     "Topic :: Software Development :: Libraries :: Python Modules",
     "Topic :: System :: Systems Administration :: Authentication/Directory",
 ]
@@ -56,6 +57,8 @@ license = "Apache License, Version 2.0"
 
 platforms = ["all"]
 
+python_requires = ">=3.9"
+
 
 #
 # Entry points
@@ -80,6 +83,9 @@ extra_link_args = getoutput("krb5-config --libs gssapi").split()
 
 extra_compile_args = getoutput("krb5-config --cflags gssapi").split()
 
+# shm_open is in librt before glibc 2.34
+libraries = ["rt"] if sys.platform.startswith("linux") else []
+
 
 #
 # Set up Extension modules that need to be built
@@ -90,17 +96,90 @@ extensions = [
         "kerberos",
         extra_link_args=extra_link_args,
         extra_compile_args=extra_compile_args,
+        libraries=libraries,
         sources=[
             "src/base64.c",
             "src/kerberos.c",
             "src/kerberosbasic.c",
+            "src/kerberosbuf.c",
+            "src/kerberoscred.c",
+            "src/kerberoserr.c",
             "src/kerberosgss.c",
+            "src/kerberospool.c",
             "src/kerberospw.c",
+            "src/kerberosrcache.c",
+            "src/kerberosrcshared.c",
+            "src/kerberosspn.c",
+            "src/kerberoswatch.c",
         ],
     ),
 ]
 
 
+#
+# Commands
+#
+
+class BenchBase64(Command):
+    """
+    Build and run support/base64bench.c, which checks src/base64.c against a
+    reference codec and reports its throughput as one JSON object per line.
+    """
+
+    description = "build and run the base64 codec benchmark"
+
+    user_options = [
+        ("seconds=", "s", "seconds to spend on each case [default: 0.25]"),
+        ("output=", "o", "also write the JSON results to this file"),
+    ]
+
+    def initialize_options(self):
+        self.seconds = "0.25"
+        self.output = None
+
+
+    def finalize_options(self):
+        self.build_temp = joinpath("build", "bench")
+
+
+    def run(self):
+        from distutils.ccompiler import new_compiler
+        from distutils.errors import DistutilsExecError
+        from distutils.sysconfig import customize_compiler
+        import subprocess
+        import sys
+
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        objects = compiler.compile(
+            ["support/base64bench.c", "src/base64.c"],
+            output_dir=self.build_temp,
+            include_dirs=["src"],
+            extra_postargs=["-O2"],
+        )
+        compiler.link_executable(
+            objects, "base64bench", output_dir=self.build_temp,
+            libraries=["pthread"],
+        )
+
+        executable = joinpath(self.build_temp, "base64bench")
+        process = subprocess.Popen(
+            [executable, self.seconds], stdout=subprocess.PIPE
+        )
+        results = process.communicate()[0].decode("utf-8")
+        sys.stdout.write(results)
+        if self.output:
+            with open(self.output, "w") as f:
+                f.write(results)
+        if process.returncode:
+            raise DistutilsExecError("base64 correctness check failed")
+
+
+cmdclass = {
+    "bench_base64": BenchBase64,
+}
+
+
 #
 # Run setup
 #
@@ -117,10 +196,12 @@ def doSetup():
         author_email=author_email,
         license=license,
         platforms=platforms,
+        python_requires=python_requires,
         ext_modules=extensions,
         setup_requires=setup_requirements,
         install_requires=install_requirements,
         extras_require=extras_requirements,
+        cmdclass=cmdclass,
     )
 
 
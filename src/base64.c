@@ -16,9 +16,16 @@
 
 #include "base64.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
 // base64 tables
 static char basis_64[] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -35,19 +42,332 @@ static signed char index_64[128] =
 };
 #define CHAR64(c)  (((c) < 0 || (c) > 127) ? -1 : index_64[(c)])
 
-// base64_encode    :    base64 encode
+// Block kernels
+//
+// An encode kernel consumes whole 3-byte groups from the front of src and
+// writes the matching 4-character groups to dst, returning the number of
+// input bytes consumed. A decode kernel consumes whole 4-character groups
+// that contain no padding and no invalid characters, returning the number of
+// characters consumed; it stops early on anything it cannot handle and
+// leaves the remainder (including error reporting) to the scalar code.
+typedef size_t (*base64_encode_kernel)(
+    const unsigned char *src, size_t srclen, char *dst
+);
+typedef size_t (*base64_decode_kernel)(
+    const char *src, size_t srclen, unsigned char *dst
+);
+
+static size_t encode_kernel_none(
+    const unsigned char *src, size_t srclen, char *dst
+) {
+    (void)src;
+    (void)srclen;
+    (void)dst;
+    return 0;
+}
+
+static size_t decode_kernel_none(
+    const char *src, size_t srclen, unsigned char *dst
+) {
+    (void)src;
+    (void)srclen;
+    (void)dst;
+    return 0;
+}
+
+#ifdef BASE64_X86_SIMD
+
+// Vectorized codecs after Wojciech Mula and Daniel Lemire, "Faster Base64
+// Encoding and Decoding using AVX2 Instructions" (ACM TOW 2018). The SSSE3
+// and AVX2 variants share the same arithmetic; the AVX2 one simply runs it
+// on two 128-bit lanes at a time.
+
+__attribute__((target("ssse3")))
+static __m128i encode_lookup_ssse3(__m128i indices)
+{
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i shift_lut = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0
+    );
+    result = _mm_shuffle_epi8(shift_lut, result);
+    return _mm_add_epi8(result, indices);
+}
+
+__attribute__((target("ssse3")))
+static size_t encode_kernel_ssse3(
+    const unsigned char *src, size_t srclen, char *dst
+) {
+    const __m128i shuf = _mm_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+    );
+    size_t i = 0;
+
+    // Each round reads 16 bytes but only uses the first 12
+    while (srclen - i >= 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        in = _mm_shuffle_epi8(in, shuf);
+        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        __m128i out = encode_lookup_ssse3(_mm_or_si128(t1, t3));
+        _mm_storeu_si128((__m128i *)dst, out);
+        dst += 16;
+        i += 12;
+    }
+
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static __m128i decode_translate_ssse3(__m128i in, int *valid)
+{
+    const __m128i shift_lut = _mm_setr_epi8(
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+    );
+    // Bit (1 << hi_nibble) is set in mask_lut[lo_nibble] for every valid
+    // character
+    const __m128i mask_lut = _mm_setr_epi8(
+        (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54
+    );
+    const __m128i bitpos_lut = _mm_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0, 0, 0, 0, 0, 0, 0, 0
+    );
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+    __m128i bits = _mm_and_si128(
+        _mm_shuffle_epi8(mask_lut, lo), _mm_shuffle_epi8(bitpos_lut, hi)
+    );
+    *valid = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(bits, _mm_setzero_si128())
+    ) == 0;
+
+    // '/' shares its high nibble with '+' but needs a different shift
+    __m128i is_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    __m128i shift = _mm_or_si128(
+        _mm_andnot_si128(is_slash, _mm_shuffle_epi8(shift_lut, hi)),
+        _mm_and_si128(is_slash, _mm_set1_epi8(16))
+    );
+    return _mm_add_epi8(in, shift);
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_kernel_ssse3(
+    const char *src, size_t srclen, unsigned char *dst
+) {
+    const __m128i pack = _mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+    );
+    size_t i = 0;
+    int valid;
+
+    while (srclen - i >= 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i values = decode_translate_ssse3(in, &valid);
+        if (! valid) {
+            break;
+        }
+        __m128i merged = _mm_maddubs_epi16(
+            values, _mm_set1_epi32(0x01400140)
+        );
+        __m128i out = _mm_shuffle_epi8(
+            _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000)), pack
+        );
+        int tail = _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+        _mm_storel_epi64((__m128i *)dst, out);
+        memcpy(dst + 8, &tail, 4);
+        dst += 12;
+        i += 16;
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t encode_kernel_avx2(
+    const unsigned char *src, size_t srclen, char *dst
+) {
+    const __m256i shuf = _mm256_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+    );
+    const __m256i shift_lut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0
+    );
+    size_t i = 0;
+
+    // Each lane reads 16 bytes and uses 12; the second lane starts at +12
+    while (srclen - i >= 28) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + i + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(
+            result, _mm256_and_si256(less, _mm256_set1_epi8(13))
+        );
+        result = _mm256_shuffle_epi8(shift_lut, result);
+        result = _mm256_add_epi8(result, indices);
+
+        _mm256_storeu_si256((__m256i *)dst, result);
+        dst += 32;
+        i += 24;
+    }
+
+    // Finish off with the narrower kernel where it still fits
+    return i + encode_kernel_ssse3(src + i, srclen - i, dst);
+}
+
+__attribute__((target("avx2")))
+static size_t decode_kernel_avx2(
+    const char *src, size_t srclen, unsigned char *dst
+) {
+    const __m256i shift_lut = _mm256_setr_epi8(
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+    );
+    const __m256i mask_lut = _mm256_setr_epi8(
+        (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+        (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54
+    );
+    const __m256i bitpos_lut = _mm256_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0, 0, 0, 0, 0, 0, 0, 0,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0, 0, 0, 0, 0, 0, 0, 0
+    );
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+    );
+    const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t i = 0;
+
+    while (srclen - i >= 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i hi = _mm256_and_si256(
+            _mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f)
+        );
+        __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+        __m256i bits = _mm256_and_si256(
+            _mm256_shuffle_epi8(mask_lut, lo),
+            _mm256_shuffle_epi8(bitpos_lut, hi)
+        );
+        if (_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(bits, _mm256_setzero_si256())
+        )) {
+            break;
+        }
+
+        __m256i is_slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        __m256i shift = _mm256_blendv_epi8(
+            _mm256_shuffle_epi8(shift_lut, hi), _mm256_set1_epi8(16), is_slash
+        );
+        __m256i values = _mm256_add_epi8(in, shift);
+        __m256i merged = _mm256_maddubs_epi16(
+            values, _mm256_set1_epi32(0x01400140)
+        );
+        __m256i out = _mm256_shuffle_epi8(
+            _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000)), pack
+        );
+        out = _mm256_permutevar8x32_epi32(out, compact);
+
+        // 24 output bytes: store exactly that many
+        _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(out));
+        _mm_storel_epi64(
+            (__m128i *)(dst + 16), _mm256_extracti128_si256(out, 1)
+        );
+        dst += 24;
+        i += 32;
+    }
+
+    return i + decode_kernel_ssse3(src + i, srclen - i, dst);
+}
+
+#endif /* BASE64_X86_SIMD */
+
+static base64_encode_kernel encode_kernel = encode_kernel_none;
+static base64_decode_kernel decode_kernel = decode_kernel_none;
+static const char *kernel_name = "scalar";
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// select_kernels   :    pick the fastest codec for this CPU, run exactly once
+static void select_kernels(void)
+{
+#ifdef BASE64_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        encode_kernel = encode_kernel_avx2;
+        decode_kernel = decode_kernel_avx2;
+        kernel_name = "avx2";
+        return;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        encode_kernel = encode_kernel_ssse3;
+        decode_kernel = decode_kernel_ssse3;
+        kernel_name = "ssse3";
+        return;
+    }
+#endif
+    encode_kernel = encode_kernel_none;
+    decode_kernel = decode_kernel_none;
+    kernel_name = "scalar";
+}
+
+// base64_init      :    select the fastest codec for this CPU
+//
+// Safe to call more than once and from several threads (each interpreter
+// that imports the module calls it); until it is called the scalar codec is
+// used.
+void base64_init(void)
+{
+    pthread_once(&kernel_once, select_kernels);
+}
+
+// base64_kernel    :    name of the codec selected by base64_init
+const char *base64_kernel(void)
+{
+    return kernel_name;
+}
+
+// encode_scalar    :    encode into a buffer known to be large enough
 //
 // value            :    data to encode
 // vlen             :    length of data
-// (result)         :    new char[] - c-str of result
-char *base64_encode(const unsigned char *value, size_t vlen)
+// out              :    destination, BASE64_ENCODED_SIZE(vlen) bytes
+// (result)         :    number of characters written (not NUL terminated)
+static size_t encode_scalar(const unsigned char *value, size_t vlen, char *out)
 {
-    char *result = (char *)malloc((vlen * 4) / 3 + 5);
-    if (result == NULL)
-    {
-        return NULL;
-    }
-    char *out = result;
+    char *start = out;
+    size_t done = encode_kernel(value, vlen, out);
+    out += (done / 3) * 4;
+    value += done;
+    vlen -= done;
     while (vlen >= 3)
     {
         *out++ = basis_64[value[0] >> 2];
@@ -66,51 +386,56 @@ char *base64_encode(const unsigned char *value, size_t vlen)
         *out++ = (vlen < 2) ? '=' : basis_64[(value[1] << 2) & 0x3C];
         *out++ = '=';
     }
-    *out = '\0';
 
-    return result;
+    return out - start;
 }
 
-// base64_decode    :    base64 decode
+// decode_scalar    :    decode into a buffer known to be large enough
 //
-// value            :    c-str to decode
+// value            :    characters to decode
+// vlen             :    number of characters
+// out              :    destination, BASE64_DECODED_SIZE(vlen) bytes
 // rlen             :    length of decoded result
-// (result)         :    new unsigned char[] - decoded result
-unsigned char *base64_decode(const char *value, size_t *rlen)
-{
-    *rlen = 0;
+// (result)         :    BASE64_OK or BASE64_ERROR_INVALID
+static int decode_scalar(
+    const char *value, size_t vlen, unsigned char *out, size_t *rlen
+) {
     int c1, c2, c3, c4;
 
-    size_t vlen = strlen(value);
-    unsigned char *result =(unsigned char *)malloc((vlen * 3) / 4 + 1);
-    if (result == NULL)
-    {
-        return NULL;
+    size_t done = decode_kernel(value, vlen, out);
+    out += (done / 4) * 3;
+    *rlen = (done / 4) * 3;
+    value += done;
+    vlen -= done;
+
+    if (vlen % 4 != 0) {
+        return BASE64_ERROR_INVALID;
     }
-    unsigned char *out = result;
 
-    while (1) {
-        if (value[0]==0) {
-            return result;
-        }
+    while (vlen > 0) {
         c1 = value[0];
         if (CHAR64(c1) == -1) {
-            goto base64_decode_error;;
+            return BASE64_ERROR_INVALID;
         }
         c2 = value[1];
         if (CHAR64(c2) == -1) {
-            goto base64_decode_error;;
+            return BASE64_ERROR_INVALID;
         }
         c3 = value[2];
         if ((c3 != '=') && (CHAR64(c3) == -1)) {
-            goto base64_decode_error;;
+            return BASE64_ERROR_INVALID;
         }
         c4 = value[3];
         if ((c4 != '=') && (CHAR64(c4) == -1)) {
-            goto base64_decode_error;;
+            return BASE64_ERROR_INVALID;
+        }
+        // Padding only ends the last group
+        if ((c3 == '=' && c4 != '=') || (c4 == '=' && vlen > 4)) {
+            return BASE64_ERROR_INVALID;
         }
 
         value += 4;
+        vlen -= 4;
         *out++ = (CHAR64(c1) << 2) | (CHAR64(c2) >> 4);
         *rlen += 1;
 
@@ -125,9 +450,249 @@ unsigned char *base64_decode(const char *value, size_t *rlen)
         }
     }
 
-base64_decode_error:
-    *result = 0;
+    return BASE64_OK;
+}
+
+// base64_encode    :    base64 encode
+//
+// value            :    data to encode
+// vlen             :    length of data
+// (result)         :    new char[] - c-str of result
+char *base64_encode(const unsigned char *value, size_t vlen)
+{
+    char *result = (char *)malloc(BASE64_ENCODED_SIZE(vlen) + 1);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    result[encode_scalar(value, vlen, result)] = '\0';
+
+    return result;
+}
+
+// base64_decode    :    base64 decode
+//
+// value            :    c-str to decode
+// rlen             :    length of decoded result
+// (result)         :    new unsigned char[] - decoded result
+unsigned char *base64_decode(const char *value, size_t *rlen)
+{
     *rlen = 0;
 
+    size_t vlen = strlen(value);
+    unsigned char *result =(unsigned char *)malloc(BASE64_DECODED_SIZE(vlen) + 1);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+
+    if (decode_scalar(value, vlen, result, rlen) != BASE64_OK) {
+        *result = 0;
+        *rlen = 0;
+    }
+
     return result;
 }
+
+// base64_encode_into    :    base64 encode into a caller-owned buffer
+//
+// src                   :    data to encode
+// srclen                :    length of data
+// dst                   :    destination buffer
+// dstcap                :    size of dst, at least BASE64_ENCODED_SIZE(srclen) + 1
+// dstlen                :    number of characters written, excluding the NUL
+// (result)              :    BASE64_OK or BASE64_ERROR_SPACE
+int base64_encode_into(
+    const unsigned char *src, size_t srclen, char *dst, size_t dstcap,
+    size_t *dstlen
+) {
+    *dstlen = 0;
+    if (dstcap < BASE64_ENCODED_SIZE(srclen) + 1) {
+        return BASE64_ERROR_SPACE;
+    }
+    *dstlen = encode_scalar(src, srclen, dst);
+    dst[*dstlen] = '\0';
+
+    return BASE64_OK;
+}
+
+// base64_decode_into    :    base64 decode into a caller-owned buffer
+//
+// src                   :    characters to decode (need not be NUL terminated)
+// srclen                :    number of characters
+// dst                   :    destination buffer
+// dstcap                :    size of dst, at least BASE64_DECODED_SIZE(srclen)
+// dstlen                :    length of decoded result
+// (result)              :    BASE64_OK, BASE64_ERROR_INVALID or
+//                            BASE64_ERROR_SPACE
+int base64_decode_into(
+    const char *src, size_t srclen, unsigned char *dst, size_t dstcap,
+    size_t *dstlen
+) {
+    *dstlen = 0;
+    if (dstcap < BASE64_DECODED_SIZE(srclen)) {
+        return BASE64_ERROR_SPACE;
+    }
+    if (decode_scalar(src, srclen, dst, dstlen) != BASE64_OK) {
+        *dstlen = 0;
+        return BASE64_ERROR_INVALID;
+    }
+
+    return BASE64_OK;
+}
+
+// base64_encode_init    :    prepare an incremental encoder
+void base64_encode_init(base64_encode_state *state)
+{
+    state->carry_len = 0;
+}
+
+// base64_encode_update  :    encode the next chunk of an incremental stream
+//
+// state                 :    encoder from base64_encode_init
+// src                   :    next chunk of data
+// srclen                :    length of chunk
+// dst                   :    destination buffer
+// dstcap                :    size of dst, at least BASE64_ENCODE_UPDATE_SIZE(srclen)
+// dstlen                :    number of characters written (not NUL terminated)
+// (result)              :    BASE64_OK or BASE64_ERROR_SPACE
+//
+// Bytes that do not complete a 3-byte group are held in state until the next
+// update or final call.
+int base64_encode_update(
+    base64_encode_state *state, const unsigned char *src, size_t srclen,
+    char *dst, size_t dstcap, size_t *dstlen
+) {
+    size_t total = state->carry_len + srclen;
+
+    *dstlen = 0;
+    if (dstcap < (total / 3) * 4) {
+        return BASE64_ERROR_SPACE;
+    }
+    if (total < 3) {
+        memcpy(state->carry + state->carry_len, src, srclen);
+        state->carry_len = total;
+        return BASE64_OK;
+    }
+
+    if (state->carry_len) {
+        size_t fill = 3 - state->carry_len;
+        memcpy(state->carry + state->carry_len, src, fill);
+        *dstlen += encode_scalar(state->carry, 3, dst);
+        src += fill;
+        srclen -= fill;
+        state->carry_len = 0;
+    }
+
+    size_t whole = (srclen / 3) * 3;
+    *dstlen += encode_scalar(src, whole, dst + *dstlen);
+    memcpy(state->carry, src + whole, srclen - whole);
+    state->carry_len = srclen - whole;
+
+    return BASE64_OK;
+}
+
+// base64_encode_final   :    flush an incremental encoder, adding padding
+//
+// dstcap                :    size of dst, at least 4
+int base64_encode_final(
+    base64_encode_state *state, char *dst, size_t dstcap, size_t *dstlen
+) {
+    *dstlen = 0;
+    if (dstcap < BASE64_ENCODED_SIZE(state->carry_len)) {
+        return BASE64_ERROR_SPACE;
+    }
+    *dstlen = encode_scalar(state->carry, state->carry_len, dst);
+    state->carry_len = 0;
+
+    return BASE64_OK;
+}
+
+// base64_decode_init    :    prepare an incremental decoder
+void base64_decode_init(base64_decode_state *state)
+{
+    state->carry_len = 0;
+    state->padded = 0;
+}
+
+// base64_decode_update  :    decode the next chunk of an incremental stream
+//
+// state                 :    decoder from base64_decode_init
+// src                   :    next chunk of characters
+// srclen                :    number of characters
+// dst                   :    destination buffer
+// dstcap                :    size of dst, at least BASE64_DECODE_UPDATE_SIZE(srclen)
+// dstlen                :    length of decoded result
+// (result)              :    BASE64_OK, BASE64_ERROR_INVALID or
+//                            BASE64_ERROR_SPACE
+//
+// Characters that do not complete a 4-character group are held in state until
+// the next update or final call. Chunks may be split anywhere, but nothing may
+// follow a group with padding.
+int base64_decode_update(
+    base64_decode_state *state, const char *src, size_t srclen,
+    unsigned char *dst, size_t dstcap, size_t *dstlen
+) {
+    size_t total = state->carry_len + srclen;
+    size_t len;
+
+    *dstlen = 0;
+    if (state->padded && srclen != 0) {
+        return BASE64_ERROR_INVALID;
+    }
+    if (dstcap < (total / 4) * 3) {
+        return BASE64_ERROR_SPACE;
+    }
+    if (total < 4) {
+        memcpy(state->carry + state->carry_len, src, srclen);
+        state->carry_len = total;
+        return BASE64_OK;
+    }
+
+    if (state->carry_len) {
+        size_t fill = 4 - state->carry_len;
+        memcpy(state->carry + state->carry_len, src, fill);
+        if (decode_scalar(state->carry, 4, dst, &len) != BASE64_OK) {
+            return BASE64_ERROR_INVALID;
+        }
+        *dstlen += len;
+        src += fill;
+        srclen -= fill;
+        state->carry_len = 0;
+        if (state->carry[3] == '=') {
+            state->padded = 1;
+            if (srclen != 0) {
+                return BASE64_ERROR_INVALID;
+            }
+        }
+    }
+
+    size_t whole = (srclen / 4) * 4;
+    if (decode_scalar(src, whole, dst + *dstlen, &len) != BASE64_OK) {
+        return BASE64_ERROR_INVALID;
+    }
+    *dstlen += len;
+    if (whole != 0 && src[whole - 1] == '=') {
+        state->padded = 1;
+        if (srclen != whole) {
+            return BASE64_ERROR_INVALID;
+        }
+    }
+    memcpy(state->carry, src + whole, srclen - whole);
+    state->carry_len = srclen - whole;
+
+    return BASE64_OK;
+}
+
+// base64_decode_final   :    finish an incremental decoder
+//
+// (result)              :    BASE64_OK, or BASE64_ERROR_INVALID if the stream
+//                            ended part way through a 4-character group
+int base64_decode_final(base64_decode_state *state)
+{
+    int ret = state->carry_len ? BASE64_ERROR_INVALID : BASE64_OK;
+    state->carry_len = 0;
+    state->padded = 0;
+
+    return ret;
+}
@@ -16,5 +16,54 @@
 
 #include <stddef.h>
 
+#define BASE64_OK                0
+#define BASE64_ERROR_INVALID    -1
+#define BASE64_ERROR_SPACE      -2
+
+// Characters needed to encode n bytes, excluding the trailing NUL
+#define BASE64_ENCODED_SIZE(n)  ((((n) + 2) / 3) * 4)
+// Upper bound on the bytes produced by decoding n characters
+#define BASE64_DECODED_SIZE(n)  ((((n) + 3) / 4) * 3)
+
+// Upper bounds on the output of one incremental update of n input bytes
+#define BASE64_ENCODE_UPDATE_SIZE(n)    ((((n) + 2) / 3) * 4)
+#define BASE64_DECODE_UPDATE_SIZE(n)    ((((n) + 3) / 4) * 3)
+
+typedef struct {
+    unsigned char    carry[3];
+    size_t           carry_len;
+} base64_encode_state;
+
+typedef struct {
+    char             carry[4];
+    size_t           carry_len;
+    int              padded;        // a padded group ended the stream
+} base64_decode_state;
+
+void base64_init(void);
+const char *base64_kernel(void);
 char *base64_encode(const unsigned char *value, size_t vlen);
 unsigned char *base64_decode(const char *value, size_t *rlen);
+int base64_encode_into(
+    const unsigned char *src, size_t srclen, char *dst, size_t dstcap,
+    size_t *dstlen
+);
+int base64_decode_into(
+    const char *src, size_t srclen, unsigned char *dst, size_t dstcap,
+    size_t *dstlen
+);
+
+void base64_encode_init(base64_encode_state *state);
+int base64_encode_update(
+    base64_encode_state *state, const unsigned char *src, size_t srclen,
+    char *dst, size_t dstcap, size_t *dstlen
+);
+int base64_encode_final(
+    base64_encode_state *state, char *dst, size_t dstcap, size_t *dstlen
+);
+void base64_decode_init(base64_decode_state *state);
+int base64_decode_update(
+    base64_decode_state *state, const char *src, size_t srclen,
+    unsigned char *dst, size_t dstcap, size_t *dstlen
+);
+int base64_decode_final(base64_decode_state *state);
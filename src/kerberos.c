@@ -14,47 +14,34 @@
  * limitations under the License.
  **/
 
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
 #include "kerberosbasic.h"
 #include "kerberospw.h"
 #include "kerberosgss.h"
+#include "kerberospool.h"
+#include "kerberosrcshared.h"
+#include "kerberosspn.h"
+#include "kerberoswatch.h"
 
+#include "base64.h"
 
-/*
- * Support the Python 3 API while maintaining backward compatibility for the
- * Python 2 API.
- * Thanks to Lennart Regebro for http://python3porting.com/cextensions.html
- */
-// Handle basic API changes
-#if PY_MAJOR_VERSION >= 3
-    // Basic renames (function parameters are the same)
-    // No more int objects
-    #define PyInt_FromLong PyLong_FromLong
-    // CObjects to Capsules
-    #define PyCObject_Check PyCapsule_CheckExact
-    #define PyCObject_SetVoidPtr PyCapsule_SetPointer
-
-    // More complex macros (function parameters are not the same)
-    // Note for PyCObject_FromVoidPtr, destr is now the third parameter
-    #define PyCObject_FromVoidPtr(cobj, destr) PyCapsule_New(cobj, NULL, destr)
-    #define PyCObject_AsVoidPtr(pobj) PyCapsule_GetPointer(pobj, NULL)
-#endif
-// Handle differences in module definition syntax and interface
-#if PY_MAJOR_VERSION >= 3
-    #define MOD_ERROR_VAL NULL
-    #define MOD_SUCCESS_VAL(val) val
-    #define MOD_INIT(name) PyMODINIT_FUNC PyInit_##name(void)
-    #define MOD_DEF(ob, name, doc, methods) \
-          static struct PyModuleDef moduledef = { \
-            PyModuleDef_HEAD_INIT, name, doc, -1, methods, }; \
-          ob = PyModule_Create(&moduledef);
-#else
-    #define MOD_ERROR_VAL
-    #define MOD_SUCCESS_VAL(val)
-    #define MOD_INIT(name) void init##name(void)
-    #define MOD_DEF(ob, name, doc, methods) \
-          ob = Py_InitModule3(name, methods, doc);
+
+#if PY_VERSION_HEX < 0x03090000
+    #error "kerberos requires Python 3.9 or later"
 #endif
 
 static char krb5_mech_oid_bytes [] = "\x2a\x86\x48\x86\xf7\x12\x01\x02\x02";
@@ -63,788 +50,5649 @@ gss_OID_desc krb5_mech_oid = { 9, &krb5_mech_oid_bytes };
 static char spnego_mech_oid_bytes[] = "\x2b\x06\x01\x05\x05\x02";
 gss_OID_desc spnego_mech_oid = { 6, &spnego_mech_oid_bytes };
 
-char STATE_NULL_C = 'C';
-void* STATE_NULL = &STATE_NULL_C;
+/*
+ * Per-module state
+ *
+ * Everything that refers to Python objects lives here rather than in C
+ * globals, so that each (sub)interpreter importing the module gets its own
+ * exception classes and types. Module functions find it from the module
+ * they are called on, and context methods from their heap type.
+ */
+
+typedef struct {
+    PyObject*        KrbException_class;
+    PyObject*        BasicAuthException_class;
+    PyObject*        PwdChangeException_class;
+    PyObject*        GssException_class;
+    PyTypeObject*    GSSClientContextType;
+    PyTypeObject*    GSSServerContextType;
+    PyTypeObject*    GSSClientTargetType;
+    PyTypeObject*    WorkerPoolType;
+    PyTypeObject*    AsyncWorkerPoolType;
+    PyTypeObject*    FutureType;
+    PyTypeObject*    KeytabWatcherType;
+    PyTypeObject*    AcceptorType;
+    PyTypeObject*    ReplayCacheDaemonType;
+    PyTypeObject*    Base64EncoderType;
+    PyTypeObject*    Base64DecoderType;
+    PyObject*        krb5_mech_oid;
+    PyObject*        spnego_mech_oid;
+    // Running KeytabWatchers, whose threads call into this interpreter and
+    // so are stopped before it goes away
+    pthread_mutex_t  watchers_lock;
+    struct KeytabWatcher* watchers;
+} kerberos_state;
+
+static kerberos_state *module_state(PyObject *module)
+{
+    return (kerberos_state *)PyModule_GetState(module);
+}
+
+static kerberos_state *type_state(PyTypeObject *type)
+{
+    return (kerberos_state *)PyType_GetModuleState(type);
+}
+
+/*
+ * A string of a krb_error as str. Details can quote names taken from a
+ * client's token, so bytes that are not UTF-8 are kept as escapes rather
+ * than failing the decode.
+ */
+static PyObject *error_string(const char *value)
+{
+    if (value == NULL) {
+        Py_RETURN_NONE;
+    }
+    return PyUnicode_DecodeUTF8(value, strlen(value), "backslashreplace");
+}
+
+/*
+ * Raise the exception described by a krb_error from the C layer. Always
+ * returns NULL.
+ *
+ * The C layer never touches Python objects and reports failures only through
+ * a krb_error, so every call into it is made with the GIL released (these
+ * can wait on the KDC, keytab or credential cache) and the error is raised
+ * here once the GIL is held again.
+ */
+static PyObject *raise_error(kerberos_state *state, const krb_error *error)
+{
+    PyObject *exception = NULL;
+    PyObject *args = NULL;
+
+    switch (error->type) {
+    case KRB_ERROR_NONE:
+        // Nothing was recorded; Python reports the missing exception
+        return NULL;
+    case KRB_ERROR_NO_MEMORY:
+        return PyErr_NoMemory();
+    case KRB_ERROR_KRB:
+        exception = state->KrbException_class;
+        break;
+    case KRB_ERROR_BASIC_AUTH:
+        exception = state->BasicAuthException_class;
+        break;
+    case KRB_ERROR_PWD_CHANGE:
+        exception = state->PwdChangeException_class;
+        break;
+    case KRB_ERROR_GSS:
+        exception = state->GssException_class;
+        break;
+    }
+
+    switch (error->args) {
+    case KRB_ERROR_ARGS_MESSAGE:
+        args = Py_BuildValue("(N)", error_string(error->message));
+        break;
+    case KRB_ERROR_ARGS_MESSAGE_CODE:
+        args = Py_BuildValue(
+            "(N:i)", error_string(error->message), error->code
+        );
+        break;
+    case KRB_ERROR_ARGS_NESTED:
+        args = Py_BuildValue(
+            "((N:i))", error_string(error->message), error->code
+        );
+        break;
+    case KRB_ERROR_ARGS_GSS:
+        args = Py_BuildValue(
+            "((N:i)(N:i))", error_string(error->message), error->code,
+            error_string(error->detail), error->detail_code
+        );
+        break;
+    case KRB_ERROR_ARGS_MESSAGE_DETAIL:
+        args = Py_BuildValue(
+            "(N:N)", error_string(error->message), error_string(error->detail)
+        );
+        break;
+    }
+
+    if (args != NULL) {
+        PyErr_SetObject(exception, args);
+        Py_DECREF(args);
+    }
+    return NULL;
+}
+
+/*
+ * Argument unpacking for the METH_FASTCALL bindings.
+ *
+ * PyArg_ParseTuple* has to re-read its format string on every call, which
+ * shows up in profiles at Negotiate request rates. unpack_args() only sorts
+ * the positional and keyword arguments into out[] in kwlist order; the
+ * arg_* helpers below then convert each one like the matching format unit.
+ * out[] must be zeroed by the caller, and omitted optional arguments are
+ * left as NULL.
+ */
+
+static int unpack_args(
+    const char *fname, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames, const char *const *kwlist, Py_ssize_t required,
+    PyObject **out
+) {
+    Py_ssize_t nkwlist = 0;
+    Py_ssize_t nkwargs = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+    Py_ssize_t i, j;
+
+    while (kwlist[nkwlist] != NULL) {
+        nkwlist++;
+    }
+
+    if (nargs > nkwlist) {
+        PyErr_Format(
+            PyExc_TypeError, "%s() takes at most %zd arguments (%zd given)",
+            fname, nkwlist, nargs + nkwargs
+        );
+        return 0;
+    }
+
+    for (i = 0; i < nargs; i++) {
+        out[i] = args[i];
+    }
+
+    for (i = 0; i < nkwargs; i++) {
+        PyObject *key = PyTuple_GET_ITEM(kwnames, i);
+
+        for (j = 0; j < nkwlist; j++) {
+            if (PyUnicode_CompareWithASCIIString(key, kwlist[j]) == 0) {
+                break;
+            }
+        }
+        if (j == nkwlist) {
+            PyErr_Format(
+                PyExc_TypeError, "'%U' is an invalid keyword argument for %s()",
+                key, fname
+            );
+            return 0;
+        }
+        if (out[j] != NULL) {
+            PyErr_Format(
+                PyExc_TypeError,
+                "argument for %s() given by name ('%s') and position (%zd)",
+                fname, kwlist[j], j + 1
+            );
+            return 0;
+        }
+        out[j] = args[nargs + i];
+    }
+
+    for (i = 0; i < required; i++) {
+        if (out[i] == NULL) {
+            PyErr_Format(
+                PyExc_TypeError,
+                "%s() missing required argument '%s' (pos %zd)",
+                fname, kwlist[i], i + 1
+            );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// s# : str (as UTF-8) or bytes, embedded NULs allowed
+static int arg_string_and_size(
+    PyObject *obj, const char **value, Py_ssize_t *len
+) {
+    if (PyUnicode_Check(obj)) {
+        *value = PyUnicode_AsUTF8AndSize(obj, len);
+        return *value != NULL;
+    }
+    if (PyBytes_Check(obj)) {
+        *value = PyBytes_AS_STRING(obj);
+        *len = PyBytes_GET_SIZE(obj);
+        return 1;
+    }
+    PyErr_Format(
+        PyExc_TypeError, "expected str or bytes, not %.200s",
+        Py_TYPE(obj)->tp_name
+    );
+    return 0;
+}
+
+// s* : str (as UTF-8) or any bytes-like object, release with PyBuffer_Release
+static int arg_buffer(PyObject *obj, Py_buffer *view)
+{
+    if (PyUnicode_Check(obj)) {
+        Py_ssize_t len = 0;
+        const char *value = PyUnicode_AsUTF8AndSize(obj, &len);
+
+        if (value == NULL) {
+            return 0;
+        }
+        PyBuffer_FillInfo(view, NULL, (void *)value, len, 1, PyBUF_SIMPLE);
+        return 1;
+    }
+    return PyObject_GetBuffer(obj, view, PyBUF_SIMPLE) == 0;
+}
+
+// y* : any bytes-like object, release with PyBuffer_Release
+static int arg_bytes_buffer(PyObject *obj, Py_buffer *view)
+{
+    return PyObject_GetBuffer(obj, view, PyBUF_SIMPLE) == 0;
+}
+
+// w* : any writable bytes-like object, release with PyBuffer_Release
+static int arg_writable_buffer(PyObject *obj, Py_buffer *view)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_WRITABLE) != 0) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "expected a read-write bytes-like object, not %.200s",
+            Py_TYPE(obj)->tp_name
+        );
+        return 0;
+    }
+    return 1;
+}
+
+// s : str without embedded NULs
+static int arg_string(PyObject *obj, const char **value)
+{
+    Py_ssize_t len = 0;
+
+    if (! PyUnicode_Check(obj)) {
+        PyErr_Format(
+            PyExc_TypeError, "expected str, not %.200s", Py_TYPE(obj)->tp_name
+        );
+        return 0;
+    }
+    if ((*value = PyUnicode_AsUTF8AndSize(obj, &len)) == NULL) {
+        return 0;
+    }
+    if (strlen(*value) != (size_t)len) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+        return 0;
+    }
+    return 1;
+}
+
+// z : like s, but None or an omitted argument gives NULL
+static int arg_optional_string(PyObject *obj, const char **value)
+{
+    if (obj == NULL || obj == Py_None) {
+        *value = NULL;
+        return 1;
+    }
+    return arg_string(obj, value);
+}
+
+// l : an omitted argument keeps the default already in *value
+static int arg_long(PyObject *obj, long *value)
+{
+    long result;
+
+    if (obj == NULL) {
+        return 1;
+    }
+    result = PyLong_AsLong(obj);
+    if (result == -1 && PyErr_Occurred()) {
+        return 0;
+    }
+    *value = result;
+    return 1;
+}
+
+// i : as arg_long, range checked
+static int arg_int(PyObject *obj, int *value)
+{
+    long result = *value;
+
+    if (! arg_long(obj, &result)) {
+        return 0;
+    }
+    if (result < INT_MIN || result > INT_MAX) {
+        PyErr_SetString(
+            PyExc_OverflowError, "signed integer is out of range for int"
+        );
+        return 0;
+    }
+    *value = (int)result;
+    return 1;
+}
+
+// p : truth value; an omitted argument keeps the default already in *value
+static int arg_bool(PyObject *obj, int *value)
+{
+    int result;
+
+    if (obj == NULL) {
+        return 1;
+    }
+    result = PyObject_IsTrue(obj);
+    if (result < 0) {
+        return 0;
+    }
+    *value = result;
+    return 1;
+}
 
-PyObject *KrbException_class;
-PyObject *BasicAuthException_class;
-PyObject *PwdChangeException_class;
-PyObject *GssException_class;
+// d : a number of seconds, at least 0; an omitted argument keeps the default
+static int arg_seconds(PyObject *obj, double *value)
+{
+    double result;
+
+    if (obj == NULL) {
+        return 1;
+    }
+    result = PyFloat_AsDouble(obj);
+    if (result == -1.0 && PyErr_Occurred()) {
+        return 0;
+    }
+    if (! (result >= 0)) {
+        PyErr_SetString(PyExc_ValueError, "seconds must not be negative");
+        return 0;
+    }
+    *value = result;
+    return 1;
+}
+
+// rcache : None or the name of a replay cache type
+static int arg_rcache(PyObject *obj, int *value)
+{
+    static const struct {
+        const char* name;
+        int         type;
+    } types[] = {
+        {"file", KRB_RCACHE_FILE},
+        {"none", KRB_RCACHE_NONE},
+        {"memory", KRB_RCACHE_MEMORY},
+        {"shared", KRB_RCACHE_SHARED},
+    };
+    const char *name = NULL;
+    size_t i;
+
+    if (obj == NULL || obj == Py_None) {
+        *value = KRB_RCACHE_DEFAULT;
+        return 1;
+    }
+    if (! arg_string(obj, &name)) {
+        return 0;
+    }
+    for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (strcmp(name, types[i].name) == 0) {
+            *value = types[i].type;
+            return 1;
+        }
+    }
+    PyErr_SetString(
+        PyExc_ValueError,
+        "rcache must be 'file', 'none', 'memory', 'shared' or None"
+    );
+    return 0;
+}
+
+// slots : a replay cache size, at least 1; an omitted argument keeps the
+// default already in *value
+static int arg_slots(PyObject *obj, size_t *value)
+{
+    size_t result;
+
+    if (obj == NULL) {
+        return 1;
+    }
+    result = PyLong_AsSize_t(obj);
+    if (result == (size_t)-1 && PyErr_Occurred()) {
+        return 0;
+    }
+    if (result == 0) {
+        PyErr_SetString(PyExc_ValueError, "slots must be positive");
+        return 0;
+    }
+    *value = result;
+    return 1;
+}
 
-static PyObject *checkPassword(PyObject *self, PyObject *args)
+// mech_oid : a GSS_MECH_OID_* capsule; anything else keeps the default
+static void arg_mech_oid(PyObject *obj, gss_OID *value)
 {
+    if (obj != NULL && PyCapsule_CheckExact(obj)) {
+        const char * mech_oid_name = PyCapsule_GetName(obj);
+        *value = PyCapsule_GetPointer(obj, mech_oid_name);
+    }
+}
+
+static PyObject *checkPassword(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {
+        "user", "pswd", "service", "default_realm", NULL
+    };
+    PyObject *argv[4] = {NULL, NULL, NULL, NULL};
     const char *user = NULL;
     const char *pswd = NULL;
     const char *service = NULL;
     const char *default_realm = NULL;
+    krb_error error;
     int result = 0;
 
-    if (! PyArg_ParseTuple(args, "ssss", &user, &pswd, &service, &default_realm)) {
+    if (
+        ! unpack_args("checkPassword", args, nargs, kwnames, kwlist, 4, argv) ||
+        ! arg_string(argv[0], &user) ||
+        ! arg_string(argv[1], &pswd) ||
+        ! arg_string(argv[2], &service) ||
+        ! arg_string(argv[3], &default_realm)
+    ) {
         return NULL;
     }
 
-    result = authenticate_user_krb5pwd(user, pswd, service, default_realm);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_user_krb5pwd(
+        user, pswd, service, default_realm, &error
+    );
+    Py_END_ALLOW_THREADS
 
     if (result) {
         return Py_INCREF(Py_True), Py_True;
     } else {
-        return NULL;
+        return raise_error(module_state(self), &error);
     }
 }
 
-static PyObject *changePassword(PyObject *self, PyObject *args)
-{
+static PyObject *changePassword(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"user", "oldpswd", "newpswd", NULL};
+    PyObject *argv[3] = {NULL, NULL, NULL};
     const char *newpswd = NULL;
     const char *oldpswd = NULL;
     const char *user = NULL;
+    krb_error error;
     int result = 0;
 
-    if (! PyArg_ParseTuple(args, "sss", &user, &oldpswd, &newpswd)) {
+    if (
+        ! unpack_args("changePassword", args, nargs, kwnames, kwlist, 3, argv) ||
+        ! arg_string(argv[0], &user) ||
+        ! arg_string(argv[1], &oldpswd) ||
+        ! arg_string(argv[2], &newpswd)
+    ) {
         return NULL;
     }
 
-    result = change_user_krb5pwd(user, oldpswd, newpswd);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = change_user_krb5pwd(user, oldpswd, newpswd, &error);
+    Py_END_ALLOW_THREADS
 
     if (result) {
         return Py_INCREF(Py_True), Py_True;
     } else {
-        return NULL;
+        return raise_error(module_state(self), &error);
     }
 }
 
-static PyObject *getServerPrincipalDetails(PyObject *self, PyObject *args)
-{
+static PyObject *getServerPrincipalDetails(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"service", "hostname", NULL};
+    PyObject *argv[2] = {NULL, NULL};
     const char *service = NULL;
     const char *hostname = NULL;
+    krb_error error;
     char* result = NULL;
 
-    if (! PyArg_ParseTuple(args, "ss", &service, &hostname)) {
+    if (
+        ! unpack_args(
+            "getServerPrincipalDetails", args, nargs, kwnames, kwlist, 2, argv
+        ) ||
+        ! arg_string(argv[0], &service) ||
+        ! arg_string(argv[1], &hostname)
+    ) {
         return NULL;
     }
 
-    result = server_principal_details(service, hostname);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = server_principal_details(service, hostname, &error);
+    Py_END_ALLOW_THREADS
 
     if (result != NULL) {
         PyObject* pyresult = Py_BuildValue("s", result);
         free(result);
         return pyresult;
     } else {
-        return NULL;
+        return raise_error(module_state(self), &error);
     }
 }
 
-static PyObject* authGSSClientInit(PyObject* self, PyObject* args, PyObject* keywds)
-{
-    const char *service = NULL;
-    const char *principal = NULL;
-    gss_client_state *state = NULL;
-    PyObject *pystate = NULL;
-    gss_server_state *delegatestate = NULL;
-    PyObject *pydelegatestate = NULL;
-    gss_OID mech_oid = GSS_C_NO_OID;
-    PyObject *pymech_oid = NULL;
-    static char *kwlist[] = {
-        "service", "principal", "gssflags", "delegated", "mech_oid", NULL
-    };
-    long int gss_flags = GSS_C_MUTUAL_FLAG | GSS_C_SEQUENCE_FLAG;
-    int result = 0;
+/*
+ * GSSAPI contexts
+ *
+ * Each context object embeds its gss_*_state, so there is no separate heap
+ * allocation and no sentinel pointer to check. String attributes are built
+ * on first access and cached until the next call that can change them.
+ *
+ * Everything in a context, including the initialized flag and the cached
+ * strings, is only touched with the context's lock held. Without this two
+ * threads could step and clean the same context at once, which is a
+ * use-after-free once the GIL is released in a step or is absent entirely
+ * (free-threaded builds). Independent contexts never contend.
+ *
+ * A step run on a WorkerPool thread cannot touch Python objects, so it
+ * only sets stale, and the cached strings are dropped on the next access.
+ */
 
-    if (! PyArg_ParseTupleAndKeywords(
-        args, keywds, "s|zlOO", kwlist,
-        &service, &principal, &gss_flags, &pydelegatestate, &pymech_oid
-    )) {
-        return NULL;
-    }
+typedef struct {
+    PyObject_HEAD
+    pthread_mutex_t  lock;
+    gss_client_state state;
+    int              initialized;
+    int              stale;
+    size_t           retained;
+    PyObject*        delegated;
+    PyObject*        response;
+    PyObject*        username;
+} GSSClientContext;
+
+typedef struct {
+    PyObject_HEAD
+    pthread_mutex_t  lock;
+    gss_server_state state;
+    int              initialized;
+    int              stale;
+    size_t           retained;
+    PyObject*        response;
+    PyObject*        username;
+    PyObject*        targetname;
+    PyObject*        ccname;
+} GSSServerContext;
 
-    state = (gss_client_state *) malloc(sizeof(gss_client_state));
-    if (state == NULL)
-    {
-        PyErr_NoMemory();
-        return NULL;
+/*
+ * Take a context lock. The owner may be blocked in GSSAPI with the GIL
+ * released and need the GIL back before it can unlock, so never wait for
+ * the lock while holding the GIL.
+ */
+static void context_lock(pthread_mutex_t *lock)
+{
+    if (pthread_mutex_trylock(lock) != 0) {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock(lock);
+        Py_END_ALLOW_THREADS
     }
-    pystate = PyCObject_FromVoidPtr(state, NULL);
+}
+
+static void context_unlock(pthread_mutex_t *lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+/*
+ * Process-wide count of the contexts holding GSSAPI state, and of the bytes
+ * they retain, for contextStats(). A context that is never cleaned is still
+ * released when it is garbage collected, but one kept alive by a stray
+ * reference is not, and this is how a long-running service can spot that.
+ *
+ * Each context remembers what it last added to the gauge in its retained
+ * field, and updates the gauge with the difference, with its lock held,
+ * whenever its state may have changed. The bytes are those allocated here
+ * and in kerberosgss.c; memory private to the GSSAPI library is not
+ * included.
+ */
+
+typedef struct {
+    atomic_llong    contexts;
+    atomic_llong    bytes;
+} context_gauge;
+
+static context_gauge client_gauge;
+static context_gauge server_gauge;
+
+static size_t string_bytes(const char *value)
+{
+    return value ? strlen(value) + 1 : 0;
+}
 
-    if (pydelegatestate != NULL && PyCObject_Check(pydelegatestate)) {
-        delegatestate = PyCObject_AsVoidPtr(pydelegatestate);
+static void context_account(
+    context_gauge *gauge, size_t *retained, size_t bytes
+) {
+    if (bytes != *retained) {
+        atomic_fetch_add_explicit(
+            &gauge->contexts, (bytes != 0) - (*retained != 0),
+            memory_order_relaxed
+        );
+        atomic_fetch_add_explicit(
+            &gauge->bytes, (long long)bytes - (long long)*retained,
+            memory_order_relaxed
+        );
+        *retained = bytes;
     }
+}
 
-    if (pymech_oid != NULL && PyCapsule_CheckExact(pymech_oid)) {
-        const char * mech_oid_name = PyCapsule_GetName(pymech_oid);
-        mech_oid = PyCapsule_GetPointer(pymech_oid, mech_oid_name);
+static PyObject *context_cached_string(
+    PyObject **cache, const char *value, Py_ssize_t len
+) {
+    if (*cache == NULL) {
+        if (value == NULL) {
+            Py_INCREF(Py_None);
+            *cache = Py_None;
+        } else {
+            *cache = Py_BuildValue("s#", value, len);
+            if (*cache == NULL) {
+                return NULL;
+            }
+        }
     }
+    Py_INCREF(*cache);
+    return *cache;
+}
 
-    result = authenticate_gss_client_init(
-        service, principal, gss_flags, delegatestate, mech_oid, state
+/*
+ * Copy an output token from a *_raw call into a bytes object and release
+ * the GSSAPI buffer.
+ */
+static PyObject *context_token_bytes(gss_buffer_desc *token)
+{
+    OM_uint32 min_stat;
+    PyObject *pyresult = PyBytes_FromStringAndSize(
+        token->value, (Py_ssize_t)token->length
     );
 
-    if (result == AUTH_GSS_ERROR) {
-        return NULL;
+    if (token->value != NULL) {
+        gss_release_buffer(&min_stat, token);
     }
-
-    return Py_BuildValue("(iO)", result, pystate);
+    return pyresult;
 }
 
-static PyObject *authGSSClientClean(PyObject *self, PyObject *args)
+/*
+ * Copy an output token from a *_raw call into a caller-supplied buffer and
+ * release the GSSAPI buffer. Returns the length, or NULL if it did not fit.
+ */
+static PyObject *context_token_into(gss_buffer_desc *token, Py_buffer *out)
 {
-    gss_client_state *state = NULL;
-    PyObject *pystate = NULL;
-    int result = 0;
-
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
+    OM_uint32 min_stat;
+    PyObject *pyresult = NULL;
+
+    if (token->length > (size_t)out->len) {
+        PyErr_Format(
+            PyExc_ValueError, "output buffer too small: %zu bytes needed",
+            token->length
+        );
+    } else {
+        if (token->length) {
+            memcpy(out->buf, token->value, token->length);
+        }
+        pyresult = PyLong_FromSize_t(token->length);
     }
 
-    if (!PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
+    if (token->value != NULL) {
+        gss_release_buffer(&min_stat, token);
     }
+    return pyresult;
+}
 
-    state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
+/*
+ * The Authorization header value for the token left by a first client step.
+ */
+static PyObject *negotiate_header(
+    kerberos_state *kstate, const gss_client_state *state
+) {
+    static const char prefix[] = "Negotiate ";
+    size_t prefix_len = sizeof(prefix) - 1;
+    PyObject *header = NULL;
+
+    if (state->response_len == 0) {
+        krb_error error;
+
+        krb_error_set_message(
+            &error, KRB_ERROR_KRB, "GSSAPI produced no initial token"
+        );
+        return raise_error(kstate, &error);
+    }
 
-    if (state != STATE_NULL) {
-        result = authenticate_gss_client_clean(state);
+    header = PyUnicode_New(prefix_len + state->response_len, 127);
+    if (header != NULL) {
+        Py_UCS1 *data = PyUnicode_1BYTE_DATA(header);
 
-        free(state);
-        PyCObject_SetVoidPtr(pystate, STATE_NULL);
+        memcpy(data, prefix, prefix_len);
+        memcpy(data + prefix_len, state->response, state->response_len);
     }
-
-    return Py_BuildValue("i", result);
+    return header;
 }
 
-static PyObject *authGSSClientStep(PyObject *self, PyObject *args)
+static int context_check_initialized(PyObject *self, int initialized)
 {
-    gss_client_state *state = NULL;
-    PyObject *pystate = NULL;
-    char *challenge = NULL;
-    int result = 0;
-
-    if (! PyArg_ParseTuple(args, "Os", &pystate, &challenge)) {
-        return NULL;
+    if (! initialized) {
+        krb_error error;
+
+        krb_error_set_message(
+            &error, KRB_ERROR_KRB, "Context has already been cleaned"
+        );
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return 0;
     }
+    return 1;
+}
 
-    if (! PyCObject_Check(pystate)) {
+static GSSClientContext *client_context(
+    kerberos_state *state, PyObject *pystate
+) {
+    if (! PyObject_TypeCheck(pystate, state->GSSClientContextType)) {
         PyErr_SetString(PyExc_TypeError, "Expected a context object");
         return NULL;
     }
+    return (GSSClientContext *)pystate;
+}
 
-    state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
-
-    if (state == STATE_NULL) {
+static GSSServerContext *server_context(
+    kerberos_state *state, PyObject *pystate
+) {
+    if (! PyObject_TypeCheck(pystate, state->GSSServerContextType)) {
+        PyErr_SetString(PyExc_TypeError, "Expected a context object");
         return NULL;
     }
+    return (GSSServerContext *)pystate;
+}
 
-    result = authenticate_gss_client_step(state, challenge);
+static void GSSClientContext_clear_cache(GSSClientContext *self)
+{
+    Py_CLEAR(self->response);
+    Py_CLEAR(self->username);
+    self->stale = 0;
+}
 
-    if (result == AUTH_GSS_ERROR) {
-        return NULL;
+static int GSSClientContext_check_cache(GSSClientContext *self)
+{
+    if (self->stale) {
+        GSSClientContext_clear_cache(self);
     }
-
-    return Py_BuildValue("i", result);
+    return context_check_initialized((PyObject *)self, self->initialized);
 }
 
-static PyObject *authGSSClientResponseConf(PyObject *self, PyObject *args)
+static void GSSClientContext_account(GSSClientContext *self)
 {
-    gss_client_state *state = NULL;
-    PyObject *pystate = NULL;
-
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
-    }
+    size_t bytes = 0;
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
+    if (self->initialized) {
+        bytes = sizeof(*self) + self->state.response_size +
+            self->state.token_size + self->state.username_size;
     }
+    context_account(&client_gauge, &self->retained, bytes);
+}
 
-    state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
+static int GSSClientContext_clean_state(GSSClientContext *self)
+{
+    int result = 0;
 
-    if (state == STATE_NULL) {
-        return NULL;
+    if (self->initialized) {
+        result = authenticate_gss_client_clean(&self->state);
+        self->initialized = 0;
     }
+    GSSClientContext_account(self);
+    GSSClientContext_clear_cache(self);
+    Py_CLEAR(self->delegated);
 
-    return Py_BuildValue("i", state->responseConf);
+    return result;
 }
 
-static PyObject *authGSSServerHasDelegated(PyObject *self, PyObject *args)
-{
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
+/*
+ * Shared by GSSClientContext.__init__ and authGSSClientInit, which take the
+ * same (service, principal, gssflags, delegated, mech_oid) arguments.
+ */
+static int GSSClientContext_setup(
+    GSSClientContext *self, PyObject *const *argv
+) {
+    kerberos_state *kstate = type_state(Py_TYPE(self));
+    const char *service = NULL;
+    const char *principal = NULL;
+    gss_server_state *delegatestate = NULL;
+    PyObject *pydelegatestate = argv[3];
+    gss_OID mech_oid = GSS_C_NO_OID;
+    long int gss_flags = GSS_C_MUTUAL_FLAG | GSS_C_SEQUENCE_FLAG;
+    krb_error error;
+    int result = 0;
 
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
+    if (
+        ! arg_string(argv[0], &service) ||
+        ! arg_optional_string(argv[1], &principal) ||
+        ! arg_long(argv[2], &gss_flags)
+    ) {
+        return -1;
     }
+    arg_mech_oid(argv[4], &mech_oid);
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
+    if (
+        pydelegatestate != NULL &&
+        ! PyObject_TypeCheck(pydelegatestate, kstate->GSSServerContextType)
+    ) {
+        pydelegatestate = NULL;
     }
 
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
+    context_lock(&self->lock);
+    GSSClientContext_clean_state(self);
+
+    // Locks are always taken client first, then server
+    if (pydelegatestate != NULL) {
+        GSSServerContext *delegated = (GSSServerContext *)pydelegatestate;
+
+        context_lock(&delegated->lock);
+        if (delegated->initialized) {
+            // The client borrows the server's delegated credentials, so keep
+            // the server context alive for as long as this one
+            delegatestate = &delegated->state;
+            Py_INCREF(pydelegatestate);
+            self->delegated = pydelegatestate;
+        } else {
+            context_unlock(&delegated->lock);
+        }
+    }
 
-    if (state == STATE_NULL) {
-        return NULL;
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_init(
+        service, principal, gss_flags, delegatestate, mech_oid, &self->state,
+        &error
+    );
+    Py_END_ALLOW_THREADS
+    self->initialized = 1;
+
+    if (delegatestate != NULL) {
+        context_unlock(&((GSSServerContext *)pydelegatestate)->lock);
+    }
+
+    if (result == AUTH_GSS_ERROR) {
+        GSSClientContext_clean_state(self);
+        context_unlock(&self->lock);
+        raise_error(kstate, &error);
+        return -1;
     }
 
-    return PyBool_FromLong(authenticate_gss_server_has_delegated(state));
+    GSSClientContext_account(self);
+    context_unlock(&self->lock);
+    return 0;
 }
 
-static PyObject *authGSSClientResponse(PyObject *self, PyObject *args)
-{
-    gss_client_state *state = NULL;
-    PyObject *pystate = NULL;
+static const char *const client_init_kwlist[] = {
+    "service", "principal", "gssflags", "delegated", "mech_oid", NULL
+};
 
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
-    }
+static int GSSClientContext_init(
+    GSSClientContext *self, PyObject *args, PyObject *keywds
+) {
+    static char *kwlist[] = {
+        "service", "principal", "gssflags", "delegated", "mech_oid", NULL
+    };
+    PyObject *argv[5] = {NULL, NULL, NULL, NULL, NULL};
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
+    // Construction is not on the per-request path, so the generic parser is
+    // fine here
+    if (! PyArg_ParseTupleAndKeywords(
+        args, keywds, "O|OOOO:GSSClientContext", kwlist,
+        &argv[0], &argv[1], &argv[2], &argv[3], &argv[4]
+    )) {
+        return -1;
     }
 
-    state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
+    return GSSClientContext_setup(self, argv);
+}
 
-    if (state == STATE_NULL) {
-        return NULL;
-    }
+static PyObject *GSSClientContext_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    GSSClientContext *self = (GSSClientContext *)type->tp_alloc(type, 0);
 
-    return Py_BuildValue("s", state->response);
+    if (self != NULL) {
+        pthread_mutex_init(&self->lock, NULL);
+    }
+    return (PyObject *)self;
 }
 
-static PyObject *authGSSClientUserName(PyObject *self, PyObject *args)
+static void GSSClientContext_dealloc(GSSClientContext *self)
 {
-    gss_client_state *state = NULL;
-    PyObject *pystate = NULL;
+    PyTypeObject *type = Py_TYPE(self);
 
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
-    }
+    // No other references remain, so there is nothing to lock against
+    GSSClientContext_clean_state(self);
+    pthread_mutex_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *GSSClientContext_clean(GSSClientContext *self, PyObject *args)
+{
+    int result = 0;
+
+    context_lock(&self->lock);
+    result = GSSClientContext_clean_state(self);
+    context_unlock(&self->lock);
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *client_step(GSSClientContext *self, PyObject *pychallenge)
+{
+    const char *challenge = NULL;
+    Py_ssize_t challenge_len = 0;
+    krb_error error;
+    int result = 0;
+
+    if (! arg_string_and_size(pychallenge, &challenge, &challenge_len)) {
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        return NULL;
+    }
+
+    GSSClientContext_clear_cache(self);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_step(
+        &self->state, challenge, challenge_len, &error
+    );
+    Py_END_ALLOW_THREADS
+    GSSClientContext_account(self);
+    context_unlock(&self->lock);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *client_unwrap(GSSClientContext *self, PyObject *pychallenge)
+{
+    Py_buffer challenge;
+    krb_error error;
+    int result = 0;
+
+    if (! arg_buffer(pychallenge, &challenge)) {
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        PyBuffer_Release(&challenge);
+        return NULL;
+    }
+
+    Py_CLEAR(self->response);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_unwrap(
+        &self->state, challenge.buf, challenge.len, &error
+    );
+    Py_END_ALLOW_THREADS
+    context_unlock(&self->lock);
+    PyBuffer_Release(&challenge);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *client_wrap(
+    GSSClientContext *self, PyObject *pychallenge, PyObject *pyuser,
+    PyObject *pyprotect
+) {
+    Py_buffer challenge;
+    const char *user = NULL;
+    int protect = 0;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! arg_optional_string(pyuser, &user) ||
+        ! arg_int(pyprotect, &protect) ||
+        ! arg_buffer(pychallenge, &challenge)
+    ) {
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        PyBuffer_Release(&challenge);
+        return NULL;
+    }
+
+    Py_CLEAR(self->response);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_wrap(
+        &self->state, challenge.buf, challenge.len, user, protect, &error
+    );
+    Py_END_ALLOW_THREADS
+    context_unlock(&self->lock);
+    PyBuffer_Release(&challenge);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *GSSClientContext_step(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"challenge", NULL};
+    PyObject *argv[1] = {NULL};
+
+    if (! unpack_args("step", args, nargs, kwnames, kwlist, 1, argv)) {
+        return NULL;
+    }
+
+    return client_step(self, argv[0]);
+}
+
+static PyObject *GSSClientContext_unwrap(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"challenge", NULL};
+    PyObject *argv[1] = {NULL};
+
+    if (! unpack_args("unwrap", args, nargs, kwnames, kwlist, 1, argv)) {
+        return NULL;
+    }
+
+    return client_unwrap(self, argv[0]);
+}
+
+static PyObject *GSSClientContext_wrap(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"data", "user", "protect", NULL};
+    PyObject *argv[3] = {NULL, NULL, NULL};
+
+    if (! unpack_args("wrap", args, nargs, kwnames, kwlist, 1, argv)) {
+        return NULL;
+    }
+
+    return client_wrap(self, argv[0], argv[1], argv[2]);
+}
+
+static PyObject *GSSClientContext_step_bytes(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"token", NULL};
+    PyObject *argv[1] = {NULL};
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+    Py_buffer input;
+    PyObject *pyoutput = NULL;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! unpack_args("step_bytes", args, nargs, kwnames, kwlist, 1, argv) ||
+        ! arg_bytes_buffer(argv[0], &input)
+    ) {
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    GSSClientContext_clear_cache(self);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_step_raw(
+        &self->state, input.buf, input.len, &output, &error
+    );
+    Py_END_ALLOW_THREADS
+    GSSClientContext_account(self);
+    context_unlock(&self->lock);
+    PyBuffer_Release(&input);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    if ((pyoutput = context_token_bytes(&output)) == NULL) {
+        return NULL;
+    }
+    return Py_BuildValue("(iN)", result, pyoutput);
+}
+
+/*
+ * Shared by unwrap_bytes and unwrap_into: unwrap the raw message in
+ * pydata into *output, which the caller must release.
+ */
+static int client_unwrap_raw(
+    GSSClientContext *self, PyObject *pydata, gss_buffer_desc *output
+) {
+    Py_buffer input;
+    krb_error error;
+    int result = 0;
+
+    if (! arg_bytes_buffer(pydata, &input)) {
+        return 0;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        PyBuffer_Release(&input);
+        return 0;
+    }
+
+    Py_CLEAR(self->response);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_unwrap_raw(
+        &self->state, input.buf, input.len, output, &error
+    );
+    Py_END_ALLOW_THREADS
+    context_unlock(&self->lock);
+    PyBuffer_Release(&input);
+
+    if (result == AUTH_GSS_ERROR) {
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Shared by wrap_bytes and wrap_into: wrap the raw data in pydata into
+ * *output, which the caller must release.
+ */
+static int client_wrap_raw(
+    GSSClientContext *self, PyObject *pydata, PyObject *pyuser,
+    PyObject *pyprotect, gss_buffer_desc *output
+) {
+    Py_buffer input;
+    const char *user = NULL;
+    int protect = 0;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! arg_optional_string(pyuser, &user) ||
+        ! arg_int(pyprotect, &protect) ||
+        ! arg_bytes_buffer(pydata, &input)
+    ) {
+        return 0;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        PyBuffer_Release(&input);
+        return 0;
+    }
+
+    Py_CLEAR(self->response);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_wrap_raw(
+        &self->state, input.buf, input.len, user, protect, output, &error
+    );
+    Py_END_ALLOW_THREADS
+    context_unlock(&self->lock);
+    PyBuffer_Release(&input);
+
+    if (result == AUTH_GSS_ERROR) {
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return 0;
+    }
+    return 1;
+}
+
+static PyObject *GSSClientContext_unwrap_bytes(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"data", NULL};
+    PyObject *argv[1] = {NULL};
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+
+    if (
+        ! unpack_args("unwrap_bytes", args, nargs, kwnames, kwlist, 1, argv) ||
+        ! client_unwrap_raw(self, argv[0], &output)
+    ) {
+        return NULL;
+    }
+
+    return context_token_bytes(&output);
+}
+
+static PyObject *GSSClientContext_unwrap_into(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"data", "buffer", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+    Py_buffer out;
+    PyObject *pyresult = NULL;
+
+    if (
+        ! unpack_args("unwrap_into", args, nargs, kwnames, kwlist, 2, argv) ||
+        ! arg_writable_buffer(argv[1], &out)
+    ) {
+        return NULL;
+    }
+
+    if (client_unwrap_raw(self, argv[0], &output)) {
+        pyresult = context_token_into(&output, &out);
+    }
+    PyBuffer_Release(&out);
+
+    return pyresult;
+}
+
+static PyObject *GSSClientContext_wrap_bytes(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"data", "user", "protect", NULL};
+    PyObject *argv[3] = {NULL, NULL, NULL};
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+
+    if (
+        ! unpack_args("wrap_bytes", args, nargs, kwnames, kwlist, 1, argv) ||
+        ! client_wrap_raw(self, argv[0], argv[1], argv[2], &output)
+    ) {
+        return NULL;
+    }
+
+    return context_token_bytes(&output);
+}
+
+static PyObject *GSSClientContext_wrap_into(
+    GSSClientContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {
+        "data", "buffer", "user", "protect", NULL
+    };
+    PyObject *argv[4] = {NULL, NULL, NULL, NULL};
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+    Py_buffer out;
+    PyObject *pyresult = NULL;
+
+    if (
+        ! unpack_args("wrap_into", args, nargs, kwnames, kwlist, 2, argv) ||
+        ! arg_writable_buffer(argv[1], &out)
+    ) {
+        return NULL;
+    }
+
+    if (client_wrap_raw(self, argv[0], argv[2], argv[3], &output)) {
+        pyresult = context_token_into(&output, &out);
+    }
+    PyBuffer_Release(&out);
+
+    return pyresult;
+}
+
+static PyObject *GSSClientContext_inquire_cred(
+    GSSClientContext *self, PyObject *args
+) {
+    krb_error error;
+    int result = 0;
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        return NULL;
+    }
+
+    Py_CLEAR(self->username);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_inquire_cred(&self->state, &error);
+    Py_END_ALLOW_THREADS
+    GSSClientContext_account(self);
+    context_unlock(&self->lock);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *GSSClientContext_get_response(
+    GSSClientContext *self, void *closure
+) {
+    PyObject *pyresult = NULL;
+
+    context_lock(&self->lock);
+    if (GSSClientContext_check_cache(self)) {
+        pyresult = context_cached_string(
+            &self->response,
+            self->state.response_len ? self->state.response : NULL,
+            self->state.response_len
+        );
+    }
+    context_unlock(&self->lock);
+
+    return pyresult;
+}
+
+static PyObject *GSSClientContext_get_response_conf(
+    GSSClientContext *self, void *closure
+) {
+    PyObject *pyresult = NULL;
+
+    context_lock(&self->lock);
+    if (context_check_initialized((PyObject *)self, self->initialized)) {
+        pyresult = PyLong_FromLong(self->state.responseConf);
+    }
+    context_unlock(&self->lock);
+
+    return pyresult;
+}
+
+static PyObject *GSSClientContext_get_username(
+    GSSClientContext *self, void *closure
+) {
+    const char *username = NULL;
+    PyObject *pyresult = NULL;
+    krb_error error;
+    int result = 0;
+
+    context_lock(&self->lock);
+    if (GSSClientContext_check_cache(self)) {
+        // Looked up on first use; GSSAPI only reads the context here
+        krb_error_clear(&error);
+        result = authenticate_gss_client_username(
+            &self->state, &username, &error
+        );
+        GSSClientContext_account(self);
+        if (result != AUTH_GSS_ERROR) {
+            pyresult = context_cached_string(
+                &self->username, username, username ? strlen(username) : 0
+            );
+        }
+    }
+    context_unlock(&self->lock);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+    return pyresult;
+}
+
+static PyMethodDef GSSClientContext_methods[] = {
+    {
+        "step",
+        (PyCFunction)(void(*)(void))GSSClientContext_step,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a client-side GSSAPI step."
+    },
+    {
+        "wrap",
+        (PyCFunction)(void(*)(void))GSSClientContext_wrap,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a GSSAPI wrap."
+    },
+    {
+        "unwrap",
+        (PyCFunction)(void(*)(void))GSSClientContext_unwrap,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a GSSAPI unwrap."
+    },
+    {
+        "step_bytes",
+        (PyCFunction)(void(*)(void))GSSClientContext_step_bytes,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a client-side GSSAPI step with a raw token."
+    },
+    {
+        "wrap_bytes",
+        (PyCFunction)(void(*)(void))GSSClientContext_wrap_bytes,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a GSSAPI wrap of raw data."
+    },
+    {
+        "unwrap_bytes",
+        (PyCFunction)(void(*)(void))GSSClientContext_unwrap_bytes,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a GSSAPI unwrap of a raw message."
+    },
+    {
+        "wrap_into",
+        (PyCFunction)(void(*)(void))GSSClientContext_wrap_into,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a GSSAPI wrap of raw data into a writable buffer."
+    },
+    {
+        "unwrap_into",
+        (PyCFunction)(void(*)(void))GSSClientContext_unwrap_into,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a GSSAPI unwrap of a raw message into a writable buffer."
+    },
+    {
+        "inquire_cred",
+        (PyCFunction)GSSClientContext_inquire_cred, METH_NOARGS,
+        "Get the current user name, if any, without a client-side GSSAPI step"
+    },
+    {
+        "clean",
+        (PyCFunction)GSSClientContext_clean, METH_NOARGS,
+        "Terminate client-side GSSAPI operations."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyGetSetDef GSSClientContext_getset[] = {
+    {
+        "response",
+        (getter)GSSClientContext_get_response, NULL,
+        "The response from the last client-side GSSAPI step.", NULL
+    },
+    {
+        "response_conf",
+        (getter)GSSClientContext_get_response_conf, NULL,
+        "1 if confidentiality was set in the last unwrapped buffer.", NULL
+    },
+    {
+        "username",
+        (getter)GSSClientContext_get_username, NULL,
+        "The user name from the last client-side GSSAPI step.", NULL
+    },
+    {NULL, NULL, NULL, NULL, NULL}        /* Sentinel */
+};
+
+static PyType_Slot GSSClientContext_slots[] = {
+    {Py_tp_doc, "Client-side GSSAPI context."},
+    {Py_tp_methods, GSSClientContext_methods},
+    {Py_tp_getset, GSSClientContext_getset},
+    {Py_tp_init, GSSClientContext_init},
+    {Py_tp_dealloc, GSSClientContext_dealloc},
+    {Py_tp_new, GSSClientContext_new},
+    {0, NULL}
+};
+
+static PyType_Spec GSSClientContext_spec = {
+    "kerberos.GSSClientContext",
+    sizeof(GSSClientContext),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    GSSClientContext_slots
+};
+
+/*
+ * A client target holds the imported service name and the credentials for
+ * one SPN, for callers that need a fresh Negotiate header for the same
+ * backend on every request. Each negotiate() call runs its own exchange
+ * that borrows these handles, so the read lock is enough and threads can
+ * negotiate with one target in parallel; only setup and cleaning, which
+ * replace the handles, take the write lock.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    pthread_rwlock_t lock;
+    gss_client_state state;
+    int              initialized;
+} GSSClientTarget;
+
+// As context_lock, for readers and writers of a target or worker pool
+static void rw_lock(pthread_rwlock_t *lock, int write)
+{
+    if (
+        (write ? pthread_rwlock_trywrlock(lock) :
+         pthread_rwlock_tryrdlock(lock)) != 0
+    ) {
+        Py_BEGIN_ALLOW_THREADS
+        if (write) {
+            pthread_rwlock_wrlock(lock);
+        } else {
+            pthread_rwlock_rdlock(lock);
+        }
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static void rw_unlock(pthread_rwlock_t *lock)
+{
+    pthread_rwlock_unlock(lock);
+}
+
+static int GSSClientTarget_clean_state(GSSClientTarget *self)
+{
+    int result = 0;
+
+    if (self->initialized) {
+        result = authenticate_gss_client_clean(&self->state);
+        self->initialized = 0;
+    }
+    return result;
+}
+
+static const char *const client_target_kwlist[] = {
+    "service", "principal", "gssflags", "mech_oid", NULL
+};
+
+static int GSSClientTarget_init(
+    GSSClientTarget *self, PyObject *args, PyObject *keywds
+) {
+    static char *kwlist[] = {
+        "service", "principal", "gssflags", "mech_oid", NULL
+    };
+    PyObject *pyservice = NULL;
+    PyObject *pyprincipal = NULL;
+    PyObject *pygss_flags = NULL;
+    PyObject *pymech_oid = NULL;
+    const char *service = NULL;
+    const char *principal = NULL;
+    long int gss_flags = GSS_C_MUTUAL_FLAG | GSS_C_SEQUENCE_FLAG;
+    gss_OID mech_oid = GSS_C_NO_OID;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! PyArg_ParseTupleAndKeywords(
+            args, keywds, "O|OOO:GSSClientTarget", kwlist,
+            &pyservice, &pyprincipal, &pygss_flags, &pymech_oid
+        ) ||
+        ! arg_string(pyservice, &service) ||
+        ! arg_optional_string(pyprincipal, &principal) ||
+        ! arg_long(pygss_flags, &gss_flags)
+    ) {
+        return -1;
+    }
+    arg_mech_oid(pymech_oid, &mech_oid);
+
+    rw_lock(&self->lock, 1);
+    GSSClientTarget_clean_state(self);
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_init(
+        service, principal, gss_flags, NULL, mech_oid, &self->state, &error
+    );
+    Py_END_ALLOW_THREADS
+    self->initialized = 1;
+
+    if (result == AUTH_GSS_ERROR) {
+        GSSClientTarget_clean_state(self);
+        rw_unlock(&self->lock);
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return -1;
+    }
+
+    rw_unlock(&self->lock);
+    return 0;
+}
+
+static PyObject *GSSClientTarget_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    GSSClientTarget *self = (GSSClientTarget *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        pthread_rwlock_init(&self->lock, NULL);
+    }
+    return (PyObject *)self;
+}
+
+static void GSSClientTarget_dealloc(GSSClientTarget *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    GSSClientTarget_clean_state(self);
+    pthread_rwlock_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *GSSClientTarget_negotiate(
+    GSSClientTarget *self, PyObject *args
+) {
+    kerberos_state *kstate = type_state(Py_TYPE(self));
+    gss_client_state exchange;
+    PyObject *pyresult = NULL;
+    krb_error error;
+    int result = 0;
+
+    rw_lock(&self->lock, 0);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        rw_unlock(&self->lock);
+        return NULL;
+    }
+
+    authenticate_gss_client_init_exchange(&self->state, &exchange);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_step(&exchange, "", 0, &error);
+    Py_END_ALLOW_THREADS
+
+    if (result == AUTH_GSS_ERROR) {
+        raise_error(kstate, &error);
+    } else {
+        pyresult = negotiate_header(kstate, &exchange);
+    }
+    authenticate_gss_client_clean_exchange(&exchange);
+    rw_unlock(&self->lock);
+
+    return pyresult;
+}
+
+static PyObject *GSSClientTarget_clean(GSSClientTarget *self, PyObject *args)
+{
+    int result = 0;
+
+    rw_lock(&self->lock, 1);
+    result = GSSClientTarget_clean_state(self);
+    rw_unlock(&self->lock);
+
+    return PyLong_FromLong(result);
+}
+
+static PyMethodDef GSSClientTarget_methods[] = {
+    {
+        "negotiate",
+        (PyCFunction)GSSClientTarget_negotiate, METH_NOARGS,
+        "Start a new exchange and return its Negotiate header value."
+    },
+    {
+        "clean",
+        (PyCFunction)GSSClientTarget_clean, METH_NOARGS,
+        "Release the name and credentials held by the target."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyType_Slot GSSClientTarget_slots[] = {
+    {Py_tp_doc, "Client-side GSSAPI target for repeated Negotiate headers."},
+    {Py_tp_methods, GSSClientTarget_methods},
+    {Py_tp_init, GSSClientTarget_init},
+    {Py_tp_dealloc, GSSClientTarget_dealloc},
+    {Py_tp_new, GSSClientTarget_new},
+    {0, NULL}
+};
+
+static PyType_Spec GSSClientTarget_spec = {
+    "kerberos.GSSClientTarget",
+    sizeof(GSSClientTarget),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    GSSClientTarget_slots
+};
+
+static void GSSServerContext_clear_cache(GSSServerContext *self)
+{
+    Py_CLEAR(self->response);
+    Py_CLEAR(self->username);
+    Py_CLEAR(self->targetname);
+    Py_CLEAR(self->ccname);
+    self->stale = 0;
+}
+
+static int GSSServerContext_check_cache(GSSServerContext *self)
+{
+    if (self->stale) {
+        GSSServerContext_clear_cache(self);
+    }
+    return context_check_initialized((PyObject *)self, self->initialized);
+}
+
+static void GSSServerContext_account(GSSServerContext *self)
+{
+    size_t bytes = 0;
+
+    if (self->initialized) {
+        bytes = sizeof(*self) + self->state.response_size +
+            self->state.token_size + self->state.username_size +
+            self->state.targetname_size + string_bytes(self->state.ccname);
+    }
+    context_account(&server_gauge, &self->retained, bytes);
+}
+
+static int GSSServerContext_clean_state(GSSServerContext *self)
+{
+    int result = 0;
+
+    if (self->initialized) {
+        result = authenticate_gss_server_clean(&self->state);
+        self->initialized = 0;
+    }
+    GSSServerContext_account(self);
+    GSSServerContext_clear_cache(self);
+
+    return result;
+}
+
+static int GSSServerContext_setup(
+    GSSServerContext *self, PyObject *pyservice, PyObject *pyrcache
+) {
+    const char *service = NULL;
+    int rcache = KRB_RCACHE_DEFAULT;
+    krb_error error;
+    int result = 0;
+
+    if (! arg_string(pyservice, &service) || ! arg_rcache(pyrcache, &rcache)) {
+        return -1;
+    }
+
+    context_lock(&self->lock);
+    GSSServerContext_clean_state(self);
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_server_init_rcache(
+        service, rcache, &self->state, &error
+    );
+    Py_END_ALLOW_THREADS
+    self->initialized = 1;
+
+    if (result == AUTH_GSS_ERROR) {
+        GSSServerContext_clean_state(self);
+        context_unlock(&self->lock);
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return -1;
+    }
+
+    GSSServerContext_account(self);
+    context_unlock(&self->lock);
+    return 0;
+}
+
+static int GSSServerContext_init(
+    GSSServerContext *self, PyObject *args, PyObject *keywds
+) {
+    static char *kwlist[] = {"service", "rcache", NULL};
+    PyObject *pyservice = NULL;
+    PyObject *pyrcache = NULL;
+
+    if (! PyArg_ParseTupleAndKeywords(
+        args, keywds, "O|O:GSSServerContext", kwlist, &pyservice, &pyrcache
+    )) {
+        return -1;
+    }
+
+    return GSSServerContext_setup(self, pyservice, pyrcache);
+}
+
+static PyObject *GSSServerContext_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    GSSServerContext *self = (GSSServerContext *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        pthread_mutex_init(&self->lock, NULL);
+    }
+    return (PyObject *)self;
+}
+
+static void GSSServerContext_dealloc(GSSServerContext *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    GSSServerContext_clean_state(self);
+    pthread_mutex_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *GSSServerContext_clean(GSSServerContext *self, PyObject *args)
+{
+    int result = 0;
+
+    context_lock(&self->lock);
+    result = GSSServerContext_clean_state(self);
+    context_unlock(&self->lock);
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *server_step(GSSServerContext *self, PyObject *pychallenge)
+{
+    const char *challenge = NULL;
+    Py_ssize_t challenge_len = 0;
+    krb_error error;
+    int result = 0;
+
+    if (! arg_string_and_size(pychallenge, &challenge, &challenge_len)) {
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        return NULL;
+    }
+
+    GSSServerContext_clear_cache(self);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_server_step(
+        &self->state, challenge, challenge_len, &error
+    );
+    Py_END_ALLOW_THREADS
+    GSSServerContext_account(self);
+    context_unlock(&self->lock);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *GSSServerContext_step(
+    GSSServerContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"challenge", NULL};
+    PyObject *argv[1] = {NULL};
+
+    if (! unpack_args("step", args, nargs, kwnames, kwlist, 1, argv)) {
+        return NULL;
+    }
+
+    return server_step(self, argv[0]);
+}
+
+static PyObject *GSSServerContext_step_bytes(
+    GSSServerContext *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"token", NULL};
+    PyObject *argv[1] = {NULL};
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+    Py_buffer input;
+    PyObject *pyoutput = NULL;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! unpack_args("step_bytes", args, nargs, kwnames, kwlist, 1, argv) ||
+        ! arg_bytes_buffer(argv[0], &input)
+    ) {
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    GSSServerContext_clear_cache(self);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_server_step_raw(
+        &self->state, input.buf, input.len, &output, &error
+    );
+    Py_END_ALLOW_THREADS
+    GSSServerContext_account(self);
+    context_unlock(&self->lock);
+    PyBuffer_Release(&input);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    if ((pyoutput = context_token_bytes(&output)) == NULL) {
+        return NULL;
+    }
+    return Py_BuildValue("(iN)", result, pyoutput);
+}
+
+static PyObject *GSSServerContext_store_delegate(
+    GSSServerContext *self, PyObject *args
+) {
+    krb_error error;
+    int result = 0;
+
+    context_lock(&self->lock);
+    if (! context_check_initialized((PyObject *)self, self->initialized)) {
+        context_unlock(&self->lock);
+        return NULL;
+    }
+
+    Py_CLEAR(self->ccname);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_server_store_delegate(&self->state, &error);
+    Py_END_ALLOW_THREADS
+    GSSServerContext_account(self);
+    context_unlock(&self->lock);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+
+    return PyLong_FromLong(result);
+}
+
+static PyObject *GSSServerContext_get_response(
+    GSSServerContext *self, void *closure
+) {
+    PyObject *pyresult = NULL;
+
+    context_lock(&self->lock);
+    if (GSSServerContext_check_cache(self)) {
+        pyresult = context_cached_string(
+            &self->response,
+            self->state.response_len ? self->state.response : NULL,
+            self->state.response_len
+        );
+    }
+    context_unlock(&self->lock);
+
+    return pyresult;
+}
+
+/*
+ * A name getter of the server context, which displays the name on first
+ * use with lookup. GSSAPI only reads the context here, so the GIL is kept.
+ */
+static PyObject *GSSServerContext_get_name(
+    GSSServerContext *self, PyObject **cache,
+    int (*lookup)(gss_server_state *, const char **, krb_error *)
+) {
+    const char *name = NULL;
+    PyObject *pyresult = NULL;
+    krb_error error;
+    int result = 0;
+
+    context_lock(&self->lock);
+    if (GSSServerContext_check_cache(self)) {
+        krb_error_clear(&error);
+        result = lookup(&self->state, &name, &error);
+        GSSServerContext_account(self);
+        if (result != AUTH_GSS_ERROR) {
+            pyresult = context_cached_string(
+                cache, name, name ? strlen(name) : 0
+            );
+        }
+    }
+    context_unlock(&self->lock);
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+    return pyresult;
+}
+
+static PyObject *GSSServerContext_get_username(
+    GSSServerContext *self, void *closure
+) {
+    return GSSServerContext_get_name(
+        self, &self->username, authenticate_gss_server_username
+    );
+}
+
+static PyObject *GSSServerContext_get_targetname(
+    GSSServerContext *self, void *closure
+) {
+    return GSSServerContext_get_name(
+        self, &self->targetname, authenticate_gss_server_targetname
+    );
+}
+
+static PyObject *GSSServerContext_get_ccname(
+    GSSServerContext *self, void *closure
+) {
+    PyObject *pyresult = NULL;
+
+    context_lock(&self->lock);
+    if (GSSServerContext_check_cache(self)) {
+        pyresult = context_cached_string(
+            &self->ccname, self->state.ccname,
+            self->state.ccname ? strlen(self->state.ccname) : 0
+        );
+    }
+    context_unlock(&self->lock);
+
+    return pyresult;
+}
+
+static PyObject *GSSServerContext_get_has_delegated(
+    GSSServerContext *self, void *closure
+) {
+    PyObject *pyresult = NULL;
+
+    context_lock(&self->lock);
+    if (context_check_initialized((PyObject *)self, self->initialized)) {
+        pyresult = PyBool_FromLong(
+            authenticate_gss_server_has_delegated(&self->state)
+        );
+    }
+    context_unlock(&self->lock);
+
+    return pyresult;
+}
+
+static PyMethodDef GSSServerContext_methods[] = {
+    {
+        "step",
+        (PyCFunction)(void(*)(void))GSSServerContext_step,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a server-side GSSAPI step."
+    },
+    {
+        "step_bytes",
+        (PyCFunction)(void(*)(void))GSSServerContext_step_bytes,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Do a server-side GSSAPI step with a raw token."
+    },
+    {
+        "store_delegate",
+        (PyCFunction)GSSServerContext_store_delegate, METH_NOARGS,
+        "Store the delegated Credentials."
+    },
+    {
+        "clean",
+        (PyCFunction)GSSServerContext_clean, METH_NOARGS,
+        "Terminate server-side GSSAPI operations."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyGetSetDef GSSServerContext_getset[] = {
+    {
+        "response",
+        (getter)GSSServerContext_get_response, NULL,
+        "The response from the last server-side GSSAPI step.", NULL
+    },
+    {
+        "username",
+        (getter)GSSServerContext_get_username, NULL,
+        "The user name from the last server-side GSSAPI step.", NULL
+    },
+    {
+        "targetname",
+        (getter)GSSServerContext_get_targetname, NULL,
+        "The target name from the last server-side GSSAPI step.", NULL
+    },
+    {
+        "ccname",
+        (getter)GSSServerContext_get_ccname, NULL,
+        "The location of the cache where delegated credentials are stored.",
+        NULL
+    },
+    {
+        "has_delegated",
+        (getter)GSSServerContext_get_has_delegated, NULL,
+        "Whether the client delegated credentials to us.", NULL
+    },
+    {NULL, NULL, NULL, NULL, NULL}        /* Sentinel */
+};
+
+static PyType_Slot GSSServerContext_slots[] = {
+    {Py_tp_doc, "Server-side GSSAPI context."},
+    {Py_tp_methods, GSSServerContext_methods},
+    {Py_tp_getset, GSSServerContext_getset},
+    {Py_tp_init, GSSServerContext_init},
+    {Py_tp_dealloc, GSSServerContext_dealloc},
+    {Py_tp_new, GSSServerContext_new},
+    {0, NULL}
+};
+
+static PyType_Spec GSSServerContext_spec = {
+    "kerberos.GSSServerContext",
+    sizeof(GSSServerContext),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    GSSServerContext_slots
+};
+
+/*
+ * The functional API is kept as thin wrappers around the context types.
+ * Each takes the context as its first argument.
+ */
+
+static const char *const context_kwlist[] = {"context", NULL};
+static const char *const context_challenge_kwlist[] = {
+    "context", "challenge", NULL
+};
+
+static GSSClientContext *client_context_arg(
+    PyObject *module, const char *fname, PyObject *const *args,
+    Py_ssize_t nargs, PyObject *kwnames
+) {
+    PyObject *argv[1] = {NULL};
+
+    // Fast path for the usual single positional argument
+    if (nargs == 1 && kwnames == NULL) {
+        return client_context(module_state(module), args[0]);
+    }
+    if (! unpack_args(fname, args, nargs, kwnames, context_kwlist, 1, argv)) {
+        return NULL;
+    }
+    return client_context(module_state(module), argv[0]);
+}
+
+static GSSServerContext *server_context_arg(
+    PyObject *module, const char *fname, PyObject *const *args,
+    Py_ssize_t nargs, PyObject *kwnames
+) {
+    PyObject *argv[1] = {NULL};
+
+    if (nargs == 1 && kwnames == NULL) {
+        return server_context(module_state(module), args[0]);
+    }
+    if (! unpack_args(fname, args, nargs, kwnames, context_kwlist, 1, argv)) {
+        return NULL;
+    }
+    return server_context(module_state(module), argv[0]);
+}
+
+static PyObject* authGSSClientInit(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    PyObject *argv[5] = {NULL, NULL, NULL, NULL, NULL};
+    PyTypeObject *type = NULL;
+    PyObject *pystate = NULL;
+
+    if (! unpack_args(
+        "authGSSClientInit", args, nargs, kwnames, client_init_kwlist, 1, argv
+    )) {
+        return NULL;
+    }
+
+    type = module_state(self)->GSSClientContextType;
+    pystate = GSSClientContext_new(type, NULL, NULL);
+    if (pystate == NULL) {
+        return NULL;
+    }
+
+    if (GSSClientContext_setup((GSSClientContext *)pystate, argv) < 0) {
+        Py_DECREF(pystate);
+        return NULL;
+    }
+
+    return Py_BuildValue("(iN)", AUTH_GSS_COMPLETE, pystate);
+}
+
+/*
+ * authGSSClientInit, authGSSClientStep(context, ""), authGSSClientResponse
+ * and authGSSClientClean in one call, with the state on the stack and a
+ * single GIL release, for callers that only want the header value.
+ */
+static PyObject *authGSSClientNegotiate(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    PyObject *argv[4] = {NULL, NULL, NULL, NULL};
+    kerberos_state *kstate = module_state(self);
+    const char *service = NULL;
+    const char *principal = NULL;
+    long int gss_flags = GSS_C_MUTUAL_FLAG | GSS_C_SEQUENCE_FLAG;
+    gss_OID mech_oid = GSS_C_NO_OID;
+    gss_client_state state;
+    PyObject *pyresult = NULL;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! unpack_args(
+            "authGSSClientNegotiate", args, nargs, kwnames,
+            client_target_kwlist, 1, argv
+        ) ||
+        ! arg_string(argv[0], &service) ||
+        ! arg_optional_string(argv[1], &principal) ||
+        ! arg_long(argv[2], &gss_flags)
+    ) {
+        return NULL;
+    }
+    arg_mech_oid(argv[3], &mech_oid);
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_client_init(
+        service, principal, gss_flags, NULL, mech_oid, &state, &error
+    );
+    if (result != AUTH_GSS_ERROR) {
+        result = authenticate_gss_client_step(&state, "", 0, &error);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (result == AUTH_GSS_ERROR) {
+        raise_error(kstate, &error);
+    } else {
+        pyresult = negotiate_header(kstate, &state);
+    }
+    authenticate_gss_client_clean(&state);
+
+    return pyresult;
+}
+
+static PyObject *authGSSClientClean(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSClientContext *context = client_context_arg(
+        self, "authGSSClientClean", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSClientContext_clean(context, NULL);
+}
+
+static PyObject *authGSSClientStep(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSClientContext *context = NULL;
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "authGSSClientStep", args, nargs, kwnames,
+            context_challenge_kwlist, 2, argv
+        ) ||
+        (context = client_context(module_state(self), argv[0])) == NULL
+    ) {
+        return NULL;
+    }
+
+    return client_step(context, argv[1]);
+}
+
+static PyObject *authGSSClientResponseConf(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSClientContext *context = client_context_arg(
+        self, "authGSSClientResponseConf", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSClientContext_get_response_conf(context, NULL);
+}
+
+static PyObject *authGSSServerHasDelegated(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = server_context_arg(
+        self, "authGSSServerHasDelegated", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSServerContext_get_has_delegated(context, NULL);
+}
+
+static PyObject *authGSSClientResponse(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSClientContext *context = client_context_arg(
+        self, "authGSSClientResponse", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSClientContext_get_response(context, NULL);
+}
+
+static PyObject *authGSSClientUserName(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSClientContext *context = client_context_arg(
+        self, "authGSSClientUserName", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSClientContext_get_username(context, NULL);
+}
+
+static PyObject *authGSSClientUnwrap(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSClientContext *context = NULL;
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "authGSSClientUnwrap", args, nargs, kwnames,
+            context_challenge_kwlist, 2, argv
+        ) ||
+        (context = client_context(module_state(self), argv[0])) == NULL
+    ) {
+        return NULL;
+    }
+
+    return client_unwrap(context, argv[1]);
+}
+
+static PyObject *authGSSClientWrap(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {
+        "context", "data", "user", "protect", NULL
+    };
+    GSSClientContext *context = NULL;
+    PyObject *argv[4] = {NULL, NULL, NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "authGSSClientWrap", args, nargs, kwnames, kwlist, 2, argv
+        ) ||
+        (context = client_context(module_state(self), argv[0])) == NULL
+    ) {
+        return NULL;
+    }
+
+    return client_wrap(context, argv[1], argv[2], argv[3]);
+}
+
+static PyObject *authGSSClientInquireCred(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSClientContext *context = client_context_arg(
+        self, "authGSSClientInquireCred", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSClientContext_inquire_cred(context, NULL);
+}
+
+static PyObject *authGSSServerInit(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"service", "rcache", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+    PyTypeObject *type = NULL;
+    PyObject *pystate = NULL;
+
+    if (! unpack_args(
+        "authGSSServerInit", args, nargs, kwnames, kwlist, 1, argv
+    )) {
+        return NULL;
+    }
+
+    type = module_state(self)->GSSServerContextType;
+    pystate = GSSServerContext_new(type, NULL, NULL);
+    if (pystate == NULL) {
+        return NULL;
+    }
+
+    if (GSSServerContext_setup(
+        (GSSServerContext *)pystate, argv[0], argv[1]
+    ) < 0) {
+        Py_DECREF(pystate);
+        return NULL;
+    }
+
+    return Py_BuildValue("(iN)", AUTH_GSS_COMPLETE, pystate);
+}
+
+static PyObject *authGSSServerClean(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = server_context_arg(
+        self, "authGSSServerClean", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSServerContext_clean(context, NULL);
+}
+
+static PyObject *authGSSServerStep(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = NULL;
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "authGSSServerStep", args, nargs, kwnames,
+            context_challenge_kwlist, 2, argv
+        ) ||
+        (context = server_context(module_state(self), argv[0])) == NULL
+    ) {
+        return NULL;
+    }
+
+    return server_step(context, argv[1]);
+}
+
+/*
+ * Build the authGSSServerAuthenticate result for a state that has been
+ * through init and one step, then clean the state or hand it over to a new
+ * context if the mechanism needs another leg. Sets an exception and returns
+ * NULL if the step failed.
+ */
+static PyObject *server_authenticate_result(
+    kerberos_state *kstate, gss_server_state *state, int result,
+    const krb_error *error
+) {
+    GSSServerContext *context = NULL;
+    PyObject *pyresult = NULL;
+
+    if (result == AUTH_GSS_ERROR) {
+        authenticate_gss_server_clean(state);
+        return raise_error(kstate, error);
+    }
+
+    if (result == AUTH_GSS_CONTINUE) {
+        // Hand the exchange over to a context for the remaining legs
+        context = (GSSServerContext *)GSSServerContext_new(
+            kstate->GSSServerContextType, NULL, NULL
+        );
+        if (context == NULL) {
+            authenticate_gss_server_clean(state);
+            return NULL;
+        }
+        context->state = *state;
+        context->initialized = 1;
+        GSSServerContext_account(context);
+
+        return Py_BuildValue(
+            "(z#OON)",
+            state->response_len ? state->response : NULL, state->response_len,
+            Py_None, Py_None, context
+        );
+    }
+
+    pyresult = Py_BuildValue(
+        "(z#zzO)",
+        state->response_len ? state->response : NULL, state->response_len,
+        state->username, state->targetname,
+        authenticate_gss_server_has_delegated(state) ? Py_True : Py_False
+    );
+    authenticate_gss_server_clean(state);
+
+    return pyresult;
+}
+
+/*
+ * authGSSServerInit, authGSSServerStep, the name getters and
+ * authGSSServerClean in one call, for single-leg Negotiate. The state lives
+ * on the stack and init and step share a single GIL release; a context
+ * object is only created when the mechanism needs another leg.
+ */
+static PyObject *authGSSServerAuthenticate(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {
+        "service", "challenge", "rcache", NULL
+    };
+    PyObject *argv[3] = {NULL, NULL, NULL};
+    kerberos_state *kstate = module_state(self);
+    const char *service = NULL;
+    const char *challenge = NULL;
+    Py_ssize_t challenge_len = 0;
+    int rcache = KRB_RCACHE_DEFAULT;
+    gss_server_state state;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! unpack_args(
+            "authGSSServerAuthenticate", args, nargs, kwnames, kwlist, 2, argv
+        ) ||
+        ! arg_string(argv[0], &service) ||
+        ! arg_string_and_size(argv[1], &challenge, &challenge_len) ||
+        ! arg_rcache(argv[2], &rcache)
+    ) {
+        return NULL;
+    }
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = authenticate_gss_server_init_rcache(
+        service, rcache, &state, &error
+    );
+    if (result != AUTH_GSS_ERROR) {
+        result = authenticate_gss_server_step(
+            &state, challenge, challenge_len, &error
+        );
+    }
+    if (result == AUTH_GSS_COMPLETE) {
+        result = authenticate_gss_server_resolve_names(&state, &error);
+    }
+    Py_END_ALLOW_THREADS
+
+    return server_authenticate_result(kstate, &state, result, &error);
+}
+
+/*
+ * Per-item state for authGSSServerAuthenticateBatch. The service and token
+ * objects are referenced here so that their UTF-8 buffers outlive the
+ * accepts, which run on the native pool with no GIL held.
+ */
+typedef struct {
+    PyObject*        pyservice;
+    PyObject*        pytoken;
+    const char*      service;
+    const char*      token;
+    Py_ssize_t       token_len;
+    gss_server_state state;
+    krb_error        error;
+    int              result;
+} server_batch_item;
+
+static void server_batch_accept(void *arg, size_t index)
+{
+    server_batch_item *item = (server_batch_item *)arg + index;
+
+    krb_error_clear(&item->error);
+    item->result = authenticate_gss_server_init(
+        item->service, &item->state, &item->error
+    );
+    if (item->result != AUTH_GSS_ERROR) {
+        item->result = authenticate_gss_server_step(
+            &item->state, item->token, item->token_len, &item->error
+        );
+    }
+    if (item->result == AUTH_GSS_COMPLETE) {
+        item->result = authenticate_gss_server_resolve_names(
+            &item->state, &item->error
+        );
+    }
+}
+
+/*
+ * authGSSServerAuthenticate for a list of (service, token) pairs, with the
+ * accepts spread over the native thread pool. The GIL is released once for
+ * the whole batch rather than once per token.
+ */
+static PyObject *authGSSServerAuthenticateBatch(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"items", NULL};
+    PyObject *argv[1] = {NULL};
+    kerberos_state *kstate = module_state(self);
+    server_batch_item *items = NULL;
+    PyObject *pyitems = NULL;
+    PyObject *pyresult = NULL;
+    Py_ssize_t count = 0;
+    Py_ssize_t i;
+
+    if (
+        ! unpack_args(
+            "authGSSServerAuthenticateBatch", args, nargs, kwnames, kwlist, 1,
+            argv
+        )
+    ) {
+        return NULL;
+    }
+
+    pyitems = PySequence_Tuple(argv[0]);
+    if (pyitems == NULL) {
+        return NULL;
+    }
+    count = PyTuple_GET_SIZE(pyitems);
+
+    items = PyMem_Calloc(count ? count : 1, sizeof(*items));
+    if (items == NULL) {
+        PyErr_NoMemory();
+        goto end;
+    }
+
+    for (i = 0; i < count; i++) {
+        server_batch_item *item = &items[i];
+        PyObject *pair = PyTuple_GET_ITEM(pyitems, i);
+
+        if (! PyTuple_Check(pair) || PyTuple_GET_SIZE(pair) != 2) {
+            PyErr_Format(
+                PyExc_TypeError,
+                "items must be (service, token) tuples, not %.200s",
+                Py_TYPE(pair)->tp_name
+            );
+            goto end;
+        }
+        item->pyservice = PyTuple_GET_ITEM(pair, 0);
+        item->pytoken = PyTuple_GET_ITEM(pair, 1);
+        Py_INCREF(item->pyservice);
+        Py_INCREF(item->pytoken);
+        if (
+            ! arg_string(item->pyservice, &item->service) ||
+            ! arg_string_and_size(
+                item->pytoken, &item->token, &item->token_len
+            )
+        ) {
+            goto end;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    krb_pool_map(krb_pool_default(), server_batch_accept, items, count);
+    Py_END_ALLOW_THREADS
+
+    pyresult = PyList_New(count);
+    if (pyresult == NULL) {
+        for (i = 0; i < count; i++) {
+            authenticate_gss_server_clean(&items[i].state);
+        }
+        goto end;
+    }
+    for (i = 0; i < count; i++) {
+        server_batch_item *item = &items[i];
+        PyObject *value = server_authenticate_result(
+            kstate, &item->state, item->result, &item->error
+        );
+
+        // Items are independent, so a failure is returned in its place
+        if (value == NULL) {
+            PyObject *type = NULL;
+            PyObject *traceback = NULL;
+
+            PyErr_Fetch(&type, &value, &traceback);
+            PyErr_NormalizeException(&type, &value, &traceback);
+            Py_XDECREF(type);
+            Py_XDECREF(traceback);
+            if (value == NULL) {
+                Py_INCREF(Py_None);
+                value = Py_None;
+            }
+        }
+        PyList_SET_ITEM(pyresult, i, value);
+    }
+end:
+    if (items != NULL) {
+        for (i = 0; i < count; i++) {
+            Py_XDECREF(items[i].pyservice);
+            Py_XDECREF(items[i].pytoken);
+        }
+        PyMem_Free(items);
+    }
+    Py_DECREF(pyitems);
+
+    return pyresult;
+}
+
+static PyObject *authGSSServerStoreDelegate(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = server_context_arg(
+        self, "authGSSServerStoreDelegate", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSServerContext_store_delegate(context, NULL);
+}
+
+static PyObject *authGSSServerResponse(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = server_context_arg(
+        self, "authGSSServerResponse", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSServerContext_get_response(context, NULL);
+}
+
+static PyObject *authGSSServerUserName(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = server_context_arg(
+        self, "authGSSServerUserName", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSServerContext_get_username(context, NULL);
+}
+
+static PyObject *authGSSServerCacheName(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = server_context_arg(
+        self, "authGSSServerCacheName", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSServerContext_get_ccname(context, NULL);
+}
+
+static PyObject *authGSSServerTargetName(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    GSSServerContext *context = server_context_arg(
+        self, "authGSSServerTargetName", args, nargs, kwnames
+    );
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    return GSSServerContext_get_targetname(context, NULL);
+}
+
+static PyObject *contextStats(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue(
+        "{s:L,s:L,s:L,s:L,s:K}",
+        "client_contexts",
+        atomic_load_explicit(&client_gauge.contexts, memory_order_relaxed),
+        "client_bytes",
+        atomic_load_explicit(&client_gauge.bytes, memory_order_relaxed),
+        "server_contexts",
+        atomic_load_explicit(&server_gauge.contexts, memory_order_relaxed),
+        "server_bytes",
+        atomic_load_explicit(&server_gauge.bytes, memory_order_relaxed),
+        "buffer_allocations", krb_buffer_allocations()
+    );
+}
+
+static PyObject *acceptorCacheStats(PyObject *self, PyObject *args)
+{
+    krb_acceptor_stats stats;
+    char keytab[KRB_KEYTAB_NAME_SIZE];
+
+    krb_acceptor_get_stats(&stats);
+    return Py_BuildValue(
+        "{s:K,s:K,s:K,s:K,s:K,s:d,s:z,s:K,s:K,s:K}",
+        "hits", stats.hits,
+        "misses", stats.misses,
+        "expirations", stats.expirations,
+        "invalidations", stats.invalidations,
+        "entries", stats.entries,
+        "ttl", krb_acceptor_get_ttl(),
+        "keytab", krb_keytab_source(keytab, sizeof(keytab)) ? keytab : NULL,
+        "keytab_loads", stats.keytab_loads,
+        "keytab_entries", stats.keytab_entries,
+        "keytab_retained", stats.keytab_retained
+    );
+}
+
+static PyObject *invalidateAcceptorCache(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"service", NULL};
+    PyObject *argv[1] = {NULL};
+    const char *service = NULL;
+
+    if (
+        ! unpack_args(
+            "invalidateAcceptorCache", args, nargs, kwnames, kwlist, 0, argv
+        ) ||
+        ! arg_optional_string(argv[0], &service)
+    ) {
+        return NULL;
+    }
+
+    // Entries no context uses any more are released here
+    Py_BEGIN_ALLOW_THREADS
+    krb_acceptor_invalidate(service);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *setAcceptorCacheTTL(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"seconds", NULL};
+    PyObject *argv[1] = {NULL};
+    double seconds = 0;
+
+    if (
+        ! unpack_args(
+            "setAcceptorCacheTTL", args, nargs, kwnames, kwlist, 1, argv
+        ) ||
+        ! arg_seconds(argv[0], &seconds)
+    ) {
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    krb_acceptor_set_ttl(seconds);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *replayCacheStats(PyObject *self, PyObject *args)
+{
+    krb_rcache_stats stats;
+    krb_rcache_shared_stats shared;
+
+    krb_rcache_get_stats(&stats);
+    krb_rcache_shared_get_stats(&shared);
+    return Py_BuildValue(
+        "{s:K,s:K,s:K,s:K,s:K,s:d,s:d,s:d,s:z,s:K,s:K,s:K,s:K,s:K}",
+        "lookups", stats.lookups,
+        "replays", stats.replays,
+        "inserts", stats.inserts,
+        "expirations", stats.expirations,
+        "entries", stats.entries,
+        "lookup_ns",
+        stats.lookups ? (double)stats.lookup_ns / stats.lookups : 0.0,
+        "insert_ns",
+        stats.inserts ? (double)stats.insert_ns / stats.inserts : 0.0,
+        "window", krb_rcache_get_window(),
+        "shared",
+        shared.mode == KRB_RCACHE_SHARED_DETACHED ? NULL : shared.name,
+        "shared_slots", shared.slots,
+        "shared_lookups", shared.lookups,
+        "shared_replays", shared.replays,
+        "shared_inserts", shared.inserts,
+        "shared_full", shared.full
+    );
+}
+
+static PyObject *setReplayCacheWindow(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"seconds", NULL};
+    PyObject *argv[1] = {NULL};
+    double seconds = 0;
+
+    if (
+        ! unpack_args(
+            "setReplayCacheWindow", args, nargs, kwnames, kwlist, 1, argv
+        ) ||
+        ! arg_seconds(argv[0], &seconds)
+    ) {
+        return NULL;
+    }
+    if (seconds == 0) {
+        PyErr_SetString(PyExc_ValueError, "seconds must be positive");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    krb_rcache_set_window(seconds);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *attachReplayCache(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"name", "slots", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+    const char *name = "/pykerberos-rcache";
+    size_t slots = KRB_RCACHE_SHARED_DEFAULT_SLOTS;
+    krb_error error;
+    int result;
+
+    if (
+        ! unpack_args(
+            "attachReplayCache", args, nargs, kwnames, kwlist, 0, argv
+        ) ||
+        (argv[0] != NULL && ! arg_string(argv[0], &name)) ||
+        ! arg_slots(argv[1], &slots)
+    ) {
+        return NULL;
+    }
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = krb_rcache_shared_attach(name, slots, &error);
+    Py_END_ALLOW_THREADS
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(module_state(self), &error);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *connectReplayCache(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"path", NULL};
+    PyObject *argv[1] = {NULL};
+    const char *path = NULL;
+    krb_error error;
+    int result;
+
+    if (
+        ! unpack_args(
+            "connectReplayCache", args, nargs, kwnames, kwlist, 1, argv
+        ) ||
+        ! arg_string(argv[0], &path)
+    ) {
+        return NULL;
+    }
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = krb_rcache_shared_connect(path, &error);
+    Py_END_ALLOW_THREADS
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(module_state(self), &error);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *detachReplayCache(PyObject *self, PyObject *args)
+{
+    Py_BEGIN_ALLOW_THREADS
+    krb_rcache_shared_detach();
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *loadKeytab(
+    PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"keytab", "lock", "overlap", NULL};
+    PyObject *argv[3] = {NULL, NULL, NULL};
+    const char *keytab = NULL;
+    int lock = 0;
+    double overlap = 0;
+    size_t entries = 0;
+    krb_error error;
+    int result;
+
+    if (
+        ! unpack_args("loadKeytab", args, nargs, kwnames, kwlist, 0, argv) ||
+        ! arg_optional_string(argv[0], &keytab) ||
+        ! arg_bool(argv[1], &lock) ||
+        ! arg_seconds(argv[2], &overlap)
+    ) {
+        return NULL;
+    }
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = krb_keytab_load(keytab, lock, overlap, &entries, &error);
+    Py_END_ALLOW_THREADS
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(module_state(self), &error);
+    }
+    return PyLong_FromSize_t(entries);
+}
+
+static PyObject *reloadKeytab(PyObject *self, PyObject *args)
+{
+    size_t entries = 0;
+    krb_error error;
+    int result;
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = krb_keytab_reload(&entries, &error);
+    Py_END_ALLOW_THREADS
+
+    if (result == AUTH_GSS_ERROR) {
+        return raise_error(module_state(self), &error);
+    }
+    return PyLong_FromSize_t(entries);
+}
+
+static PyObject *unloadKeytab(PyObject *self, PyObject *args)
+{
+    Py_BEGIN_ALLOW_THREADS
+    krb_keytab_unload();
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * Keytab watcher: loads a keytab with loadKeytab() and reloads it from a
+ * native thread whenever the file changes. The callback is run on that
+ * thread, with a thread state of its own for the interpreter that created
+ * the watcher.
+ */
+
+typedef struct KeytabWatcher {
+    PyObject_HEAD
+    pthread_mutex_t      lock;
+    krb_watch*           watch;
+    PyObject*            callback;
+    PyInterpreterState*  interp;
+    atomic_llong         reloads;
+    atomic_llong         errors;
+    struct KeytabWatcher* next;
+    struct KeytabWatcher* prev;
+} KeytabWatcher;
+
+#if PY_VERSION_HEX < 0x030D0000
+#define Py_IsFinalizing _Py_IsFinalizing
+#endif
+
+// Called on the watcher thread, without the GIL
+static void KeytabWatcher_notify(void *arg, const krb_watch_event *event)
+{
+    KeytabWatcher *self = (KeytabWatcher *)arg;
+    PyThreadState *tstate = NULL;
+    PyObject *error = NULL;
+    PyObject *result = NULL;
+
+    atomic_fetch_add_explicit(
+        event->reloaded ? &self->reloads : &self->errors, 1,
+        memory_order_relaxed
+    );
+    // Once the interpreter is finalizing, taking the GIL could end or hang
+    // this thread
+    if (self->callback == NULL || Py_IsFinalizing()) {
+        return;
+    }
+
+    tstate = PyThreadState_New(self->interp);
+    if (tstate == NULL) {
+        return;
+    }
+    PyEval_RestoreThread(tstate);
+
+    if (! event->reloaded) {
+        PyObject *type = NULL;
+        PyObject *traceback = NULL;
+
+        raise_error(type_state(Py_TYPE(self)), &event->error);
+        PyErr_Fetch(&type, &error, &traceback);
+        PyErr_NormalizeException(&type, &error, &traceback);
+        Py_XDECREF(type);
+        Py_XDECREF(traceback);
+    }
+    if (error == NULL) {
+        Py_INCREF(Py_None);
+        error = Py_None;
+    }
+
+    result = PyObject_CallFunction(
+        self->callback, "nO", (Py_ssize_t)event->entries, error
+    );
+    if (result == NULL) {
+        PyErr_WriteUnraisable(self->callback);
+    }
+    Py_XDECREF(result);
+    Py_DECREF(error);
+
+    PyThreadState_Clear(tstate);
+    PyThreadState_DeleteCurrent();
+}
+
+// Add a started watcher to the module's list of running ones
+static void KeytabWatcher_link(KeytabWatcher *self)
+{
+    kerberos_state *state = type_state(Py_TYPE(self));
+
+    pthread_mutex_lock(&state->watchers_lock);
+    self->prev = NULL;
+    self->next = state->watchers;
+    if (self->next != NULL) {
+        self->next->prev = self;
+    }
+    state->watchers = self;
+    pthread_mutex_unlock(&state->watchers_lock);
+}
+
+static void KeytabWatcher_unlink(KeytabWatcher *self)
+{
+    kerberos_state *state = type_state(Py_TYPE(self));
+
+    pthread_mutex_lock(&state->watchers_lock);
+    if (self->prev != NULL) {
+        self->prev->next = self->next;
+    } else if (state->watchers == self) {
+        state->watchers = self->next;
+    }
+    if (self->next != NULL) {
+        self->next->prev = self->prev;
+    }
+    self->next = self->prev = NULL;
+    pthread_mutex_unlock(&state->watchers_lock);
+}
+
+static void KeytabWatcher_stop(KeytabWatcher *self)
+{
+    krb_watch *watch;
+
+    pthread_mutex_lock(&self->lock);
+    watch = self->watch;
+    self->watch = NULL;
+    pthread_mutex_unlock(&self->lock);
+
+    // The callback may be waiting for the GIL
+    KeytabWatcher_unlink(self);
+    if (watch != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        krb_watch_stop(watch);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+// Stop every running watcher of the module, joining their threads
+static void stop_watchers(kerberos_state *state)
+{
+    KeytabWatcher *watcher;
+
+    for (;;) {
+        pthread_mutex_lock(&state->watchers_lock);
+        watcher = state->watchers;
+        Py_XINCREF(watcher);
+        pthread_mutex_unlock(&state->watchers_lock);
+        if (watcher == NULL) {
+            break;
+        }
+        KeytabWatcher_stop(watcher);
+        Py_DECREF(watcher);
+    }
+}
+
+// Registered with atexit, so that watchers stop before finalization starts
+static PyObject *kerberos_stop_watchers(PyObject *m, PyObject *unused)
+{
+    stop_watchers(module_state(m));
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef kerberos_stop_watchers_def = {
+    "_stop_watchers", (PyCFunction)kerberos_stop_watchers, METH_NOARGS, NULL
+};
+
+static int KeytabWatcher_init(
+    KeytabWatcher *self, PyObject *args, PyObject *keywds
+) {
+    static char *kwlist[] = {"keytab", "callback", "overlap", "lock", NULL};
+    const char *keytab = NULL;
+    PyObject *callback = Py_None;
+    double overlap = 86400;
+    int lock = 0;
+    char source[KRB_KEYTAB_NAME_SIZE];
+    size_t entries = 0;
+    krb_watch *watch = NULL;
+    krb_error error;
+    int result;
+
+    if (! PyArg_ParseTupleAndKeywords(
+        args, keywds, "|zOdp", kwlist, &keytab, &callback, &overlap, &lock
+    )) {
+        return -1;
+    }
+    if (callback != Py_None && ! PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return -1;
+    }
+    if (! (overlap >= 0)) {
+        PyErr_SetString(PyExc_ValueError, "seconds must not be negative");
+        return -1;
+    }
+    // Checked before loading, so that an unusable name changes nothing
+    if (keytab != NULL && krb_watch_path(keytab) == NULL) {
+        PyErr_SetString(
+            type_state(Py_TYPE(self))->KrbException_class,
+            "Only FILE: keytabs can be watched"
+        );
+        return -1;
+    }
+
+    KeytabWatcher_stop(self);
+    Py_CLEAR(self->callback);
+    if (callback != Py_None) {
+        Py_INCREF(callback);
+        self->callback = callback;
+    }
+    self->interp = PyInterpreterState_Get();
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    result = krb_keytab_load(keytab, lock, overlap, &entries, &error);
+    if (result == AUTH_GSS_COMPLETE) {
+        if (krb_keytab_source(source, sizeof(source))) {
+            watch = krb_watch_start(
+                source, KeytabWatcher_notify, self, &error
+            );
+        } else {
+            krb_error_set_message(
+                &error, KRB_ERROR_KRB, "Keytab was unloaded"
+            );
+        }
+        if (watch == NULL) {
+            result = AUTH_GSS_ERROR;
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (result == AUTH_GSS_ERROR) {
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return -1;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    self->watch = watch;
+    pthread_mutex_unlock(&self->lock);
+    KeytabWatcher_link(self);
+
+    return 0;
+}
+
+static PyObject *KeytabWatcher_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    KeytabWatcher *self = (KeytabWatcher *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        pthread_mutex_init(&self->lock, NULL);
+        atomic_init(&self->reloads, 0);
+        atomic_init(&self->errors, 0);
+    }
+    return (PyObject *)self;
+}
+
+static void KeytabWatcher_dealloc(KeytabWatcher *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    KeytabWatcher_stop(self);
+    Py_CLEAR(self->callback);
+    pthread_mutex_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *KeytabWatcher_close(KeytabWatcher *self, PyObject *args)
+{
+    KeytabWatcher_stop(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *KeytabWatcher_enter(KeytabWatcher *self, PyObject *args)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *KeytabWatcher_exit(KeytabWatcher *self, PyObject *args)
+{
+    KeytabWatcher_stop(self);
+    Py_RETURN_FALSE;
+}
+
+static PyObject *KeytabWatcher_get_reloads(
+    KeytabWatcher *self, void *closure
+) {
+    return PyLong_FromLongLong(
+        atomic_load_explicit(&self->reloads, memory_order_relaxed)
+    );
+}
+
+static PyObject *KeytabWatcher_get_errors(KeytabWatcher *self, void *closure)
+{
+    return PyLong_FromLongLong(
+        atomic_load_explicit(&self->errors, memory_order_relaxed)
+    );
+}
+
+static PyMethodDef KeytabWatcher_methods[] = {
+    {
+        "close",
+        (PyCFunction)KeytabWatcher_close, METH_NOARGS,
+        "Stop watching; the loaded keytab stays in use."
+    },
+    {
+        "__enter__",
+        (PyCFunction)KeytabWatcher_enter, METH_NOARGS,
+        NULL
+    },
+    {
+        "__exit__",
+        (PyCFunction)KeytabWatcher_exit, METH_VARARGS,
+        NULL
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyGetSetDef KeytabWatcher_getset[] = {
+    {
+        "reloads", (getter)KeytabWatcher_get_reloads, NULL,
+        "Number of successful reloads.", NULL
+    },
+    {
+        "errors", (getter)KeytabWatcher_get_errors, NULL,
+        "Number of failed reloads.", NULL
+    },
+    {NULL, NULL, NULL, NULL, NULL}        /* Sentinel */
+};
+
+static PyType_Slot KeytabWatcher_slots[] = {
+    {Py_tp_doc, "Reload the loaded keytab whenever its file changes."},
+    {Py_tp_methods, KeytabWatcher_methods},
+    {Py_tp_getset, KeytabWatcher_getset},
+    {Py_tp_init, KeytabWatcher_init},
+    {Py_tp_dealloc, KeytabWatcher_dealloc},
+    {Py_tp_new, KeytabWatcher_new},
+    {0, NULL}
+};
+
+static PyType_Spec KeytabWatcher_spec = {
+    "kerberos.KeytabWatcher",
+    sizeof(KeytabWatcher),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    KeytabWatcher_slots
+};
+
+/*
+ * An acceptor for many service principals. The index is replaced only by
+ * __init__; accepts hold the read lock for as long as they route with it.
+ */
+typedef struct {
+    PyObject_HEAD
+    pthread_rwlock_t lock;
+    krb_spn_index*   index;
+    PyObject*        spns;
+    int              rcache;
+} Acceptor;
+
+static int Acceptor_init(Acceptor *self, PyObject *args, PyObject *keywds)
+{
+    static char *kwlist[] = {"spns", "rcache", NULL};
+    PyObject *pyspns = NULL;
+    PyObject *pyrcache = NULL;
+    int rcache = KRB_RCACHE_DEFAULT;
+    PyObject *seq = NULL;
+    PyObject *names = NULL;
+    const char **spns = NULL;
+    krb_spn_index *index = NULL;
+    krb_error error;
+    Py_ssize_t count;
+    Py_ssize_t i;
+
+    if (
+        ! PyArg_ParseTupleAndKeywords(
+            args, keywds, "O|O:Acceptor", kwlist, &pyspns, &pyrcache
+        ) ||
+        ! arg_rcache(pyrcache, &rcache)
+    ) {
+        return -1;
+    }
+    if (PyUnicode_Check(pyspns) || PyBytes_Check(pyspns)) {
+        PyErr_SetString(
+            PyExc_TypeError, "spns must be a sequence of principal names"
+        );
+        return -1;
+    }
+    seq = PySequence_Fast(pyspns, "spns must be a sequence of principal names");
+    if (seq == NULL) {
+        return -1;
+    }
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count == 0) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "spns must not be empty");
+        return -1;
+    }
+    spns = (const char **)PyMem_Malloc(count * sizeof(const char *));
+    if (spns == NULL) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (! arg_string(PySequence_Fast_GET_ITEM(seq, i), &spns[i])) {
+            PyMem_Free(spns);
+            Py_DECREF(seq);
+            return -1;
+        }
+    }
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    index = krb_spn_index_create(spns, (size_t)count, &error);
+    Py_END_ALLOW_THREADS
+    PyMem_Free(spns);
+    Py_DECREF(seq);
+
+    if (index == NULL) {
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return -1;
+    }
+
+    names = PyTuple_New(count);
+    if (names == NULL) {
+        krb_spn_index_free(index);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        PyObject *name = PyUnicode_FromString(
+            krb_spn_index_name(index, (size_t)i)
+        );
+
+        if (name == NULL) {
+            Py_DECREF(names);
+            krb_spn_index_free(index);
+            return -1;
+        }
+        PyUnicode_InternInPlace(&name);
+        PyTuple_SET_ITEM(names, i, name);
+    }
+
+    rw_lock(&self->lock, 1);
+    krb_spn_index_free(self->index);
+    self->index = index;
+    Py_XSETREF(self->spns, names);
+    self->rcache = rcache;
+    rw_unlock(&self->lock);
+
+    return 0;
+}
+
+static PyObject *Acceptor_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    Acceptor *self = (Acceptor *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        pthread_rwlock_init(&self->lock, NULL);
+    }
+    return (PyObject *)self;
+}
+
+static void Acceptor_dealloc(Acceptor *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    krb_spn_index_free(self->index);
+    Py_CLEAR(self->spns);
+    pthread_rwlock_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static int Acceptor_check_initialized(Acceptor *self)
+{
+    return context_check_initialized((PyObject *)self, self->index != NULL);
+}
+
+static PyObject *Acceptor_authenticate(
+    Acceptor *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"challenge", NULL};
+    PyObject *argv[1] = {NULL};
+    kerberos_state *kstate = type_state(Py_TYPE(self));
+    const char *challenge = NULL;
+    Py_ssize_t challenge_len = 0;
+    gss_server_state state;
+    krb_spn_route route;
+    PyObject *spns = NULL;
+    PyObject *spn = NULL;
+    PyObject *pyresult = NULL;
+    krb_error error;
+    int result = 0;
+
+    if (
+        ! unpack_args("authenticate", args, nargs, kwnames, kwlist, 1, argv) ||
+        ! arg_string_and_size(argv[0], &challenge, &challenge_len)
+    ) {
+        return NULL;
+    }
+
+    rw_lock(&self->lock, 0);
+    if (! Acceptor_check_initialized(self)) {
+        rw_unlock(&self->lock);
+        return NULL;
+    }
+
+    route.index = self->index;
+    route.rcache = self->rcache;
+    route.matched = -1;
+    spns = self->spns;
+    Py_INCREF(spns);
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    // The route supplies the credentials, so none are acquired here
+    result = authenticate_gss_server_init("", &state, &error);
+    state.rcache = self->rcache;
+    if (result != AUTH_GSS_ERROR) {
+        result = authenticate_gss_server_step_routed(
+            &state, challenge, challenge_len, krb_spn_route_token, &route,
+            &error
+        );
+    }
+    if (result == AUTH_GSS_COMPLETE) {
+        result = authenticate_gss_server_resolve_names(&state, &error);
+    }
+    Py_END_ALLOW_THREADS
+    rw_unlock(&self->lock);
+
+    pyresult = server_authenticate_result(kstate, &state, result, &error);
+    if (pyresult != NULL) {
+        // The matched principal as the interned name from spns, and its
+        // position there
+        spn = PyTuple_GET_ITEM(spns, route.matched);
+        Py_SETREF(pyresult, Py_BuildValue(
+            "(OOOOl)",
+            PyTuple_GET_ITEM(pyresult, 0), PyTuple_GET_ITEM(pyresult, 1),
+            result == AUTH_GSS_COMPLETE ? spn : Py_None,
+            PyTuple_GET_ITEM(pyresult, 3), route.matched
+        ));
+    }
+    Py_DECREF(spns);
+
+    return pyresult;
+}
+
+static PyObject *Acceptor_route(
+    Acceptor *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"token", NULL};
+    PyObject *argv[1] = {NULL};
+    Py_buffer token;
+    krb_error error;
+    long matched;
+
+    if (
+        ! unpack_args("route", args, nargs, kwnames, kwlist, 1, argv) ||
+        ! arg_bytes_buffer(argv[0], &token)
+    ) {
+        return NULL;
+    }
+
+    rw_lock(&self->lock, 0);
+    if (! Acceptor_check_initialized(self)) {
+        rw_unlock(&self->lock);
+        PyBuffer_Release(&token);
+        return NULL;
+    }
+
+    krb_error_clear(&error);
+    matched = krb_spn_index_lookup(
+        self->index, token.buf, (size_t)token.len, &error
+    );
+    rw_unlock(&self->lock);
+    PyBuffer_Release(&token);
+
+    if (matched < 0) {
+        return raise_error(type_state(Py_TYPE(self)), &error);
+    }
+    return PyLong_FromLong(matched);
+}
+
+static PyObject *Acceptor_get_spns(Acceptor *self, void *closure)
+{
+    PyObject *spns;
+
+    rw_lock(&self->lock, 0);
+    spns = self->spns != NULL ? self->spns : Py_None;
+    Py_INCREF(spns);
+    rw_unlock(&self->lock);
+
+    return spns;
+}
+
+static PyMethodDef Acceptor_methods[] = {
+    {
+        "authenticate",
+        (PyCFunction)(void(*)(void))Acceptor_authenticate,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Accept a challenge with the credentials of the principal its "
+        "ticket is for."
+    },
+    {
+        "route",
+        (PyCFunction)(void(*)(void))Acceptor_route,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Return the position in spns of the principal a decoded token's "
+        "ticket is for."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyGetSetDef Acceptor_getset[] = {
+    {
+        "spns", (getter)Acceptor_get_spns, NULL,
+        "The normalized service principal names.", NULL
+    },
+    {NULL, NULL, NULL, NULL, NULL}        /* Sentinel */
+};
+
+static PyType_Slot Acceptor_slots[] = {
+    {Py_tp_doc, "Server-side acceptor routing tickets among many principals."},
+    {Py_tp_methods, Acceptor_methods},
+    {Py_tp_getset, Acceptor_getset},
+    {Py_tp_init, Acceptor_init},
+    {Py_tp_dealloc, Acceptor_dealloc},
+    {Py_tp_new, Acceptor_new},
+    {0, NULL}
+};
+
+static PyType_Spec Acceptor_spec = {
+    "kerberos.Acceptor",
+    sizeof(Acceptor),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    Acceptor_slots
+};
+
+typedef struct {
+    PyObject_HEAD
+    pthread_mutex_t      lock;
+    krb_rcache_daemon*   daemon;
+} ReplayCacheDaemon;
+
+static void ReplayCacheDaemon_stop(ReplayCacheDaemon *self)
+{
+    krb_rcache_daemon *daemon;
+
+    pthread_mutex_lock(&self->lock);
+    daemon = self->daemon;
+    self->daemon = NULL;
+    pthread_mutex_unlock(&self->lock);
+
+    if (daemon != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        krb_rcache_daemon_stop(daemon);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static int ReplayCacheDaemon_init(
+    ReplayCacheDaemon *self, PyObject *args, PyObject *keywds
+) {
+    static char *kwlist[] = {"path", "slots", "mode", NULL};
+    const char *path = NULL;
+    PyObject *pyslots = NULL;
+    int mode = 0600;
+    size_t slots = KRB_RCACHE_SHARED_DEFAULT_SLOTS;
+    krb_rcache_daemon *daemon = NULL;
+    krb_error error;
+
+    if (
+        ! PyArg_ParseTupleAndKeywords(
+            args, keywds, "s|Oi:ReplayCacheDaemon", kwlist, &path, &pyslots,
+            &mode
+        ) ||
+        ! arg_slots(pyslots, &slots)
+    ) {
+        return -1;
+    }
+
+    ReplayCacheDaemon_stop(self);
+
+    krb_error_clear(&error);
+    Py_BEGIN_ALLOW_THREADS
+    daemon = krb_rcache_daemon_start(path, slots, mode, &error);
+    Py_END_ALLOW_THREADS
+
+    if (daemon == NULL) {
+        raise_error(type_state(Py_TYPE(self)), &error);
+        return -1;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    self->daemon = daemon;
+    pthread_mutex_unlock(&self->lock);
+
+    return 0;
+}
+
+static PyObject *ReplayCacheDaemon_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    ReplayCacheDaemon *self = (ReplayCacheDaemon *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        pthread_mutex_init(&self->lock, NULL);
+    }
+    return (PyObject *)self;
+}
+
+static void ReplayCacheDaemon_dealloc(ReplayCacheDaemon *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    ReplayCacheDaemon_stop(self);
+    pthread_mutex_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *ReplayCacheDaemon_close(
+    ReplayCacheDaemon *self, PyObject *args
+) {
+    ReplayCacheDaemon_stop(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *ReplayCacheDaemon_enter(
+    ReplayCacheDaemon *self, PyObject *args
+) {
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *ReplayCacheDaemon_exit(
+    ReplayCacheDaemon *self, PyObject *args
+) {
+    ReplayCacheDaemon_stop(self);
+    Py_RETURN_FALSE;
+}
+
+static PyObject *ReplayCacheDaemon_stats(
+    ReplayCacheDaemon *self, PyObject *args
+) {
+    krb_rcache_shared_stats stats;
+    int running;
+
+    // The thread only updates the counters, so they can be read while it
+    // runs; the lock keeps the daemon from being freed meanwhile
+    pthread_mutex_lock(&self->lock);
+    running = (self->daemon != NULL);
+    if (running) {
+        krb_rcache_daemon_get_stats(self->daemon, &stats);
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    if (! running) {
+        Py_RETURN_NONE;
+    }
+    return Py_BuildValue(
+        "{s:s,s:K,s:K,s:K,s:K,s:K}",
+        "path", stats.name,
+        "slots", stats.slots,
+        "lookups", stats.lookups,
+        "replays", stats.replays,
+        "inserts", stats.inserts,
+        "full", stats.full
+    );
+}
+
+static PyMethodDef ReplayCacheDaemon_methods[] = {
+    {
+        "close",
+        (PyCFunction)ReplayCacheDaemon_close, METH_NOARGS,
+        "Stop serving and remove the socket."
+    },
+    {
+        "stats",
+        (PyCFunction)ReplayCacheDaemon_stats, METH_NOARGS,
+        "Get the counters of the daemon's table, or None once closed."
+    },
+    {
+        "__enter__",
+        (PyCFunction)ReplayCacheDaemon_enter, METH_NOARGS,
+        NULL
+    },
+    {
+        "__exit__",
+        (PyCFunction)ReplayCacheDaemon_exit, METH_VARARGS,
+        NULL
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyType_Slot ReplayCacheDaemon_slots[] = {
+    {Py_tp_doc, "Serve a shared replay cache on a Unix socket."},
+    {Py_tp_methods, ReplayCacheDaemon_methods},
+    {Py_tp_init, ReplayCacheDaemon_init},
+    {Py_tp_dealloc, ReplayCacheDaemon_dealloc},
+    {Py_tp_new, ReplayCacheDaemon_new},
+    {0, NULL}
+};
+
+static PyType_Spec ReplayCacheDaemon_spec = {
+    "kerberos.ReplayCacheDaemon",
+    sizeof(ReplayCacheDaemon),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    ReplayCacheDaemon_slots
+};
+
+/*
+ * Incremental base64 codecs, so that large payloads can be converted in
+ * fixed-size chunks without holding the whole message in memory. The
+ * carried state is guarded by a lock, as for contexts, so that a codec
+ * shared between threads without the GIL is not corrupted; the chunks of
+ * one stream still have to be fed in order.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    pthread_mutex_t     lock;
+    base64_encode_state state;
+} Base64Encoder;
+
+typedef struct {
+    PyObject_HEAD
+    pthread_mutex_t     lock;
+    base64_decode_state state;
+} Base64Decoder;
+
+static PyObject *Base64Encoder_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    Base64Encoder *self = (Base64Encoder *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        pthread_mutex_init(&self->lock, NULL);
+        base64_encode_init(&self->state);
+    }
+    return (PyObject *)self;
+}
+
+static void Base64Encoder_dealloc(Base64Encoder *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    pthread_mutex_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static int Base64Encoder_init(Base64Encoder *self, PyObject *args, PyObject *kw)
+{
+    if (! PyArg_ParseTuple(args, ":Base64Encoder")) {
+        return -1;
+    }
+    context_lock(&self->lock);
+    base64_encode_init(&self->state);
+    context_unlock(&self->lock);
+    return 0;
+}
+
+static PyObject *Base64Encoder_update(Base64Encoder *self, PyObject *arg)
+{
+    Py_buffer data;
+    PyObject *pyresult = NULL;
+    size_t len = 0;
+
+    if (! arg_buffer(arg, &data)) {
+        return NULL;
+    }
+
+    pyresult = PyBytes_FromStringAndSize(
+        NULL, BASE64_ENCODE_UPDATE_SIZE(data.len)
+    );
+    if (pyresult == NULL) {
+        PyBuffer_Release(&data);
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    base64_encode_update(
+        &self->state, (const unsigned char *)data.buf, data.len,
+        PyBytes_AS_STRING(pyresult), PyBytes_GET_SIZE(pyresult), &len
+    );
+    context_unlock(&self->lock);
+    PyBuffer_Release(&data);
+
+    _PyBytes_Resize(&pyresult, len);
+    return pyresult;
+}
+
+static PyObject *Base64Encoder_final(Base64Encoder *self, PyObject *args)
+{
+    char out[4];
+    size_t len = 0;
+
+    context_lock(&self->lock);
+    base64_encode_final(&self->state, out, sizeof(out), &len);
+    context_unlock(&self->lock);
+    return PyBytes_FromStringAndSize(out, len);
+}
+
+static PyMethodDef Base64Encoder_methods[] = {
+    {
+        "update",
+        (PyCFunction)Base64Encoder_update, METH_O,
+        "Encode the next chunk of data, returning the complete characters."
+    },
+    {
+        "final",
+        (PyCFunction)Base64Encoder_final, METH_NOARGS,
+        "Encode any buffered bytes with padding and reset the encoder."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyType_Slot Base64Encoder_slots[] = {
+    {Py_tp_doc, "Incremental base64 encoder."},
+    {Py_tp_methods, Base64Encoder_methods},
+    {Py_tp_init, Base64Encoder_init},
+    {Py_tp_dealloc, Base64Encoder_dealloc},
+    {Py_tp_new, Base64Encoder_new},
+    {0, NULL}
+};
+
+static PyType_Spec Base64Encoder_spec = {
+    "kerberos.Base64Encoder",
+    sizeof(Base64Encoder),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    Base64Encoder_slots
+};
+
+static PyObject *Base64Decoder_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    Base64Decoder *self = (Base64Decoder *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        pthread_mutex_init(&self->lock, NULL);
+        base64_decode_init(&self->state);
+    }
+    return (PyObject *)self;
+}
+
+static void Base64Decoder_dealloc(Base64Decoder *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    pthread_mutex_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static int Base64Decoder_init(Base64Decoder *self, PyObject *args, PyObject *kw)
+{
+    if (! PyArg_ParseTuple(args, ":Base64Decoder")) {
+        return -1;
+    }
+    context_lock(&self->lock);
+    base64_decode_init(&self->state);
+    context_unlock(&self->lock);
+    return 0;
+}
+
+static PyObject *Base64Decoder_update(Base64Decoder *self, PyObject *arg)
+{
+    Py_buffer data;
+    PyObject *pyresult = NULL;
+    size_t len = 0;
+    int result;
+
+    if (! arg_buffer(arg, &data)) {
+        return NULL;
+    }
+
+    pyresult = PyBytes_FromStringAndSize(
+        NULL, BASE64_DECODE_UPDATE_SIZE(data.len)
+    );
+    if (pyresult == NULL) {
+        PyBuffer_Release(&data);
+        return NULL;
+    }
+
+    context_lock(&self->lock);
+    result = base64_decode_update(
+        &self->state, (const char *)data.buf, data.len,
+        (unsigned char *)PyBytes_AS_STRING(pyresult),
+        PyBytes_GET_SIZE(pyresult), &len
+    );
+    context_unlock(&self->lock);
+    PyBuffer_Release(&data);
+
+    if (result != BASE64_OK) {
+        Py_DECREF(pyresult);
+        PyErr_SetString(PyExc_ValueError, "Invalid base64 data");
+        return NULL;
+    }
+
+    _PyBytes_Resize(&pyresult, len);
+    return pyresult;
+}
+
+static PyObject *Base64Decoder_final(Base64Decoder *self, PyObject *args)
+{
+    int result;
+
+    context_lock(&self->lock);
+    result = base64_decode_final(&self->state);
+    context_unlock(&self->lock);
+
+    if (result != BASE64_OK) {
+        PyErr_SetString(PyExc_ValueError, "Truncated base64 data");
+        return NULL;
+    }
+    return PyBytes_FromStringAndSize(NULL, 0);
+}
+
+static PyMethodDef Base64Decoder_methods[] = {
+    {
+        "update",
+        (PyCFunction)Base64Decoder_update, METH_O,
+        "Decode the next chunk of base64 text, returning the complete bytes."
+    },
+    {
+        "final",
+        (PyCFunction)Base64Decoder_final, METH_NOARGS,
+        "Check that the stream ended on a group boundary and reset the decoder."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyType_Slot Base64Decoder_slots[] = {
+    {Py_tp_doc, "Incremental base64 decoder."},
+    {Py_tp_methods, Base64Decoder_methods},
+    {Py_tp_init, Base64Decoder_init},
+    {Py_tp_dealloc, Base64Decoder_dealloc},
+    {Py_tp_new, Base64Decoder_new},
+    {0, NULL}
+};
+
+static PyType_Spec Base64Decoder_spec = {
+    "kerberos.Base64Decoder",
+    sizeof(Base64Decoder),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    Base64Decoder_slots
+};
+
+/*
+ * Worker pools
+ *
+ * A WorkerPool runs the blocking calls on its own native threads (see
+ * kerberospool.h) and hands back a Future for each. The Future embeds the
+ * task and everything the call needs, and holds references to its string
+ * arguments and context so that their buffers stay put while a pool thread
+ * uses them without the GIL. Nothing on the pool threads touches Python
+ * objects: the result is only turned into one when it is first read.
+ *
+ * A Future whose call is still queued or running when it is deallocated
+ * waits for the call to finish, since the pool thread still refers to it.
+ *
+ * An AsyncWorkerPool returns an asyncio future instead, and keeps the
+ * Future itself until the call has finished. The pool thread then puts the
+ * Future on the pool's finished list and wakes the event loop through an
+ * eventfd (a pipe where there is no eventfd), whose reader callback
+ * delivers the results on the loop's own thread.
+ */
+
+enum {
+    FUTURE_CHECK_PASSWORD,
+    FUTURE_CHANGE_PASSWORD,
+    FUTURE_PRINCIPAL_DETAILS,
+    FUTURE_SERVER_AUTHENTICATE,
+    FUTURE_SERVER_STEP,
+    FUTURE_CLIENT_STEP,
+};
+
+#define FUTURE_MAX_ARGS     4
+
+typedef struct Future {
+    PyObject_HEAD
+    krb_task         task;
+    int              op;
+    PyObject*        args[FUTURE_MAX_ARGS];
+    const char*      strings[FUTURE_MAX_ARGS];
+    Py_ssize_t       lengths[FUTURE_MAX_ARGS];
+    PyObject*        context;
+    pthread_mutex_t  lock;
+    pthread_cond_t   finished;
+    atomic_int       done;
+    int              result;
+    char*            principal;
+    gss_server_state server;
+    krb_error        error;
+    int              converted;
+    PyObject*        value;
+    PyObject*        async_pool;
+    PyObject*        waiter;
+    struct Future*   finished_next;
+} Future;
+
+static void AsyncWorkerPool_post(PyObject *pool, Future *future);
+
+static void Future_run(krb_task *task)
+{
+    Future *self = (Future *)((char *)task - offsetof(Future, task));
+    GSSServerContext *server = NULL;
+    GSSClientContext *client = NULL;
+    PyObject *async_pool = NULL;
+
+    krb_error_clear(&self->error);
+    switch (self->op) {
+    case FUTURE_CHECK_PASSWORD:
+        self->result = authenticate_user_krb5pwd(
+            self->strings[0], self->strings[1], self->strings[2],
+            self->strings[3], &self->error
+        );
+        break;
+    case FUTURE_CHANGE_PASSWORD:
+        self->result = change_user_krb5pwd(
+            self->strings[0], self->strings[1], self->strings[2], &self->error
+        );
+        break;
+    case FUTURE_PRINCIPAL_DETAILS:
+        self->principal = server_principal_details(
+            self->strings[0], self->strings[1], &self->error
+        );
+        break;
+    case FUTURE_SERVER_AUTHENTICATE:
+        self->result = authenticate_gss_server_init(
+            self->strings[0], &self->server, &self->error
+        );
+        if (self->result != AUTH_GSS_ERROR) {
+            self->result = authenticate_gss_server_step(
+                &self->server, self->strings[1], self->lengths[1],
+                &self->error
+            );
+        }
+        if (self->result == AUTH_GSS_COMPLETE) {
+            self->result = authenticate_gss_server_resolve_names(
+                &self->server, &self->error
+            );
+        }
+        break;
+    case FUTURE_SERVER_STEP:
+        server = (GSSServerContext *)self->context;
+        pthread_mutex_lock(&server->lock);
+        if (server->initialized) {
+            self->result = authenticate_gss_server_step(
+                &server->state, self->strings[0], self->lengths[0],
+                &self->error
+            );
+            server->stale = 1;
+            GSSServerContext_account(server);
+        } else {
+            krb_error_set_message(
+                &self->error, KRB_ERROR_KRB, "Context has already been cleaned"
+            );
+            self->result = AUTH_GSS_ERROR;
+        }
+        pthread_mutex_unlock(&server->lock);
+        break;
+    case FUTURE_CLIENT_STEP:
+        client = (GSSClientContext *)self->context;
+        pthread_mutex_lock(&client->lock);
+        if (client->initialized) {
+            self->result = authenticate_gss_client_step(
+                &client->state, self->strings[0], self->lengths[0],
+                &self->error
+            );
+            client->stale = 1;
+            GSSClientContext_account(client);
+        } else {
+            krb_error_set_message(
+                &self->error, KRB_ERROR_KRB, "Context has already been cleaned"
+            );
+            self->result = AUTH_GSS_ERROR;
+        }
+        pthread_mutex_unlock(&client->lock);
+        break;
+    }
+
+    // The future may be freed as soon as the lock is released, unless an
+    // async pool holds it
+    async_pool = self->async_pool;
+    pthread_mutex_lock(&self->lock);
+    atomic_store(&self->done, 1);
+    pthread_cond_broadcast(&self->finished);
+    pthread_mutex_unlock(&self->lock);
+
+    if (async_pool != NULL) {
+        AsyncWorkerPool_post(async_pool, self);
+    }
+}
+
+static Future *Future_create(kerberos_state *kstate, int op)
+{
+    Future *self = (Future *)kstate->FutureType->tp_alloc(
+        kstate->FutureType, 0
+    );
+
+    if (self != NULL) {
+        self->task.run = Future_run;
+        self->op = op;
+        pthread_mutex_init(&self->lock, NULL);
+        pthread_cond_init(&self->finished, NULL);
+        atomic_init(&self->done, 0);
+    }
+    return self;
+}
+
+// Keep a reference to a string argument and its UTF-8 buffer. Arguments
+// the call uses as C strings are converted as the synchronous functions do,
+// with arg_string, and only a challenge (sized) may be bytes or hold NULs.
+static int Future_set_string(
+    Future *self, int index, PyObject *obj, int sized
+) {
+    if (sized) {
+        if (! arg_string_and_size(
+            obj, &self->strings[index], &self->lengths[index]
+        )) {
+            return 0;
+        }
+    } else {
+        if (! arg_string(obj, &self->strings[index])) {
+            return 0;
+        }
+        self->lengths[index] = (Py_ssize_t)strlen(self->strings[index]);
+    }
+    Py_INCREF(obj);
+    self->args[index] = obj;
+    return 1;
+}
+
+// Wait for the call to finish, for at most timeout seconds if timeout >= 0
+static int Future_wait(Future *self, double timeout)
+{
+    struct timespec deadline;
+    int done = atomic_load(&self->done);
+
+    if (done) {
+        return 1;
+    }
+
+    if (timeout >= 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)timeout;
+        deadline.tv_nsec += (long)((timeout - (time_t)timeout) * 1e9);
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->lock);
+    while (! atomic_load(&self->done)) {
+        if (timeout < 0) {
+            pthread_cond_wait(&self->finished, &self->lock);
+        } else if (
+            pthread_cond_timedwait(&self->finished, &self->lock, &deadline) ==
+            ETIMEDOUT
+        ) {
+            break;
+        }
+    }
+    done = atomic_load(&self->done);
+    pthread_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+
+    return done;
+}
+
+// Build the Python result of a finished call; called with self->lock held
+static PyObject *Future_convert(Future *self, kerberos_state *kstate)
+{
+    switch (self->op) {
+    case FUTURE_CHECK_PASSWORD:
+    case FUTURE_CHANGE_PASSWORD:
+        if (! self->result) {
+            return raise_error(kstate, &self->error);
+        }
+        Py_INCREF(Py_True);
+        return Py_True;
+    case FUTURE_PRINCIPAL_DETAILS:
+        if (self->principal == NULL) {
+            return raise_error(kstate, &self->error);
+        }
+        return Py_BuildValue("s", self->principal);
+    case FUTURE_SERVER_AUTHENTICATE:
+        return server_authenticate_result(
+            kstate, &self->server, self->result, &self->error
+        );
+    default:
+        if (self->result == AUTH_GSS_ERROR) {
+            return raise_error(kstate, &self->error);
+        }
+        return PyLong_FromLong(self->result);
+    }
+}
+
+// Release what a finished call left behind for Future_convert
+static void Future_release(Future *self)
+{
+    free(self->principal);
+    self->principal = NULL;
+    if (self->op == FUTURE_SERVER_AUTHENTICATE && ! self->converted) {
+        authenticate_gss_server_clean(&self->server);
+    }
+}
+
+// The result of a finished call, converted on the first read
+static PyObject *Future_value(Future *self, kerberos_state *kstate)
+{
+    PyObject *pyresult = NULL;
+
+    context_lock(&self->lock);
+    if (! self->converted) {
+        self->value = Future_convert(self, kstate);
+        self->converted = 1;
+        Future_release(self);
+    }
+    if (self->value != NULL) {
+        Py_INCREF(self->value);
+        pyresult = self->value;
+    } else if (! PyErr_Occurred()) {
+        // The call failed; raise the same error on every read
+        raise_error(kstate, &self->error);
+    }
+    context_unlock(&self->lock);
+
+    return pyresult;
+}
+
+static void Future_dealloc(Future *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    int i;
+
+    Future_wait(self, -1);
+    Future_release(self);
+    for (i = 0; i < FUTURE_MAX_ARGS; i++) {
+        Py_XDECREF(self->args[i]);
+    }
+    Py_XDECREF(self->context);
+    Py_XDECREF(self->value);
+    Py_XDECREF(self->async_pool);
+    Py_XDECREF(self->waiter);
+    pthread_cond_destroy(&self->finished);
+    pthread_mutex_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *Future_done(Future *self, PyObject *args)
+{
+    return PyBool_FromLong(atomic_load(&self->done));
+}
+
+static PyObject *Future_result(
+    Future *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"timeout", NULL};
+    PyObject *argv[1] = {NULL};
+    kerberos_state *kstate = type_state(Py_TYPE(self));
+    double timeout = -1;
+
+    if (! unpack_args("result", args, nargs, kwnames, kwlist, 0, argv)) {
+        return NULL;
+    }
+    if (argv[0] != NULL && argv[0] != Py_None) {
+        timeout = PyFloat_AsDouble(argv[0]);
+        if (timeout == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (timeout < 0) {
+            timeout = 0;
+        }
+    }
+
+    if (! Future_wait(self, timeout)) {
+        PyErr_SetNone(PyExc_TimeoutError);
+        return NULL;
+    }
+
+    return Future_value(self, kstate);
+}
+
+// Futures only come from WorkerPool methods
+static PyObject *Future_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    PyErr_Format(
+        PyExc_TypeError, "cannot create '%.100s' instances", type->tp_name
+    );
+    return NULL;
+}
+
+static PyMethodDef Future_methods[] = {
+    {
+        "done",
+        (PyCFunction)Future_done, METH_NOARGS,
+        "Return True if the call has finished."
+    },
+    {
+        "result",
+        (PyCFunction)(void(*)(void))Future_result,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Wait for the call to finish and return its result."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyType_Slot Future_slots[] = {
+    {Py_tp_doc, "The pending result of a call submitted to a WorkerPool."},
+    {Py_tp_methods, Future_methods},
+    {Py_tp_dealloc, Future_dealloc},
+    {Py_tp_new, Future_new},
+    {0, NULL}
+};
+
+static PyType_Spec Future_spec = {
+    "kerberos.Future",
+    sizeof(Future),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    Future_slots
+};
+
+typedef struct {
+    PyObject_HEAD
+    pthread_rwlock_t lock;
+    krb_pool*        pool;
+    int              block;
+    int              async;
+    // AsyncWorkerPool only: the loop and the wakeup descriptors, set up on
+    // the first call, and the finished futures not yet delivered
+    PyObject*        loop;
+    int              wakeup_read;
+    int              wakeup_write;
+    pthread_mutex_t  finished_lock;
+    Future*          finished;
+} WorkerPool;
+
+static void wakeup_signal(int fd)
+{
+#if defined(__linux__)
+    uint64_t one = 1;
+#else
+    char one = 1;
+#endif
+    ssize_t written;
+
+    // A full pipe already has a wakeup pending
+    do {
+        written = write(fd, &one, sizeof(one));
+    } while (written < 0 && errno == EINTR);
+}
+
+static void wakeup_clear(int fd)
+{
+    char buf[64];
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
+    while (read(fd, buf, sizeof(buf)) > 0) {
+        ;
     }
+}
 
-    state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
+static int wakeup_open(int *read_fd, int *write_fd)
+{
+#if defined(__linux__)
+    *read_fd = *write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return (*read_fd < 0) ? -1 : 0;
+#else
+    int fds[2];
+    int i;
 
-    if (state == STATE_NULL) {
-        return NULL;
+    if (pipe(fds) != 0) {
+        return -1;
     }
-
-    return Py_BuildValue("s", state->username);
+    for (i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    *read_fd = fds[0];
+    *write_fd = fds[1];
+    return 0;
+#endif
 }
 
-static PyObject *authGSSClientUnwrap(PyObject *self, PyObject *args)
+static void wakeup_close(int *read_fd, int *write_fd)
 {
-	gss_client_state *state = NULL;
-	PyObject *pystate = NULL;
-	char *challenge = NULL;
-	int result = 0;
-
-	if (! PyArg_ParseTuple(args, "Os", &pystate, &challenge)) {
-		return NULL;
+    if (*write_fd >= 0 && *write_fd != *read_fd) {
+        close(*write_fd);
     }
+    if (*read_fd >= 0) {
+        close(*read_fd);
+    }
+    *read_fd = *write_fd = -1;
+}
 
-	if (! PyCObject_Check(pystate)) {
-		PyErr_SetString(PyExc_TypeError, "Expected a context object");
-		return NULL;
-	}
+// Called on a pool thread once a future of an async pool has finished
+static void AsyncWorkerPool_post(PyObject *pypool, Future *future)
+{
+    WorkerPool *self = (WorkerPool *)pypool;
+    int wake = 0;
 
-	state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
+    pthread_mutex_lock(&self->finished_lock);
+    wake = (self->finished == NULL);
+    future->finished_next = self->finished;
+    self->finished = future;
+    pthread_mutex_unlock(&self->finished_lock);
 
-	if (state == STATE_NULL) {
-		return NULL;
+    if (wake) {
+        wakeup_signal(self->wakeup_write);
     }
+}
 
-	result = authenticate_gss_client_unwrap(state, challenge);
-
-	if (result == AUTH_GSS_ERROR) {
-		return NULL;
+// Hand the result of a finished future to its asyncio future
+static void Future_resolve(Future *self, kerberos_state *kstate)
+{
+    PyObject *waiter = self->waiter;
+    PyObject *done = NULL;
+    PyObject *value = NULL;
+    PyObject *result = NULL;
+    PyObject *type = NULL;
+    PyObject *traceback = NULL;
+
+    self->waiter = NULL;
+    Py_CLEAR(self->async_pool);
+
+    // Nothing to do for a cancelled await; the call itself has run anyway
+    done = PyObject_CallMethod(waiter, "done", NULL);
+    if (done == Py_False) {
+        value = Future_value(self, kstate);
+        if (value != NULL) {
+            result = PyObject_CallMethod(waiter, "set_result", "(O)", value);
+        } else {
+            PyErr_Fetch(&type, &value, &traceback);
+            PyErr_NormalizeException(&type, &value, &traceback);
+            if (traceback != NULL) {
+                PyException_SetTraceback(value, traceback);
+            }
+            result = PyObject_CallMethod(waiter, "set_exception", "(O)", value);
+            Py_XDECREF(type);
+            Py_XDECREF(traceback);
+        }
+        Py_XDECREF(value);
+    } else {
+        result = done;
+        done = NULL;
     }
 
-	return Py_BuildValue("i", result);
+    if (result == NULL) {
+        PyErr_WriteUnraisable(waiter);
+    }
+    Py_XDECREF(result);
+    Py_XDECREF(done);
+    Py_DECREF(waiter);
 }
 
-static PyObject *authGSSClientWrap(PyObject *self, PyObject *args)
+// Deliver the futures finished so far, in the order they finished
+static void AsyncWorkerPool_deliver(WorkerPool *self)
 {
-	gss_client_state *state = NULL;
-	PyObject *pystate = NULL;
-	char *challenge = NULL;
-	char *user = NULL;
-	int protect = 0;
-	int result = 0;
-
-	if (! PyArg_ParseTuple(
-        args, "Os|zi", &pystate, &challenge, &user, &protect
-    )) {
-		return NULL;
+    kerberos_state *kstate = type_state(Py_TYPE(self));
+    Future *finished = NULL;
+    Future *ordered = NULL;
+    Future *next = NULL;
+
+    pthread_mutex_lock(&self->finished_lock);
+    finished = self->finished;
+    self->finished = NULL;
+    pthread_mutex_unlock(&self->finished_lock);
+
+    while (finished != NULL) {
+        next = finished->finished_next;
+        finished->finished_next = ordered;
+        ordered = finished;
+        finished = next;
     }
 
-	if (! PyCObject_Check(pystate)) {
-		PyErr_SetString(PyExc_TypeError, "Expected a context object");
-		return NULL;
-	}
-
-	state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
-
-	if (state == STATE_NULL) {
-		return NULL;
+    while (ordered != NULL) {
+        next = ordered->finished_next;
+        ordered->finished_next = NULL;
+        Future_resolve(ordered, kstate);
+        Py_DECREF(ordered);
+        ordered = next;
     }
+}
 
-	result = authenticate_gss_client_wrap(state, challenge, user, protect);
-
-	if (result == AUTH_GSS_ERROR) {
-		return NULL;
-    }
+// The event loop's reader callback for the wakeup descriptor
+static PyObject *AsyncWorkerPool_wakeup(PyObject *pypool, PyObject *unused)
+{
+    WorkerPool *self = (WorkerPool *)pypool;
 
-	return Py_BuildValue("i", result);
+    wakeup_clear(self->wakeup_read);
+    AsyncWorkerPool_deliver(self);
+    Py_RETURN_NONE;
 }
 
-static PyObject *authGSSClientInquireCred(PyObject *self, PyObject *args)
+static PyMethodDef AsyncWorkerPool_wakeup_def = {
+    "_wakeup", (PyCFunction)AsyncWorkerPool_wakeup, METH_NOARGS, NULL
+};
+
+/*
+ * Bind an async pool to the running event loop: open the wakeup
+ * descriptors on the first call and register the reader callback. A pool
+ * whose loop has closed since, as after asyncio.run() returns, moves to the
+ * running loop. It keeps its descriptors, which pool threads may still be
+ * signalling, and the new loop delivers what finished in between. Called
+ * with the pool's lock held for writing.
+ */
+static int AsyncWorkerPool_bind(WorkerPool *self)
 {
-    gss_client_state *state = NULL;
-    PyObject *pystate = NULL;
-    int result = 0;
-    if (!PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
+    PyObject *asyncio = NULL;
+    PyObject *loop = NULL;
+    PyObject *closed = NULL;
+    PyObject *callback = NULL;
+    PyObject *result = NULL;
+
+    asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL) {
+        return -1;
+    }
+    loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if (loop == NULL) {
+        return -1;
+    }
+    if (loop == self->loop) {
+        Py_DECREF(loop);
+        return 0;
     }
 
-    if (!PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
+    if (self->loop != NULL) {
+        closed = PyObject_CallMethod(self->loop, "is_closed", NULL);
+        if (closed != Py_True) {
+            if (closed != NULL) {
+                PyErr_SetString(
+                    PyExc_RuntimeError,
+                    "AsyncWorkerPool is bound to another event loop that "
+                    "is still open"
+                );
+            }
+            Py_XDECREF(closed);
+            Py_DECREF(loop);
+            return -1;
+        }
+        Py_DECREF(closed);
+
+        result = PyObject_CallMethod(
+            self->loop, "remove_reader", "i", self->wakeup_read
+        );
+        if (result == NULL) {
+            PyErr_Clear();
+        }
+        Py_XDECREF(result);
+        Py_CLEAR(self->loop);
     }
 
-    state = (gss_client_state *)PyCObject_AsVoidPtr(pystate);
-    if (state == STATE_NULL) {
-        return NULL;
+    if (
+        self->wakeup_read < 0 &&
+        wakeup_open(&self->wakeup_read, &self->wakeup_write) != 0
+    ) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(loop);
+        return -1;
     }
 
-    result = authenticate_gss_client_inquire_cred(state);
-    if (result == AUTH_GSS_ERROR) {
-        return NULL;
+    callback = PyCFunction_New(&AsyncWorkerPool_wakeup_def, (PyObject *)self);
+    if (callback != NULL) {
+        result = PyObject_CallMethod(
+            loop, "add_reader", "iO", self->wakeup_read, callback
+        );
+        Py_DECREF(callback);
     }
+    if (result == NULL) {
+        Py_DECREF(loop);
+        return -1;
+    }
+    Py_DECREF(result);
 
-    return Py_BuildValue("i", result);
+    self->loop = loop;
+    return 0;
 }
 
-static PyObject *authGSSServerInit(PyObject *self, PyObject *args)
+/*
+ * Stop the threads, once the queued calls have run. For an async pool,
+ * also deliver their results and detach from the loop, preserving any
+ * exception already set.
+ */
+static void WorkerPool_close_pool(WorkerPool *self)
 {
-    const char *service = NULL;
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
-    int result = 0;
-
-    if (! PyArg_ParseTuple(args, "s", &service)) {
-        return NULL;
+    krb_pool *pool = NULL;
+    PyObject *loop = NULL;
+    PyObject *type = NULL;
+    PyObject *value = NULL;
+    PyObject *traceback = NULL;
+    PyObject *result = NULL;
+
+    rw_lock(&self->lock, 1);
+    pool = self->pool;
+    self->pool = NULL;
+    loop = self->loop;
+    self->loop = NULL;
+    rw_unlock(&self->lock);
+
+    if (pool != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        krb_pool_destroy(pool);
+        Py_END_ALLOW_THREADS
     }
 
-    state = (gss_server_state *) malloc(sizeof(gss_server_state));
-    if (state == NULL)
-    {
-        PyErr_NoMemory();
-        return NULL;
+    if (self->wakeup_read >= 0) {
+        PyErr_Fetch(&type, &value, &traceback);
+        if (loop != NULL) {
+            result = PyObject_CallMethod(
+                loop, "remove_reader", "i", self->wakeup_read
+            );
+            if (result == NULL) {
+                // The loop may be closed already
+                PyErr_Clear();
+            }
+            Py_XDECREF(result);
+            Py_DECREF(loop);
+        }
+        AsyncWorkerPool_deliver(self);
+        wakeup_close(&self->wakeup_read, &self->wakeup_write);
+        PyErr_Restore(type, value, traceback);
     }
-    pystate = PyCObject_FromVoidPtr(state, NULL);
+}
 
-    result = authenticate_gss_server_init(service, state);
+static int WorkerPool_init(
+    WorkerPool *self, PyObject *args, PyObject *keywds
+) {
+    static char *kwlist[] = {"threads", "max_queued", "block", NULL};
+    int async = (Py_TYPE(self) == type_state(Py_TYPE(self))->AsyncWorkerPoolType);
+    int threads = 0;
+    Py_ssize_t max_queued = 1024;
+    int block = ! async;
+    krb_pool *pool = NULL;
 
-    if (result == AUTH_GSS_ERROR) {
-        return NULL;
+    if (! PyArg_ParseTupleAndKeywords(
+        args, keywds, "|inp", kwlist, &threads, &max_queued, &block
+    )) {
+        return -1;
+    }
+    if (max_queued < 1) {
+        PyErr_SetString(PyExc_ValueError, "max_queued must be at least 1");
+        return -1;
     }
 
-    return Py_BuildValue("(iO)", result, pystate);
-}
-
-static PyObject *authGSSServerClean(PyObject *self, PyObject *args)
-{
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
-    int result = 0;
+    WorkerPool_close_pool(self);
 
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    pool = krb_pool_create(threads, (size_t)max_queued);
+    Py_END_ALLOW_THREADS
+    if (pool == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "could not start worker threads");
+        return -1;
     }
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
-    }
+    rw_lock(&self->lock, 1);
+    self->pool = pool;
+    self->block = block;
+    self->async = async;
+    rw_unlock(&self->lock);
 
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
+    return 0;
+}
 
-    if (state != STATE_NULL) {
-        result = authenticate_gss_server_clean(state);
+static PyObject *WorkerPool_new(
+    PyTypeObject *type, PyObject *args, PyObject *keywds
+) {
+    WorkerPool *self = (WorkerPool *)type->tp_alloc(type, 0);
 
-        free(state);
-        PyCObject_SetVoidPtr(pystate, STATE_NULL);
+    if (self != NULL) {
+        pthread_rwlock_init(&self->lock, NULL);
+        pthread_mutex_init(&self->finished_lock, NULL);
+        self->wakeup_read = self->wakeup_write = -1;
     }
-
-    return Py_BuildValue("i", result);
+    return (PyObject *)self;
 }
 
-static PyObject *authGSSServerStep(PyObject *self, PyObject *args)
+static void WorkerPool_dealloc(WorkerPool *self)
 {
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
-    char *challenge = NULL;
-    int result = 0;
+    PyTypeObject *type = Py_TYPE(self);
 
-    if (! PyArg_ParseTuple(args, "Os", &pystate, &challenge)) {
-        return NULL;
+    WorkerPool_close_pool(self);
+    pthread_mutex_destroy(&self->finished_lock);
+    pthread_rwlock_destroy(&self->lock);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+/*
+ * Queue a future built by one of the methods below, or wait for room in
+ * the queue with the GIL released. Steals the reference to future, which
+ * an async pool keeps until the call has finished and returns an asyncio
+ * future for instead.
+ */
+static PyObject *WorkerPool_submit(WorkerPool *self, Future *future)
+{
+    PyObject *waiter = NULL;
+    int result = KRB_POOL_CLOSED;
+
+    if (self->async) {
+        rw_lock(&self->lock, 1);
+        if (self->pool != NULL) {
+            if (AsyncWorkerPool_bind(self) < 0) {
+                rw_unlock(&self->lock);
+                atomic_store(&future->done, 1);
+                Py_DECREF(future);
+                return NULL;
+            }
+        }
+        if (self->loop != NULL) {
+            waiter = PyObject_CallMethod(self->loop, "create_future", NULL);
+            if (waiter == NULL) {
+                rw_unlock(&self->lock);
+                atomic_store(&future->done, 1);
+                Py_DECREF(future);
+                return NULL;
+            }
+            Py_INCREF(waiter);
+            future->waiter = waiter;
+            Py_INCREF(self);
+            future->async_pool = (PyObject *)self;
+        }
+        rw_unlock(&self->lock);
     }
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
+    rw_lock(&self->lock, 0);
+    if (self->pool != NULL) {
+        result = krb_pool_submit(self->pool, &future->task, 0);
+        if (result == KRB_POOL_FULL && self->block) {
+            Py_BEGIN_ALLOW_THREADS
+            result = krb_pool_submit(self->pool, &future->task, 1);
+            Py_END_ALLOW_THREADS
+        }
     }
+    rw_unlock(&self->lock);
 
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
+    if (result == KRB_POOL_QUEUED) {
+        return (waiter != NULL) ? waiter : (PyObject *)future;
+    }
 
-    if (state == STATE_NULL) {
-        return NULL;
+    // Never queued, so there is nothing to wait for
+    atomic_store(&future->done, 1);
+    Py_CLEAR(future->waiter);
+    Py_CLEAR(future->async_pool);
+    Py_XDECREF(waiter);
+    Py_DECREF(future);
+    if (result == KRB_POOL_FULL) {
+        PyErr_SetString(PyExc_BlockingIOError, "worker pool queue is full");
+    } else {
+        PyErr_SetString(PyExc_ValueError, "worker pool is closed");
     }
+    return NULL;
+}
 
-    result = authenticate_gss_server_step(state, challenge);
+// Submit op with the nargs string arguments in argv, of which the one at
+// sized (if any, else -1) is a challenge
+static PyObject *WorkerPool_submit_strings(
+    WorkerPool *self, int op, PyObject **argv, int nargs, int sized
+) {
+    Future *future = Future_create(type_state(Py_TYPE(self)), op);
+    int i;
 
-    if (result == AUTH_GSS_ERROR) {
+    if (future == NULL) {
         return NULL;
     }
+    for (i = 0; i < nargs; i++) {
+        if (! Future_set_string(future, i, argv[i], i == sized)) {
+            atomic_store(&future->done, 1);
+            Py_DECREF(future);
+            return NULL;
+        }
+    }
 
-    return Py_BuildValue("i", result);
+    return WorkerPool_submit(self, future);
 }
 
-static PyObject *authGSSServerStoreDelegate(PyObject *self, PyObject *args)
-{
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
-    int result = 0;
+static PyObject *WorkerPool_checkPassword(
+    WorkerPool *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {
+        "user", "pswd", "service", "default_realm", NULL
+    };
+    PyObject *argv[4] = {NULL, NULL, NULL, NULL};
 
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
+    if (! unpack_args("checkPassword", args, nargs, kwnames, kwlist, 4, argv)) {
         return NULL;
     }
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
+    return WorkerPool_submit_strings(
+        self, FUTURE_CHECK_PASSWORD, argv, 4, -1
+    );
+}
+
+static PyObject *WorkerPool_changePassword(
+    WorkerPool *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"user", "oldpswd", "newpswd", NULL};
+    PyObject *argv[3] = {NULL, NULL, NULL};
+
+    if (! unpack_args("changePassword", args, nargs, kwnames, kwlist, 3, argv)) {
         return NULL;
     }
 
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
+    return WorkerPool_submit_strings(
+        self, FUTURE_CHANGE_PASSWORD, argv, 3, -1
+    );
+}
 
-    if (state == STATE_NULL) {
+static PyObject *WorkerPool_getServerPrincipalDetails(
+    WorkerPool *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"service", "hostname", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "getServerPrincipalDetails", args, nargs, kwnames, kwlist, 2, argv
+        )
+    ) {
         return NULL;
     }
 
-    result = authenticate_gss_server_store_delegate(state);
+    return WorkerPool_submit_strings(
+        self, FUTURE_PRINCIPAL_DETAILS, argv, 2, -1
+    );
+}
 
-    if (result == AUTH_GSS_ERROR) {
+static PyObject *WorkerPool_authGSSServerAuthenticate(
+    WorkerPool *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"service", "challenge", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "authGSSServerAuthenticate", args, nargs, kwnames, kwlist, 2, argv
+        )
+    ) {
         return NULL;
     }
-    
-    return Py_BuildValue("i", result);
-}
 
-static PyObject *authGSSServerResponse(PyObject *self, PyObject *args)
-{
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
+    return WorkerPool_submit_strings(
+        self, FUTURE_SERVER_AUTHENTICATE, argv, 2, 1
+    );
+}
 
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
+// Submit a step of the client or server context in argv[0]
+static PyObject *WorkerPool_submit_step(
+    WorkerPool *self, int op, PyObject **argv
+) {
+    kerberos_state *kstate = type_state(Py_TYPE(self));
+    Future *future = NULL;
+
+    if (op == FUTURE_SERVER_STEP) {
+        if (server_context(kstate, argv[0]) == NULL) {
+            return NULL;
+        }
+    } else if (client_context(kstate, argv[0]) == NULL) {
         return NULL;
     }
 
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
+    future = Future_create(kstate, op);
+    if (future == NULL) {
         return NULL;
     }
-
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
-
-    if (state == STATE_NULL) {
+    Py_INCREF(argv[0]);
+    future->context = argv[0];
+    if (! Future_set_string(future, 0, argv[1], 1)) {
+        atomic_store(&future->done, 1);
+        Py_DECREF(future);
         return NULL;
     }
 
-    return Py_BuildValue("s", state->response);
+    return WorkerPool_submit(self, future);
 }
 
-static PyObject *authGSSServerUserName(PyObject *self, PyObject *args)
-{
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
-    
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
+static PyObject *WorkerPool_authGSSServerStep(
+    WorkerPool *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"context", "challenge", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "authGSSServerStep", args, nargs, kwnames, kwlist, 2, argv
+        )
+    ) {
         return NULL;
     }
-    
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
-    }
-    
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
 
-    if (state == STATE_NULL) {
+    return WorkerPool_submit_step(self, FUTURE_SERVER_STEP, argv);
+}
+
+static PyObject *WorkerPool_authGSSClientStep(
+    WorkerPool *self, PyObject *const *args, Py_ssize_t nargs,
+    PyObject *kwnames
+) {
+    static const char *const kwlist[] = {"context", "challenge", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (
+        ! unpack_args(
+            "authGSSClientStep", args, nargs, kwnames, kwlist, 2, argv
+        )
+    ) {
         return NULL;
     }
-    
-    return Py_BuildValue("s", state->username);
+
+    return WorkerPool_submit_step(self, FUTURE_CLIENT_STEP, argv);
 }
 
-static PyObject *authGSSServerCacheName(PyObject *self, PyObject *args)
+static PyObject *WorkerPool_close(WorkerPool *self, PyObject *args)
 {
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
-    
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
-    }
-    
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
-    }
-    
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
+    WorkerPool_close_pool(self);
+    Py_RETURN_NONE;
+}
 
-    if (state == STATE_NULL) {
-        return NULL;
-    }
+static PyObject *WorkerPool_enter(WorkerPool *self, PyObject *args)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
 
-    return Py_BuildValue("s", state->ccname);
+static PyObject *WorkerPool_exit(WorkerPool *self, PyObject *args)
+{
+    WorkerPool_close_pool(self);
+    Py_RETURN_FALSE;
 }
 
-static PyObject *authGSSServerTargetName(PyObject *self, PyObject *args)
+static PyObject *WorkerPool_get_threads(WorkerPool *self, void *closure)
 {
-    gss_server_state *state = NULL;
-    PyObject *pystate = NULL;
-    
-    if (! PyArg_ParseTuple(args, "O", &pystate)) {
-        return NULL;
-    }
-    
-    if (! PyCObject_Check(pystate)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a context object");
-        return NULL;
-    }
-    
-    state = (gss_server_state *)PyCObject_AsVoidPtr(pystate);
+    int threads = 0;
 
-    if (state == STATE_NULL) {
-        return NULL;
-    }
-    
-    return Py_BuildValue("s", state->targetname);
+    rw_lock(&self->lock, 0);
+    threads = krb_pool_threads(self->pool);
+    rw_unlock(&self->lock);
+
+    return PyLong_FromLong(threads);
+}
+
+static PyObject *WorkerPool_get_queued(WorkerPool *self, void *closure)
+{
+    size_t queued = 0;
+
+    rw_lock(&self->lock, 0);
+    queued = krb_pool_queued(self->pool);
+    rw_unlock(&self->lock);
+
+    return PyLong_FromSize_t(queued);
 }
 
+static PyMethodDef WorkerPool_methods[] = {
+    {
+        "checkPassword",
+        (PyCFunction)(void(*)(void))WorkerPool_checkPassword,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Submit checkPassword and return a Future."
+    },
+    {
+        "changePassword",
+        (PyCFunction)(void(*)(void))WorkerPool_changePassword,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Submit changePassword and return a Future."
+    },
+    {
+        "getServerPrincipalDetails",
+        (PyCFunction)(void(*)(void))WorkerPool_getServerPrincipalDetails,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Submit getServerPrincipalDetails and return a Future."
+    },
+    {
+        "authGSSServerAuthenticate",
+        (PyCFunction)(void(*)(void))WorkerPool_authGSSServerAuthenticate,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Submit authGSSServerAuthenticate and return a Future."
+    },
+    {
+        "authGSSServerStep",
+        (PyCFunction)(void(*)(void))WorkerPool_authGSSServerStep,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Submit authGSSServerStep and return a Future."
+    },
+    {
+        "authGSSClientStep",
+        (PyCFunction)(void(*)(void))WorkerPool_authGSSClientStep,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Submit authGSSClientStep and return a Future."
+    },
+    {
+        "close",
+        (PyCFunction)WorkerPool_close, METH_NOARGS,
+        "Finish the queued calls and stop the threads."
+    },
+    {
+        "__enter__",
+        (PyCFunction)WorkerPool_enter, METH_NOARGS,
+        NULL
+    },
+    {
+        "__exit__",
+        (PyCFunction)WorkerPool_exit, METH_VARARGS,
+        NULL
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyGetSetDef WorkerPool_getset[] = {
+    {
+        "threads", (getter)WorkerPool_get_threads, NULL,
+        "Number of threads, or 0 once closed.", NULL
+    },
+    {
+        "queued", (getter)WorkerPool_get_queued, NULL,
+        "Number of calls waiting for a thread.", NULL
+    },
+    {NULL, NULL, NULL, NULL, NULL}        /* Sentinel */
+};
+
+static PyType_Slot WorkerPool_slots[] = {
+    {Py_tp_doc, "Native threads for running blocking Kerberos calls."},
+    {Py_tp_methods, WorkerPool_methods},
+    {Py_tp_getset, WorkerPool_getset},
+    {Py_tp_init, WorkerPool_init},
+    {Py_tp_dealloc, WorkerPool_dealloc},
+    {Py_tp_new, WorkerPool_new},
+    {0, NULL}
+};
+
+static PyType_Spec WorkerPool_spec = {
+    "kerberos.WorkerPool",
+    sizeof(WorkerPool),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    WorkerPool_slots
+};
+
+static PyType_Slot AsyncWorkerPool_slots[] = {
+    {Py_tp_doc, "Native threads for awaiting blocking Kerberos calls."},
+    {Py_tp_methods, WorkerPool_methods},
+    {Py_tp_getset, WorkerPool_getset},
+    {Py_tp_init, WorkerPool_init},
+    {Py_tp_dealloc, WorkerPool_dealloc},
+    {Py_tp_new, WorkerPool_new},
+    {0, NULL}
+};
+
+static PyType_Spec AsyncWorkerPool_spec = {
+    "kerberos.AsyncWorkerPool",
+    sizeof(WorkerPool),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    AsyncWorkerPool_slots
+};
+
 static PyMethodDef KerberosMethods[] = {
     {
         "checkPassword",
-        checkPassword, METH_VARARGS,
+        (PyCFunction)(void(*)(void))checkPassword,
+        METH_FASTCALL | METH_KEYWORDS,
         "Check the supplied user/password against Kerberos KDC."
     },
     {
         "changePassword",
-        changePassword, METH_VARARGS,
+        (PyCFunction)(void(*)(void))changePassword,
+        METH_FASTCALL | METH_KEYWORDS,
         "Change the user password."
     },
     {
         "getServerPrincipalDetails",
-        getServerPrincipalDetails, METH_VARARGS,
+        (PyCFunction)(void(*)(void))getServerPrincipalDetails,
+        METH_FASTCALL | METH_KEYWORDS,
         "Return the service principal for a given service and hostname."
     },
     {
         "authGSSClientInit",
-        (PyCFunction)authGSSClientInit, METH_VARARGS | METH_KEYWORDS,
+        (PyCFunction)(void(*)(void))authGSSClientInit,
+        METH_FASTCALL | METH_KEYWORDS,
         "Initialize client-side GSSAPI operations."
     },
+    {
+        "authGSSClientNegotiate",
+        (PyCFunction)(void(*)(void))authGSSClientNegotiate,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Return a Negotiate header value for a service in one call."
+    },
     {
         "authGSSClientClean",
-        authGSSClientClean, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSClientClean,
+        METH_FASTCALL | METH_KEYWORDS,
         "Terminate client-side GSSAPI operations."
     },
     {
         "authGSSClientStep",
-        authGSSClientStep, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSClientStep,
+        METH_FASTCALL | METH_KEYWORDS,
         "Do a client-side GSSAPI step."
     },
     {
         "authGSSClientResponse",
-        authGSSClientResponse, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSClientResponse,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the response from the last client-side GSSAPI step."
     },
     {
-        "authGSSClientInquireCred",  authGSSClientInquireCred, METH_VARARGS,
+        "authGSSClientInquireCred",
+        (PyCFunction)(void(*)(void))authGSSClientInquireCred,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the current user name, if any, without a client-side GSSAPI step"
     },
     {
         "authGSSClientResponseConf",
-        authGSSClientResponseConf, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSClientResponseConf,
+        METH_FASTCALL | METH_KEYWORDS,
         "return 1 if confidentiality was set in the last unwrapped buffer, 0 otherwise."
     },
     {
         "authGSSClientUserName",
-        authGSSClientUserName, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSClientUserName,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the user name from the last client-side GSSAPI step."
     },
     {
         "authGSSServerInit",
-        authGSSServerInit, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerInit,
+        METH_FASTCALL | METH_KEYWORDS,
         "Initialize server-side GSSAPI operations."
     },
     {
         "authGSSClientWrap",
-        authGSSClientWrap, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSClientWrap,
+        METH_FASTCALL | METH_KEYWORDS,
         "Do a GSSAPI wrap."
     },
     {
         "authGSSClientUnwrap",
-        authGSSClientUnwrap, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSClientUnwrap,
+        METH_FASTCALL | METH_KEYWORDS,
         "Do a GSSAPI unwrap."
     },
     {
-        "authGSSClientInquireCred", authGSSClientInquireCred, METH_VARARGS,
+        "authGSSClientInquireCred",
+        (PyCFunction)(void(*)(void))authGSSClientInquireCred,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the current user name, if any."
     },
     {
         "authGSSServerClean",
-        authGSSServerClean, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerClean,
+        METH_FASTCALL | METH_KEYWORDS,
         "Terminate server-side GSSAPI operations."
     },
     {
         "authGSSServerStep",
-        authGSSServerStep, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerStep,
+        METH_FASTCALL | METH_KEYWORDS,
         "Do a server-side GSSAPI step."
     },
+    {
+        "authGSSServerAuthenticate",
+        (PyCFunction)(void(*)(void))authGSSServerAuthenticate,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Authenticate a client token in one call, for single-leg Negotiate."
+    },
+    {
+        "authGSSServerAuthenticateBatch",
+        (PyCFunction)(void(*)(void))authGSSServerAuthenticateBatch,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Authenticate a list of (service, token) pairs in parallel."
+    },
     {
         "authGSSServerHasDelegated",
-        authGSSServerHasDelegated, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerHasDelegated,
+        METH_FASTCALL | METH_KEYWORDS,
         "Check whether the client delegated credentials to us."
     },
     {
         "authGSSServerStoreDelegate",
-        authGSSServerStoreDelegate, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerStoreDelegate,
+        METH_FASTCALL | METH_KEYWORDS,
         "Store the delegated Credentials."
     },
     {
         "authGSSServerResponse",
-        authGSSServerResponse, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerResponse,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the response from the last server-side GSSAPI step."
     },
     {
         "authGSSServerUserName",
-        authGSSServerUserName, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerUserName,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the user name from the last server-side GSSAPI step."
     },
     {
         "authGSSServerCacheName",
-        authGSSServerCacheName, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerCacheName,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the location of the cache where delegated credentials are stored."
     },
     {
         "authGSSServerTargetName",
-        authGSSServerTargetName, METH_VARARGS,
+        (PyCFunction)(void(*)(void))authGSSServerTargetName,
+        METH_FASTCALL | METH_KEYWORDS,
         "Get the target name from the last server-side GSSAPI step."
     },
+    {
+        "contextStats",
+        (PyCFunction)contextStats, METH_NOARGS,
+        "Count the live GSSAPI contexts in the process and the bytes they hold."
+    },
+    {
+        "acceptorCacheStats",
+        (PyCFunction)acceptorCacheStats, METH_NOARGS,
+        "Get the counters of the acceptor credential cache."
+    },
+    {
+        "invalidateAcceptorCache",
+        (PyCFunction)(void(*)(void))invalidateAcceptorCache,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Drop cached acceptor credentials for a service, or for all services."
+    },
+    {
+        "setAcceptorCacheTTL",
+        (PyCFunction)(void(*)(void))setAcceptorCacheTTL,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Set how long acceptor credentials are cached for."
+    },
+    {
+        "replayCacheStats",
+        (PyCFunction)replayCacheStats, METH_NOARGS,
+        "Get the counters of the in-memory replay cache."
+    },
+    {
+        "setReplayCacheWindow",
+        (PyCFunction)(void(*)(void))setReplayCacheWindow,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Set how long the in-memory replay cache remembers authenticators."
+    },
+    {
+        "attachReplayCache",
+        (PyCFunction)(void(*)(void))attachReplayCache,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Attach the shared memory replay cache, creating it if needed."
+    },
+    {
+        "connectReplayCache",
+        (PyCFunction)(void(*)(void))connectReplayCache,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Use the replay cache daemon listening on a Unix socket."
+    },
+    {
+        "detachReplayCache",
+        (PyCFunction)detachReplayCache, METH_NOARGS,
+        "Stop using the shared replay cache."
+    },
+    {
+        "loadKeytab",
+        (PyCFunction)(void(*)(void))loadKeytab,
+        METH_FASTCALL | METH_KEYWORDS,
+        "Load a keytab into memory and accept with the keys loaded."
+    },
+    {
+        "reloadKeytab",
+        (PyCFunction)reloadKeytab, METH_NOARGS,
+        "Load the keytab loaded by loadKeytab() again."
+    },
+    {
+        "unloadKeytab",
+        (PyCFunction)unloadKeytab, METH_NOARGS,
+        "Accept with the keytab on disk again."
+    },
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
-MOD_INIT(kerberos)
-{
-    PyObject *m,*d;
+static int add_type(
+    PyObject *module, PyType_Spec *spec, PyTypeObject **type
+) {
+    const char *name = strrchr(spec->name, '.') + 1;
+
+    *type = (PyTypeObject *)PyType_FromModuleAndSpec(module, spec, NULL);
+    if (*type == NULL) {
+        return -1;
+    }
+    Py_INCREF(*type);
+    if (PyModule_AddObject(module, name, (PyObject *)*type) < 0) {
+        Py_DECREF(*type);
+        return -1;
+    }
+    return 0;
+}
 
-    MOD_DEF(m, "kerberos", NULL, KerberosMethods);
+static int add_exception(
+    PyObject *module, const char *name, PyObject *base, PyObject **exception
+) {
+    *exception = PyErr_NewException(name, base, NULL);
+    if (*exception == NULL) {
+        return -1;
+    }
+    Py_INCREF(*exception);
+    if (PyModule_AddObject(module, strchr(name, '.') + 1, *exception) < 0) {
+        Py_DECREF(*exception);
+        return -1;
+    }
+    return 0;
+}
 
-    if (m == NULL) {
-        return MOD_ERROR_VAL;
+static int add_capsule(
+    PyObject *module, const char *name, gss_OID oid, PyObject **capsule
+) {
+    *capsule = PyCapsule_New(oid, name, NULL);
+    if (*capsule == NULL) {
+        return -1;
     }
+    Py_INCREF(*capsule);
+    if (PyModule_AddObject(module, strchr(name, '.') + 1, *capsule) < 0) {
+        Py_DECREF(*capsule);
+        return -1;
+    }
+    return 0;
+}
 
-    d = PyModule_GetDict(m);
+static int kerberos_exec(PyObject *m)
+{
+    kerberos_state *state = module_state(m);
+    PyObject *atexit = NULL;
+    PyObject *stop = NULL;
+    PyObject *result = NULL;
+
+    pthread_mutex_init(&state->watchers_lock, NULL);
+    base64_init();
+
+    if (
+        add_type(m, &GSSClientContext_spec, &state->GSSClientContextType) ||
+        add_type(m, &GSSServerContext_spec, &state->GSSServerContextType) ||
+        add_type(m, &GSSClientTarget_spec, &state->GSSClientTargetType) ||
+        add_type(m, &WorkerPool_spec, &state->WorkerPoolType) ||
+        add_type(m, &AsyncWorkerPool_spec, &state->AsyncWorkerPoolType) ||
+        add_type(m, &Future_spec, &state->FutureType) ||
+        add_type(m, &KeytabWatcher_spec, &state->KeytabWatcherType) ||
+        add_type(m, &Acceptor_spec, &state->AcceptorType) ||
+        add_type(
+            m, &ReplayCacheDaemon_spec, &state->ReplayCacheDaemonType
+        ) ||
+        add_type(m, &Base64Encoder_spec, &state->Base64EncoderType) ||
+        add_type(m, &Base64Decoder_spec, &state->Base64DecoderType)
+    ) {
+        return -1;
+    }
 
     /* create the base exception class */
-    if (! (KrbException_class = PyErr_NewException(
-        "kerberos.KrbError", NULL, NULL
-    ))) {
-        goto error;
+    if (add_exception(
+        m, "kerberos.KrbError", NULL, &state->KrbException_class
+    )) {
+        return -1;
     }
 
-    PyDict_SetItemString(d, "KrbError", KrbException_class);
-    Py_INCREF(KrbException_class);
-
     /* ...and the derived exceptions */
-    if (! (BasicAuthException_class = PyErr_NewException(
-        "kerberos.BasicAuthError", KrbException_class, NULL
-    ))) {
-        goto error;
+    if (
+        add_exception(
+            m, "kerberos.BasicAuthError", state->KrbException_class,
+            &state->BasicAuthException_class
+        ) ||
+        add_exception(
+            m, "kerberos.PwdChangeError", state->KrbException_class,
+            &state->PwdChangeException_class
+        ) ||
+        add_exception(
+            m, "kerberos.GSSError", state->KrbException_class,
+            &state->GssException_class
+        )
+    ) {
+        return -1;
     }
 
-    Py_INCREF(BasicAuthException_class);
-    PyDict_SetItemString(d, "BasicAuthError", BasicAuthException_class);
-
-    if (! (PwdChangeException_class = PyErr_NewException(
-        "kerberos.PwdChangeError", KrbException_class, NULL
-    ))) {
-        goto error;
+    if (
+        PyModule_AddIntConstant(m, "AUTH_GSS_COMPLETE", AUTH_GSS_COMPLETE) ||
+        PyModule_AddIntConstant(m, "AUTH_GSS_CONTINUE", AUTH_GSS_CONTINUE) ||
+        PyModule_AddIntConstant(m, "GSS_C_DELEG_FLAG", GSS_C_DELEG_FLAG) ||
+        PyModule_AddIntConstant(m, "GSS_C_MUTUAL_FLAG", GSS_C_MUTUAL_FLAG) ||
+        PyModule_AddIntConstant(m, "GSS_C_REPLAY_FLAG", GSS_C_REPLAY_FLAG) ||
+        PyModule_AddIntConstant(
+            m, "GSS_C_SEQUENCE_FLAG", GSS_C_SEQUENCE_FLAG
+        ) ||
+        PyModule_AddIntConstant(m, "GSS_C_CONF_FLAG", GSS_C_CONF_FLAG) ||
+        PyModule_AddIntConstant(m, "GSS_C_INTEG_FLAG", GSS_C_INTEG_FLAG) ||
+        PyModule_AddIntConstant(m, "GSS_C_ANON_FLAG", GSS_C_ANON_FLAG) ||
+        PyModule_AddIntConstant(
+            m, "GSS_C_PROT_READY_FLAG", GSS_C_PROT_READY_FLAG
+        ) ||
+        PyModule_AddIntConstant(m, "GSS_C_TRANS_FLAG", GSS_C_TRANS_FLAG)
+    ) {
+        return -1;
     }
 
-    Py_INCREF(PwdChangeException_class);
-    PyDict_SetItemString(d, "PwdChangeError", PwdChangeException_class);
+    if (
+        add_capsule(
+            m, "kerberos.GSS_MECH_OID_KRB5", &krb5_mech_oid,
+            &state->krb5_mech_oid
+        ) ||
+        add_capsule(
+            m, "kerberos.GSS_MECH_OID_SPNEGO", &spnego_mech_oid,
+            &state->spnego_mech_oid
+        )
+    ) {
+        return -1;
+    }
 
-    if (! (GssException_class = PyErr_NewException(
-        "kerberos.GSSError", KrbException_class, NULL
-    ))) {
-        goto error;
+    // Watcher threads take the GIL to run callbacks, which they must not
+    // do once the interpreter is finalizing
+    atexit = PyImport_ImportModule("atexit");
+    if (atexit != NULL) {
+        stop = PyCFunction_New(&kerberos_stop_watchers_def, m);
+        if (stop != NULL) {
+            result = PyObject_CallMethod(atexit, "register", "O", stop);
+            Py_DECREF(stop);
+        }
+        Py_DECREF(atexit);
     }
+    if (result == NULL) {
+        return -1;
+    }
+    Py_DECREF(result);
 
-    Py_INCREF(GssException_class);
-    PyDict_SetItemString(
-        d, "GSSError", GssException_class
-    );
+    return 0;
+}
 
-    PyDict_SetItemString(
-        d, "AUTH_GSS_COMPLETE", PyInt_FromLong(AUTH_GSS_COMPLETE)
-    );
-    PyDict_SetItemString(
-        d, "AUTH_GSS_CONTINUE", PyInt_FromLong(AUTH_GSS_CONTINUE)
-    );
+static int kerberos_traverse(PyObject *m, visitproc visit, void *arg)
+{
+    kerberos_state *state = module_state(m);
+
+    Py_VISIT(state->KrbException_class);
+    Py_VISIT(state->BasicAuthException_class);
+    Py_VISIT(state->PwdChangeException_class);
+    Py_VISIT(state->GssException_class);
+    Py_VISIT(state->GSSClientContextType);
+    Py_VISIT(state->GSSServerContextType);
+    Py_VISIT(state->GSSClientTargetType);
+    Py_VISIT(state->WorkerPoolType);
+    Py_VISIT(state->AsyncWorkerPoolType);
+    Py_VISIT(state->FutureType);
+    Py_VISIT(state->KeytabWatcherType);
+    Py_VISIT(state->AcceptorType);
+    Py_VISIT(state->ReplayCacheDaemonType);
+    Py_VISIT(state->Base64EncoderType);
+    Py_VISIT(state->Base64DecoderType);
+    Py_VISIT(state->krb5_mech_oid);
+    Py_VISIT(state->spnego_mech_oid);
+    return 0;
+}
 
-    PyDict_SetItemString(
-        d, "GSS_C_DELEG_FLAG", PyInt_FromLong(GSS_C_DELEG_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_MUTUAL_FLAG", PyInt_FromLong(GSS_C_MUTUAL_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_REPLAY_FLAG", PyInt_FromLong(GSS_C_REPLAY_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_SEQUENCE_FLAG", PyInt_FromLong(GSS_C_SEQUENCE_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_CONF_FLAG", PyInt_FromLong(GSS_C_CONF_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_INTEG_FLAG", PyInt_FromLong(GSS_C_INTEG_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_ANON_FLAG", PyInt_FromLong(GSS_C_ANON_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_PROT_READY_FLAG", PyInt_FromLong(GSS_C_PROT_READY_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_C_TRANS_FLAG", PyInt_FromLong(GSS_C_TRANS_FLAG)
-    );
-    PyDict_SetItemString(
-        d, "GSS_MECH_OID_KRB5", PyCapsule_New(&krb5_mech_oid, "kerberos.GSS_MECH_OID_KRB5", NULL)
-    );
-    PyDict_SetItemString(
-        d, "GSS_MECH_OID_SPNEGO", PyCapsule_New(&spnego_mech_oid, "kerberos.GSS_MECH_OID_SPNEGO", NULL)
-    );
+static int kerberos_clear(PyObject *m)
+{
+    kerberos_state *state = module_state(m);
+
+    stop_watchers(state);
+
+    Py_CLEAR(state->KrbException_class);
+    Py_CLEAR(state->BasicAuthException_class);
+    Py_CLEAR(state->PwdChangeException_class);
+    Py_CLEAR(state->GssException_class);
+    Py_CLEAR(state->GSSClientContextType);
+    Py_CLEAR(state->GSSServerContextType);
+    Py_CLEAR(state->GSSClientTargetType);
+    Py_CLEAR(state->WorkerPoolType);
+    Py_CLEAR(state->AsyncWorkerPoolType);
+    Py_CLEAR(state->FutureType);
+    Py_CLEAR(state->KeytabWatcherType);
+    Py_CLEAR(state->AcceptorType);
+    Py_CLEAR(state->ReplayCacheDaemonType);
+    Py_CLEAR(state->Base64EncoderType);
+    Py_CLEAR(state->Base64DecoderType);
+    Py_CLEAR(state->krb5_mech_oid);
+    Py_CLEAR(state->spnego_mech_oid);
+    return 0;
+}
 
-error:
-    if (PyErr_Occurred()) {
-         PyErr_SetString(PyExc_ImportError, "kerberos: init failed");
-        return MOD_ERROR_VAL;
-    }
+static void kerberos_free(void *m)
+{
+    kerberos_clear((PyObject *)m);
+    pthread_mutex_destroy(&module_state((PyObject *)m)->watchers_lock);
+}
+
+static PyModuleDef_Slot kerberos_slots[] = {
+    {Py_mod_exec, kerberos_exec},
+#ifdef Py_mod_multiple_interpreters
+    // Each interpreter gets its own module state, but the C layer keeps
+    // process-wide state that all of them share: the replay cache shards
+    // and the attached shared-memory table or daemon connections, the
+    // acceptor credential cache and loaded keytab, the default worker pool,
+    // the context gauges and buffer counters, and the Base64 SIMD kernels.
+    // These are guarded by their own pthread locks, atomics or pthread_once
+    // rather than a GIL, and hold no PyObjects, so each interpreter may run
+    // under its own GIL
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+    // Contexts carry their own locks and the module state is read-only
+    // after exec, so free-threaded builds need not re-enable the GIL
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
+
+static struct PyModuleDef moduledef = {
+    PyModuleDef_HEAD_INIT,
+    "kerberos",
+    NULL,
+    sizeof(kerberos_state),
+    KerberosMethods,
+    kerberos_slots,
+    kerberos_traverse,
+    kerberos_clear,
+    kerberos_free,
+};
 
-    return MOD_SUCCESS_VAL(m);
+PyMODINIT_FUNC PyInit_kerberos(void)
+{
+    return PyModuleDef_Init(&moduledef);
 }
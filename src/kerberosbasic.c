@@ -14,7 +14,6 @@
  * limitations under the License.
  **/
 
-#include <Python.h>
 #include "kerberosbasic.h"
 
 #include <stdio.h>
@@ -23,17 +22,18 @@
 
 #undef PRINTFS
 
-extern PyObject *BasicAuthException_class;
-static void set_basicauth_error(krb5_context context, krb5_error_code code);
+static void set_basicauth_error(
+    krb5_context context, krb5_error_code code, krb_error *error
+);
 
 static krb5_error_code verify_krb5_user(
     krb5_context context, krb5_principal principal, const char *password,
-    krb5_principal server
+    krb5_principal server, krb_error *error
 );
 
 int authenticate_user_krb5pwd(
     const char *user, const char *pswd, const char *service,
-    const char *default_realm
+    const char *default_realm, krb_error *error
 ) {
     krb5_context    kcontext = NULL;
     krb5_error_code code;
@@ -46,11 +46,9 @@ int authenticate_user_krb5pwd(
     code = krb5_init_context(&kcontext);
     if (code)
     {
-        PyErr_SetObject(
-            BasicAuthException_class,
-            Py_BuildValue(
-                "((s:i))", "Cannot initialize Kerberos5 context", code
-            )
+        krb_error_set_nested(
+            error, KRB_ERROR_BASIC_AUTH,
+            "Cannot initialize Kerberos5 context", code
         );
         return 0;
     }
@@ -58,14 +56,14 @@ int authenticate_user_krb5pwd(
     ret = krb5_parse_name (kcontext, service, &server);
 
     if (ret) {
-        set_basicauth_error(kcontext, ret);
+        set_basicauth_error(kcontext, ret, error);
         ret = 0;
         goto end;
     }
 
     code = krb5_unparse_name(kcontext, server, &name);
     if (code) {
-        set_basicauth_error(kcontext, code);
+        set_basicauth_error(kcontext, code, error);
         ret = 0;
         goto end;
     }
@@ -78,7 +76,7 @@ int authenticate_user_krb5pwd(
     name = (char *)malloc(256);
     if (name == NULL)
     {
-        PyErr_NoMemory();
+        krb_error_set_no_memory(error);
         ret = 0;
         goto end;
     }
@@ -91,12 +89,12 @@ int authenticate_user_krb5pwd(
 
     code = krb5_parse_name(kcontext, name, &client);
     if (code) {
-        set_basicauth_error(kcontext, code);
+        set_basicauth_error(kcontext, code, error);
         ret = 0;
         goto end;
     }
 
-    code = verify_krb5_user(kcontext, client, pswd, server);
+    code = verify_krb5_user(kcontext, client, pswd, server, error);
 
     if (code) {
         ret = 0;
@@ -129,7 +127,7 @@ end:
 /* Inspired by krb5_verify_user from Heimdal */
 static krb5_error_code verify_krb5_user(
     krb5_context context, krb5_principal principal, const char *password,
-    krb5_principal server
+    krb5_principal server, krb_error *error
 ) {
     krb5_creds creds;
     krb5_get_init_creds_opt gic_options;
@@ -152,7 +150,7 @@ static krb5_error_code verify_krb5_user(
         NULL, NULL, 0, NULL, &gic_options
     );
     if (ret) {
-        set_basicauth_error(context, ret);
+        set_basicauth_error(context, ret, error);
         goto end;
     }
 
@@ -162,10 +160,10 @@ end:
     return ret;
 }
 
-static void set_basicauth_error(krb5_context context, krb5_error_code code)
-{
-    PyErr_SetObject(
-        BasicAuthException_class,
-        Py_BuildValue("(s:i)", krb5_get_err_text(context, code), code)
+static void set_basicauth_error(
+    krb5_context context, krb5_error_code code, krb_error *error
+) {
+    krb_error_set_code(
+        error, KRB_ERROR_BASIC_AUTH, krb5_get_err_text(context, code), code
     );
 }
@@ -18,9 +18,11 @@
 #include <gssapi/gssapi_generic.h>
 #include <gssapi/gssapi_krb5.h>
 
+#include "kerberoserr.h"
+
 #define krb5_get_err_text(context,code) error_message(code)
 
 int authenticate_user_krb5pwd(
     const char *user, const char *pswd, const char *service,
-    const char *default_realm
+    const char *default_realm, krb_error *error
 );
@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberosbuf.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// A handshake holds at most four buffers (response, token and two names)
+#define CACHE_SLOTS         8
+
+// Sizes are rounded up to a power of two, no smaller than this, so that a
+// cached buffer still fits when the next token or name is a little longer
+#define MIN_BUFFER_SIZE     64
+
+typedef struct {
+    void*            buf[CACHE_SLOTS];
+    size_t           size[CACHE_SLOTS];
+    int              count;
+} buffer_cache;
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static int cache_usable = 0;
+
+static atomic_ullong allocations;
+
+static void free_cache(void *value)
+{
+    buffer_cache *cache = (buffer_cache *)value;
+    int i;
+
+    for (i = 0; i < cache->count; i++) {
+        free(cache->buf[i]);
+    }
+    free(cache);
+}
+
+static void create_cache_key(void)
+{
+    cache_usable = (pthread_key_create(&cache_key, free_cache) == 0);
+}
+
+// This thread's cache, creating it if asked to; NULL if there is none
+static buffer_cache *thread_cache(int create)
+{
+    buffer_cache *cache = NULL;
+
+    pthread_once(&cache_once, create_cache_key);
+    if (! cache_usable) {
+        return NULL;
+    }
+
+    cache = (buffer_cache *)pthread_getspecific(cache_key);
+    if (cache == NULL && create) {
+        cache = (buffer_cache *)calloc(1, sizeof(*cache));
+        if (cache == NULL) {
+            return NULL;
+        }
+        atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+        if (pthread_setspecific(cache_key, cache) != 0) {
+            free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+// Take the smallest cached buffer of at least needed bytes, if any
+static int take_cached(
+    buffer_cache *cache, size_t needed, void **buf, size_t *size
+) {
+    int best = -1;
+    int i;
+
+    for (i = 0; i < cache->count; i++) {
+        if (
+            cache->size[i] >= needed &&
+            (best < 0 || cache->size[i] < cache->size[best])
+        ) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        return 0;
+    }
+
+    *buf = cache->buf[best];
+    *size = cache->size[best];
+    cache->count--;
+    cache->buf[best] = cache->buf[cache->count];
+    cache->size[best] = cache->size[cache->count];
+    return 1;
+}
+
+void *krb_buffer_reserve(void **buf, size_t *size, size_t needed)
+{
+    buffer_cache *cache = NULL;
+    size_t rounded = MIN_BUFFER_SIZE;
+    void *grown = NULL;
+
+    if (needed <= *size) {
+        return *buf;
+    }
+
+    while (rounded < needed) {
+        rounded <<= 1;
+        if (rounded == 0) {
+            rounded = needed;
+            break;
+        }
+    }
+
+    if (*buf == NULL && (cache = thread_cache(0)) != NULL) {
+        if (take_cached(cache, needed, buf, size)) {
+            return *buf;
+        }
+    }
+
+    grown = realloc(*buf, rounded);
+    if (grown == NULL) {
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    *buf = grown;
+    *size = rounded;
+    return grown;
+}
+
+void krb_buffer_release(void **buf, size_t *size)
+{
+    buffer_cache *cache = NULL;
+
+    if (*buf == NULL) {
+        return;
+    }
+
+    if (
+        *size <= KRB_BUFFER_CACHE_MAX &&
+        (cache = thread_cache(1)) != NULL &&
+        cache->count < CACHE_SLOTS
+    ) {
+        cache->buf[cache->count] = *buf;
+        cache->size[cache->count] = *size;
+        cache->count++;
+    } else {
+        free(*buf);
+    }
+
+    *buf = NULL;
+    *size = 0;
+}
+
+unsigned long long krb_buffer_allocations(void)
+{
+    return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSBUF_H
+#define KERBEROSBUF_H
+
+#include <stddef.h>
+
+/*
+ * Growable buffers for the responses, decoded tokens and names held by a
+ * GSSAPI context. A context keeps its buffers from one step to the next,
+ * and hands them to a small per-thread cache when it is cleaned, where the
+ * next context set up on that thread picks them up. Once a thread has
+ * warmed up, a handshake on a fresh context needs no malloc of its own.
+ *
+ * *buf is NULL and *size 0 for a context that holds no buffer.
+ */
+
+// Buffers larger than this are freed rather than cached
+#define KRB_BUFFER_CACHE_MAX    65536
+
+// Make *buf at least needed bytes, returning NULL (with *buf untouched) if
+// memory is exhausted
+void *krb_buffer_reserve(void **buf, size_t *size, size_t needed);
+
+// Give *buf back to this thread's cache, or free it, and reset *buf/*size
+void krb_buffer_release(void **buf, size_t *size);
+
+// Number of malloc/realloc calls made by krb_buffer_reserve so far
+unsigned long long krb_buffer_allocations(void);
+
+#endif
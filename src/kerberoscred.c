@@ -0,0 +1,906 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberoscred.h"
+#include "kerberosgss.h"
+
+#include <gssapi/gssapi_ext.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * Entries are chained in buckets by the hash of their name, since a front
+ * for many virtual hosts may accept as hundreds of principals. Everything
+ * here is guarded by cache_lock, which is never held across a GSSAPI call.
+ */
+struct krb_acceptor {
+    krb_acceptor*    next;
+    char*            service;
+    int              type;
+    int              rcache;
+    gss_name_t       name;
+    gss_cred_id_t    creds;
+    int              refs;
+    double           expires;
+};
+
+#define CACHE_BUCKETS   256
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static krb_acceptor *cache[CACHE_BUCKETS];
+static double cache_ttl = KRB_ACCEPTOR_DEFAULT_TTL;
+static krb_acceptor_stats cache_stats;
+
+// Bumped whenever entries are dropped, so that credentials acquired before
+// then are not added to the cache afterwards
+static unsigned long cache_generation = 0;
+
+/*
+ * The loaded keytab. keytab_handle is held open for as long as the copy is
+ * current: a MEMORY: keytab is destroyed when its last handle is closed,
+ * and credentials acquired from it hold handles of their own.
+ */
+static krb5_context keytab_context = NULL;
+static krb5_keytab keytab_handle = NULL;
+static char keytab_source[KRB_KEYTAB_NAME_SIZE];
+static char keytab_memory[64];
+static int keytab_lock_pages = 0;
+// Whether mlockall() was called for the loaded keytab; guarded by cache_lock
+static int keytab_pages_locked = 0;
+static double keytab_overlap = 0;
+
+/*
+ * A key in a keytab. Keys that were in the previous copy but are gone from
+ * the keytab are carried over for the overlap, so that tickets issued
+ * under an old kvno still work after a rotation; retired is when each was
+ * first found missing.
+ */
+typedef struct {
+    char*           principal;
+    krb5_kvno       kvno;
+    krb5_enctype    enctype;
+    double          retired;
+} keytab_key;
+
+static keytab_key *keytab_retired = NULL;
+static size_t keytab_nretired = 0;
+static double keytab_expiry = 0;
+
+// Loads and unloads are serialized by load_lock, which guards the copy
+// counter and the retired keys; readers of the rest use cache_lock
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long keytab_copies = 0;
+
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+// The lock may have been held by a thread that does not exist in the child
+static void reset_after_fork(void)
+{
+    pthread_mutex_init(&cache_lock, NULL);
+    pthread_mutex_init(&load_lock, NULL);
+}
+
+static void register_fork_handler(void)
+{
+    pthread_atfork(NULL, NULL, reset_after_fork);
+}
+
+static double monotonic_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void free_acceptor(krb_acceptor *acceptor)
+{
+    OM_uint32 min_stat;
+
+    if (acceptor->creds != GSS_C_NO_CREDENTIAL) {
+        gss_release_cred(&min_stat, &acceptor->creds);
+    }
+    if (acceptor->name != GSS_C_NO_NAME) {
+        gss_release_name(&min_stat, &acceptor->name);
+    }
+    free(acceptor->service);
+    free(acceptor);
+}
+
+// Drop a reference with cache_lock held; returns the entry if it is now
+// unused and must be freed once the lock is released
+static krb_acceptor *unref_locked(krb_acceptor *acceptor)
+{
+    return (--acceptor->refs == 0) ? acceptor : NULL;
+}
+
+static krb_acceptor **bucket(const char *service)
+{
+    const unsigned char *c = (const unsigned char *)service;
+    unsigned long hash = 2166136261UL;
+
+    // FNV-1a
+    while (*c) {
+        hash = (hash ^ *c++) * 16777619UL;
+    }
+    return &cache[hash % CACHE_BUCKETS];
+}
+
+// Unlink an entry from the chain at p with cache_lock held; returns it if
+// it is now unused, chained onto unused
+static krb_acceptor *unlink_entry_locked(
+    krb_acceptor **p, krb_acceptor *unused, int expired
+) {
+    krb_acceptor *entry = *p;
+
+    *p = entry->next;
+    entry->next = NULL;
+    cache_stats.entries--;
+    if (expired) {
+        cache_stats.expirations++;
+    } else {
+        cache_stats.invalidations++;
+    }
+    if (unref_locked(entry) != NULL) {
+        entry->next = unused;
+        unused = entry;
+    }
+    return unused;
+}
+
+// Unlink the entries for service, of either type (all if NULL) with
+// cache_lock held, and return those that are now unused, chained through
+// next
+static krb_acceptor *unlink_locked(const char *service)
+{
+    krb_acceptor *unused = NULL;
+    size_t i;
+
+    for (i = 0; i < CACHE_BUCKETS; i++) {
+        krb_acceptor **p = &cache[i];
+
+        if (service != NULL && p != bucket(service)) {
+            continue;
+        }
+        while (*p != NULL) {
+            if (service == NULL || strcmp((*p)->service, service) == 0) {
+                unused = unlink_entry_locked(p, unused, 0);
+            } else {
+                p = &(*p)->next;
+            }
+        }
+    }
+    return unused;
+}
+
+static void free_unused(krb_acceptor *unused)
+{
+    while (unused != NULL) {
+        krb_acceptor *next = unused->next;
+
+        free_acceptor(unused);
+        unused = next;
+    }
+}
+
+// Import the name and acquire acceptor credentials for it, from the
+// keytab named by keytab or the default keytab if it is empty. An empty
+// name acquires credentials for any principal in the keytab.
+static krb_acceptor *acquire(
+    const char *service, int type, int rcache, const char *keytab,
+    krb_error *error
+) {
+    OM_uint32 maj_stat = GSS_S_COMPLETE;
+    OM_uint32 min_stat = 0;
+    gss_buffer_desc name_token = GSS_C_EMPTY_BUFFER;
+    gss_key_value_element_desc elements[2];
+    gss_key_value_set_desc store = {0, elements};
+    const char *rcache_name = krb_rcache_store_name(rcache);
+    krb_acceptor *acceptor = NULL;
+
+    acceptor = (krb_acceptor *)calloc(1, sizeof(*acceptor));
+    if (acceptor == NULL || (acceptor->service = strdup(service)) == NULL) {
+        free(acceptor);
+        krb_error_set_no_memory(error);
+        return NULL;
+    }
+    acceptor->type = type;
+    acceptor->rcache = rcache;
+    acceptor->name = GSS_C_NO_NAME;
+    acceptor->creds = GSS_C_NO_CREDENTIAL;
+
+    if (keytab[0] != '\0') {
+        elements[store.count].key = "keytab";
+        elements[store.count].value = keytab;
+        store.count++;
+    }
+    if (rcache_name != NULL) {
+        elements[store.count].key = "rcache";
+        elements[store.count].value = rcache_name;
+        store.count++;
+    }
+
+    if (service[0] != '\0') {
+        name_token.length = strlen(service);
+        name_token.value = (char *)service;
+        maj_stat = gss_import_name(
+            &min_stat, &name_token,
+            (type == KRB_ACCEPTOR_PRINCIPAL) ?
+                GSS_KRB5_NT_PRINCIPAL_NAME : GSS_C_NT_HOSTBASED_SERVICE,
+            &acceptor->name
+        );
+    }
+    if (! GSS_ERROR(maj_stat) && store.count != 0) {
+        maj_stat = gss_acquire_cred_from(
+            &min_stat, acceptor->name, GSS_C_INDEFINITE, GSS_C_NO_OID_SET,
+            GSS_C_ACCEPT, &store, &acceptor->creds, NULL, NULL
+        );
+    } else if (! GSS_ERROR(maj_stat)) {
+        maj_stat = gss_acquire_cred(
+            &min_stat, acceptor->name, GSS_C_INDEFINITE, GSS_C_NO_OID_SET,
+            GSS_C_ACCEPT, &acceptor->creds, NULL, NULL
+        );
+    }
+    if (GSS_ERROR(maj_stat)) {
+        set_gss_error(maj_stat, min_stat, error);
+        free_acceptor(acceptor);
+        return NULL;
+    }
+
+    acceptor->refs = 1;
+    return acceptor;
+}
+
+// Find the entry for service in its bucket with cache_lock held, dropping
+// it if it has expired
+static krb_acceptor *find_locked(
+    const char *service, int type, int rcache, double now,
+    krb_acceptor **unused
+) {
+    krb_acceptor **p = bucket(service);
+
+    while (*p != NULL) {
+        krb_acceptor *entry = *p;
+
+        if (
+            entry->type == type && entry->rcache == rcache &&
+            strcmp(entry->service, service) == 0
+        ) {
+            if (now > 0 && entry->expires <= now) {
+                *unused = unlink_entry_locked(p, *unused, 1);
+                return NULL;
+            }
+            return entry;
+        }
+        p = &entry->next;
+    }
+    return NULL;
+}
+
+int krb_acceptor_get(
+    const char *service, int type, int rcache, krb_acceptor **acceptor,
+    krb_error *error
+) {
+    krb_acceptor *entry = NULL;
+    krb_acceptor *fresh = NULL;
+    krb_acceptor *unused = NULL;
+    double now = monotonic_now();
+    double ttl;
+    char keytab[sizeof(keytab_memory)];
+    unsigned long generation;
+
+    pthread_once(&fork_once, register_fork_handler);
+
+    pthread_mutex_lock(&cache_lock);
+    entry = find_locked(service, type, rcache, now, &unused);
+    if (entry != NULL) {
+        entry->refs++;
+        cache_stats.hits++;
+    } else {
+        cache_stats.misses++;
+    }
+    memcpy(keytab, keytab_memory, sizeof(keytab));
+    generation = cache_generation;
+    pthread_mutex_unlock(&cache_lock);
+    free_unused(unused);
+
+    if (entry != NULL) {
+        *acceptor = entry;
+        return AUTH_GSS_COMPLETE;
+    }
+
+    // Acquire without the lock, so that other services are not held up
+    fresh = acquire(service, type, rcache, keytab, error);
+    if (fresh == NULL) {
+        return AUTH_GSS_ERROR;
+    }
+
+    unused = NULL;
+    pthread_mutex_lock(&cache_lock);
+    ttl = cache_ttl;
+    entry = find_locked(service, type, rcache, now, &unused);
+    if (entry != NULL) {
+        // Another thread got there first; use its entry
+        entry->refs++;
+    } else if (ttl > 0 && generation == cache_generation) {
+        krb_acceptor **p = bucket(service);
+
+        fresh->refs++;
+        fresh->expires = now + ttl;
+        fresh->next = *p;
+        *p = fresh;
+        cache_stats.entries++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    free_unused(unused);
+
+    if (entry != NULL) {
+        free_acceptor(fresh);
+        *acceptor = entry;
+    } else {
+        *acceptor = fresh;
+    }
+    return AUTH_GSS_COMPLETE;
+}
+
+void krb_acceptor_release(krb_acceptor *acceptor)
+{
+    krb_acceptor *unused = NULL;
+
+    if (acceptor == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    unused = unref_locked(acceptor);
+    pthread_mutex_unlock(&cache_lock);
+
+    if (unused != NULL) {
+        free_acceptor(unused);
+    }
+}
+
+gss_cred_id_t krb_acceptor_creds(const krb_acceptor *acceptor)
+{
+    return acceptor->creds;
+}
+
+int krb_acceptor_named(const krb_acceptor *acceptor)
+{
+    return acceptor->name != GSS_C_NO_NAME;
+}
+
+void krb_acceptor_invalidate(const char *service)
+{
+    krb_acceptor *unused = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    unused = unlink_locked(service);
+    cache_generation++;
+    pthread_mutex_unlock(&cache_lock);
+
+    free_unused(unused);
+}
+
+void krb_acceptor_set_ttl(double seconds)
+{
+    pthread_mutex_lock(&cache_lock);
+    cache_ttl = (seconds > 0) ? seconds : 0;
+    pthread_mutex_unlock(&cache_lock);
+
+    // Entries made under the old setting are not kept past the change
+    krb_acceptor_invalidate(NULL);
+}
+
+double krb_acceptor_get_ttl(void)
+{
+    double ttl;
+
+    pthread_mutex_lock(&cache_lock);
+    ttl = cache_ttl;
+    pthread_mutex_unlock(&cache_lock);
+
+    return ttl;
+}
+
+void krb_acceptor_get_stats(krb_acceptor_stats *stats)
+{
+    pthread_mutex_lock(&cache_lock);
+    *stats = cache_stats;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static void close_keytab(krb5_context kcontext, krb5_keytab kt)
+{
+    if (kt != NULL) {
+        krb5_kt_close(kcontext, kt);
+    }
+    if (kcontext != NULL) {
+        krb5_free_context(kcontext);
+    }
+}
+
+static void free_keys(keytab_key *keys, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        free(keys[i].principal);
+    }
+    free(keys);
+}
+
+static int append_key(
+    keytab_key **keys, size_t *count, size_t *size, const char *principal,
+    const krb5_keytab_entry *entry, double retired
+) {
+    keytab_key *key;
+
+    if (*count == *size) {
+        size_t grown = *size ? *size * 2 : 16;
+        keytab_key *larger = realloc(*keys, grown * sizeof(**keys));
+
+        if (larger == NULL) {
+            return 0;
+        }
+        *keys = larger;
+        *size = grown;
+    }
+    key = &(*keys)[*count];
+    key->principal = strdup(principal);
+    if (key->principal == NULL) {
+        return 0;
+    }
+    key->kvno = entry->vno;
+    key->enctype = entry->key.enctype;
+    key->retired = retired;
+    (*count)++;
+    return 1;
+}
+
+static const keytab_key *find_key(
+    const keytab_key *keys, size_t count, const char *principal,
+    const krb5_keytab_entry *entry
+) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (
+            keys[i].kvno == entry->vno &&
+            keys[i].enctype == entry->key.enctype &&
+            strcmp(keys[i].principal, principal) == 0
+        ) {
+            return &keys[i];
+        }
+    }
+    return NULL;
+}
+
+// Copy every entry of source into the MEMORY: keytab memory, and list the
+// keys copied
+static int copy_keytab(
+    const char *source, const char *memory, krb5_context *kcontext,
+    krb5_keytab *copy, char *source_name, keytab_key **keys, size_t *count,
+    krb_error *error
+) {
+    krb5_error_code code;
+    krb5_keytab kt = NULL;
+    krb5_kt_cursor cursor = NULL;
+    krb5_keytab_entry entry;
+    char *pname = NULL;
+    size_t size = 0;
+    int ret = AUTH_GSS_ERROR;
+
+    *kcontext = NULL;
+    *copy = NULL;
+    *keys = NULL;
+    *count = 0;
+
+    code = krb5_init_context(kcontext);
+    if (code) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot initialize Kerberos5 context", code
+        );
+        *kcontext = NULL;
+        return AUTH_GSS_ERROR;
+    }
+
+    if (source == NULL) {
+        code = krb5_kt_default(*kcontext, &kt);
+    } else {
+        code = krb5_kt_resolve(*kcontext, source, &kt);
+    }
+    if (code) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot resolve keytab", code
+        );
+        goto end;
+    }
+
+    // Keep the full name, so reloads read the same keytab even if the
+    // default changes in the meantime
+    code = krb5_kt_get_name(*kcontext, kt, source_name, KRB_KEYTAB_NAME_SIZE);
+    if (code) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot get keytab name", code
+        );
+        goto end;
+    }
+
+    code = krb5_kt_resolve(*kcontext, memory, copy);
+    if (code) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot create memory keytab", code
+        );
+        goto end;
+    }
+
+    if ((code = krb5_kt_start_seq_get(*kcontext, kt, &cursor))) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot get sequence cursor from keytab", code
+        );
+        goto end;
+    }
+
+    while ((code = krb5_kt_next_entry(*kcontext, kt, &entry, &cursor)) == 0) {
+        code = krb5_unparse_name(*kcontext, entry.principal, &pname);
+        if (code) {
+            krb5_free_keytab_entry_contents(*kcontext, &entry);
+            krb_error_set_nested(
+                error, KRB_ERROR_KRB,
+                "Cannot parse principal name from keytab", code
+            );
+            goto end;
+        }
+        code = krb5_kt_add_entry(*kcontext, *copy, &entry);
+        if (code) {
+            krb_error_set_nested(
+                error, KRB_ERROR_KRB, "Cannot add entry to memory keytab", code
+            );
+        } else if (! append_key(keys, count, &size, pname, &entry, 0)) {
+            krb_error_set_no_memory(error);
+            code = -1;
+        }
+        krb5_free_unparsed_name(*kcontext, pname);
+        krb5_free_keytab_entry_contents(*kcontext, &entry);
+        if (code) {
+            goto end;
+        }
+    }
+
+    if (code != KRB5_KT_END) {
+        krb_error_set_nested(error, KRB_ERROR_KRB, "Cannot read keytab", code);
+    } else if (*count == 0) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "No keys found in keytab", -1
+        );
+    } else {
+        ret = AUTH_GSS_COMPLETE;
+    }
+
+end:
+    if (cursor) {
+        krb5_kt_end_seq_get(*kcontext, kt, &cursor);
+    }
+    if (kt) {
+        krb5_kt_close(*kcontext, kt);
+    }
+    if (ret == AUTH_GSS_ERROR) {
+        close_keytab(*kcontext, *copy);
+        free_keys(*keys, *count);
+        *kcontext = NULL;
+        *copy = NULL;
+        *keys = NULL;
+        *count = 0;
+    }
+    return ret;
+}
+
+// Carry the keys of the previous copy that are no longer in the keytab
+// over to copy, unless they have been gone for longer than overlap; called
+// with load_lock held
+static int retain_keys(
+    krb5_context kcontext, krb5_keytab copy, const keytab_key *keys,
+    size_t count, double overlap, double now, keytab_key **retired,
+    size_t *nretired, krb_error *error
+) {
+    krb5_error_code code;
+    krb5_keytab previous = NULL;
+    krb5_kt_cursor cursor = NULL;
+    krb5_keytab_entry entry;
+    char *pname = NULL;
+    size_t size = 0;
+    int ret = AUTH_GSS_ERROR;
+
+    *retired = NULL;
+    *nretired = 0;
+
+    // The previous copy is kept alive by keytab_handle while we read it
+    code = krb5_kt_resolve(kcontext, keytab_memory, &previous);
+    if (code) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot resolve memory keytab", code
+        );
+        return AUTH_GSS_ERROR;
+    }
+
+    if ((code = krb5_kt_start_seq_get(kcontext, previous, &cursor))) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot get sequence cursor from keytab", code
+        );
+        goto end;
+    }
+
+    while ((code = krb5_kt_next_entry(kcontext, previous, &entry, &cursor)) == 0) {
+        const keytab_key *old;
+        double since = now;
+
+        code = krb5_unparse_name(kcontext, entry.principal, &pname);
+        if (code) {
+            krb5_free_keytab_entry_contents(kcontext, &entry);
+            krb_error_set_nested(
+                error, KRB_ERROR_KRB,
+                "Cannot parse principal name from keytab", code
+            );
+            goto end;
+        }
+        if (find_key(keys, count, pname, &entry) == NULL) {
+            old = find_key(keytab_retired, keytab_nretired, pname, &entry);
+            if (old != NULL) {
+                since = old->retired;
+            }
+            if (now - since < overlap) {
+                code = krb5_kt_add_entry(kcontext, copy, &entry);
+                if (code) {
+                    krb_error_set_nested(
+                        error, KRB_ERROR_KRB,
+                        "Cannot add entry to memory keytab", code
+                    );
+                } else if (
+                    ! append_key(retired, nretired, &size, pname, &entry, since)
+                ) {
+                    krb_error_set_no_memory(error);
+                    code = -1;
+                }
+            }
+        }
+        krb5_free_unparsed_name(kcontext, pname);
+        krb5_free_keytab_entry_contents(kcontext, &entry);
+        if (code) {
+            goto end;
+        }
+    }
+
+    if (code != KRB5_KT_END) {
+        krb_error_set_nested(error, KRB_ERROR_KRB, "Cannot read keytab", code);
+    } else {
+        ret = AUTH_GSS_COMPLETE;
+    }
+
+end:
+    if (cursor) {
+        krb5_kt_end_seq_get(kcontext, previous, &cursor);
+    }
+    krb5_kt_close(kcontext, previous);
+    if (ret == AUTH_GSS_ERROR) {
+        free_keys(*retired, *nretired);
+        *retired = NULL;
+        *nretired = 0;
+    }
+    return ret;
+}
+
+// Undo the mlockall() of a locked keytab once none is loaded with lock set.
+// Like mlockall() this applies to the whole process, so it also unlocks
+// pages locked by anything else. Called with cache_lock held.
+static void unlock_pages(void)
+{
+    if (keytab_pages_locked) {
+        munlockall();
+        keytab_pages_locked = 0;
+    }
+}
+
+// Make kcontext and kt the loaded keytab, or unload it if kt is NULL, and
+// drop the cache entries acquired from the previous one; called with
+// load_lock held
+static void swap_keytab(
+    krb5_context kcontext, krb5_keytab kt, const char *source,
+    const char *memory, int lock, double overlap, size_t entries,
+    keytab_key *retired, size_t nretired
+) {
+    krb5_context old_context;
+    krb5_keytab old_kt;
+    keytab_key *old_retired;
+    size_t old_nretired;
+    krb_acceptor *unused = NULL;
+    double expiry = 0;
+    size_t i;
+
+    for (i = 0; i < nretired; i++) {
+        double expires = retired[i].retired + overlap;
+
+        if (expiry == 0 || expires < expiry) {
+            expiry = expires;
+        }
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    old_context = keytab_context;
+    old_kt = keytab_handle;
+    old_retired = keytab_retired;
+    old_nretired = keytab_nretired;
+    keytab_context = kcontext;
+    keytab_handle = kt;
+    keytab_retired = retired;
+    keytab_nretired = nretired;
+    keytab_expiry = expiry;
+    if (kt != NULL) {
+        snprintf(keytab_source, sizeof(keytab_source), "%s", source);
+        snprintf(keytab_memory, sizeof(keytab_memory), "%s", memory);
+        keytab_lock_pages = lock;
+        keytab_overlap = overlap;
+        cache_stats.keytab_loads++;
+        cache_stats.keytab_entries = entries;
+        cache_stats.keytab_retained = nretired;
+    } else {
+        keytab_source[0] = '\0';
+        keytab_memory[0] = '\0';
+        keytab_lock_pages = 0;
+        keytab_overlap = 0;
+        cache_stats.keytab_entries = 0;
+        cache_stats.keytab_retained = 0;
+    }
+    if (lock) {
+        keytab_pages_locked = 1;
+    } else {
+        unlock_pages();
+    }
+    unused = unlink_locked(NULL);
+    cache_generation++;
+    pthread_mutex_unlock(&cache_lock);
+
+    free_unused(unused);
+    free_keys(old_retired, old_nretired);
+    close_keytab(old_context, old_kt);
+}
+
+int krb_keytab_load(
+    const char *keytab, int lock, double overlap, size_t *entries,
+    krb_error *error
+) {
+    krb5_context kcontext = NULL;
+    krb5_keytab copy = NULL;
+    keytab_key *keys = NULL;
+    keytab_key *retired = NULL;
+    size_t count = 0;
+    size_t nretired = 0;
+    char source[KRB_KEYTAB_NAME_SIZE];
+    char memory[sizeof(keytab_memory)];
+    int ret;
+
+    pthread_once(&fork_once, register_fork_handler);
+
+    pthread_mutex_lock(&load_lock);
+
+    // MEMORY: keytabs are shared by name across the process
+    snprintf(
+        memory, sizeof(memory), "MEMORY:pykerberos-%ld-%lu",
+        (long)getpid(), ++keytab_copies
+    );
+
+    ret = copy_keytab(
+        keytab, memory, &kcontext, &copy, source, &keys, &count, error
+    );
+    if (ret == AUTH_GSS_COMPLETE && overlap > 0 && keytab_handle != NULL) {
+        ret = retain_keys(
+            kcontext, copy, keys, count, overlap, monotonic_now(), &retired,
+            &nretired, error
+        );
+    }
+    free_keys(keys, count);
+
+    // The copies of the keys live in allocations private to the Kerberos
+    // library, so the only way to keep them out of swap is to lock every
+    // page the process has mapped so far
+    if (ret == AUTH_GSS_COMPLETE && lock && mlockall(MCL_CURRENT) != 0) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot lock keytab in memory", errno
+        );
+        ret = AUTH_GSS_ERROR;
+    }
+
+    if (ret == AUTH_GSS_COMPLETE) {
+        *entries = count + nretired;
+        swap_keytab(
+            kcontext, copy, source, memory, lock, overlap, *entries, retired,
+            nretired
+        );
+    } else {
+        free_keys(retired, nretired);
+        close_keytab(kcontext, copy);
+    }
+
+    pthread_mutex_unlock(&load_lock);
+    return ret;
+}
+
+int krb_keytab_reload(size_t *entries, krb_error *error)
+{
+    char source[KRB_KEYTAB_NAME_SIZE];
+    int lock;
+    double overlap;
+
+    pthread_mutex_lock(&cache_lock);
+    memcpy(source, keytab_source, sizeof(source));
+    lock = keytab_lock_pages;
+    overlap = keytab_overlap;
+    pthread_mutex_unlock(&cache_lock);
+
+    if (source[0] == '\0') {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "No keytab has been loaded"
+        );
+        return AUTH_GSS_ERROR;
+    }
+
+    return krb_keytab_load(source, lock, overlap, entries, error);
+}
+
+void krb_keytab_unload(void)
+{
+    pthread_mutex_lock(&load_lock);
+    swap_keytab(NULL, NULL, NULL, NULL, 0, 0, 0, NULL, 0);
+    pthread_mutex_unlock(&load_lock);
+}
+
+int krb_keytab_source(char *name, size_t size)
+{
+    int loaded;
+
+    pthread_mutex_lock(&cache_lock);
+    loaded = (keytab_source[0] != '\0');
+    if (loaded) {
+        snprintf(name, size, "%s", keytab_source);
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return loaded;
+}
+
+double krb_keytab_expiry(void)
+{
+    double expiry;
+
+    pthread_mutex_lock(&cache_lock);
+    expiry = keytab_expiry;
+    pthread_mutex_unlock(&cache_lock);
+
+    return expiry;
+}
+
+double krb_monotonic_now(void)
+{
+    return monotonic_now();
+}
@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSCRED_H
+#define KERBEROSCRED_H
+
+#include <gssapi/gssapi.h>
+
+#include "kerberoserr.h"
+#include "kerberosrcache.h"
+
+/*
+ * Process-wide cache of acceptor credentials, keyed by service name, so
+ * that a server context does not import the name and acquire credentials
+ * (which for a FILE keytab means opening and scanning it) on every
+ * request. GSSAPI credentials may be used by several accepts at once.
+ *
+ * Entries are reference counted. A server state holds a reference for as
+ * long as it uses the credentials, and an entry that expires or is
+ * invalidated is only released once the last state using it is cleaned,
+ * so dropping an entry never affects an accept in progress.
+ */
+
+typedef struct krb_acceptor krb_acceptor;
+
+typedef struct {
+    unsigned long long  hits;
+    unsigned long long  misses;
+    unsigned long long  expirations;
+    unsigned long long  invalidations;
+    unsigned long long  entries;
+    unsigned long long  keytab_loads;
+    unsigned long long  keytab_entries;
+    unsigned long long  keytab_retained;
+} krb_acceptor_stats;
+
+// Seconds an entry is used for before credentials are acquired afresh
+#define KRB_ACCEPTOR_DEFAULT_TTL    300.0
+
+// How the name passed to krb_acceptor_get is imported
+#define KRB_ACCEPTOR_SERVICE        0   // "service@host"
+#define KRB_ACCEPTOR_PRINCIPAL      1   // "service/host@REALM"
+
+// Take a reference to the acceptor credentials for name, with the replay
+// cache rcache (a KRB_RCACHE_ type), acquiring them on a miss; an empty
+// name is any principal in the keytab. Returns AUTH_GSS_COMPLETE or
+// AUTH_GSS_ERROR.
+int krb_acceptor_get(
+    const char *name, int type, int rcache, krb_acceptor **acceptor,
+    krb_error *error
+);
+
+void krb_acceptor_release(krb_acceptor *acceptor);
+
+gss_cred_id_t krb_acceptor_creds(const krb_acceptor *acceptor);
+
+// Whether the credentials are for a name rather than any principal
+int krb_acceptor_named(const krb_acceptor *acceptor);
+
+// Drop the entries for name, or every entry if name is NULL
+void krb_acceptor_invalidate(const char *service);
+
+// Set the time to live of new entries; 0 turns caching off
+void krb_acceptor_set_ttl(double seconds);
+
+double krb_acceptor_get_ttl(void);
+
+void krb_acceptor_get_stats(krb_acceptor_stats *stats);
+
+/*
+ * The MIT acceptor reads the keytab on disk for every AP-REQ. A keytab
+ * loaded here is copied into a MEMORY: keytab, and acceptor credentials
+ * are acquired from that copy until it is unloaded, so accepts no longer
+ * touch the file. Loading again swaps in a new copy and invalidates the
+ * cache; states that still use credentials from the old copy keep it
+ * alive until they are cleaned.
+ *
+ * With an overlap, keys of the old copy that are gone from the keytab are
+ * kept in the new one for that many seconds, so that tickets issued under
+ * the previous kvno are still accepted after the keys are rotated.
+ */
+
+// MIT allows keytab names of up to 1100 bytes
+#define KRB_KEYTAB_NAME_SIZE    1100
+
+// Load keytab (the default keytab if NULL) and pin the process's pages in
+// memory if lock is set, or unpin them if the keytab it replaces had pinned
+// them; returns AUTH_GSS_COMPLETE or AUTH_GSS_ERROR
+int krb_keytab_load(
+    const char *keytab, int lock, double overlap, size_t *entries,
+    krb_error *error
+);
+
+// Load the keytab most recently loaded again, with the same settings
+int krb_keytab_reload(size_t *entries, krb_error *error);
+
+// Go back to acquiring credentials from the keytab on disk, unpinning the
+// process's pages if the keytab had pinned them
+void krb_keytab_unload(void);
+
+// Copy the name of the loaded keytab into name; returns 0 if none is loaded
+int krb_keytab_source(char *name, size_t size);
+
+// The krb_monotonic_now() time at which the next retained key expires, or
+// 0 if none are retained
+double krb_keytab_expiry(void);
+
+double krb_monotonic_now(void);
+
+#endif
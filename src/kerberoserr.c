@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberoserr.h"
+
+#include <stdio.h>
+
+static void set_error(
+    krb_error *error, krb_error_type type, krb_error_args args,
+    const char *message, int code, const char *detail, int detail_code
+) {
+    error->type = type;
+    error->args = args;
+    error->code = code;
+    error->detail_code = detail_code;
+    snprintf(error->message, sizeof(error->message), "%s", message);
+    snprintf(error->detail, sizeof(error->detail), "%s", detail);
+}
+
+void krb_error_clear(krb_error *error)
+{
+    error->type = KRB_ERROR_NONE;
+}
+
+void krb_error_set_message(
+    krb_error *error, krb_error_type type, const char *message
+) {
+    set_error(error, type, KRB_ERROR_ARGS_MESSAGE, message, 0, "", 0);
+}
+
+void krb_error_set_code(
+    krb_error *error, krb_error_type type, const char *message, int code
+) {
+    set_error(error, type, KRB_ERROR_ARGS_MESSAGE_CODE, message, code, "", 0);
+}
+
+void krb_error_set_nested(
+    krb_error *error, krb_error_type type, const char *message, int code
+) {
+    set_error(error, type, KRB_ERROR_ARGS_NESTED, message, code, "", 0);
+}
+
+void krb_error_set_detail(
+    krb_error *error, krb_error_type type, const char *message,
+    const char *detail
+) {
+    set_error(
+        error, type, KRB_ERROR_ARGS_MESSAGE_DETAIL, message, 0, detail, 0
+    );
+}
+
+void krb_error_set_gss(
+    krb_error *error, const char *major, int major_code, const char *minor,
+    int minor_code
+) {
+    set_error(
+        error, KRB_ERROR_GSS, KRB_ERROR_ARGS_GSS, major, major_code, minor,
+        minor_code
+    );
+}
+
+void krb_error_set_no_memory(krb_error *error)
+{
+    set_error(error, KRB_ERROR_NO_MEMORY, KRB_ERROR_ARGS_MESSAGE, "", 0, "", 0);
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSERR_H
+#define KERBEROSERR_H
+
+/*
+ * Errors from the Kerberos and GSSAPI layers are recorded here rather than
+ * raised directly, since those layers know neither which module instance
+ * (and so which exception classes) they are working for nor whether they
+ * hold the GIL. The Python bindings turn a krb_error into an exception.
+ */
+
+// The Python exception to raise
+typedef enum {
+    KRB_ERROR_NONE = 0,
+    KRB_ERROR_KRB,              // kerberos.KrbError
+    KRB_ERROR_BASIC_AUTH,       // kerberos.BasicAuthError
+    KRB_ERROR_PWD_CHANGE,       // kerberos.PwdChangeError
+    KRB_ERROR_GSS,              // kerberos.GSSError
+    KRB_ERROR_NO_MEMORY,        // MemoryError
+} krb_error_type;
+
+// The shape of the exception arguments
+typedef enum {
+    KRB_ERROR_ARGS_MESSAGE,         // (message,)
+    KRB_ERROR_ARGS_MESSAGE_CODE,    // (message, code)
+    KRB_ERROR_ARGS_NESTED,          // ((message, code),)
+    KRB_ERROR_ARGS_GSS,             // ((message, code), (detail, detail_code))
+    KRB_ERROR_ARGS_MESSAGE_DETAIL,  // (message, detail)
+} krb_error_args;
+
+#define KRB_ERROR_MESSAGE_SIZE  512
+
+typedef struct {
+    krb_error_type  type;
+    krb_error_args  args;
+    int             code;
+    int             detail_code;
+    char            message[KRB_ERROR_MESSAGE_SIZE];
+    char            detail[KRB_ERROR_MESSAGE_SIZE];
+} krb_error;
+
+void krb_error_clear(krb_error *error);
+void krb_error_set_message(
+    krb_error *error, krb_error_type type, const char *message
+);
+void krb_error_set_code(
+    krb_error *error, krb_error_type type, const char *message, int code
+);
+void krb_error_set_nested(
+    krb_error *error, krb_error_type type, const char *message, int code
+);
+void krb_error_set_detail(
+    krb_error *error, krb_error_type type, const char *message,
+    const char *detail
+);
+void krb_error_set_gss(
+    krb_error *error, const char *major, int major_code, const char *minor,
+    int minor_code
+);
+void krb_error_set_no_memory(krb_error *error);
+
+#endif
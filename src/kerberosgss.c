@@ -14,28 +14,44 @@
  * limitations under the License.
  **/
 
-#include <Python.h>
 #include "kerberosgss.h"
 
 #include "base64.h"
 
+#include <gssapi/gssapi_ext.h>
+
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 
-static void set_gss_error(OM_uint32 err_maj, OM_uint32 err_min);
+static int decode_challenge(
+    const char *challenge, size_t challenge_len, unsigned char *stack_buf,
+    unsigned char **buf, size_t *size, gss_buffer_desc *token,
+    krb_error *error
+);
+static int store_response(
+    gss_buffer_desc *output_token, char **response, size_t *response_len,
+    size_t *response_size, krb_error *error
+);
+static int store_name(
+    gss_buffer_desc *name_token, char **name, size_t *name_size,
+    krb_error *error
+);
+static int store_display_name(
+    gss_name_t gss_name, char **name, size_t *name_size, krb_error *error
+);
 
 int create_krb5_ccache(
     gss_server_state *state, krb5_context kcontext, krb5_principal princ,
-    krb5_ccache *ccache
+    krb5_ccache *ccache, krb_error *error
 );
 
-extern PyObject *GssException_class;
-extern PyObject *KrbException_class;
-
-char* server_principal_details(const char* service, const char* hostname)
-{
+char* server_principal_details(
+    const char* service, const char* hostname, krb_error *error
+) {
     char match[1024];
     size_t match_len = 0;
     char* result = NULL;
@@ -53,40 +69,31 @@ char* server_principal_details(const char* service, const char* hostname)
     
     code = krb5_init_context(&kcontext);
     if (code) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue(
-                "((s:i))", "Cannot initialize Kerberos5 context", code
-            )
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot initialize Kerberos5 context", code
         );
         return NULL;
     }
     
     if ((code = krb5_kt_default(kcontext, &kt))) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue("((s:i))", "Cannot get default keytab", code)
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot get default keytab", code
         );
         goto end;
     }
     
     if ((code = krb5_kt_start_seq_get(kcontext, kt, &cursor))) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue(
-                "((s:i))", "Cannot get sequence cursor from keytab", code
-            )
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot get sequence cursor from keytab", code
         );
         goto end;
     }
     
     while ((code = krb5_kt_next_entry(kcontext, kt, &entry, &cursor)) == 0) {
         if ((code = krb5_unparse_name(kcontext, entry.principal, &pname))) {
-            PyErr_SetObject(
-                KrbException_class,
-                Py_BuildValue(
-                    "((s:i))", "Cannot parse principal name from keytab", code
-                )
+            krb_error_set_nested(
+                error, KRB_ERROR_KRB,
+                "Cannot parse principal name from keytab", code
             );
             goto end;
         }
@@ -94,7 +101,7 @@ char* server_principal_details(const char* service, const char* hostname)
         if (strncmp(pname, match, match_len) == 0) {
             result = malloc(strlen(pname) + 1);
             if (result == NULL) {
-                PyErr_NoMemory();
+                krb_error_set_no_memory(error);
                 goto end;
             }
             strcpy(result, pname);
@@ -108,9 +115,8 @@ char* server_principal_details(const char* service, const char* hostname)
     }
     
     if (result == NULL) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue("((s:i))", "Principal not found in keytab", -1)
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Principal not found in keytab", -1
         );
     }
     
@@ -128,7 +134,8 @@ end:
 
 int authenticate_gss_client_init(
     const char* service, const char* principal, long int gss_flags,
-    gss_server_state* delegatestate, gss_OID mech_oid, gss_client_state* state
+    gss_server_state* delegatestate, gss_OID mech_oid, gss_client_state* state,
+    krb_error *error
 )
 {
     OM_uint32 maj_stat;
@@ -143,7 +150,13 @@ int authenticate_gss_client_init(
     state->gss_flags = gss_flags;
     state->client_creds = GSS_C_NO_CREDENTIAL;
     state->username = NULL;
+    state->username_size = 0;
     state->response = NULL;
+    state->response_len = 0;
+    state->response_size = 0;
+    state->token = NULL;
+    state->token_size = 0;
+    state->names_pending = 0;
     
     // Import server name first
     name_token.length = strlen(service);
@@ -154,7 +167,7 @@ int authenticate_gss_client_init(
     );
     
     if (GSS_ERROR(maj_stat)) {
-        set_gss_error(maj_stat, min_stat);
+        set_gss_error(maj_stat, min_stat, error);
         ret = AUTH_GSS_ERROR;
         goto end;
     }
@@ -172,7 +185,7 @@ int authenticate_gss_client_init(
             &min_stat, &principal_token, GSS_C_NT_USER_NAME, &name
         );
         if (GSS_ERROR(maj_stat)) {
-            set_gss_error(maj_stat, min_stat);
+            set_gss_error(maj_stat, min_stat, error);
             ret = AUTH_GSS_ERROR;
     	    goto end;
         }
@@ -182,14 +195,14 @@ int authenticate_gss_client_init(
             GSS_C_INITIATE, &state->client_creds, NULL, NULL
         );
         if (GSS_ERROR(maj_stat)) {
-            set_gss_error(maj_stat, min_stat);
+            set_gss_error(maj_stat, min_stat, error);
             ret = AUTH_GSS_ERROR;
             goto end;
         }
 
         maj_stat = gss_release_name(&min_stat, &name);
         if (GSS_ERROR(maj_stat)) {
-            set_gss_error(maj_stat, min_stat);
+            set_gss_error(maj_stat, min_stat, error);
             ret = AUTH_GSS_ERROR;
             goto end;
         }
@@ -199,17 +212,48 @@ end:
     return ret;
 }
 
+void authenticate_gss_client_init_exchange(
+    const gss_client_state *target, gss_client_state *state
+) {
+    state->server_name = target->server_name;
+    state->mech_oid = target->mech_oid;
+    state->context = GSS_C_NO_CONTEXT;
+    state->gss_flags = target->gss_flags;
+    state->client_creds = target->client_creds;
+    state->username = NULL;
+    state->username_size = 0;
+    state->response = NULL;
+    state->response_len = 0;
+    state->response_size = 0;
+    state->token = NULL;
+    state->token_size = 0;
+    state->responseConf = 0;
+    state->names_pending = 0;
+}
+
+int authenticate_gss_client_clean_exchange(gss_client_state *state)
+{
+    OM_uint32 min_stat;
+    
+    if (state->context != GSS_C_NO_CONTEXT) {
+        gss_delete_sec_context(&min_stat, &state->context, GSS_C_NO_BUFFER);
+    }
+    krb_buffer_release((void **)&state->username, &state->username_size);
+    state->names_pending = 0;
+    krb_buffer_release((void **)&state->response, &state->response_size);
+    state->response_len = 0;
+    krb_buffer_release((void **)&state->token, &state->token_size);
+    
+    return AUTH_GSS_COMPLETE;
+}
+
 int authenticate_gss_client_clean(gss_client_state *state)
 {
     OM_uint32 maj_stat;
     OM_uint32 min_stat;
     int ret = AUTH_GSS_COMPLETE;
     
-    if (state->context != GSS_C_NO_CONTEXT) {
-        maj_stat = gss_delete_sec_context(
-            &min_stat, &state->context, GSS_C_NO_BUFFER
-        );
-    }
+    authenticate_gss_client_clean_exchange(state);
     if (state->server_name != GSS_C_NO_NAME) {
         maj_stat = gss_release_name(&min_stat, &state->server_name);
     }
@@ -219,48 +263,68 @@ int authenticate_gss_client_clean(gss_client_state *state)
     ) {
         maj_stat = gss_release_cred(&min_stat, &state->client_creds);
     }
-    if (state->username != NULL) {
-        free(state->username);
-        state->username = NULL;
-    }
-    if (state->response != NULL) {
-        free(state->response);
-        state->response = NULL;
-    }
     
     return ret;
 }
 
 int authenticate_gss_client_step(
-    gss_client_state* state, const char* challenge
+    gss_client_state* state, const char* challenge, size_t challenge_len,
+    krb_error *error
 ) {
-    OM_uint32 maj_stat;
     OM_uint32 min_stat;
-    gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
     gss_buffer_desc output_token = GSS_C_EMPTY_BUFFER;
+    unsigned char stack_token[GSS_TOKEN_STACK_SIZE];
+    gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
     int ret = AUTH_GSS_CONTINUE;
     
-    // Always clear out the old response
-    if (state->response != NULL) {
-        free(state->response);
-        state->response = NULL;
+    // If there is a challenge (data from the server) we need to give it to GSS
+    if (challenge_len) {
+        ret = decode_challenge(
+            challenge, challenge_len, stack_token, &state->token,
+            &state->token_size, &input_token, error
+        );
+        if (ret == AUTH_GSS_ERROR) {
+            state->response_len = 0;
+            return ret;
+        }
     }
     
-    // If there is a challenge (data from the server) we need to give it to GSS
-    if (challenge && *challenge) {
-        size_t len;
-        input_token.value = base64_decode(challenge, &len);
-        if (input_token.value == NULL)
-        {
-            PyErr_NoMemory();
+    ret = authenticate_gss_client_step_raw(
+        state, input_token.value, input_token.length, &output_token, error
+    );
+    
+    // Grab the client response to send back to the server
+    if (ret != AUTH_GSS_ERROR && output_token.length) {
+        if (store_response(
+            &output_token, &state->response, &state->response_len,
+            &state->response_size, error
+        ) == AUTH_GSS_ERROR) {
             ret = AUTH_GSS_ERROR;
-            goto end;
         }
-        input_token.length = len;
     }
     
+    if (output_token.value) {
+        gss_release_buffer(&min_stat, &output_token);
+    }
+    return ret;
+}
+
+int authenticate_gss_client_step_raw(
+    gss_client_state* state, const void* input, size_t input_len,
+    gss_buffer_desc* output_token, krb_error *error
+) {
+    OM_uint32 maj_stat;
+    OM_uint32 min_stat;
+    gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
+    int ret = AUTH_GSS_CONTINUE;
+    
+    // Always clear out the old response
+    state->response_len = 0;
+    
+    input_token.value = (void *)input;
+    input_token.length = input_len;
+    
     // Do GSSAPI step
-    Py_BEGIN_ALLOW_THREADS
     maj_stat = gss_init_sec_context(
         &min_stat,
         state->client_creds,
@@ -272,201 +336,199 @@ int authenticate_gss_client_step(
         GSS_C_NO_CHANNEL_BINDINGS,
         &input_token,
         NULL,
-        &output_token,
+        output_token,
         NULL,
         NULL
     );
-    Py_END_ALLOW_THREADS
     
     if ((maj_stat != GSS_S_COMPLETE) && (maj_stat != GSS_S_CONTINUE_NEEDED)) {
-        set_gss_error(maj_stat, min_stat);
+        set_gss_error(maj_stat, min_stat, error);
         ret = AUTH_GSS_ERROR;
         goto end;
     }
     
     ret = (maj_stat == GSS_S_COMPLETE) ? AUTH_GSS_COMPLETE : AUTH_GSS_CONTINUE;
-    // Grab the client response to send back to the server
-    if (output_token.length) {
-        state->response = base64_encode((const unsigned char *)output_token.value, output_token.length);
-        if (state->response == NULL) {
-            PyErr_NoMemory();
-            ret = AUTH_GSS_ERROR;
-            goto end;
-        }
-        maj_stat = gss_release_buffer(&min_stat, &output_token);
-    }
     
-    // Try to get the user name if we have completed all GSS operations
+    // The user name is only looked up if it is asked for
     if (ret == AUTH_GSS_COMPLETE) {
-        gss_name_t gssuser = GSS_C_NO_NAME;
-        maj_stat = gss_inquire_context(&min_stat, state->context, &gssuser, NULL, NULL, NULL,  NULL, NULL, NULL);
-        if (GSS_ERROR(maj_stat)) {
-            set_gss_error(maj_stat, min_stat);
-            ret = AUTH_GSS_ERROR;
-            goto end;
-        }
-        
-        gss_buffer_desc name_token;
-        name_token.length = 0;
-        maj_stat = gss_display_name(&min_stat, gssuser, &name_token, NULL);
-        if (GSS_ERROR(maj_stat)) {
-            if (name_token.value) {
-                gss_release_buffer(&min_stat, &name_token);
-            }
-            gss_release_name(&min_stat, &gssuser);
-            
-            set_gss_error(maj_stat, min_stat);
-            ret = AUTH_GSS_ERROR;
-            goto end;
-        } else {
-            if (state->username != NULL) {                                                                                                    
-                free(state->username);                                                                                                        
-                state->username = NULL;                                                                                                       
-            }                                                                                                                                 
-            state->username = (char *)malloc(name_token.length + 1);
-            if (state->username == NULL) {
-                PyErr_NoMemory();
-                ret = AUTH_GSS_ERROR;
-                goto end;
-            }
-            strncpy(state->username, (char*) name_token.value, name_token.length);
-            state->username[name_token.length] = 0;
-            gss_release_buffer(&min_stat, &name_token);
-            gss_release_name(&min_stat, &gssuser);
-        }
+        state->names_pending = GSS_NAME_USER;
     }
 
 end:
-    if (output_token.value) {
-        gss_release_buffer(&min_stat, &output_token);
-    }
-    if (input_token.value) {
-        free(input_token.value);
+    if (ret == AUTH_GSS_ERROR && output_token->value) {
+        gss_release_buffer(&min_stat, output_token);
     }
     return ret;
 }
 
 int authenticate_gss_client_unwrap(
-    gss_client_state *state, const char *challenge
+    gss_client_state *state, const char *challenge, size_t challenge_len,
+    krb_error *error
 ) {
-	OM_uint32 maj_stat;
 	OM_uint32 min_stat;
 	gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
 	gss_buffer_desc output_token = GSS_C_EMPTY_BUFFER;
+	unsigned char stack_token[GSS_TOKEN_STACK_SIZE];
 	int ret = AUTH_GSS_CONTINUE;
-	int conf = 0;
     
-	// Always clear out the old response
-	if (state->response != NULL) {
-		free(state->response);
-		state->response = NULL;
-		state->responseConf = 0;
+	// If there is a challenge (data from the server) we need to give it to GSS
+	if (challenge_len) {
+		ret = decode_challenge(
+            challenge, challenge_len, stack_token, &state->token,
+            &state->token_size, &input_token, error
+        );
+		if (ret == AUTH_GSS_ERROR) {
+		    state->response_len = 0;
+		    state->responseConf = 0;
+		    return ret;
+		}
 	}
     
-	// If there is a challenge (data from the server) we need to give it to GSS
-	if (challenge && *challenge) {
-		size_t len;
-		input_token.value = base64_decode(challenge, &len);
-		if (input_token.value == NULL) {
-		    PyErr_NoMemory();
+	ret = authenticate_gss_client_unwrap_raw(
+        state, input_token.value, input_token.length, &output_token, error
+    );
+    
+	// Grab the client response
+	if (ret != AUTH_GSS_ERROR && output_token.length) {
+		if (store_response(
+            &output_token, &state->response, &state->response_len,
+            &state->response_size, error
+        ) == AUTH_GSS_ERROR) {
 		    ret = AUTH_GSS_ERROR;
-		    goto end;
 		}
-		input_token.length = len;
 	}
     
+	if (output_token.value) {
+		gss_release_buffer(&min_stat, &output_token);
+    }
+	return ret;
+}
+
+int authenticate_gss_client_unwrap_raw(
+    gss_client_state *state, const void *input, size_t input_len,
+    gss_buffer_desc *output_token, krb_error *error
+) {
+	OM_uint32 maj_stat;
+	OM_uint32 min_stat;
+	gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
+	int conf = 0;
+    
+	// Always clear out the old response
+	state->response_len = 0;
+	state->responseConf = 0;
+    
+	input_token.value = (void *)input;
+	input_token.length = input_len;
+    
 	// Do GSSAPI step
 	maj_stat = gss_unwrap(
         &min_stat,
         state->context,
         &input_token,
-        &output_token,
+        output_token,
         &conf,
         NULL
     );
     
 	if (maj_stat != GSS_S_COMPLETE)	{
-		set_gss_error(maj_stat, min_stat);
-		ret = AUTH_GSS_ERROR;
-		goto end;
-	} else {
-		ret = AUTH_GSS_COMPLETE;
-    }
+		set_gss_error(maj_stat, min_stat, error);
+		if (output_token->value) {
+			gss_release_buffer(&min_stat, output_token);
+		}
+		return AUTH_GSS_ERROR;
+	}
     
-	// Grab the client response
-	if (output_token.length) {
-		state->response = base64_encode(
-            (const unsigned char *)output_token.value, output_token.length
+	if (output_token->length) {
+		state->responseConf = conf;
+	}
+	return AUTH_GSS_COMPLETE;
+}
+
+int authenticate_gss_client_wrap(
+    gss_client_state* state, const char* challenge, size_t challenge_len,
+    const char* user, int protect, krb_error *error
+) {
+	OM_uint32 min_stat;
+	gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
+	gss_buffer_desc output_token = GSS_C_EMPTY_BUFFER;
+	unsigned char stack_token[GSS_TOKEN_STACK_SIZE];
+	int ret = AUTH_GSS_CONTINUE;
+    
+	if (challenge_len) {
+		ret = decode_challenge(
+            challenge, challenge_len, stack_token, &state->token,
+            &state->token_size, &input_token, error
         );
-		if (state->response == NULL)
-		{
-		    PyErr_NoMemory();
+		if (ret == AUTH_GSS_ERROR) {
+		    state->response_len = 0;
+		    return ret;
+		}
+	}
+    
+	ret = authenticate_gss_client_wrap_raw(
+        state, input_token.value, input_token.length, user, protect,
+        &output_token, error
+    );
+    
+	// Grab the client response to send back to the server
+	if (ret != AUTH_GSS_ERROR && output_token.length) {
+		if (store_response(
+            &output_token, &state->response, &state->response_len,
+            &state->response_size, error
+        ) == AUTH_GSS_ERROR) {
 		    ret = AUTH_GSS_ERROR;
-		    goto end;
 		}
-		state->responseConf = conf;
-		maj_stat = gss_release_buffer(&min_stat, &output_token);
 	}
-
-end:
+    
 	if (output_token.value) {
 		gss_release_buffer(&min_stat, &output_token);
-    }
-	if (input_token.value) {
-		free(input_token.value);
     }
 	return ret;
 }
 
-int authenticate_gss_client_wrap(
-    gss_client_state* state, const char* challenge, const char* user,
-    int protect
+int authenticate_gss_client_wrap_raw(
+    gss_client_state* state, const void* input, size_t input_len,
+    const char* user, int protect, gss_buffer_desc* output_token,
+    krb_error *error
 ) {
 	OM_uint32 maj_stat;
 	OM_uint32 min_stat;
 	gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
-	gss_buffer_desc output_token = GSS_C_EMPTY_BUFFER;
-	int ret = AUTH_GSS_CONTINUE;
-	char buf[4096], server_conf_flags;
-	unsigned long buf_size;
+	char buf[4096];
     
 	// Always clear out the old response
-	if (state->response != NULL) {
-		free(state->response);
-		state->response = NULL;
-	}
+	state->response_len = 0;
     
-	if (challenge && *challenge) {
-		size_t len;
-		input_token.value = base64_decode(challenge, &len);
-		if (input_token.value == NULL)
-		{
-		    PyErr_NoMemory();
-		    ret = AUTH_GSS_ERROR;
-		    goto end;
-		}
-		input_token.length = len;
-	}
+	input_token.value = (void *)input;
+	input_token.length = input_len;
     
 	if (user) {
-		// get bufsize
-		server_conf_flags = ((char*) input_token.value)[0];
-		((char*) input_token.value)[0] = 0;
-		buf_size = ntohl(*((long *) input_token.value));
-		free(input_token.value);
+		if (input_len < 4) {
+			krb_error_set_message(
+			    error, KRB_ERROR_KRB, "Security layer challenge too short"
+			);
+			return AUTH_GSS_ERROR;
+		}
 #ifdef PRINTFS
-		printf(
-            "User: %s, %c%c%c\n", user,
-            server_conf_flags & GSS_AUTH_P_NONE      ? 'N' : '-',
-            server_conf_flags & GSS_AUTH_P_INTEGRITY ? 'I' : '-',
-            server_conf_flags & GSS_AUTH_P_PRIVACY   ? 'P' : '-'
-        );
-		printf("Maximum GSS token size is %ld\n", buf_size);
+		{
+			const unsigned char *flags = (const unsigned char *)input;
+			unsigned long buf_size;
+
+			buf_size = ((unsigned long)flags[1] << 16) |
+			    ((unsigned long)flags[2] << 8) | flags[3];
+			printf(
+			    "User: %s, %c%c%c\n", user,
+			    flags[0] & GSS_AUTH_P_NONE      ? 'N' : '-',
+			    flags[0] & GSS_AUTH_P_INTEGRITY ? 'I' : '-',
+			    flags[0] & GSS_AUTH_P_PRIVACY   ? 'P' : '-'
+			);
+			printf("Maximum GSS token size is %ld\n", buf_size);
+		}
 #endif
         
-		// agree to terms (hack!)
-		buf_size = htonl(buf_size); // not relevant without integrity/privacy
-		memcpy(buf, &buf_size, 4);
+		// agree to terms (hack!): echo the server's maximum buffer size,
+		// which is not relevant without integrity/privacy
+		memcpy(buf, input, 4);
 		buf[0] = GSS_AUTH_P_NONE;
 		// server decides if principal can log in as user
 		strncpy(buf + 4, user, sizeof(buf) - 4);
@@ -482,36 +544,22 @@ int authenticate_gss_client_wrap(
         GSS_C_QOP_DEFAULT,
         &input_token,
         NULL,
-        &output_token
+        output_token
     );
     
 	if (maj_stat != GSS_S_COMPLETE)	{
-		set_gss_error(maj_stat, min_stat);
-		ret = AUTH_GSS_ERROR;
-		goto end;
-	} else {
-		ret = AUTH_GSS_COMPLETE;
-    }
-	// Grab the client response to send back to the server
-	if (output_token.length) {
-		state->response = base64_encode((const unsigned char *)output_token.value, output_token.length);
-		if (state->response == NULL) {
-		    PyErr_NoMemory();
-		    ret = AUTH_GSS_ERROR;
-		    goto end;
+		set_gss_error(maj_stat, min_stat, error);
+		if (output_token->value) {
+			gss_release_buffer(&min_stat, output_token);
 		}
-		maj_stat = gss_release_buffer(&min_stat, &output_token);
+		return AUTH_GSS_ERROR;
 	}
-
-end:
-	if (output_token.value) {
-		gss_release_buffer(&min_stat, &output_token);
-    }
-	return ret;
+	return AUTH_GSS_COMPLETE;
 }
 
-int authenticate_gss_client_inquire_cred(gss_client_state* state)
-{
+int authenticate_gss_client_inquire_cred(
+    gss_client_state* state, krb_error *error
+) {
     OM_uint32 maj_stat;
     OM_uint32 min_stat;
     gss_cred_id_t client_creds = GSS_C_NO_CREDENTIAL;
@@ -519,6 +567,16 @@ int authenticate_gss_client_inquire_cred(gss_client_state* state)
     gss_name_t name = GSS_C_NO_NAME;
     int ret = AUTH_GSS_COMPLETE;
 
+    // The name of an established context comes first
+    if (state->names_pending & GSS_NAME_USER) {
+        const char *username = NULL;
+
+        ret = authenticate_gss_client_username(state, &username, error);
+        if (ret == AUTH_GSS_ERROR) {
+            goto end;
+        }
+    }
+
     // Check whether credentials have already been obtained.
     if (state->username != NULL) {
         goto end;
@@ -531,7 +589,7 @@ int authenticate_gss_client_inquire_cred(gss_client_state* state)
     );
 
     if (GSS_ERROR(maj_stat)) {
-        set_gss_error(maj_stat, min_stat);
+        set_gss_error(maj_stat, min_stat, error);
         ret = AUTH_GSS_ERROR;
         goto end;
     }
@@ -542,7 +600,7 @@ int authenticate_gss_client_inquire_cred(gss_client_state* state)
     );
 
     if (GSS_ERROR(maj_stat)) {
-        set_gss_error(maj_stat, min_stat);
+        set_gss_error(maj_stat, min_stat, error);
         ret = AUTH_GSS_ERROR;
         goto end;
     }
@@ -550,19 +608,14 @@ int authenticate_gss_client_inquire_cred(gss_client_state* state)
     maj_stat = gss_display_name(&min_stat, name, &name_token, NULL);
 
     if (GSS_ERROR(maj_stat)) {
-        set_gss_error(maj_stat, min_stat);
+        set_gss_error(maj_stat, min_stat, error);
         ret = AUTH_GSS_ERROR;
         goto end;
     }
 
-    state->username = (char *)malloc(name_token.length + 1);
-    if (state->username == NULL) {
-        PyErr_NoMemory();
-        ret = AUTH_GSS_ERROR;
-        goto end;
-    }
-    strncpy(state->username, (char*) name_token.value, name_token.length);
-    state->username[name_token.length] = 0;
+    ret = store_name(
+        &name_token, &state->username, &state->username_size, error
+    );
 
 end:
     if (client_creds != GSS_C_NO_CREDENTIAL) {
@@ -577,11 +630,51 @@ end:
     return ret;
 }
 
-int authenticate_gss_server_init(const char *service, gss_server_state *state)
-{
+int authenticate_gss_client_username(
+    gss_client_state* state, const char** name, krb_error *error
+) {
+    OM_uint32 maj_stat;
+    OM_uint32 min_stat;
+    gss_name_t gssuser = GSS_C_NO_NAME;
+    int ret = AUTH_GSS_COMPLETE;
+
+    if (state->names_pending & GSS_NAME_USER) {
+        maj_stat = gss_inquire_context(
+            &min_stat, state->context, &gssuser, NULL, NULL, NULL, NULL,
+            NULL, NULL
+        );
+        if (GSS_ERROR(maj_stat)) {
+            set_gss_error(maj_stat, min_stat, error);
+            return AUTH_GSS_ERROR;
+        }
+        ret = store_display_name(
+            gssuser, &state->username, &state->username_size, error
+        );
+        gss_release_name(&min_stat, &gssuser);
+        if (ret == AUTH_GSS_ERROR) {
+            return ret;
+        }
+        state->names_pending &= ~GSS_NAME_USER;
+    }
+
+    *name = state->username;
+    return ret;
+}
+
+int authenticate_gss_server_init(
+    const char *service, gss_server_state *state, krb_error *error
+) {
+    return authenticate_gss_server_init_rcache(
+        service, KRB_RCACHE_DEFAULT, state, error
+    );
+}
+
+int authenticate_gss_server_init_rcache(
+    const char *service, int rcache, gss_server_state *state,
+    krb_error *error
+) {
     OM_uint32 maj_stat;
     OM_uint32 min_stat;
-    gss_buffer_desc name_token = GSS_C_EMPTY_BUFFER;
     int ret = AUTH_GSS_COMPLETE;
     
     state->context = GSS_C_NO_CONTEXT;
@@ -590,44 +683,61 @@ int authenticate_gss_server_init(const char *service, gss_server_state *state)
     state->server_creds = GSS_C_NO_CREDENTIAL;
     state->client_creds = GSS_C_NO_CREDENTIAL;
     state->username = NULL;
+    state->username_size = 0;
     state->targetname = NULL;
+    state->targetname_size = 0;
     state->response = NULL;
+    state->response_len = 0;
+    state->response_size = 0;
+    state->token = NULL;
+    state->token_size = 0;
     state->ccname = NULL;
-    int cred_usage = GSS_C_ACCEPT;
+    state->acceptor = NULL;
+    state->rcache = rcache;
+    state->replay_checked = 0;
+    state->names_pending = 0;
     
-    // Server name may be empty which means we aren't going to create our own creds
+    // Server name may be empty which means we aren't going to create our
+    // own creds, unless they are needed to choose the replay cache
     size_t service_len = strlen(service);
-    if (service_len != 0) {
-        // Import server name first
+    if (service_len != 0 || rcache != KRB_RCACHE_DEFAULT) {
         if (strcmp(service, "DELEGATE") == 0) {
-	    cred_usage = GSS_C_BOTH;
+            // Default credentials, which can also initiate for delegation
+            const char *rcache_name = krb_rcache_store_name(rcache);
+
+            if (rcache_name != NULL) {
+                gss_key_value_element_desc element = {"rcache", rcache_name};
+                gss_key_value_set_desc store = {1, &element};
+
+                maj_stat = gss_acquire_cred_from(
+                    &min_stat, GSS_C_NO_NAME, GSS_C_INDEFINITE,
+                    GSS_C_NO_OID_SET, GSS_C_BOTH, &store,
+                    &state->server_creds, NULL, NULL
+                );
+            } else {
+                maj_stat = gss_acquire_cred(
+                    &min_stat, GSS_C_NO_NAME, GSS_C_INDEFINITE,
+                    GSS_C_NO_OID_SET, GSS_C_BOTH, &state->server_creds, NULL,
+                    NULL
+                );
+            }
+
+            if (GSS_ERROR(maj_stat)) {
+                set_gss_error(maj_stat, min_stat, error);
+                ret = AUTH_GSS_ERROR;
+                goto end;
+            }
         }
         else {
-            name_token.length = strlen(service);
-            name_token.value = (char *)service;
-        
-            maj_stat = gss_import_name(
-                &min_stat, &name_token, GSS_C_NT_HOSTBASED_SERVICE,
-                &state->server_name
+            // Acceptor credentials are shared through the process-wide
+            // cache; server_creds borrows the handle the cache entry owns
+            ret = krb_acceptor_get(
+                service, KRB_ACCEPTOR_SERVICE, rcache, &state->acceptor, error
             );
-        
-            if (GSS_ERROR(maj_stat)) {
-                set_gss_error(maj_stat, min_stat);
-                ret = AUTH_GSS_ERROR;
+            if (ret == AUTH_GSS_ERROR) {
                 goto end;
             }
-	}
-
-        // Get credentials
-        maj_stat = gss_acquire_cred(
-            &min_stat, state->server_name, GSS_C_INDEFINITE, GSS_C_NO_OID_SET,
-            cred_usage, &state->server_creds, NULL, NULL
-        );
-
-        if (GSS_ERROR(maj_stat)) {
-            set_gss_error(maj_stat, min_stat);
-            ret = AUTH_GSS_ERROR;
-            goto end;
+            state->server_creds = krb_acceptor_creds(state->acceptor);
         }
     }
     
@@ -652,24 +762,25 @@ int authenticate_gss_server_clean(gss_server_state *state)
     if (state->client_name != GSS_C_NO_NAME) {
         maj_stat = gss_release_name(&min_stat, &state->client_name);
     }
+    if (state->acceptor != NULL) {
+        krb_acceptor_release(state->acceptor);
+        state->acceptor = NULL;
+        state->server_creds = GSS_C_NO_CREDENTIAL;
+    }
     if (state->server_creds != GSS_C_NO_CREDENTIAL) {
         maj_stat = gss_release_cred(&min_stat, &state->server_creds);
     }
     if (state->client_creds != GSS_C_NO_CREDENTIAL) {
         maj_stat = gss_release_cred(&min_stat, &state->client_creds);
     }
-    if (state->username != NULL) {
-        free(state->username);
-        state->username = NULL;
-    }
-    if (state->targetname != NULL) {
-        free(state->targetname);
-        state->targetname = NULL;
-    }
-    if (state->response != NULL) {
-        free(state->response);
-        state->response = NULL;
-    }
+    krb_buffer_release((void **)&state->username, &state->username_size);
+    krb_buffer_release(
+        (void **)&state->targetname, &state->targetname_size
+    );
+    state->names_pending = 0;
+    krb_buffer_release((void **)&state->response, &state->response_size);
+    state->response_len = 0;
+    krb_buffer_release((void **)&state->token, &state->token_size);
     if (state->ccname != NULL) {
         free(state->ccname);
         state->ccname = NULL;
@@ -679,40 +790,115 @@ int authenticate_gss_server_clean(gss_server_state *state)
 }
 
 int authenticate_gss_server_step(
-    gss_server_state *state, const char *challenge
+    gss_server_state *state, const char *challenge, size_t challenge_len,
+    krb_error *error
+) {
+    return authenticate_gss_server_step_routed(
+        state, challenge, challenge_len, NULL, NULL, error
+    );
+}
+
+int authenticate_gss_server_step_routed(
+    gss_server_state *state, const char *challenge, size_t challenge_len,
+    gss_server_route route, void *arg, krb_error *error
 ) {
-    OM_uint32 maj_stat;
     OM_uint32 min_stat;
     gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
     gss_buffer_desc output_token = GSS_C_EMPTY_BUFFER;
+    unsigned char stack_token[GSS_TOKEN_STACK_SIZE];
     int ret = AUTH_GSS_CONTINUE;
     
-    // Always clear out the old response
-    if (state->response != NULL) {
-        free(state->response);
-        state->response = NULL;
+    // If there is a challenge (data from the server) we need to give it to GSS
+    if (challenge_len) {
+        ret = decode_challenge(
+            challenge, challenge_len, stack_token, &state->token,
+            &state->token_size, &input_token, error
+        );
+        if (ret == AUTH_GSS_ERROR) {
+            state->response_len = 0;
+            return ret;
+        }
     }
     
-    // If there is a challenge (data from the server) we need to give it to GSS
-    if (challenge && *challenge) {
-        size_t len;
-        input_token.value = base64_decode(challenge, &len);
-        if (input_token.value == NULL)
-        {
-            PyErr_NoMemory();
+    if (route != NULL && state->context == GSS_C_NO_CONTEXT) {
+        const char *target = NULL;
+        gss_buffer_desc target_token;
+
+        if (state->acceptor != NULL) {
+            krb_acceptor_release(state->acceptor);
+            state->acceptor = NULL;
+            state->server_creds = GSS_C_NO_CREDENTIAL;
+        }
+        target = route(
+            arg, input_token.value, input_token.length, &state->acceptor,
+            error
+        );
+        if (target == NULL) {
+            state->response_len = 0;
+            return AUTH_GSS_ERROR;
+        }
+        state->server_creds = krb_acceptor_creds(state->acceptor);
+
+        target_token.value = (void *)target;
+        target_token.length = strlen(target);
+        if (store_name(
+            &target_token, &state->targetname, &state->targetname_size, error
+        ) == AUTH_GSS_ERROR) {
+            state->response_len = 0;
+            return AUTH_GSS_ERROR;
+        }
+    }
+    
+    ret = authenticate_gss_server_step_raw(
+        state, input_token.value, input_token.length, &output_token, error
+    );
+    
+    // Grab the server response to send back to the client
+    if (ret != AUTH_GSS_ERROR && output_token.length) {
+        if (store_response(
+            &output_token, &state->response, &state->response_len,
+            &state->response_size, error
+        ) == AUTH_GSS_ERROR) {
             ret = AUTH_GSS_ERROR;
-            goto end;
         }
-        input_token.length = len;
-    } else {
-        PyErr_SetString(
-            KrbException_class, "No challenge parameter in request from client"
+    }
+    
+    if (output_token.value) {
+        gss_release_buffer(&min_stat, &output_token);
+    }
+    return ret;
+}
+
+int authenticate_gss_server_step_raw(
+    gss_server_state *state, const void *input, size_t input_len,
+    gss_buffer_desc *response_token, krb_error *error
+) {
+    OM_uint32 maj_stat;
+    OM_uint32 min_stat;
+    gss_buffer_desc input_token = GSS_C_EMPTY_BUFFER;
+    krb_rcache_tag tag;
+    int tagged = 0;
+    int ret = AUTH_GSS_CONTINUE;
+    
+    // Always clear out the old response
+    state->response_len = 0;
+    
+    if (input_len == 0) {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB,
+            "No challenge parameter in request from client"
         );
-        ret = AUTH_GSS_ERROR;
-        goto end;
+        return AUTH_GSS_ERROR;
+    }
+    input_token.value = (void *)input;
+    input_token.length = input_len;
+    
+    // GSSAPI accepts these with no replay cache; find the authenticator
+    // now, and record it once the token has been verified
+    if (krb_rcache_checked_here(state->rcache) && ! state->replay_checked) {
+        tagged = krb_rcache_tag_token(input, input_len, &tag);
     }
     
-    Py_BEGIN_ALLOW_THREADS
     maj_stat = gss_accept_sec_context(
         &min_stat,
         &state->context,
@@ -721,95 +907,124 @@ int authenticate_gss_server_step(
         GSS_C_NO_CHANNEL_BINDINGS,
         &state->client_name,
         NULL,
-        &output_token,
+        response_token,
         NULL,
         NULL,
         &state->client_creds
     );
-    Py_END_ALLOW_THREADS
     
     if (GSS_ERROR(maj_stat)) {
-        set_gss_error(maj_stat, min_stat);
+        set_gss_error(maj_stat, min_stat, error);
         ret = AUTH_GSS_ERROR;
         goto end;
     }
     
-    // Grab the server response to send back to the client
-    if (output_token.length) {
-        state->response = base64_encode(
-            (const unsigned char *)output_token.value, output_token.length
-        );
-        if (state->response == NULL)
-        {
-            PyErr_NoMemory();
+    if (tagged) {
+        if (krb_rcache_check(state->rcache, &tag, error) == AUTH_GSS_ERROR) {
+            gss_delete_sec_context(
+                &min_stat, &state->context, GSS_C_NO_BUFFER
+            );
             ret = AUTH_GSS_ERROR;
             goto end;
         }
-        maj_stat = gss_release_buffer(&min_stat, &output_token);
+        state->replay_checked = 1;
     }
     
-    // Get the user name
-    maj_stat = gss_display_name(
-        &min_stat, state->client_name, &output_token, NULL
-    );
-    if (GSS_ERROR(maj_stat)) {
-        set_gss_error(maj_stat, min_stat);
-        ret = AUTH_GSS_ERROR;
+    // Multi-leg mechanisms (SPNEGO) need another token from the client
+    // before the client name is known
+    if (maj_stat & GSS_S_CONTINUE_NEEDED) {
+        ret = AUTH_GSS_CONTINUE;
         goto end;
     }
-    state->username = (char *)malloc(output_token.length + 1);
-    if (state->username == NULL)
-    {
-        PyErr_NoMemory();
+    
+    // Never accept what could not be checked for a replay
+    if (krb_rcache_checked_here(state->rcache) && ! state->replay_checked) {
+        gss_delete_sec_context(&min_stat, &state->context, GSS_C_NO_BUFFER);
+        krb_error_set_message(
+            error, KRB_ERROR_KRB,
+            "No Kerberos authenticator to check for a replay"
+        );
         ret = AUTH_GSS_ERROR;
         goto end;
     }
-    strncpy(state->username, (char*) output_token.value, output_token.length);
-    state->username[output_token.length] = 0;
     
-    // Get the target name if no server creds were supplied
-    if (state->server_creds == GSS_C_NO_CREDENTIAL) {
-        gss_name_t target_name = GSS_C_NO_NAME;
+    // The user name, and the target name if no server creds were supplied
+    // or only ones for any principal, are only looked up if asked for
+    state->names_pending = GSS_NAME_USER;
+    if (
+        state->server_creds == GSS_C_NO_CREDENTIAL ||
+        (state->acceptor != NULL && ! krb_acceptor_named(state->acceptor))
+    ) {
+        state->names_pending |= GSS_NAME_TARGET;
+    }
+
+    ret = AUTH_GSS_COMPLETE;
+    
+end:
+    if (ret == AUTH_GSS_ERROR && response_token->value) {
+        gss_release_buffer(&min_stat, response_token);
+    }
+    return ret;
+}
+
+int authenticate_gss_server_username(
+    gss_server_state *state, const char **name, krb_error *error
+) {
+    if (state->names_pending & GSS_NAME_USER) {
+        if (store_display_name(
+            state->client_name, &state->username, &state->username_size,
+            error
+        ) == AUTH_GSS_ERROR) {
+            return AUTH_GSS_ERROR;
+        }
+        state->names_pending &= ~GSS_NAME_USER;
+    }
+
+    *name = state->username;
+    return AUTH_GSS_COMPLETE;
+}
+
+int authenticate_gss_server_targetname(
+    gss_server_state *state, const char **name, krb_error *error
+) {
+    OM_uint32 maj_stat;
+    OM_uint32 min_stat;
+    gss_name_t target_name = GSS_C_NO_NAME;
+    int ret;
+
+    if (state->names_pending & GSS_NAME_TARGET) {
         maj_stat = gss_inquire_context(
             &min_stat, state->context, NULL, &target_name, NULL, NULL, NULL,
             NULL, NULL
         );
         if (GSS_ERROR(maj_stat)) {
-            set_gss_error(maj_stat, min_stat);
-            ret = AUTH_GSS_ERROR;
-            goto end;
+            set_gss_error(maj_stat, min_stat, error);
+            return AUTH_GSS_ERROR;
         }
-        maj_stat = gss_display_name(
-            &min_stat, target_name, &output_token, NULL
+        ret = store_display_name(
+            target_name, &state->targetname, &state->targetname_size, error
         );
-        if (GSS_ERROR(maj_stat)) {
-            set_gss_error(maj_stat, min_stat);
-            ret = AUTH_GSS_ERROR;
-            goto end;
-        }
-        state->targetname = (char *)malloc(output_token.length + 1);
-        if (state->targetname == NULL)
-        {
-            PyErr_NoMemory();
-            ret = AUTH_GSS_ERROR;
-            goto end;
+        gss_release_name(&min_stat, &target_name);
+        if (ret == AUTH_GSS_ERROR) {
+            return ret;
         }
-        strncpy(
-            state->targetname, (char*) output_token.value, output_token.length
-        );
-        state->targetname[output_token.length] = 0;
+        state->names_pending &= ~GSS_NAME_TARGET;
     }
 
-    ret = AUTH_GSS_COMPLETE;
-    
-end:
-    if (output_token.length) {
-        gss_release_buffer(&min_stat, &output_token);
-    }
-    if (input_token.value) {
-        free(input_token.value);
+    *name = state->targetname;
+    return AUTH_GSS_COMPLETE;
+}
+
+int authenticate_gss_server_resolve_names(
+    gss_server_state *state, krb_error *error
+) {
+    const char *name = NULL;
+
+    if (authenticate_gss_server_username(state, &name, error) ==
+        AUTH_GSS_ERROR) {
+        return AUTH_GSS_ERROR;
     }
-    return ret;
+    return authenticate_gss_server_targetname(state, &name, error);
 }
 
 int authenticate_gss_server_has_delegated(gss_server_state *state)
@@ -817,13 +1032,13 @@ int authenticate_gss_server_has_delegated(gss_server_state *state)
     return (state->client_creds != GSS_C_NO_CREDENTIAL);
 }
 
-static void set_gss_error(OM_uint32 err_maj, OM_uint32 err_min)
+void set_gss_error(OM_uint32 err_maj, OM_uint32 err_min, krb_error *error)
 {
     OM_uint32 maj_stat, min_stat;
     OM_uint32 msg_ctx = 0;
     gss_buffer_desc status_string;
-    char buf_maj[512];
-    char buf_min[512];
+    char buf_maj[512] = "";
+    char buf_min[512] = "";
     
     do {
         maj_stat = gss_display_status(
@@ -854,16 +1069,102 @@ static void set_gss_error(OM_uint32 err_maj, OM_uint32 err_min)
         }
     } while (!GSS_ERROR(maj_stat) && msg_ctx != 0);
     
-    PyErr_SetObject(
-        GssException_class,
-        Py_BuildValue("((s:i)(s:i))", buf_maj, err_maj, buf_min, err_min)
+    krb_error_set_gss(error, buf_maj, err_maj, buf_min, err_min);
+}
+
+// Decode a base64 challenge, into stack_buf (GSS_TOKEN_STACK_SIZE bytes) when
+// it fits and into the reusable *buf otherwise
+static int decode_challenge(
+    const char *challenge, size_t challenge_len, unsigned char *stack_buf,
+    unsigned char **buf, size_t *size, gss_buffer_desc *token,
+    krb_error *error
+) {
+    size_t needed = BASE64_DECODED_SIZE(challenge_len);
+    unsigned char *dst = stack_buf;
+    size_t len;
+
+    if (needed > GSS_TOKEN_STACK_SIZE) {
+        if (krb_buffer_reserve((void **)buf, size, needed) == NULL) {
+            krb_error_set_no_memory(error);
+            return AUTH_GSS_ERROR;
+        }
+        dst = *buf;
+    }
+
+    if (base64_decode_into(challenge, challenge_len, dst, needed, &len)) {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Challenge is not valid base64"
+        );
+        return AUTH_GSS_ERROR;
+    }
+
+    token->value = dst;
+    token->length = len;
+    return AUTH_GSS_COMPLETE;
+}
+
+// Base64 encode a GSS output token into the reusable response buffer
+static int store_response(
+    gss_buffer_desc *output_token, char **response, size_t *response_len,
+    size_t *response_size, krb_error *error
+) {
+    size_t needed = BASE64_ENCODED_SIZE(output_token->length) + 1;
+
+    if (krb_buffer_reserve((void **)response, response_size, needed) == NULL) {
+        krb_error_set_no_memory(error);
+        return AUTH_GSS_ERROR;
+    }
+
+    base64_encode_into(
+        (const unsigned char *)output_token->value, output_token->length,
+        *response, *response_size, response_len
     );
+    return AUTH_GSS_COMPLETE;
 }
 
-int authenticate_gss_server_store_delegate(gss_server_state *state)
-{
+// Copy a GSS display name into the context's reusable, NUL terminated buffer
+static int store_name(
+    gss_buffer_desc *name_token, char **name, size_t *name_size,
+    krb_error *error
+) {
+    if (krb_buffer_reserve(
+        (void **)name, name_size, name_token->length + 1
+    ) == NULL) {
+        krb_error_set_no_memory(error);
+        return AUTH_GSS_ERROR;
+    }
+    memcpy(*name, name_token->value, name_token->length);
+    (*name)[name_token->length] = 0;
+    return AUTH_GSS_COMPLETE;
+}
+
+// store_name for the display form of a GSS name
+static int store_display_name(
+    gss_name_t gss_name, char **name, size_t *name_size, krb_error *error
+) {
+    OM_uint32 maj_stat;
+    OM_uint32 min_stat;
+    gss_buffer_desc name_token = GSS_C_EMPTY_BUFFER;
+    int ret;
+
+    maj_stat = gss_display_name(&min_stat, gss_name, &name_token, NULL);
+    if (GSS_ERROR(maj_stat)) {
+        set_gss_error(maj_stat, min_stat, error);
+        ret = AUTH_GSS_ERROR;
+    } else {
+        ret = store_name(&name_token, name, name_size, error);
+    }
+    if (name_token.value) {
+        gss_release_buffer(&min_stat, &name_token);
+    }
+    return ret;
+}
+
+int authenticate_gss_server_store_delegate(
+    gss_server_state *state, krb_error *error
+) {
     gss_cred_id_t delegated_cred = state->client_creds;
-    char *princ_name = state->username;
+    const char *princ_name = NULL;
     OM_uint32 maj_stat, min_stat;
     krb5_principal princ = NULL;
     krb5_ccache ccache = NULL;
@@ -872,43 +1173,39 @@ int authenticate_gss_server_store_delegate(gss_server_state *state)
     int ret = 500;
 
     if (delegated_cred == GSS_C_NO_CREDENTIAL){
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue("(s)", "Ticket is not delegatable")
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Ticket is not delegatable"
         );
         return AUTH_GSS_ERROR;
     }
+    if (authenticate_gss_server_username(state, &princ_name, error) ==
+        AUTH_GSS_ERROR) {
+        return AUTH_GSS_ERROR;
+    }
 
     problem = krb5_init_context(&context);
     if (problem) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue("(s)", "Cannot initialize krb5 context")
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Cannot initialize krb5 context"
         );
         return AUTH_GSS_ERROR;
     }
 
     problem = krb5_parse_name(context, princ_name, &princ);
     if (problem) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue(
-                "(s:s)", "Cannot parse delegated username",
-                krb5_get_err_text(context, problem)
-            )
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Cannot parse delegated username",
+            krb5_get_err_text(context, problem)
         );
         ret = AUTH_GSS_ERROR;
         goto end;
     }
 
-    problem = create_krb5_ccache(state, context, princ, &ccache);
+    problem = create_krb5_ccache(state, context, princ, &ccache, error);
     if (problem) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue(
-                "(s:s)", "Error in creating krb5 cache",
-                krb5_get_err_text(context, problem)
-            )
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Error in creating krb5 cache",
+            krb5_get_err_text(context, problem)
         );
         ret = AUTH_GSS_ERROR;
         goto end;
@@ -916,7 +1213,7 @@ int authenticate_gss_server_store_delegate(gss_server_state *state)
 
     maj_stat = gss_krb5_copy_ccache(&min_stat, delegated_cred, ccache);
     if (GSS_ERROR(maj_stat)) {
-        set_gss_error(maj_stat, min_stat);
+        set_gss_error(maj_stat, min_stat, error);
         ret = AUTH_GSS_ERROR;
         goto end;
     }
@@ -939,7 +1236,7 @@ end:
 
 int create_krb5_ccache(
     gss_server_state *state, krb5_context kcontext, krb5_principal princ,
-    krb5_ccache *ccache
+    krb5_ccache *ccache, krb_error *error
 ) {
     int fd;
     char ccname[32];
@@ -950,9 +1247,9 @@ int create_krb5_ccache(
     snprintf(ccname, sizeof(ccname), "/tmp/krb5cc_pyserv_XXXXXX");
     fd = mkstemp(ccname);
     if (fd < 0) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue("(s:s)", "Error in mkstemp", strerror(errno))
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Error in mkstemp",
+            strerror(errno)
         );
         ret = 1;
         goto end;
@@ -961,12 +1258,9 @@ int create_krb5_ccache(
 
     problem = krb5_cc_resolve(kcontext, ccname, &tmp_ccache);
     if (problem) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue(
-                "(s:s)", "Error resolving the credential cache",
-                krb5_get_err_text(kcontext, problem)
-            )
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Error resolving the credential cache",
+            krb5_get_err_text(kcontext, problem)
         );
         ret = 1;
         unlink(ccname);
@@ -975,12 +1269,9 @@ int create_krb5_ccache(
 
     problem = krb5_cc_initialize(kcontext, tmp_ccache, princ);
     if (problem) {
-        PyErr_SetObject(
-            KrbException_class,
-            Py_BuildValue(
-                "(s:s)", "Error initialising the credential cache",
-                krb5_get_err_text(kcontext, problem)
-            )
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Error initialising the credential cache",
+            krb5_get_err_text(kcontext, problem)
         );
         ret = 1;
         goto end;
@@ -998,7 +1289,7 @@ end:
 
     state->ccname = (char *)malloc(32*sizeof(char));
     if (state->ccname == NULL) {
-        PyErr_NoMemory();
+        krb_error_set_no_memory(error);
         return 1;
     }
     strcpy(state->ccname, ccname);
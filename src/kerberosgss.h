@@ -18,6 +18,10 @@
 #include <gssapi/gssapi_generic.h>
 #include <gssapi/gssapi_krb5.h>
 
+#include "kerberosbuf.h"
+#include "kerberoscred.h"
+#include "kerberoserr.h"
+
 #define krb5_get_err_text(context,code) error_message(code)
 
 #define AUTH_GSS_ERROR      -1
@@ -28,6 +32,13 @@
 #define GSS_AUTH_P_INTEGRITY    2
 #define GSS_AUTH_P_PRIVACY      4
 
+// Decoded challenges up to this size never touch the heap
+#define GSS_TOKEN_STACK_SIZE    8192
+
+// Names of an established context that are displayed on first use
+#define GSS_NAME_USER           1
+#define GSS_NAME_TARGET         2
+
 typedef struct {
     gss_ctx_id_t     context;
     gss_name_t       server_name;
@@ -35,8 +46,14 @@ typedef struct {
     long int         gss_flags;
     gss_cred_id_t    client_creds;
     char*            username;
+    size_t           username_size;
     char*            response;
+    size_t           response_len;
+    size_t           response_size;
+    unsigned char*   token;
+    size_t           token_size;
     int              responseConf;
+    int              names_pending;
 } gss_client_state;
 
 typedef struct {
@@ -46,45 +63,148 @@ typedef struct {
     gss_cred_id_t    server_creds;
     gss_cred_id_t    client_creds;
     char*            username;
+    size_t           username_size;
     char*            targetname;
+    size_t           targetname_size;
     char*            response;
+    size_t           response_len;
+    size_t           response_size;
+    unsigned char*   token;
+    size_t           token_size;
     char*            ccname;
+    krb_acceptor*    acceptor;
+    int              rcache;
+    int              replay_checked;
+    int              names_pending;
 } gss_server_state;
 
-char* server_principal_details(const char* service, const char* hostname);
+void set_gss_error(OM_uint32 err_maj, OM_uint32 err_min, krb_error *error);
+
+char* server_principal_details(
+    const char* service, const char* hostname, krb_error *error
+);
 
 int authenticate_gss_client_init(
     const char* service, const char* principal, long int gss_flags,
-    gss_server_state* delegatestate, gss_OID mech_oid, gss_client_state* state
+    gss_server_state* delegatestate, gss_OID mech_oid, gss_client_state* state,
+    krb_error *error
 );
 int authenticate_gss_client_clean(
     gss_client_state *state
 );
+
+/*
+ * Start a new exchange in state with the server name, mechanism, flags and
+ * credentials of target, an initialized state that is only read, so any
+ * number of exchanges may share one target. End it with
+ * authenticate_gss_client_clean_exchange, which releases what the exchange
+ * itself acquired and leaves the shared handles alone.
+ */
+void authenticate_gss_client_init_exchange(
+    const gss_client_state *target, gss_client_state *state
+);
+int authenticate_gss_client_clean_exchange(
+    gss_client_state *state
+);
 int authenticate_gss_client_step(
-    gss_client_state *state, const char *challenge
+    gss_client_state *state, const char *challenge, size_t challenge_len,
+    krb_error *error
 );
 int authenticate_gss_client_unwrap(
-    gss_client_state* state, const char* challenge
+    gss_client_state* state, const char* challenge, size_t challenge_len,
+    krb_error *error
 );
 int authenticate_gss_client_wrap(
-    gss_client_state* state, const char* challenge, const char* user,
-    int protect
+    gss_client_state* state, const char* challenge, size_t challenge_len,
+    const char* user, int protect, krb_error *error
+);
+
+/*
+ * The *_raw variants take the GSSAPI input token as is rather than base64
+ * encoded, and hand back the output token in *output_token instead of
+ * storing it in state->response, which they leave empty. On success the
+ * caller owns *output_token and must gss_release_buffer() it; on error it
+ * is left empty.
+ */
+int authenticate_gss_client_step_raw(
+    gss_client_state* state, const void* input, size_t input_len,
+    gss_buffer_desc* output_token, krb_error *error
+);
+int authenticate_gss_client_unwrap_raw(
+    gss_client_state* state, const void* input, size_t input_len,
+    gss_buffer_desc* output_token, krb_error *error
+);
+int authenticate_gss_client_wrap_raw(
+    gss_client_state* state, const void* input, size_t input_len,
+    const char* user, int protect, gss_buffer_desc* output_token,
+    krb_error *error
 );
 int authenticate_gss_client_inquire_cred(
-    gss_client_state* state
+    gss_client_state* state, krb_error *error
+);
+
+/*
+ * The step functions leave the names of an established context in
+ * names_pending rather than displaying them, as most callers only want the
+ * response. These display one on first use and keep it in the state, and
+ * set *name to it, or to NULL if there is none.
+ */
+int authenticate_gss_client_username(
+    gss_client_state* state, const char** name, krb_error *error
 );
 
 int authenticate_gss_server_init(
-    const char* service, gss_server_state* state
+    const char* service, gss_server_state* state, krb_error *error
+);
+// authenticate_gss_server_init with the replay cache rcache, one of the
+// KRB_RCACHE_ types
+int authenticate_gss_server_init_rcache(
+    const char* service, int rcache, gss_server_state* state,
+    krb_error *error
 );
 int authenticate_gss_server_clean(
     gss_server_state *state
 );
 int authenticate_gss_server_step(
-    gss_server_state *state, const char *challenge
+    gss_server_state *state, const char *challenge, size_t challenge_len,
+    krb_error *error
+);
+int authenticate_gss_server_step_raw(
+    gss_server_state *state, const void *input, size_t input_len,
+    gss_buffer_desc *output_token, krb_error *error
+);
+
+/*
+ * Picks the acceptor credentials for the first token of an exchange, given
+ * the decoded token. Returns the name of the principal chosen, which the
+ * caller keeps alive, with a reference to its credentials in acceptor; or
+ * NULL with error set.
+ */
+typedef const char *(*gss_server_route)(
+    void *arg, const void *token, size_t token_len, krb_acceptor **acceptor,
+    krb_error *error
+);
+
+// authenticate_gss_server_step for a state initialized with no service,
+// which routes the first token to credentials with route and takes the
+// target name from it rather than asking GSSAPI
+int authenticate_gss_server_step_routed(
+    gss_server_state *state, const char *challenge, size_t challenge_len,
+    gss_server_route route, void *arg, krb_error *error
+);
+int authenticate_gss_server_username(
+    gss_server_state *state, const char **name, krb_error *error
+);
+int authenticate_gss_server_targetname(
+    gss_server_state *state, const char **name, krb_error *error
+);
+// Display every pending name, for callers that clean the state before
+// returning the names
+int authenticate_gss_server_resolve_names(
+    gss_server_state *state, krb_error *error
 );
 int authenticate_gss_server_store_delegate(
-    gss_server_state *state
+    gss_server_state *state, krb_error *error
 );
 int authenticate_gss_server_has_delegated(
     gss_server_state *state
@@ -0,0 +1,390 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberospool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_THREADS         256
+
+/*
+ * A batch lives on the stack of the thread that called krb_pool_map. Items
+ * are claimed with an atomic counter; the batch stays on the pending list
+ * until a thread finds nothing left to claim. users counts the threads
+ * still holding a pointer to the batch, so that krb_pool_map only returns
+ * once none of them can touch it again.
+ */
+typedef struct pool_batch {
+    krb_pool_fn         fn;
+    void*               arg;
+    size_t              count;
+    atomic_size_t       next;
+    size_t              done;
+    int                 users;
+    pthread_cond_t      finished;
+    struct pool_batch*  link;
+} pool_batch;
+
+typedef struct {
+    krb_pool*           pool;
+    int                 index;
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    krb_task*           head;
+    krb_task*           tail;
+} pool_worker;
+
+/*
+ * queued counts the tasks in all the deques and is only changed with lock
+ * held; the deques themselves have their own locks so that stealing does
+ * not contend with submission to other threads.
+ */
+struct krb_pool {
+    pthread_mutex_t     lock;
+    pthread_cond_t      work;
+    pthread_cond_t      room;
+    size_t              queued;
+    size_t              max_queued;
+    size_t              next_worker;
+    int                 closing;
+    pid_t               pid;
+    pool_batch*         pending;
+    int                 threads;
+    pool_worker*        workers;
+};
+
+static pthread_mutex_t default_lock = PTHREAD_MUTEX_INITIALIZER;
+static krb_pool *default_pool = NULL;
+static int default_started = 0;
+
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+// The threads are gone in the child; leave the old default pool be
+static void reset_after_fork(void)
+{
+    pthread_mutex_init(&default_lock, NULL);
+    default_pool = NULL;
+    default_started = 0;
+}
+
+static void register_fork_handler(void)
+{
+    pthread_atfork(NULL, NULL, reset_after_fork);
+}
+
+static int pool_usable(const krb_pool *pool)
+{
+    return pool != NULL && pool->threads > 0 && pool->pid == getpid();
+}
+
+// Run items of batch until none are left; called with pool->lock held and
+// b->users already counting this thread, returns with it held again
+static void run_batch(krb_pool *pool, pool_batch *b)
+{
+    pool_batch **p = NULL;
+    size_t ran = 0;
+    size_t i;
+
+    if (pool != NULL) {
+        pthread_mutex_unlock(&pool->lock);
+    }
+    while (
+        (i = atomic_fetch_add_explicit(&b->next, 1, memory_order_relaxed)) <
+        b->count
+    ) {
+        b->fn(b->arg, i);
+        ran++;
+    }
+    if (pool == NULL) {
+        b->done += ran;
+        b->users--;
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+
+    for (p = &pool->pending; *p != NULL; p = &(*p)->link) {
+        if (*p == b) {
+            *p = b->link;
+            break;
+        }
+    }
+
+    b->done += ran;
+    b->users--;
+    if (b->done == b->count && b->users == 0) {
+        pthread_cond_signal(&b->finished);
+    }
+}
+
+// The oldest task of this thread's deque, or else the newest of another's
+static krb_task *take_task(krb_pool *pool, int self)
+{
+    krb_task *task = NULL;
+    int i;
+
+    for (i = 0; i < pool->threads && task == NULL; i++) {
+        pool_worker *w = &pool->workers[(self + i) % pool->threads];
+
+        pthread_mutex_lock(&w->lock);
+        task = (i == 0) ? w->head : w->tail;
+        if (task != NULL) {
+            if (task->prev != NULL) {
+                task->prev->next = task->next;
+            } else {
+                w->head = task->next;
+            }
+            if (task->next != NULL) {
+                task->next->prev = task->prev;
+            } else {
+                w->tail = task->prev;
+            }
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+    return task;
+}
+
+static void *pool_thread(void *arg)
+{
+    pool_worker *self = (pool_worker *)arg;
+    krb_pool *pool = self->pool;
+    krb_task *task = NULL;
+    pool_batch *b = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        if (pool->pending != NULL) {
+            b = pool->pending;
+            b->users++;
+            run_batch(pool, b);
+        } else if (pool->queued > 0) {
+            // Another thread may have taken the task but not counted it yet
+            pthread_mutex_unlock(&pool->lock);
+            task = take_task(pool, self->index);
+            pthread_mutex_lock(&pool->lock);
+            if (task != NULL) {
+                pool->queued--;
+                pthread_cond_signal(&pool->room);
+                pthread_mutex_unlock(&pool->lock);
+                task->run(task);
+                pthread_mutex_lock(&pool->lock);
+            }
+        } else if (pool->closing) {
+            break;
+        } else {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+krb_pool *krb_pool_create(int threads, size_t max_queued)
+{
+    krb_pool *pool = NULL;
+    long cpus = 0;
+    int i;
+
+    if (threads <= 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus < 1) ? 1 : (cpus > MAX_THREADS) ? MAX_THREADS : cpus;
+    } else if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    pool = (krb_pool *)calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = (pool_worker *)calloc(threads, sizeof(*pool->workers));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->room, NULL);
+    pool->max_queued = max_queued ? max_queued : 1;
+    pool->pid = getpid();
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < threads; i++) {
+        pool_worker *w = &pool->workers[i];
+
+        w->pool = pool;
+        w->index = i;
+        pthread_mutex_init(&w->lock, NULL);
+        if (pthread_create(&w->thread, NULL, pool_thread, w) != 0) {
+            pthread_mutex_destroy(&w->lock);
+            break;
+        }
+        pool->threads++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (pool->threads == 0) {
+        krb_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void krb_pool_destroy(krb_pool *pool)
+{
+    int i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    // Inherited across fork(): there are no threads to stop
+    if (pool->pid != getpid()) {
+        free(pool->workers);
+        free(pool);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_cond_broadcast(&pool->room);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+
+    pthread_cond_destroy(&pool->room);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+krb_pool *krb_pool_default(void)
+{
+    krb_pool *pool = NULL;
+
+    pthread_once(&fork_once, register_fork_handler);
+    pthread_mutex_lock(&default_lock);
+    if (! default_started) {
+        default_started = 1;
+        default_pool = krb_pool_create(0, (size_t)-1);
+    }
+    pool = default_pool;
+    pthread_mutex_unlock(&default_lock);
+
+    return pool;
+}
+
+int krb_pool_threads(const krb_pool *pool)
+{
+    return pool_usable(pool) ? pool->threads : 0;
+}
+
+size_t krb_pool_queued(krb_pool *pool)
+{
+    size_t queued = 0;
+
+    if (pool_usable(pool)) {
+        pthread_mutex_lock(&pool->lock);
+        queued = pool->queued;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return queued;
+}
+
+int krb_pool_submit(krb_pool *pool, krb_task *task, int wait)
+{
+    pool_worker *w = NULL;
+
+    if (! pool_usable(pool)) {
+        return KRB_POOL_CLOSED;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (! pool->closing && pool->queued >= pool->max_queued) {
+        if (! wait) {
+            pthread_mutex_unlock(&pool->lock);
+            return KRB_POOL_FULL;
+        }
+        pthread_cond_wait(&pool->room, &pool->lock);
+    }
+    if (pool->closing) {
+        pthread_mutex_unlock(&pool->lock);
+        return KRB_POOL_CLOSED;
+    }
+
+    w = &pool->workers[pool->next_worker++ % pool->threads];
+    pthread_mutex_lock(&w->lock);
+    task->next = NULL;
+    task->prev = w->tail;
+    if (w->tail != NULL) {
+        w->tail->next = task;
+    } else {
+        w->head = task;
+    }
+    w->tail = task;
+    pthread_mutex_unlock(&w->lock);
+
+    pool->queued++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    return KRB_POOL_QUEUED;
+}
+
+void krb_pool_map(krb_pool *pool, krb_pool_fn fn, void *arg, size_t count)
+{
+    pool_batch b;
+
+    if (count == 0) {
+        return;
+    }
+
+    b.fn = fn;
+    b.arg = arg;
+    b.count = count;
+    atomic_init(&b.next, 0);
+    b.done = 0;
+    b.users = 1;
+    b.link = NULL;
+
+    if (! pool_usable(pool) || count == 1) {
+        run_batch(NULL, &b);
+        return;
+    }
+
+    pthread_cond_init(&b.finished, NULL);
+    pthread_mutex_lock(&pool->lock);
+    b.link = pool->pending;
+    pool->pending = &b;
+    pthread_cond_broadcast(&pool->work);
+
+    run_batch(pool, &b);
+    while (b.done < b.count || b.users > 0) {
+        pthread_cond_wait(&b.finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_cond_destroy(&b.finished);
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSPOOL_H
+#define KERBEROSPOOL_H
+
+#include <stddef.h>
+
+/*
+ * Pools of native threads for running blocking Kerberos calls side by side
+ * without a Python thread for each.
+ *
+ * Each thread of a pool has its own deque of tasks. Submitted tasks are
+ * dealt out to the deques in turn; a thread runs the oldest task in its
+ * own deque and, once that is empty, steals the newest task from another
+ * thread's deque, so one slow KDC round trip does not hold up the tasks
+ * queued behind it. At most max_queued tasks wait in a pool at once, and
+ * submitters beyond that wait for room or are turned away.
+ *
+ * A pool's threads do not survive fork(); in the child a pool inherited
+ * from the parent refuses new tasks and krb_pool_map runs everything on
+ * the calling thread.
+ *
+ * Work handed to a pool must not touch Python objects.
+ */
+
+typedef struct krb_pool krb_pool;
+
+typedef struct krb_task krb_task;
+
+struct krb_task {
+    // Called on a pool thread; the task may be freed once this is entered
+    void      (*run)(krb_task *task);
+    krb_task*   prev;
+    krb_task*   next;
+};
+
+typedef void (*krb_pool_fn)(void *arg, size_t index);
+
+#define KRB_POOL_QUEUED      0
+#define KRB_POOL_FULL       -1
+#define KRB_POOL_CLOSED     -2
+
+// Start a pool of threads (one per online CPU if threads <= 0) holding at
+// most max_queued waiting tasks; NULL if memory or threads are exhausted
+krb_pool *krb_pool_create(int threads, size_t max_queued);
+
+// Run the tasks still queued, stop the threads and free the pool
+void krb_pool_destroy(krb_pool *pool);
+
+// The pool shared by the batch calls: one thread per CPU, no queue bound,
+// created on first use and again in a forked child; NULL if it could not
+// be started
+krb_pool *krb_pool_default(void);
+
+int krb_pool_threads(const krb_pool *pool);
+
+// Tasks waiting to start
+size_t krb_pool_queued(krb_pool *pool);
+
+// Queue a task. If max_queued tasks are already waiting, wait for room if
+// asked to, and otherwise return KRB_POOL_FULL; KRB_POOL_CLOSED means the
+// pool is being destroyed or was inherited across fork()
+int krb_pool_submit(krb_pool *pool, krb_task *task, int wait);
+
+// Call fn(arg, i) for every i below count, on the pool's threads and the
+// calling thread, and return once every call has finished. Batches go
+// ahead of queued tasks and are not limited by max_queued. pool may be
+// NULL, in which case the calling thread does all the work.
+void krb_pool_map(krb_pool *pool, krb_pool_fn fn, void *arg, size_t count);
+
+#endif
@@ -14,7 +14,7 @@
  * limitations under the License.
  **/
 
-#include <Python.h>
+#define _GNU_SOURCE     // for asprintf on glibc
 #include "kerberospw.h"
 
 #include <stdio.h>
@@ -23,13 +23,11 @@
 
 #undef PRINTFS
 
-extern PyObject *PwdChangeException_class;
-
-static void set_pwchange_error(krb5_context context, krb5_error_code code)
-{
-    PyErr_SetObject(
-        PwdChangeException_class,
-        Py_BuildValue("(s:i)", krb5_get_err_text(context, code), code)
+static void set_pwchange_error(
+    krb5_context context, krb5_error_code code, krb_error *error
+) {
+    krb_error_set_code(
+        error, KRB_ERROR_PWD_CHANGE, krb5_get_err_text(context, code), code
     );
 }
 
@@ -39,7 +37,8 @@ static krb5_error_code verify_krb5_user(
     krb5_principal principal,
     const char *password,
     const char *service,
-    krb5_creds* creds
+    krb5_creds* creds,
+    krb_error *error
 ) {
     krb5_get_init_creds_opt gic_options;
     krb5_error_code code;
@@ -69,7 +68,7 @@ static krb5_error_code verify_krb5_user(
         (char *)service, &gic_options
     );
     if (code) {
-        set_pwchange_error(context, code);
+        set_pwchange_error(context, code, error);
         goto end;
     }
     ret = 1; /* success */
@@ -79,7 +78,8 @@ end:
 }
 
 int change_user_krb5pwd(
-    const char *user, const char* oldpswd, const char *newpswd
+    const char *user, const char* oldpswd, const char *newpswd,
+    krb_error *error
 ) {
     krb5_context    kcontext = NULL;
     krb5_error_code code;
@@ -95,11 +95,9 @@ int change_user_krb5pwd(
 
     code = krb5_init_context(&kcontext);
     if (code) {
-        PyErr_SetObject(
-            PwdChangeException_class,
-            Py_BuildValue(
-                "((s:i))", "Cannot initialize Kerberos5 context", code
-            )
+        krb_error_set_nested(
+            error, KRB_ERROR_PWD_CHANGE,
+            "Cannot initialize Kerberos5 context", code
         );
         return 0;
     }
@@ -107,18 +105,20 @@ int change_user_krb5pwd(
     name = (char *)malloc(256);
     if (name == NULL)
     {
-        PyErr_NoMemory();
+        krb_error_set_no_memory(error);
         goto end;
     }
     snprintf(name, 256, "%s", user);
         
     code = krb5_parse_name(kcontext, name, &client);
     if (code) {
-        set_pwchange_error(kcontext, code);
+        set_pwchange_error(kcontext, code, error);
         goto end;
     }
 
-    code = verify_krb5_user(kcontext, client, oldpswd, service, &creds);
+    code = verify_krb5_user(
+        kcontext, client, oldpswd, service, &creds, error
+    );
     if (! code) {  /* exception set by verify_krb5_user */
         goto end;
     }
@@ -126,7 +126,7 @@ int change_user_krb5pwd(
     code = krb5_change_password(kcontext, &creds, (char*)newpswd,
                                 &result_code, &result_code_string, &result_string);
     if (code) {
-        set_pwchange_error(kcontext, code);
+        set_pwchange_error(kcontext, code, error);
         goto end;
     }
     if (result_code) {
@@ -140,13 +140,12 @@ int change_user_krb5pwd(
         );
         if (bytes == -1)
         {
-            PyErr_NoMemory();
+            krb_error_set_no_memory(error);
         }
         else
         {
-            PyErr_SetObject(
-                PwdChangeException_class,
-                Py_BuildValue("((s:i))", message, result_code)
+            krb_error_set_nested(
+                error, KRB_ERROR_PWD_CHANGE, message, result_code
             );
             free(message);
         }
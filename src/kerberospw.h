@@ -19,8 +19,11 @@
 #include <gssapi/gssapi_generic.h>
 #include <gssapi/gssapi_krb5.h>
 
+#include "kerberoserr.h"
+
 #define krb5_get_err_text(context,code) error_message(code)
 
 int change_user_krb5pwd(
-    const char *user, const char* oldpswd, const char *newpswd
+    const char *user, const char* oldpswd, const char *newpswd,
+    krb_error *error
 );
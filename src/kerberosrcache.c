@@ -0,0 +1,341 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberosrcache.h"
+#include "kerberosgss.h"
+#include "kerberosrcshared.h"
+#include "kerberosspn.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RCACHE_SHARDS   64
+// Time buckets per shard; one of them is always the one being filled
+#define RCACHE_BUCKETS  8
+#define RCACHE_MIN_SLOTS 64
+
+typedef struct {
+    long            epoch;
+    krb_rcache_tag* slots;
+    size_t          size;
+    size_t          count;
+} rcache_bucket;
+
+typedef struct {
+    pthread_mutex_t     lock;
+    rcache_bucket       buckets[RCACHE_BUCKETS];
+    krb_rcache_stats    stats;
+} rcache_shard;
+
+static rcache_shard shards[RCACHE_SHARDS];
+static double rcache_window = KRB_RCACHE_DEFAULT_WINDOW;
+// Seconds per time bucket, such that the other buckets cover the window
+static double rcache_width = KRB_RCACHE_DEFAULT_WINDOW / (RCACHE_BUCKETS - 1);
+// Buckets are numbered from rcache_base_epoch at rcache_base_ns, so that
+// those numbered with an earlier width keep their place when it changes
+static uint64_t rcache_base_ns = 0;
+static long rcache_base_epoch = 0;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+// The lock may have been held by a thread that does not exist in the child
+static void reset_after_fork(void)
+{
+    size_t i;
+
+    for (i = 0; i < RCACHE_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+    }
+}
+
+static void init_shards(void)
+{
+    reset_after_fork();
+    pthread_atfork(NULL, NULL, reset_after_fork);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+const char *krb_rcache_store_name(int type)
+{
+    switch (type) {
+    case KRB_RCACHE_FILE:
+        return "dfl:";
+    case KRB_RCACHE_NONE:
+    case KRB_RCACHE_MEMORY:
+    case KRB_RCACHE_SHARED:
+        return "none:";
+    }
+    return NULL;
+}
+
+int krb_rcache_checked_here(int type)
+{
+    return type == KRB_RCACHE_MEMORY || type == KRB_RCACHE_SHARED;
+}
+
+static uint64_t mix(uint64_t x)
+{
+    // The splitmix64 finalizer, so that every bit of a tag is usable
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+int krb_rcache_tag_token(
+    const void *token, size_t token_len, krb_rcache_tag *tag
+) {
+    const unsigned char *cipher = NULL;
+    size_t cipher_len = 0;
+    uint64_t hi = 14695981039346656037ULL;
+    uint64_t lo = 7809847782465536322ULL;
+    size_t i;
+
+    if (! krb_token_authenticator(
+        token, token_len, (const void **)&cipher, &cipher_len
+    )) {
+        return 0;
+    }
+
+    // Two FNV-1a hashes from different offsets; the ciphertext of a genuine
+    // authenticator is unique, so this only has to spread it
+    for (i = 0; i < cipher_len; i++) {
+        hi = (hi ^ cipher[i]) * 1099511628211ULL;
+        lo = (lo ^ cipher[cipher_len - 1 - i]) * 1099511628211ULL;
+    }
+    tag->hi = mix(hi ^ cipher_len);
+    // A zero tag marks an empty slot
+    tag->lo = mix(lo) | 1;
+    return 1;
+}
+
+static int bucket_find(const rcache_bucket *bucket, const krb_rcache_tag *tag)
+{
+    size_t mask = bucket->size - 1;
+    size_t i;
+
+    if (bucket->size == 0) {
+        return 0;
+    }
+    i = (size_t)tag->lo & mask;
+    while (bucket->slots[i].lo != 0) {
+        if (bucket->slots[i].lo == tag->lo && bucket->slots[i].hi == tag->hi) {
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+static void bucket_put(rcache_bucket *bucket, const krb_rcache_tag *tag)
+{
+    size_t mask = bucket->size - 1;
+    size_t i = (size_t)tag->lo & mask;
+
+    while (bucket->slots[i].lo != 0) {
+        i = (i + 1) & mask;
+    }
+    bucket->slots[i] = *tag;
+    bucket->count++;
+}
+
+// Make room for one more tag, keeping the table at most half full
+static int bucket_reserve(rcache_bucket *bucket)
+{
+    rcache_bucket grown;
+    size_t i;
+
+    if ((bucket->count + 1) * 2 <= bucket->size) {
+        return 1;
+    }
+    grown.epoch = bucket->epoch;
+    grown.size = bucket->size ? bucket->size * 2 : RCACHE_MIN_SLOTS;
+    grown.count = 0;
+    grown.slots = (krb_rcache_tag *)calloc(grown.size, sizeof(krb_rcache_tag));
+    if (grown.slots == NULL) {
+        return 0;
+    }
+    for (i = 0; i < bucket->size; i++) {
+        if (bucket->slots[i].lo != 0) {
+            bucket_put(&grown, &bucket->slots[i]);
+        }
+    }
+    free(bucket->slots);
+    *bucket = grown;
+    return 1;
+}
+
+// Empty a bucket, keeping its table unless it has grown past its last use
+static void bucket_clear(rcache_bucket *bucket, size_t *dropped)
+{
+    *dropped += bucket->count;
+    if (bucket->size > RCACHE_MIN_SLOTS && bucket->count * 4 < bucket->size) {
+        free(bucket->slots);
+        bucket->slots = NULL;
+        bucket->size = 0;
+    } else if (bucket->size != 0) {
+        memset(bucket->slots, 0, bucket->size * sizeof(krb_rcache_tag));
+    }
+    bucket->count = 0;
+}
+
+// The number of the bucket being filled at time ns
+static long epoch_at(uint64_t ns)
+{
+    return rcache_base_epoch +
+        (long)((ns - rcache_base_ns) / 1e9 / rcache_width);
+}
+
+static int memory_check(const krb_rcache_tag *tag, krb_error *error)
+{
+    rcache_shard *shard = &shards[tag->hi % RCACHE_SHARDS];
+    rcache_bucket *current;
+    uint64_t start = now_ns();
+    uint64_t found;
+    long epoch;
+    size_t dropped = 0;
+    int replay = 0;
+    int stored;
+    size_t i;
+
+    pthread_once(&init_once, init_shards);
+
+    pthread_mutex_lock(&shard->lock);
+    epoch = epoch_at(start);
+    for (i = 0; i < RCACHE_BUCKETS && ! replay; i++) {
+        rcache_bucket *bucket = &shard->buckets[i];
+
+        if (
+            bucket->count != 0 && epoch - bucket->epoch < RCACHE_BUCKETS &&
+            bucket_find(bucket, tag)
+        ) {
+            replay = 1;
+        }
+    }
+    found = now_ns();
+    shard->stats.lookups++;
+    shard->stats.lookup_ns += found - start;
+
+    if (replay) {
+        shard->stats.replays++;
+        pthread_mutex_unlock(&shard->lock);
+        // As GSSAPI reports a replay caught by its own replay cache
+        krb_error_set_gss(
+            error, "Request is a replay", GSS_S_FAILURE,
+            "Authenticator was already used", KRB5KRB_AP_ERR_REPEAT
+        );
+        return AUTH_GSS_ERROR;
+    }
+
+    // The bucket for this epoch last held one at least RCACHE_BUCKETS old
+    current = &shard->buckets[epoch % RCACHE_BUCKETS];
+    if (current->epoch != epoch) {
+        bucket_clear(current, &dropped);
+        current->epoch = epoch;
+        shard->stats.expirations += dropped;
+        shard->stats.entries -= dropped;
+    }
+    stored = bucket_reserve(current);
+    if (stored) {
+        bucket_put(current, tag);
+        shard->stats.inserts++;
+        shard->stats.entries++;
+        shard->stats.insert_ns += now_ns() - found;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (! stored) {
+        // Accepting a token that could not be recorded would let it be
+        // replayed
+        krb_error_set_no_memory(error);
+        return AUTH_GSS_ERROR;
+    }
+    return AUTH_GSS_COMPLETE;
+}
+
+int krb_rcache_check(int type, const krb_rcache_tag *tag, krb_error *error)
+{
+    if (type == KRB_RCACHE_SHARED) {
+        return krb_rcache_shared_check(tag, error);
+    }
+    return memory_check(tag, error);
+}
+
+void krb_rcache_set_window(double seconds)
+{
+    uint64_t now;
+    size_t i;
+
+    pthread_once(&init_once, init_shards);
+
+    // Entries are kept: buckets of the new width are numbered on from the
+    // one being filled, so the old ones still count as the newest and age
+    // out over the new window. Dropping them would let the tokens they
+    // hold be replayed.
+    for (i = 0; i < RCACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+    }
+    now = now_ns();
+    rcache_base_epoch = epoch_at(now) + 1;
+    rcache_base_ns = now;
+    rcache_window = seconds;
+    rcache_width = seconds / (RCACHE_BUCKETS - 1);
+    for (i = RCACHE_SHARDS; i > 0; i--) {
+        pthread_mutex_unlock(&shards[i - 1].lock);
+    }
+}
+
+double krb_rcache_get_window(void)
+{
+    double window;
+
+    pthread_once(&init_once, init_shards);
+
+    pthread_mutex_lock(&shards[0].lock);
+    window = rcache_window;
+    pthread_mutex_unlock(&shards[0].lock);
+
+    return window;
+}
+
+void krb_rcache_get_stats(krb_rcache_stats *stats)
+{
+    size_t i;
+
+    pthread_once(&init_once, init_shards);
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < RCACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        stats->lookups += shards[i].stats.lookups;
+        stats->replays += shards[i].stats.replays;
+        stats->inserts += shards[i].stats.inserts;
+        stats->expirations += shards[i].stats.expirations;
+        stats->entries += shards[i].stats.entries;
+        stats->lookup_ns += shards[i].stats.lookup_ns;
+        stats->insert_ns += shards[i].stats.insert_ns;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+}
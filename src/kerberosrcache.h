@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSRCACHE_H
+#define KERBEROSRCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kerberoserr.h"
+
+/*
+ * Replay caches for acceptors. MIT's default is a file in /var/tmp that
+ * every accept writes under a lock, which serializes the accepts of all
+ * threads. An acceptor may instead turn replay detection off, or keep it
+ * in the memory cache here: GSSAPI accepts with no replay cache, and each
+ * accepted AP-REQ is then looked up by a hash of its authenticator in a
+ * table sharded by that hash.
+ *
+ * Each shard keeps the hashes of the last window seconds in a ring of
+ * time buckets, so that expiry drops a whole bucket at once rather than
+ * scanning for old entries. An authenticator is valid within the clock
+ * skew of its timestamp, which may itself be up to the skew ahead of the
+ * server's clock when it is first accepted. Entries expire by the time
+ * they were recorded, so it takes a window of twice the skew to catch
+ * every replay.
+ */
+
+#define KRB_RCACHE_DEFAULT  0   // As configured for the library
+#define KRB_RCACHE_FILE     1   // MIT's file replay cache
+#define KRB_RCACHE_NONE     2   // No replay detection
+#define KRB_RCACHE_MEMORY   3   // The in-process cache here
+#define KRB_RCACHE_SHARED   4   // The cache in kerberosrcshared.h
+
+// MIT's default clock skew
+#define KRB_RCACHE_CLOCKSKEW        300.0
+#define KRB_RCACHE_DEFAULT_WINDOW   (2 * KRB_RCACHE_CLOCKSKEW)
+
+typedef struct {
+    uint64_t    hi;
+    uint64_t    lo;
+} krb_rcache_tag;
+
+typedef struct {
+    unsigned long long  lookups;
+    unsigned long long  replays;
+    unsigned long long  inserts;
+    unsigned long long  expirations;
+    unsigned long long  entries;
+    unsigned long long  lookup_ns;
+    unsigned long long  insert_ns;
+} krb_rcache_stats;
+
+// The GSSAPI "rcache" credential store value for type, or NULL to leave
+// the library default
+const char *krb_rcache_store_name(int type);
+
+// Whether accepts with replay cache type are checked with krb_rcache_check
+// rather than by GSSAPI
+int krb_rcache_checked_here(int type);
+
+// Hash the authenticator of the AP-REQ in token into tag; returns 0 if the
+// token holds no AP-REQ
+int krb_rcache_tag_token(
+    const void *token, size_t token_len, krb_rcache_tag *tag
+);
+
+// Record tag in the cache of type; returns AUTH_GSS_ERROR with error set if
+// it was already there, AUTH_GSS_COMPLETE otherwise
+int krb_rcache_check(int type, const krb_rcache_tag *tag, krb_error *error);
+
+// Set how long entries of the memory cache, and of shared caches created
+// from now on, are kept. Those the memory cache holds are kept too, for
+// the new window.
+void krb_rcache_set_window(double seconds);
+
+double krb_rcache_get_window(void);
+
+// Totals since the process started; lookup_ns and insert_ns are the time
+// spent in each
+void krb_rcache_get_stats(krb_rcache_stats *stats);
+
+#endif
@@ -0,0 +1,939 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberosrcshared.h"
+#include "kerberosgss.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define SHARED_MAGIC        0x70796b7263000001ULL
+// Slots searched for a tag, from the one its hash selects
+#define SHARED_PROBE        32
+// Epochs a slot stays live for; the others of the window, as in memory
+#define SHARED_EPOCHS       8
+#define SHARED_MIN_SLOTS    1024
+#define SHARED_MAX_SLOTS    ((size_t)1 << 32)
+// Seconds to wait for another process to set up a new segment, or for
+// the daemon to answer
+#define SHARED_WAIT         1.0
+#define DAEMON_TIMEOUT      2
+
+// Idle daemon connections kept for reuse
+#define DAEMON_POOL         16
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL    0   // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+#define TABLE_NEW       0
+#define TABLE_REPLAY    1
+#define TABLE_FULL      2
+
+/*
+ * The segment starts with this header, set up once by the process that
+ * creates it; magic is stored last, so a process that finds it set may use
+ * the rest. Each slot holds the top 47 bits of a tag's low half, a set bit
+ * 63 so that it is never 0, and the low 16 bits of its epoch.
+ */
+typedef struct {
+    _Atomic uint64_t    magic;
+    uint64_t            slots;
+    uint64_t            width_ns;
+    uint64_t            reserved[5];
+    _Atomic uint64_t    lookups;
+    _Atomic uint64_t    replays;
+    _Atomic uint64_t    inserts;
+    _Atomic uint64_t    full;
+    uint64_t            reserved2[4];
+} shared_header;
+
+typedef struct {
+    shared_header*      header;
+    _Atomic uint64_t*   slots;
+    size_t              mask;
+    size_t              length;
+} shared_table;
+
+struct krb_rcache_daemon {
+    pthread_t           thread;
+    char*               path;
+    dev_t               dev;            // of the socket, once bound
+    ino_t               ino;
+    int                 listen_fd;
+    int                 stop_read;
+    int                 stop_write;
+    shared_header*      memory;
+    shared_table        table;
+};
+
+/*
+ * The attachment. Checks hold the read lock, so that the segment is not
+ * unmapped under them; the table itself needs no lock.
+ */
+static pthread_rwlock_t attach_lock = PTHREAD_RWLOCK_INITIALIZER;
+static int attach_mode = KRB_RCACHE_SHARED_DETACHED;
+static char attach_name[sizeof(((krb_rcache_shared_stats *)0)->name)];
+static shared_table attach_table;
+
+// Daemon connections, and this process's counters for them
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static int pool_fds[DAEMON_POOL];
+static size_t pool_count = 0;
+static _Atomic uint64_t daemon_lookups;
+static _Atomic uint64_t daemon_replays;
+static _Atomic uint64_t daemon_inserts;
+static _Atomic uint64_t daemon_full;
+
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+/*
+ * The locks may have been held by threads that do not exist in the child,
+ * and connections shared with the parent would mix up their answers.
+ */
+static void reset_after_fork(void)
+{
+    size_t i;
+
+    pthread_rwlock_init(&attach_lock, NULL);
+    pthread_mutex_init(&pool_lock, NULL);
+    for (i = 0; i < pool_count; i++) {
+        close(pool_fds[i]);
+    }
+    pool_count = 0;
+}
+
+static void register_fork_handler(void)
+{
+    pthread_atfork(NULL, NULL, reset_after_fork);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    // System-wide, so the same for every process attached to a segment
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static size_t table_slots(size_t slots)
+{
+    size_t size = SHARED_MIN_SLOTS;
+
+    while (size < slots && size < SHARED_MAX_SLOTS) {
+        size *= 2;
+    }
+    return size;
+}
+
+static void table_init(shared_header *header, size_t slots)
+{
+    header->slots = slots;
+    // The window of the memory cache, twice the clock skew unless it was
+    // changed, which is what catching every replay takes (see
+    // kerberosrcache.h)
+    header->width_ns = (uint64_t)(
+        krb_rcache_get_window() / (SHARED_EPOCHS - 1) * 1e9
+    );
+    if (header->width_ns == 0) {
+        header->width_ns = 1;
+    }
+    atomic_store(&header->magic, SHARED_MAGIC);
+}
+
+static void table_use(shared_table *table, shared_header *header, size_t length)
+{
+    table->header = header;
+    table->slots = (_Atomic uint64_t *)(header + 1);
+    table->mask = header->slots - 1;
+    table->length = length;
+}
+
+static int slot_live(uint64_t word, uint64_t stamp)
+{
+    return word != 0 && ((stamp - (word & 0xffff)) & 0xffff) < SHARED_EPOCHS;
+}
+
+/*
+ * Record tag unless a live slot in its probe range holds it. Two
+ * processes that insert the same tag at once write different slots and
+ * then look again: with sequentially consistent atomics at least one of
+ * them sees the other's slot, and every process that does reports a
+ * replay. Slots are never cleared, so a tag refused either way stays
+ * refused.
+ */
+static int table_check(const shared_table *table, const krb_rcache_tag *tag)
+{
+    shared_header *header = table->header;
+    uint64_t stamp = (now_ns() / header->width_ns) & 0xffff;
+    uint64_t word = (tag->lo & ~0xffffULL) | (1ULL << 63) | stamp;
+    size_t start = (size_t)tag->hi;
+    size_t inserted = SHARED_PROBE;
+    size_t free_slot = SHARED_PROBE;
+    uint64_t current;
+    size_t i;
+
+    atomic_fetch_add_explicit(&header->lookups, 1, memory_order_relaxed);
+
+    for (i = 0; i < SHARED_PROBE; i++) {
+        current = atomic_load(&table->slots[(start + i) & table->mask]);
+        if (! slot_live(current, stamp)) {
+            if (free_slot == SHARED_PROBE) {
+                free_slot = i;
+            }
+        } else if ((current >> 16) == (word >> 16)) {
+            goto replay;
+        }
+    }
+
+    for (i = free_slot; i < SHARED_PROBE && inserted == SHARED_PROBE; i++) {
+        _Atomic uint64_t *slot = &table->slots[(start + i) & table->mask];
+
+        current = atomic_load(slot);
+        while (! slot_live(current, stamp)) {
+            if (atomic_compare_exchange_strong(slot, &current, word)) {
+                inserted = i;
+                break;
+            }
+        }
+        if (inserted == SHARED_PROBE && (current >> 16) == (word >> 16)) {
+            goto replay;
+        }
+    }
+    if (inserted == SHARED_PROBE) {
+        atomic_fetch_add_explicit(&header->full, 1, memory_order_relaxed);
+        return TABLE_FULL;
+    }
+
+    for (i = 0; i < SHARED_PROBE; i++) {
+        if (i == inserted) {
+            continue;
+        }
+        current = atomic_load(&table->slots[(start + i) & table->mask]);
+        if (slot_live(current, stamp) && (current >> 16) == (word >> 16)) {
+            goto replay;
+        }
+    }
+    atomic_fetch_add_explicit(&header->inserts, 1, memory_order_relaxed);
+    return TABLE_NEW;
+
+replay:
+    atomic_fetch_add_explicit(&header->replays, 1, memory_order_relaxed);
+    return TABLE_REPLAY;
+}
+
+static void set_errno_error(
+    krb_error *error, const char *message, const char *name
+) {
+    char detail[KRB_ERROR_MESSAGE_SIZE];
+
+    snprintf(detail, sizeof(detail), "%s: %s", name, strerror(errno));
+    krb_error_set_detail(error, KRB_ERROR_KRB, message, detail);
+}
+
+static int table_result(int result, krb_error *error)
+{
+    if (result == TABLE_REPLAY) {
+        // As GSSAPI reports a replay caught by its own replay cache
+        krb_error_set_gss(
+            error, "Request is a replay", GSS_S_FAILURE,
+            "Authenticator was already used", KRB5KRB_AP_ERR_REPEAT
+        );
+        return AUTH_GSS_ERROR;
+    }
+    if (result == TABLE_FULL) {
+        // Accepting a token that could not be recorded would let it be
+        // replayed
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Shared replay cache is full"
+        );
+        return AUTH_GSS_ERROR;
+    }
+    return AUTH_GSS_COMPLETE;
+}
+
+// Map the segment open on fd, waiting for its creator to set it up
+static shared_header *map_segment(int fd, size_t *length)
+{
+    shared_header *header = NULL;
+    struct stat st;
+    uint64_t deadline = now_ns() + (uint64_t)(SHARED_WAIT * 1e9);
+
+    for (;;) {
+        if (fstat(fd, &st) != 0) {
+            return NULL;
+        }
+        if ((size_t)st.st_size >= sizeof(shared_header)) {
+            header = (shared_header *)mmap(
+                NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0
+            );
+            if (header == MAP_FAILED) {
+                return NULL;
+            }
+            if (atomic_load(&header->magic) == SHARED_MAGIC) {
+                break;
+            }
+            munmap(header, (size_t)st.st_size);
+        }
+        if (now_ns() > deadline) {
+            errno = EINVAL;
+            return NULL;
+        }
+        usleep(1000);
+    }
+
+    if (
+        header->slots < SHARED_MIN_SLOTS ||
+        (header->slots & (header->slots - 1)) != 0 ||
+        sizeof(shared_header) + header->slots * sizeof(uint64_t) !=
+            (size_t)st.st_size
+    ) {
+        munmap(header, (size_t)st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    *length = (size_t)st.st_size;
+    return header;
+}
+
+static void detach_locked(void)
+{
+    if (attach_mode == KRB_RCACHE_SHARED_SEGMENT) {
+        munmap(attach_table.header, attach_table.length);
+    }
+    memset(&attach_table, 0, sizeof(attach_table));
+    attach_mode = KRB_RCACHE_SHARED_DETACHED;
+    attach_name[0] = '\0';
+}
+
+static void close_pool(void)
+{
+    size_t i;
+
+    pthread_mutex_lock(&pool_lock);
+    for (i = 0; i < pool_count; i++) {
+        close(pool_fds[i]);
+    }
+    pool_count = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int krb_rcache_shared_attach(
+    const char *name, size_t slots, krb_error *error
+) {
+    shared_header *header = NULL;
+    size_t length = 0;
+    int fd;
+
+    pthread_once(&fork_once, register_fork_handler);
+
+    if (strlen(name) >= sizeof(attach_name)) {
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Shared replay cache name is too long", name
+        );
+        return AUTH_GSS_ERROR;
+    }
+
+    slots = table_slots(slots);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        length = sizeof(shared_header) + slots * sizeof(uint64_t);
+        if (ftruncate(fd, (off_t)length) != 0) {
+            set_errno_error(error, "Cannot size shared replay cache", name);
+            close(fd);
+            shm_unlink(name);
+            return AUTH_GSS_ERROR;
+        }
+        header = (shared_header *)mmap(
+            NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+        );
+        if (header == MAP_FAILED) {
+            set_errno_error(error, "Cannot map shared replay cache", name);
+            close(fd);
+            shm_unlink(name);
+            return AUTH_GSS_ERROR;
+        }
+        table_init(header, slots);
+    } else if (errno == EEXIST) {
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0 || (header = map_segment(fd, &length)) == NULL) {
+            set_errno_error(error, "Cannot attach shared replay cache", name);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return AUTH_GSS_ERROR;
+        }
+    } else {
+        set_errno_error(error, "Cannot create shared replay cache", name);
+        return AUTH_GSS_ERROR;
+    }
+    close(fd);
+
+    pthread_rwlock_wrlock(&attach_lock);
+    detach_locked();
+    table_use(&attach_table, header, length);
+    attach_mode = KRB_RCACHE_SHARED_SEGMENT;
+    strcpy(attach_name, name);
+    pthread_rwlock_unlock(&attach_lock);
+    close_pool();
+
+    return AUTH_GSS_COMPLETE;
+}
+
+// Make a socket safe to hand to child processes and to write to after its
+// peer has gone
+static void socket_setup(int fd)
+{
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#if defined(SO_NOSIGPIPE)
+    {
+        int on = 1;
+
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+}
+
+static int daemon_dial(const char *path)
+{
+    struct sockaddr_un address;
+    struct timeval timeout = {DAEMON_TIMEOUT, 0};
+    int fd;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    socket_setup(fd);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        int saved = errno;
+
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int krb_rcache_shared_connect(const char *path, krb_error *error)
+{
+    int fd;
+
+    pthread_once(&fork_once, register_fork_handler);
+
+    if (
+        strlen(path) >= sizeof(attach_name) ||
+        strlen(path) >= sizeof(((struct sockaddr_un *)0)->sun_path)
+    ) {
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Replay cache socket path is too long", path
+        );
+        return AUTH_GSS_ERROR;
+    }
+
+    // Connect now, so that a wrong path is reported here
+    fd = daemon_dial(path);
+    if (fd < 0) {
+        set_errno_error(error, "Cannot connect to replay cache daemon", path);
+        return AUTH_GSS_ERROR;
+    }
+
+    pthread_rwlock_wrlock(&attach_lock);
+    detach_locked();
+    attach_mode = KRB_RCACHE_SHARED_DAEMON;
+    strcpy(attach_name, path);
+    pthread_rwlock_unlock(&attach_lock);
+
+    close_pool();
+    pthread_mutex_lock(&pool_lock);
+    pool_fds[pool_count++] = fd;
+    pthread_mutex_unlock(&pool_lock);
+
+    return AUTH_GSS_COMPLETE;
+}
+
+void krb_rcache_shared_detach(void)
+{
+    pthread_rwlock_wrlock(&attach_lock);
+    detach_locked();
+    pthread_rwlock_unlock(&attach_lock);
+    close_pool();
+}
+
+static int send_all(int fd, const unsigned char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return 0;
+        }
+        buf += sent;
+        len -= (size_t)sent;
+    }
+    return 1;
+}
+
+static void encode_tag(const krb_rcache_tag *tag, unsigned char *buf)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        buf[i] = (unsigned char)(tag->hi >> (56 - 8 * i));
+        buf[8 + i] = (unsigned char)(tag->lo >> (56 - 8 * i));
+    }
+}
+
+static void decode_tag(const unsigned char *buf, krb_rcache_tag *tag)
+{
+    int i;
+
+    tag->hi = 0;
+    tag->lo = 0;
+    for (i = 0; i < 8; i++) {
+        tag->hi = (tag->hi << 8) | buf[i];
+        tag->lo = (tag->lo << 8) | buf[8 + i];
+    }
+}
+
+// Ask the daemon about tag on a pooled connection, redialling once in case
+// the daemon was restarted since it was opened; returns -1 on failure
+static int daemon_ask(const char *path, const krb_rcache_tag *tag)
+{
+    unsigned char request[16];
+    unsigned char answer;
+    int attempt;
+    int fd;
+
+    encode_tag(tag, request);
+    for (attempt = 0; attempt < 2; attempt++) {
+        ssize_t received;
+
+        fd = -1;
+        pthread_mutex_lock(&pool_lock);
+        if (attempt == 0 && pool_count > 0) {
+            fd = pool_fds[--pool_count];
+        }
+        pthread_mutex_unlock(&pool_lock);
+        if (fd < 0 && (fd = daemon_dial(path)) < 0) {
+            return -1;
+        }
+
+        if (send_all(fd, request, sizeof(request))) {
+            do {
+                received = recv(fd, &answer, 1, 0);
+            } while (received < 0 && errno == EINTR);
+            if (received == 1 && answer <= TABLE_FULL) {
+                pthread_mutex_lock(&pool_lock);
+                if (pool_count < DAEMON_POOL) {
+                    pool_fds[pool_count++] = fd;
+                    fd = -1;
+                }
+                pthread_mutex_unlock(&pool_lock);
+                if (fd >= 0) {
+                    close(fd);
+                }
+                return answer;
+            }
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+int krb_rcache_shared_check(const krb_rcache_tag *tag, krb_error *error)
+{
+    char path[sizeof(attach_name)];
+    int result;
+
+    pthread_rwlock_rdlock(&attach_lock);
+    if (attach_mode == KRB_RCACHE_SHARED_SEGMENT) {
+        result = table_check(&attach_table, tag);
+        pthread_rwlock_unlock(&attach_lock);
+        return table_result(result, error);
+    }
+    if (attach_mode == KRB_RCACHE_SHARED_DETACHED) {
+        pthread_rwlock_unlock(&attach_lock);
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "No shared replay cache is attached"
+        );
+        return AUTH_GSS_ERROR;
+    }
+    strcpy(path, attach_name);
+    pthread_rwlock_unlock(&attach_lock);
+
+    atomic_fetch_add_explicit(&daemon_lookups, 1, memory_order_relaxed);
+    result = daemon_ask(path, tag);
+    if (result < 0) {
+        set_errno_error(error, "Cannot reach replay cache daemon", path);
+        return AUTH_GSS_ERROR;
+    }
+    if (result == TABLE_REPLAY) {
+        atomic_fetch_add_explicit(&daemon_replays, 1, memory_order_relaxed);
+    } else if (result == TABLE_FULL) {
+        atomic_fetch_add_explicit(&daemon_full, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&daemon_inserts, 1, memory_order_relaxed);
+    }
+    return table_result(result, error);
+}
+
+static void table_stats(
+    const shared_table *table, krb_rcache_shared_stats *stats
+) {
+    stats->slots = table->header->slots;
+    stats->lookups = atomic_load(&table->header->lookups);
+    stats->replays = atomic_load(&table->header->replays);
+    stats->inserts = atomic_load(&table->header->inserts);
+    stats->full = atomic_load(&table->header->full);
+}
+
+void krb_rcache_shared_get_stats(krb_rcache_shared_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_rwlock_rdlock(&attach_lock);
+    stats->mode = attach_mode;
+    strcpy(stats->name, attach_name);
+    if (attach_mode == KRB_RCACHE_SHARED_SEGMENT) {
+        table_stats(&attach_table, stats);
+    } else if (attach_mode == KRB_RCACHE_SHARED_DAEMON) {
+        stats->lookups = atomic_load(&daemon_lookups);
+        stats->replays = atomic_load(&daemon_replays);
+        stats->inserts = atomic_load(&daemon_inserts);
+        stats->full = atomic_load(&daemon_full);
+    }
+    pthread_rwlock_unlock(&attach_lock);
+}
+
+/*
+ * The daemon. One thread polls the socket and its clients; each request is
+ * a 16-byte tag, big-endian, and each answer one byte, TABLE_NEW,
+ * TABLE_REPLAY or TABLE_FULL.
+ */
+
+typedef struct {
+    int             fd;
+    size_t          len;
+    unsigned char   request[16];
+} daemon_client;
+
+static void *daemon_thread(void *arg)
+{
+    krb_rcache_daemon *daemon = (krb_rcache_daemon *)arg;
+    daemon_client *clients = NULL;
+    struct pollfd *fds = NULL;
+    size_t count = 0;
+    size_t size = 0;
+    size_t i;
+
+    for (;;) {
+        // Room for the stop pipe, the listener, the clients and one more
+        if (size < count + 3) {
+            size_t grown = (count + 3) * 2;
+            struct pollfd *more_fds = realloc(fds, grown * sizeof(*fds));
+
+            if (more_fds != NULL) {
+                fds = more_fds;
+                size = grown;
+            }
+        }
+        if (fds == NULL) {
+            break;
+        }
+        fds[0].fd = daemon->stop_read;
+        fds[0].events = POLLIN;
+        fds[1].fd = daemon->listen_fd;
+        // Stop accepting when there is no room to poll another client
+        fds[1].events = (size >= count + 3) ? POLLIN : 0;
+        for (i = 0; i < count; i++) {
+            fds[i + 2].fd = clients[i].fd;
+            fds[i + 2].events = POLLIN;
+        }
+
+        if (poll(fds, count + 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+
+        for (i = count; i > 0; i--) {
+            daemon_client *client = &clients[i - 1];
+            ssize_t received;
+
+            if (fds[i + 1].revents == 0) {
+                continue;
+            }
+            received = recv(
+                client->fd, client->request + client->len,
+                sizeof(client->request) - client->len, MSG_DONTWAIT
+            );
+            if (received < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            if (received > 0) {
+                client->len += (size_t)received;
+                if (client->len == sizeof(client->request)) {
+                    krb_rcache_tag tag;
+                    unsigned char answer;
+
+                    decode_tag(client->request, &tag);
+                    answer = (unsigned char)table_check(&daemon->table, &tag);
+                    client->len = 0;
+                    if (send_all(client->fd, &answer, 1)) {
+                        continue;
+                    }
+                } else {
+                    continue;
+                }
+            }
+            // Gone, or failed; the last client takes its place
+            close(client->fd);
+            *client = clients[--count];
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(daemon->listen_fd, NULL, NULL);
+
+            if (fd >= 0) {
+                daemon_client *more = realloc(
+                    clients, (count + 1) * sizeof(*clients)
+                );
+
+                if (more == NULL) {
+                    close(fd);
+                } else {
+                    socket_setup(fd);
+                    clients = more;
+                    clients[count].fd = fd;
+                    clients[count].len = 0;
+                    count++;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        close(clients[i].fd);
+    }
+    free(clients);
+    free(fds);
+    return NULL;
+}
+
+static void free_daemon(krb_rcache_daemon *daemon)
+{
+    struct stat st;
+
+    if (daemon->listen_fd >= 0) {
+        close(daemon->listen_fd);
+        // Only if the path still names the socket bound here
+        if (
+            daemon->ino != 0 && lstat(daemon->path, &st) == 0 &&
+            S_ISSOCK(st.st_mode) && st.st_dev == daemon->dev &&
+            st.st_ino == daemon->ino
+        ) {
+            unlink(daemon->path);
+        }
+    }
+    if (daemon->stop_read >= 0) {
+        close(daemon->stop_read);
+        close(daemon->stop_write);
+    }
+    free(daemon->memory);
+    free(daemon->path);
+    free(daemon);
+}
+
+krb_rcache_daemon *krb_rcache_daemon_start(
+    const char *path, size_t slots, int mode, krb_error *error
+) {
+    krb_rcache_daemon *daemon = NULL;
+    struct sockaddr_un address;
+    struct stat st;
+    int stale = 0;
+    int fds[2];
+    int fd;
+    int i;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Replay cache socket path is too long", path
+        );
+        return NULL;
+    }
+
+    // A socket left behind by a daemon that is gone is replaced, but not
+    // one that is still answering, and nothing that is not a socket
+    if (lstat(path, &st) == 0) {
+        if (! S_ISSOCK(st.st_mode)) {
+            krb_error_set_detail(
+                error, KRB_ERROR_KRB,
+                "Replay cache socket path exists and is not a socket", path
+            );
+            return NULL;
+        }
+        fd = daemon_dial(path);
+        if (fd >= 0) {
+            close(fd);
+            krb_error_set_detail(
+                error, KRB_ERROR_KRB, "Replay cache daemon is already running",
+                path
+            );
+            return NULL;
+        }
+        if (errno != ECONNREFUSED) {
+            set_errno_error(error, "Cannot check replay cache socket", path);
+            return NULL;
+        }
+        stale = 1;
+    }
+
+    daemon = (krb_rcache_daemon *)calloc(1, sizeof(*daemon));
+    if (daemon == NULL || (daemon->path = strdup(path)) == NULL) {
+        free(daemon);
+        krb_error_set_no_memory(error);
+        return NULL;
+    }
+    daemon->listen_fd = -1;
+    daemon->stop_read = -1;
+    daemon->stop_write = -1;
+
+    slots = table_slots(slots);
+    daemon->memory = (shared_header *)calloc(
+        1, sizeof(shared_header) + slots * sizeof(uint64_t)
+    );
+    if (daemon->memory == NULL) {
+        krb_error_set_no_memory(error);
+        free_daemon(daemon);
+        return NULL;
+    }
+    table_init(daemon->memory, slots);
+    table_use(&daemon->table, daemon->memory, 0);
+
+    if (pipe(fds) != 0) {
+        set_errno_error(error, "Cannot start replay cache daemon", path);
+        free_daemon(daemon);
+        return NULL;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    daemon->stop_read = fds[0];
+    daemon->stop_write = fds[1];
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (stale) {
+            unlink(path);
+        }
+        // Anyone who can connect can record authenticators, and so refuse
+        // other users' tokens. Linux gives the socket file the mode of the
+        // socket, elsewhere it is set once bound; either way before
+        // listen, so no client connects in between.
+        fchmod(fd, (mode_t)mode);
+        if (
+            bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+#if ! defined(__linux__)
+            chmod(path, (mode_t)mode) != 0 ||
+#endif
+            lstat(path, &st) != 0 ||
+            listen(fd, 128) != 0
+        ) {
+            int saved = errno;
+
+            close(fd);
+            fd = -1;
+            errno = saved;
+        }
+    }
+    if (fd < 0) {
+        set_errno_error(error, "Cannot listen for replay cache clients", path);
+        free_daemon(daemon);
+        return NULL;
+    }
+    daemon->listen_fd = fd;
+    daemon->dev = st.st_dev;
+    daemon->ino = st.st_ino;
+
+    if (pthread_create(&daemon->thread, NULL, daemon_thread, daemon) != 0) {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Cannot start replay cache daemon thread"
+        );
+        free_daemon(daemon);
+        return NULL;
+    }
+
+    return daemon;
+}
+
+void krb_rcache_daemon_stop(krb_rcache_daemon *daemon)
+{
+    ssize_t written;
+
+    if (daemon == NULL) {
+        return;
+    }
+
+    do {
+        written = write(daemon->stop_write, "", 1);
+    } while (written < 0 && errno == EINTR);
+
+    pthread_join(daemon->thread, NULL);
+    free_daemon(daemon);
+}
+
+void krb_rcache_daemon_get_stats(
+    const krb_rcache_daemon *daemon, krb_rcache_shared_stats *stats
+) {
+    memset(stats, 0, sizeof(*stats));
+    stats->mode = KRB_RCACHE_SHARED_DAEMON;
+    strcpy(stats->name, daemon->path);
+    table_stats(&daemon->table, stats);
+}
@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSRCSHARED_H
+#define KERBEROSRCSHARED_H
+
+#include <stddef.h>
+
+#include "kerberoserr.h"
+#include "kerberosrcache.h"
+
+/*
+ * A replay cache shared between processes, for servers that run many
+ * prefork workers: the in-memory cache of each worker only catches replays
+ * to that worker, and MIT's file cache makes them all wait on one lock.
+ *
+ * Workers on a host attach the same POSIX shared memory segment, which
+ * holds an open addressing table of authenticator hashes updated with
+ * atomic compare-and-swap, so no process ever waits for another. Each
+ * slot is stamped with the epoch it was written in, and a slot whose
+ * epoch is older than the window is free to be reused, so nothing needs
+ * to sweep the table.
+ *
+ * Hosts that share a balanced address can instead connect to a daemon
+ * that keeps the table and answers over a Unix socket (forwarded to the
+ * other hosts as needed). krb_rcache_daemon_start runs one on a thread.
+ */
+
+#define KRB_RCACHE_SHARED_DEFAULT_SLOTS     (1 << 20)
+
+// How the shared cache is reached
+#define KRB_RCACHE_SHARED_DETACHED  0
+#define KRB_RCACHE_SHARED_SEGMENT   1
+#define KRB_RCACHE_SHARED_DAEMON    2
+
+typedef struct {
+    int                 mode;
+    char                name[256];
+    unsigned long long  slots;
+    unsigned long long  lookups;
+    unsigned long long  replays;
+    unsigned long long  inserts;
+    unsigned long long  full;
+} krb_rcache_shared_stats;
+
+// Attach the shared memory segment name (such as "/pykerberos-rcache"),
+// creating it with room for slots authenticators if it does not exist
+int krb_rcache_shared_attach(
+    const char *name, size_t slots, krb_error *error
+);
+
+// Use the daemon listening on the Unix socket path
+int krb_rcache_shared_connect(const char *path, krb_error *error);
+
+void krb_rcache_shared_detach(void);
+
+// As krb_rcache_check, against the shared cache
+int krb_rcache_shared_check(const krb_rcache_tag *tag, krb_error *error);
+
+// The counters of a segment are those of every process attached to it;
+// those of a daemon connection are this process's
+void krb_rcache_shared_get_stats(krb_rcache_shared_stats *stats);
+
+typedef struct krb_rcache_daemon krb_rcache_daemon;
+
+// Serve a table of slots authenticators on the Unix socket path, from a
+// thread of this process. The socket is created with the permission bits
+// mode, less the umask; a stale socket at path is replaced, anything else
+// there is an error.
+krb_rcache_daemon *krb_rcache_daemon_start(
+    const char *path, size_t slots, int mode, krb_error *error
+);
+
+// Stop the thread, remove the socket and free daemon
+void krb_rcache_daemon_stop(krb_rcache_daemon *daemon);
+
+void krb_rcache_daemon_get_stats(
+    const krb_rcache_daemon *daemon, krb_rcache_shared_stats *stats
+);
+
+#endif
@@ -0,0 +1,480 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberosspn.h"
+#include "kerberosgss.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest principal name read from a ticket
+#define SPN_NAME_SIZE   1024
+
+struct krb_spn_index {
+    size_t      count;
+    char**      names;
+    size_t*     lengths;
+    // Open addressing; each slot holds a principal's position plus one
+    size_t*     slots;
+    size_t      mask;
+};
+
+static const unsigned char spnego_oid[] = {
+    0x06, 0x06, 0x2b, 0x06, 0x01, 0x05, 0x05, 0x02
+};
+static const unsigned char krb5_oid[] = {
+    0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x12, 0x01, 0x02, 0x02
+};
+// The misencoded Kerberos OID that older Windows clients send
+static const unsigned char krb5_ms_oid[] = {
+    0x06, 0x09, 0x2a, 0x86, 0x48, 0x82, 0xf7, 0x12, 0x01, 0x02, 0x02
+};
+
+static uint64_t hash_name(const char *name, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+
+    // FNV-1a
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static long find_name(const krb_spn_index *index, const char *name, size_t len)
+{
+    size_t slot = (size_t)hash_name(name, len) & index->mask;
+
+    while (index->slots[slot] != 0) {
+        size_t i = index->slots[slot] - 1;
+
+        if (index->lengths[i] == len && memcmp(index->names[i], name, len) == 0) {
+            return (long)i;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    return -1;
+}
+
+krb_spn_index *krb_spn_index_create(
+    const char *const *spns, size_t count, krb_error *error
+) {
+    krb_spn_index *index = NULL;
+    krb5_context kcontext = NULL;
+    krb5_principal principal = NULL;
+    krb5_error_code code;
+    size_t slots = 2;
+    size_t i;
+
+    index = (krb_spn_index *)calloc(1, sizeof(*index));
+    if (index == NULL) {
+        krb_error_set_no_memory(error);
+        return NULL;
+    }
+    while (slots < count * 2) {
+        slots *= 2;
+    }
+    index->mask = slots - 1;
+    index->names = (char **)calloc(count ? count : 1, sizeof(char *));
+    index->lengths = (size_t *)calloc(count ? count : 1, sizeof(size_t));
+    index->slots = (size_t *)calloc(slots, sizeof(size_t));
+    if (index->names == NULL || index->lengths == NULL || index->slots == NULL) {
+        krb_error_set_no_memory(error);
+        goto fail;
+    }
+
+    code = krb5_init_context(&kcontext);
+    if (code) {
+        krb_error_set_nested(
+            error, KRB_ERROR_KRB, "Cannot initialize Kerberos5 context", code
+        );
+        kcontext = NULL;
+        goto fail;
+    }
+
+    for (i = 0; i < count; i++) {
+        char *pname = NULL;
+        size_t slot;
+
+        // Normalize, so that names match those read from tickets
+        code = krb5_parse_name(kcontext, spns[i], &principal);
+        if (code) {
+            krb_error_set_detail(
+                error, KRB_ERROR_KRB, "Cannot parse service principal",
+                spns[i]
+            );
+            goto fail;
+        }
+        code = krb5_unparse_name(kcontext, principal, &pname);
+        krb5_free_principal(kcontext, principal);
+        if (code) {
+            krb_error_set_nested(
+                error, KRB_ERROR_KRB, "Cannot unparse service principal", code
+            );
+            goto fail;
+        }
+        index->names[i] = strdup(pname);
+        krb5_free_unparsed_name(kcontext, pname);
+        if (index->names[i] == NULL) {
+            krb_error_set_no_memory(error);
+            goto fail;
+        }
+        index->lengths[i] = strlen(index->names[i]);
+        index->count = i + 1;
+
+        if (find_name(index, index->names[i], index->lengths[i]) >= 0) {
+            krb_error_set_detail(
+                error, KRB_ERROR_KRB, "Duplicate service principal",
+                index->names[i]
+            );
+            goto fail;
+        }
+        slot = (size_t)hash_name(index->names[i], index->lengths[i]) &
+            index->mask;
+        while (index->slots[slot] != 0) {
+            slot = (slot + 1) & index->mask;
+        }
+        index->slots[slot] = i + 1;
+    }
+
+    krb5_free_context(kcontext);
+    return index;
+
+fail:
+    if (kcontext != NULL) {
+        krb5_free_context(kcontext);
+    }
+    krb_spn_index_free(index);
+    return NULL;
+}
+
+void krb_spn_index_free(krb_spn_index *index)
+{
+    size_t i;
+
+    if (index == NULL) {
+        return;
+    }
+    if (index->names != NULL) {
+        for (i = 0; i < index->count; i++) {
+            free(index->names[i]);
+        }
+    }
+    free(index->names);
+    free(index->lengths);
+    free(index->slots);
+    free(index);
+}
+
+size_t krb_spn_index_count(const krb_spn_index *index)
+{
+    return index->count;
+}
+
+const char *krb_spn_index_name(const krb_spn_index *index, size_t i)
+{
+    return index->names[i];
+}
+
+/*
+ * A minimal DER reader, for the few fields on the way to the ticket's
+ * server name and the authenticator. Only single-byte tags occur on those
+ * paths.
+ */
+
+typedef struct {
+    const unsigned char*    p;
+    const unsigned char*    end;
+} der;
+
+// Read an element with the given tag into inner, and move past it
+static int der_read(der *d, unsigned char tag, der *inner)
+{
+    size_t len = 0;
+    size_t n;
+
+    if (d->end - d->p < 2 || d->p[0] != tag) {
+        return 0;
+    }
+    d->p++;
+    if (*d->p < 0x80) {
+        len = *d->p++;
+    } else {
+        n = *d->p++ & 0x7f;
+        if (n == 0 || n > sizeof(size_t) || (size_t)(d->end - d->p) < n) {
+            return 0;
+        }
+        while (n--) {
+            len = (len << 8) | *d->p++;
+        }
+    }
+    if ((size_t)(d->end - d->p) < len) {
+        return 0;
+    }
+    inner->p = d->p;
+    inner->end = d->p + len;
+    d->p += len;
+    return 1;
+}
+
+// Find the field with the given context tag in a SEQUENCE's contents
+static int der_field(const der *seq, unsigned char tag, der *field)
+{
+    der d = *seq;
+
+    while (d.p < d.end) {
+        if (d.p[0] == tag) {
+            return der_read(&d, tag, field);
+        }
+        if (! der_read(&d, d.p[0], field)) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int der_skip_oid(der *d, const unsigned char *oid, size_t len)
+{
+    if ((size_t)(d->end - d->p) < len || memcmp(d->p, oid, len) != 0) {
+        return 0;
+    }
+    d->p += len;
+    return 1;
+}
+
+// Append s to name the way krb5_unparse_name quotes it
+static int append_quoted(
+    char *name, size_t size, size_t *len, const der *s, int realm
+) {
+    const unsigned char *c;
+
+    for (c = s->p; c < s->end; c++) {
+        char quoted = 0;
+        // Other control characters only ever come from a bad token; keep
+        // them out of error messages as \xNN
+        int hex = (*c < 0x20 || *c == 0x7f);
+
+        switch (*c) {
+        case '/': quoted = realm ? 0 : '/'; break;
+        case '@': quoted = '@'; break;
+        case '\\': quoted = '\\'; break;
+        case '\0': quoted = '0'; break;
+        case '\n': quoted = 'n'; break;
+        case '\t': quoted = 't'; break;
+        case '\b': quoted = 'b'; break;
+        }
+        if (*len + (quoted ? 2 : hex ? 4 : 1) + 1 > size) {
+            return 0;
+        }
+        if (quoted) {
+            name[(*len)++] = '\\';
+            name[(*len)++] = quoted;
+        } else if (hex) {
+            snprintf(name + *len, 5, "\\x%02x", *c);
+            *len += 4;
+        } else {
+            name[(*len)++] = (char)*c;
+        }
+    }
+    name[*len] = '\0';
+    return 1;
+}
+
+/*
+ * Find the contents of the AP-REQ in a token:
+ *
+ *   [SPNEGO: 60 { OID, a0 { 30 { ..., a2 { 04 { mechToken } } } } }
+ *     or a1 { 30 { ..., a2 { 04 { responseToken } } } }]
+ *   mechToken: 60 { OID, 01 00, 6e { 30 { AP-REQ } } }
+ */
+static int token_ap_req(const void *token, size_t token_len, der *ap_req)
+{
+    der d = {token, (const unsigned char *)token + token_len};
+    der outer, inner, field;
+
+    if (d.p < d.end && d.p[0] == 0xa1) {
+        // A later SPNEGO leg, which carries the AP-REQ if the first did not
+        if (
+            ! der_read(&d, 0xa1, &inner) ||
+            ! der_read(&inner, 0x30, &field) ||
+            ! der_field(&field, 0xa2, &inner) ||
+            ! der_read(&inner, 0x04, &d)
+        ) {
+            return 0;
+        }
+    }
+    if (! der_read(&d, 0x60, &outer)) {
+        return 0;
+    }
+    if (der_skip_oid(&outer, spnego_oid, sizeof(spnego_oid))) {
+        if (
+            ! der_read(&outer, 0xa0, &inner) ||
+            ! der_read(&inner, 0x30, &field) ||
+            ! der_field(&field, 0xa2, &inner) ||
+            ! der_read(&inner, 0x04, &field)
+        ) {
+            return 0;
+        }
+        d = field;
+        if (! der_read(&d, 0x60, &outer)) {
+            return 0;
+        }
+    }
+    if (
+        ! der_skip_oid(&outer, krb5_oid, sizeof(krb5_oid)) &&
+        ! der_skip_oid(&outer, krb5_ms_oid, sizeof(krb5_ms_oid))
+    ) {
+        return 0;
+    }
+    // TOK_ID of an AP-REQ
+    if (outer.end - outer.p < 2 || outer.p[0] != 0x01 || outer.p[1] != 0x00) {
+        return 0;
+    }
+    outer.p += 2;
+
+    return der_read(&outer, 0x6e, &inner) && der_read(&inner, 0x30, ap_req);
+}
+
+/*
+ * Read the server principal of the ticket in an AP-REQ token into name:
+ *
+ *   AP-REQ: ..., a3 { Ticket }
+ *   Ticket: 61 { 30 { a0 vno, a1 { 1b realm }, a2 { 30 { a0 type,
+ *       a1 { 30 { 1b component ... } } } }, a3 enc-part } }
+ */
+static int token_sname(
+    const void *token, size_t token_len, char *name, size_t size
+) {
+    der ap_req, inner, field, ticket, sname, components, s;
+    size_t len = 0;
+    int first = 1;
+
+    if (! token_ap_req(token, token_len, &ap_req)) {
+        return 0;
+    }
+    if (
+        ! der_field(&ap_req, 0xa3, &inner) ||
+        ! der_read(&inner, 0x61, &field) ||
+        ! der_read(&field, 0x30, &ticket) ||
+        ! der_field(&ticket, 0xa2, &inner) ||
+        ! der_read(&inner, 0x30, &sname) ||
+        ! der_field(&sname, 0xa1, &inner) ||
+        ! der_read(&inner, 0x30, &components)
+    ) {
+        return 0;
+    }
+    while (components.p < components.end) {
+        if (! der_read(&components, 0x1b, &s)) {
+            return 0;
+        }
+        if (! first) {
+            if (len + 2 > size) {
+                return 0;
+            }
+            name[len++] = '/';
+        }
+        if (! append_quoted(name, size, &len, &s, 0)) {
+            return 0;
+        }
+        first = 0;
+    }
+
+    if (
+        first ||
+        ! der_field(&ticket, 0xa1, &inner) ||
+        ! der_read(&inner, 0x1b, &s) ||
+        len + 2 > size
+    ) {
+        return 0;
+    }
+    name[len++] = '@';
+    return append_quoted(name, size, &len, &s, 1);
+}
+
+/*
+ *   AP-REQ: ..., a4 { 30 { a0 etype, [a1 kvno,] a2 { 04 { cipher } } } }
+ */
+int krb_token_authenticator(
+    const void *token, size_t token_len, const void **cipher,
+    size_t *cipher_len
+) {
+    der ap_req, inner, field, data;
+
+    if (
+        ! token_ap_req(token, token_len, &ap_req) ||
+        ! der_field(&ap_req, 0xa4, &inner) ||
+        ! der_read(&inner, 0x30, &field) ||
+        ! der_field(&field, 0xa2, &inner) ||
+        ! der_read(&inner, 0x04, &data)
+    ) {
+        return 0;
+    }
+    *cipher = data.p;
+    *cipher_len = (size_t)(data.end - data.p);
+    return 1;
+}
+
+long krb_spn_index_lookup(
+    const krb_spn_index *index, const void *token, size_t token_len,
+    krb_error *error
+) {
+    char name[SPN_NAME_SIZE];
+    long i;
+
+    if (! token_sname(token, token_len, name, sizeof(name))) {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Token does not contain a Kerberos ticket"
+        );
+        return -1;
+    }
+    i = find_name(index, name, strlen(name));
+    if (i < 0) {
+        krb_error_set_detail(
+            error, KRB_ERROR_KRB, "Ticket is for an unknown service principal",
+            name
+        );
+    }
+    return i;
+}
+
+const char *krb_spn_route_token(
+    void *arg, const void *token, size_t token_len, krb_acceptor **acceptor,
+    krb_error *error
+) {
+    krb_spn_route *route = (krb_spn_route *)arg;
+    const char *name;
+
+    route->matched = krb_spn_index_lookup(
+        route->index, token, token_len, error
+    );
+    if (route->matched < 0) {
+        return NULL;
+    }
+    name = route->index->names[route->matched];
+    if (
+        krb_acceptor_get(
+            name, KRB_ACCEPTOR_PRINCIPAL, route->rcache, acceptor, error
+        ) == AUTH_GSS_ERROR
+    ) {
+        route->matched = -1;
+        return NULL;
+    }
+    return name;
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSSPN_H
+#define KERBEROSSPN_H
+
+#include <stddef.h>
+
+#include "kerberoscred.h"
+#include "kerberoserr.h"
+
+/*
+ * Routing of AP-REQs for a server that accepts as many service principals,
+ * such as a front for hundreds of virtual hosts sharing one keytab.
+ *
+ * Accepting with no service name makes GSSAPI search the whole keytab for
+ * the key of each ticket and leaves the caller to ask which principal was
+ * used. An index instead reads the ticket's server principal straight from
+ * the DER of the token (a Kerberos token, bare or wrapped in a SPNEGO
+ * NegTokenInit), finds it in a hash table of the principals it was built
+ * with, and accepts with the credentials of that principal alone.
+ *
+ * An index is immutable once built, so lookups need no lock.
+ */
+
+typedef struct krb_spn_index krb_spn_index;
+
+// Build an index of count principals, each normalized to the form
+// "service/host@REALM" (the default realm is added where none is given)
+krb_spn_index *krb_spn_index_create(
+    const char *const *spns, size_t count, krb_error *error
+);
+
+void krb_spn_index_free(krb_spn_index *index);
+
+size_t krb_spn_index_count(const krb_spn_index *index);
+
+// The normalized name of principal i
+const char *krb_spn_index_name(const krb_spn_index *index, size_t i);
+
+// The principal the ticket in token (decoded, not base64) is for, or -1
+// with error set if the token holds no ticket or the principal is unknown
+long krb_spn_index_lookup(
+    const krb_spn_index *index, const void *token, size_t token_len,
+    krb_error *error
+);
+
+// Find the encrypted authenticator of the AP-REQ in token (decoded, not
+// base64); returns 0 if there is none
+int krb_token_authenticator(
+    const void *token, size_t token_len, const void **cipher,
+    size_t *cipher_len
+);
+
+/*
+ * A gss_server_route for authenticate_gss_server_step_routed: arg is a
+ * krb_spn_route, whose matched is set to the principal the token was
+ * routed to. Credentials are acquired with the replay cache rcache.
+ */
+typedef struct {
+    const krb_spn_index*    index;
+    int                     rcache;
+    long                    matched;
+} krb_spn_route;
+
+const char *krb_spn_route_token(
+    void *arg, const void *token, size_t token_len, krb_acceptor **acceptor,
+    krb_error *error
+);
+
+#endif
@@ -0,0 +1,327 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "kerberoswatch.h"
+#include "kerberoscred.h"
+#include "kerberosgss.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+// Seconds to wait after a change for more before reloading
+#define WATCH_SETTLE    0.2
+
+// Seconds between checks of the file where inotify is not available
+#define WATCH_POLL      1.0
+
+// Seconds to wait before retrying a reload for expired keys that failed
+#define WATCH_RETRY     30.0
+
+struct krb_watch {
+    pthread_t           thread;
+    char*               path;
+    char*               dir;
+    const char*         base;
+    int                 stop_read;
+    int                 stop_write;
+    int                 events;
+    int                 detached;
+    krb_watch_notify    notify;
+    void*               arg;
+    struct stat         loaded;
+};
+
+// The path of a FILE: or WRFILE: keytab, or NULL for other types
+const char *krb_watch_path(const char *keytab)
+{
+    const char *colon = strchr(keytab, ':');
+    const char *slash = strchr(keytab, '/');
+
+    if (strncmp(keytab, "FILE:", 5) == 0) {
+        return keytab + 5;
+    }
+    if (strncmp(keytab, "WRFILE:", 7) == 0) {
+        return keytab + 7;
+    }
+    // A name without a type prefix is a file
+    if (colon == NULL || (slash != NULL && slash < colon)) {
+        return keytab;
+    }
+    return NULL;
+}
+
+static void free_watch(krb_watch *watch)
+{
+    if (watch->events >= 0) {
+        close(watch->events);
+    }
+    if (watch->stop_read >= 0) {
+        close(watch->stop_read);
+    }
+    if (watch->stop_write >= 0) {
+        close(watch->stop_write);
+    }
+    free(watch->path);
+    free(watch->dir);
+    free(watch);
+}
+
+static int reload(krb_watch *watch)
+{
+    krb_watch_event event;
+
+    krb_error_clear(&event.error);
+    event.entries = 0;
+    event.reloaded = (
+        krb_keytab_reload(&event.entries, &event.error) == AUTH_GSS_COMPLETE
+    );
+    watch->notify(watch->arg, &event);
+    return event.reloaded;
+}
+
+// Identify the file at path, to notice when it is replaced or rewritten
+static void stat_file(const char *path, struct stat *st)
+{
+    if (stat(path, st) != 0) {
+        memset(st, 0, sizeof(*st));
+    }
+}
+
+static int same_file(const struct stat *a, const struct stat *b)
+{
+    return (
+        a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+        a->st_size == b->st_size && a->st_mtime == b->st_mtime
+    );
+}
+
+static void *watch_thread(void *arg)
+{
+    krb_watch *watch = (krb_watch *)arg;
+    struct pollfd fds[2];
+    struct stat last;
+    struct stat now_st;
+    double settle = 0;
+    double hold = 0;
+    int events = watch->events;
+
+    last = watch->loaded;
+
+    fds[0].fd = watch->stop_read;
+    fds[0].events = POLLIN;
+    fds[1].fd = events;
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        double now = krb_monotonic_now();
+        double expiry = krb_keytab_expiry();
+        double deadline = settle;
+        int timeout = -1;
+        int changed = 0;
+        int others = 0;
+
+        if (expiry > 0 && expiry < hold) {
+            expiry = hold;
+        }
+        if (expiry > 0 && (deadline == 0 || expiry < deadline)) {
+            deadline = expiry;
+        }
+        if (events < 0 && (deadline == 0 || now + WATCH_POLL < deadline)) {
+            deadline = now + WATCH_POLL;
+        }
+        if (deadline > 0) {
+            timeout = (deadline > now) ? (int)((deadline - now) * 1000) + 1 : 0;
+        }
+
+        if (poll(fds, (events < 0) ? 1 : 2, timeout) < 0) {
+            continue;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+
+#if defined(__linux__)
+        if (events >= 0 && fds[1].revents) {
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t len;
+
+            while ((len = read(events, buf, sizeof(buf))) > 0) {
+                char *p = buf;
+
+                while (p < buf + len) {
+                    struct inotify_event *event = (struct inotify_event *)p;
+
+                    if (
+                        event->len &&
+                        strcmp(event->name, watch->base) == 0 &&
+                        (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                    ) {
+                        changed = 1;
+                    } else {
+                        // Anything else may still change the file: the
+                        // keytab may be a symlink through another name, as
+                        // when a mounted secret swaps its data directory,
+                        // so look at what the path now names
+                        others = 1;
+                    }
+                    p += sizeof(*event) + event->len;
+                }
+            }
+        }
+#endif
+        if (events < 0 || others) {
+            stat_file(watch->path, &now_st);
+            if (! same_file(&last, &now_st)) {
+                last = now_st;
+                changed = 1;
+            }
+        }
+
+        now = krb_monotonic_now();
+        if (changed) {
+            settle = now + WATCH_SETTLE;
+        } else if (
+            (settle > 0 && now >= settle) || (expiry > 0 && now >= expiry)
+        ) {
+            settle = 0;
+            stat_file(watch->path, &last);
+            hold = reload(watch) ? 0 : now + WATCH_RETRY;
+        }
+    }
+
+    if (watch->detached) {
+        free_watch(watch);
+    }
+    return NULL;
+}
+
+krb_watch *krb_watch_start(
+    const char *keytab, krb_watch_notify notify, void *arg, krb_error *error
+) {
+    krb_watch *watch = NULL;
+    const char *path = krb_watch_path(keytab);
+    char *slash;
+    int fds[2];
+    int i;
+
+    if (path == NULL) {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Only FILE: keytabs can be watched"
+        );
+        return NULL;
+    }
+
+    watch = (krb_watch *)calloc(1, sizeof(*watch));
+    if (watch == NULL) {
+        krb_error_set_no_memory(error);
+        return NULL;
+    }
+    watch->stop_read = watch->stop_write = watch->events = -1;
+    watch->notify = notify;
+    watch->arg = arg;
+
+    watch->path = strdup(path);
+    watch->dir = strdup(path);
+    if (watch->path == NULL || watch->dir == NULL) {
+        krb_error_set_no_memory(error);
+        free_watch(watch);
+        return NULL;
+    }
+    slash = strrchr(watch->dir, '/');
+    if (slash == NULL) {
+        strcpy(watch->dir, ".");
+        watch->base = watch->path;
+    } else {
+        *(slash == watch->dir ? slash + 1 : slash) = '\0';
+        watch->base = watch->path + (slash - watch->dir) + 1;
+    }
+
+    if (pipe(fds) != 0) {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Cannot create keytab watcher"
+        );
+        free_watch(watch);
+        return NULL;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    watch->stop_read = fds[0];
+    watch->stop_write = fds[1];
+
+#if defined(__linux__)
+    // Watch the directory, since keytabs are usually replaced by rename
+    // or through a symlink; without inotify the thread polls the file
+    watch->events = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (
+        watch->events >= 0 &&
+        inotify_add_watch(
+            watch->events, watch->dir,
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB
+        ) < 0
+    ) {
+        close(watch->events);
+        watch->events = -1;
+    }
+#endif
+
+    // Taken before the thread starts, so that a change made meanwhile is
+    // still noticed
+    stat_file(watch->path, &watch->loaded);
+
+    if (pthread_create(&watch->thread, NULL, watch_thread, watch) != 0) {
+        krb_error_set_message(
+            error, KRB_ERROR_KRB, "Cannot start keytab watcher thread"
+        );
+        free_watch(watch);
+        return NULL;
+    }
+
+    return watch;
+}
+
+void krb_watch_stop(krb_watch *watch)
+{
+    ssize_t written;
+
+    if (watch == NULL) {
+        return;
+    }
+
+    do {
+        written = write(watch->stop_write, "", 1);
+    } while (written < 0 && errno == EINTR);
+
+    // Stopped from notify: the thread frees the watch once notify returns
+    if (pthread_equal(pthread_self(), watch->thread)) {
+        watch->detached = 1;
+        pthread_detach(watch->thread);
+        return;
+    }
+
+    pthread_join(watch->thread, NULL);
+    free_watch(watch);
+}
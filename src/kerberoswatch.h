@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#ifndef KERBEROSWATCH_H
+#define KERBEROSWATCH_H
+
+#include <stddef.h>
+
+#include "kerberoserr.h"
+
+/*
+ * A native thread that reloads the keytab loaded with krb_keytab_load when
+ * the file it was read from changes, so that rotated keys are picked up
+ * without restarting the process. The file is watched with inotify where
+ * available and otherwise polled. Writes that follow one another closely
+ * are reloaded once, and the keytab is also reloaded when keys retained
+ * from the previous copy expire.
+ *
+ * notify is called on the watcher thread after every reload, with no
+ * locks held. It may stop the watcher.
+ */
+
+typedef struct krb_watch krb_watch;
+
+typedef struct {
+    int         reloaded;       // 0 if the reload failed
+    size_t      entries;
+    krb_error   error;
+} krb_watch_event;
+
+typedef void (*krb_watch_notify)(void *arg, const krb_watch_event *event);
+
+// The path of a FILE: or WRFILE: keytab name, or NULL for other types
+const char *krb_watch_path(const char *keytab);
+
+// Start watching keytab, a keytab name such as "FILE:/etc/krb5.keytab";
+// returns NULL and sets error if it is not a file or no thread can start
+krb_watch *krb_watch_start(
+    const char *keytab, krb_watch_notify notify, void *arg, krb_error *error
+);
+
+// Stop the thread and free watch; no notifications follow
+void krb_watch_stop(krb_watch *watch);
+
+#endif
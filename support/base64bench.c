@@ -0,0 +1,288 @@
+/**
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+/*
+ * Throughput benchmark and differential correctness check for src/base64.c.
+ *
+ * Build and run with "python setup.py bench_base64", or by hand:
+ *
+ *   cc -O2 -Isrc -o base64bench support/base64bench.c src/base64.c
+ *   ./base64bench [seconds-per-case]
+ *
+ * Every line of output is a JSON object. The exit status is non-zero if the
+ * codec disagrees with the reference implementation below.
+ */
+
+#include "base64.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Token sizes seen in Kerberos traffic: AP-REP, AP-REQ, and SPNEGO tokens
+// carrying large PACs
+static const struct {
+    const char *name;
+    size_t      size;
+} bench_sizes[] = {
+    { "ap-rep",      200 },
+    { "ap-req",     2048 },
+    { "pac-12k",   12288 },
+    { "pac-64k",   65536 },
+};
+
+static const char ref_basis[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Reference encoder: one 6-bit group at a time, no tables beyond the alphabet
+static size_t ref_encode(const unsigned char *src, size_t len, char *dst)
+{
+    size_t i, o = 0;
+
+    for (i = 0; i < len; i += 3) {
+        unsigned long v = (unsigned long)src[i] << 16;
+        if (i + 1 < len) v |= (unsigned long)src[i + 1] << 8;
+        if (i + 2 < len) v |= src[i + 2];
+        dst[o++] = ref_basis[(v >> 18) & 0x3f];
+        dst[o++] = ref_basis[(v >> 12) & 0x3f];
+        dst[o++] = (i + 1 < len) ? ref_basis[(v >> 6) & 0x3f] : '=';
+        dst[o++] = (i + 2 < len) ? ref_basis[v & 0x3f] : '=';
+    }
+
+    return o;
+}
+
+static int ref_value(int c)
+{
+    const char *p = (c == 0) ? NULL : strchr(ref_basis, c);
+    return p ? (int)(p - ref_basis) : -1;
+}
+
+// Reference decoder accepting the same grammar as base64_decode: a sequence
+// of 4-character groups, the last of which may end in "=" or "==".
+static int ref_decode(const char *src, size_t len, unsigned char *dst, size_t *out)
+{
+    size_t i;
+
+    *out = 0;
+    if (len % 4) {
+        return -1;
+    }
+    for (i = 0; i < len; i += 4) {
+        int a = ref_value(src[i]), b = ref_value(src[i + 1]);
+        int c = ref_value(src[i + 2]), d = ref_value(src[i + 3]);
+        if (a < 0 || b < 0) return -1;
+        if (c < 0 && src[i + 2] != '=') return -1;
+        if (d < 0 && src[i + 3] != '=') return -1;
+        if (src[i + 2] == '=' && src[i + 3] != '=') return -1;
+        if (src[i + 3] == '=' && i + 4 < len) return -1;
+        dst[(*out)++] = (a << 2) | (b >> 4);
+        if (src[i + 2] != '=') {
+            dst[(*out)++] = ((b << 4) & 0xf0) | (c >> 2);
+            if (src[i + 3] != '=') {
+                dst[(*out)++] = ((c << 6) & 0xc0) | d;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long rng_state = 0x2545f491;
+
+static unsigned char rng_byte(void)
+{
+    rng_state = rng_state * 6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned char)(rng_state >> 33);
+}
+
+// Compare the codec against the reference on round trips of every length up
+// to 4 KB plus the benchmark sizes, and on single-character corruptions.
+static int check_corpus(void)
+{
+    size_t maxlen = 65536 + 16;
+    unsigned char *data = malloc(maxlen);
+    unsigned char *got = malloc(maxlen);
+    unsigned char *want = malloc(maxlen);
+    char *enc = malloc(BASE64_ENCODED_SIZE(maxlen) + 1);
+    char *ref = malloc(BASE64_ENCODED_SIZE(maxlen) + 1);
+    size_t len, i, elen, glen, wlen;
+    unsigned long cases = 0, failures = 0;
+
+    if (!data || !got || !want || !enc || !ref) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (len = 0; len <= 65536 + 3; len++) {
+        if (len > 4096 && len < 65536 - 3 &&
+            len != 12288 && len != 12289 && len != 12290) {
+            continue;
+        }
+        for (i = 0; i < len; i++) {
+            data[i] = (len % 7 == 0) ? 0xff : rng_byte();
+        }
+
+        cases++;
+        base64_encode_into(data, len, enc, BASE64_ENCODED_SIZE(len) + 1, &elen);
+        if (elen != ref_encode(data, len, ref) || memcmp(enc, ref, elen)) {
+            printf("{\"check\": \"encode\", \"length\": %zu, \"ok\": false}\n", len);
+            failures++;
+            continue;
+        }
+
+        cases++;
+        if (base64_decode_into(enc, elen, got, maxlen, &glen) != BASE64_OK ||
+            glen != len || memcmp(got, data, len)) {
+            printf("{\"check\": \"decode\", \"length\": %zu, \"ok\": false}\n", len);
+            failures++;
+            continue;
+        }
+
+        // Corrupt one position with every byte value and check the codec
+        // accepts or rejects exactly what the reference does
+        if (len > 0 && len <= 96) {
+            size_t pos = rng_byte() % elen;
+            int c;
+            for (c = 0; c < 256; c++) {
+                char saved = enc[pos];
+                int gstat, wstat;
+                enc[pos] = (char)c;
+                gstat = base64_decode_into(enc, elen, got, maxlen, &glen);
+                wstat = ref_decode(enc, elen, want, &wlen);
+                enc[pos] = saved;
+                cases++;
+                if ((gstat == BASE64_OK) != (wstat == 0) ||
+                    (wstat == 0 && (glen != wlen || memcmp(got, want, wlen)))) {
+                    printf(
+                        "{\"check\": \"corrupt\", \"length\": %zu, "
+                        "\"position\": %zu, \"byte\": %d, \"ok\": false}\n",
+                        len, pos, c
+                    );
+                    failures++;
+                }
+            }
+        }
+    }
+
+    printf(
+        "{\"check\": \"corpus\", \"kernel\": \"%s\", \"cases\": %lu, "
+        "\"failures\": %lu, \"ok\": %s}\n",
+        base64_kernel(), cases, failures, failures ? "false" : "true"
+    );
+
+    free(data);
+    free(got);
+    free(want);
+    free(enc);
+    free(ref);
+    return failures != 0;
+}
+
+static void bench_case(const char *name, size_t size, double seconds)
+{
+    unsigned char *data = malloc(size);
+    unsigned char *back = malloc(BASE64_DECODED_SIZE(BASE64_ENCODED_SIZE(size)));
+    char *enc = malloc(BASE64_ENCODED_SIZE(size) + 1);
+    size_t i, elen = 0, dlen = 0;
+    unsigned long iters;
+    double start, elapsed;
+    volatile size_t sink = 0;
+
+    for (i = 0; i < size; i++) {
+        data[i] = rng_byte();
+    }
+
+    iters = 0;
+    start = now();
+    do {
+        for (i = 0; i < 64; i++) {
+            base64_encode_into(data, size, enc, BASE64_ENCODED_SIZE(size) + 1, &elen);
+            sink += elen;
+        }
+        iters += 64;
+        elapsed = now() - start;
+    } while (elapsed < seconds);
+    printf(
+        "{\"bench\": \"encode\", \"case\": \"%s\", \"bytes\": %zu, "
+        "\"kernel\": \"%s\", \"iterations\": %lu, \"seconds\": %.6f, "
+        "\"gbps\": %.4f}\n",
+        name, size, base64_kernel(), iters, elapsed,
+        (double)size * iters / elapsed / 1e9
+    );
+
+    iters = 0;
+    start = now();
+    do {
+        for (i = 0; i < 64; i++) {
+            if (base64_decode_into(
+                enc, elen, back, BASE64_DECODED_SIZE(elen), &dlen
+            ) != BASE64_OK) {
+                fprintf(stderr, "decode failed for %s\n", name);
+                exit(1);
+            }
+            sink += dlen;
+        }
+        iters += 64;
+        elapsed = now() - start;
+    } while (elapsed < seconds);
+    printf(
+        "{\"bench\": \"decode\", \"case\": \"%s\", \"bytes\": %zu, "
+        "\"kernel\": \"%s\", \"iterations\": %lu, \"seconds\": %.6f, "
+        "\"gbps\": %.4f}\n",
+        name, size, base64_kernel(), iters, elapsed,
+        (double)size * iters / elapsed / 1e9
+    );
+
+    free(data);
+    free(back);
+    free(enc);
+}
+
+int main(int argc, char * const argv[])
+{
+    double seconds = 0.25;
+    size_t i;
+    int failed;
+
+    if (argc > 1) {
+        seconds = atof(argv[1]);
+    }
+
+    // Measure the scalar codec first, then whatever the CPU dispatch selects
+    failed = check_corpus();
+    for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+        bench_case(bench_sizes[i].name, bench_sizes[i].size, seconds);
+    }
+
+    base64_init();
+    if (strcmp(base64_kernel(), "scalar") != 0) {
+        failed |= check_corpus();
+        for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+            bench_case(bench_sizes[i].name, bench_sizes[i].size, seconds);
+        }
+    }
+
+    return failed;
+}
@@ -27,22 +27,50 @@ Examples:
 
     ./test.py -s HTTP@example.com -h calendar.example.com -i 8008 server
 
-For the gssapi and server tests you will need to kinit a principal on the
-server first.
-"""
+    sudo ./test.py -s HTTP@example.com stress
+
+    sudo ./test.py -s HTTP@example.com alloc
+
+    sudo ./test.py -s HTTP@example.com stats
+
+    sudo ./test.py -s HTTP@example.com bytes
+
+    sudo ./test.py -s HTTP@example.com names
+
+    ./test.py pool
+
+    ./test.py async
+
+    ./test.py route
+
+    ./test.py watch
+
+    ./test.py base64
 
-from __future__ import print_function
+    sudo ./test.py -s HTTP@example.com rcache
+
+For the gssapi, server, stress, alloc, stats, bytes and names tests you
+will need to kinit a principal on the server first. The pool, async,
+route, watch and base64 tests need no Kerberos setup, and the rcache
+test only needs it for its checks of tokens.
+Tests that check results print each check, and the script exits with
+status 1 if any of them failed.
+"""
 
 import kerberos
+import asyncio
+import base64
 import getopt
+import os
+import struct
 import sys
 import socket
+import tempfile
 import ssl
+import threading
+import time
 
-try:
-    from http.client import HTTPSConnection, HTTPConnection
-except ImportError:
-    from httplib import HTTPSConnection, HTTPConnection
+from http.client import HTTPSConnection, HTTPConnection
 
 
 
@@ -56,7 +84,11 @@ def main():
     port = 8008
     mech = None
     use_ssl = False
-    allowedActions = ("service", "basic", "gssapi", "server",)
+    allowedActions = (
+        "service", "basic", "gssapi", "server", "stress", "alloc", "stats",
+        "bytes", "names", "pool", "async", "route", "watch", "base64",
+        "rcache",
+    )
 
     options, args = getopt.getopt(sys.argv[1:], "u:p:s:h:i:r:m:x")
 
@@ -109,17 +141,78 @@ def main():
         print("\n*** Running HTTP test")
         testHTTP(host, port, use_ssl, service, mech)
 
+    if "stress" in actions:
+        print("\n*** Running multi-threaded stress test")
+        testStress(service)
+
+    if "alloc" in actions:
+        print("\n*** Running allocation test")
+        testAllocations(service)
+
+    if "stats" in actions:
+        print("\n*** Running context statistics test")
+        testContextStats(service)
+
+    if "bytes" in actions:
+        print("\n*** Running raw token test")
+        testRawBytes(service)
+        testWrapInto(service)
+
+    if "names" in actions:
+        print("\n*** Running context name test")
+        testLazyNames(service)
+
+    if "pool" in actions:
+        print("\n*** Running worker pool argument test")
+        testWorkerPoolArguments()
+
+    if "async" in actions:
+        print("\n*** Running async worker pool test")
+        testAsyncPool()
+
+    if "route" in actions:
+        print("\n*** Running Acceptor routing test")
+        testRoute()
+
+    if "watch" in actions:
+        print("\n*** Running keytab watcher test")
+        testKeytabWatcher()
+
+    if "base64" in actions:
+        print("\n*** Running incremental base64 test")
+        testBase64()
+
+    if "rcache" in actions:
+        print("\n*** Running replay cache test")
+        testMemoryReplayCache(service)
+        testReplayCache(service)
+
     print("\n*** Done\n")
+    if failures:
+        print("%d checks failed" % (len(failures),))
+        sys.exit(1)
+
+
+
+failures = []
+
+def check(label, ok):
+    """
+    Report one check of a test, and remember it if it failed.
+    """
+    print("%s: %s" % ("ok" if ok else "FAILED", label))
+    if not ok:
+        failures.append(label)
 
 
 
 def testServicePrincipal(service, hostname):
     try:
         result = kerberos.getServerPrincipalDetails(service, hostname)
-    except kerberos.KrbError, e:
+    except kerberos.KrbError as e:
         print(
             "Kerberos service principal for %s/%s failed: %s"
-            % (service, hostname, e[0])
+            % (service, hostname, e.args[0])
         )
     else:
         print(
@@ -132,8 +225,8 @@ def testServicePrincipal(service, hostname):
 def testCheckpassword(user, pswd, service, realm):
     try:
         kerberos.checkPassword(user, pswd, service, realm)
-    except kerberos.BasicAuthError, e:
-        print("Kerberos authentication for %s failed: %s" % (user, e[0]))
+    except kerberos.BasicAuthError as e:
+        print("Kerberos authentication for %s failed: %s" % (user, e.args[0]))
     else:
         print("Kerberos authentication for %s succeeded" % user)
 
@@ -183,6 +276,877 @@ def testGSSAPI(service):
     rs = kerberos.authGSSServerClean(vs)
     print("Status for authGSSServerClean = %s" % statusText(rs))
 
+    # The same exchange with the one-shot server call
+    vc = kerberos.GSSClientContext(service)
+    vc.step("")
+    response, username, targetname, delegated = (
+        kerberos.authGSSServerAuthenticate(service, vc.response)
+    )
+    print("One-shot server user name: %s" % (username,))
+    print("One-shot server target name: %s" % (targetname,))
+    if response is not None:
+        rc = vc.step(response)
+        print("Status for one-shot authGSSClientStep = %s" % statusText(rc))
+    vc.clean()
+
+    # And with the one-shot client calls
+    for header in (
+        kerberos.authGSSClientNegotiate(service),
+        kerberos.GSSClientTarget(service).negotiate(),
+    ):
+        response, username, targetname, delegated = (
+            kerberos.authGSSServerAuthenticate(service, header.split(" ", 1)[1])
+        )
+        print("One-shot client header accepted for: %s" % (username,))
+
+
+
+def handshake(service):
+    vc = kerberos.GSSClientContext(service)
+    vs = kerberos.GSSServerContext(service)
+    vc.step("")
+    vs.step(vc.response)
+    vc.step(vs.response)
+    vc.clean()
+    vs.clean()
+
+
+
+def testStress(service, seconds=2.0):
+    """
+    Run independent client/server handshakes on 1, 2, 4, ... threads up to
+    the number of CPUs and report the handshake rate at each step, then have
+    several threads step and clean one shared context at once.  On a
+    free-threaded interpreter the rate should grow with the thread count.
+    """
+
+    def worker(deadline, counts, index):
+        count = 0
+        while time.monotonic() < deadline:
+            handshake(service)
+            count += 1
+        counts[index] = count
+
+    try:
+        handshake(service)
+    except kerberos.KrbError as e:
+        print("Could not complete a handshake: %s" % (e.args[0],))
+        return
+
+    gil = getattr(sys, "_is_gil_enabled", lambda: True)()
+    print("GIL enabled: %s" % (gil,))
+
+    cpus = os.cpu_count() or 1
+    single = None
+    threads = 1
+    while threads <= cpus:
+        counts = [0] * threads
+        deadline = time.monotonic() + seconds
+        workers = [
+            threading.Thread(target=worker, args=(deadline, counts, i))
+            for i in range(threads)
+        ]
+        for t in workers:
+            t.start()
+        for t in workers:
+            t.join()
+        rate = sum(counts) / seconds
+        if single is None:
+            single = rate
+        print(
+            "%3d threads: %10.1f handshakes/s (%.2fx)"
+            % (threads, rate, rate / single if single else 0.0)
+        )
+        threads *= 2
+
+    # Concurrent use of one context must only ever raise, never crash
+    shared = kerberos.GSSClientContext(service)
+    failures = []
+
+    def hammer(iterations):
+        for i in range(iterations):
+            try:
+                if i % 3 == 0:
+                    shared.clean()
+                    shared.__init__(service)
+                else:
+                    shared.step("")
+                    shared.response
+            except kerberos.KrbError:
+                pass
+            except Exception as e:
+                failures.append(e)
+
+    workers = [
+        threading.Thread(target=hammer, args=(1000,))
+        for _ignore_i in range(max(cpus, 4))
+    ]
+    for t in workers:
+        t.start()
+    for t in workers:
+        t.join()
+    if failures:
+        print("Shared context failed: %r" % (failures[0],))
+    else:
+        print("Shared context survived concurrent step/clean")
+
+
+
+def testAllocations(service, warmup=10, rounds=1000):
+    """
+    Check that once this thread has warmed up, handshakes on fresh contexts
+    make no heap allocations of their own for responses, tokens or names.
+    """
+    try:
+        for _ignore_i in range(warmup):
+            handshake(service)
+    except kerberos.KrbError as e:
+        print("Could not complete a handshake: %s" % (e.args[0],))
+        return
+
+    before = kerberos.contextStats()["buffer_allocations"]
+    for _ignore_i in range(rounds):
+        handshake(service)
+    after = kerberos.contextStats()["buffer_allocations"]
+
+    print("%d buffer allocations in %d handshakes" % (after - before, rounds))
+    check("no buffer allocations after warm-up", after == before)
+
+
+
+def openContexts(service):
+    """
+    Run a handshake for service, and return the client and server contexts
+    without cleaning them.
+    """
+    vc = kerberos.GSSClientContext(service)
+    vs = kerberos.GSSServerContext(service)
+    vc.step("")
+    vs.step(vc.response)
+    vc.step(vs.response)
+    return vc, vs
+
+
+
+def testContextStats(service):
+    """
+    Check that contextStats() counts the contexts holding GSSAPI state and
+    their bytes, and drops them again when they are cleaned or collected.
+    """
+    before = kerberos.contextStats()
+    check(
+        "contextStats() fields",
+        sorted(before) == [
+            "buffer_allocations", "client_bytes", "client_contexts",
+            "server_bytes", "server_contexts",
+        ]
+    )
+
+    try:
+        vc, vs = openContexts(service)
+    except kerberos.KrbError as e:
+        print("Could not complete a handshake: %s" % (e.args[0],))
+        return
+
+    during = kerberos.contextStats()
+    check(
+        "open contexts are counted",
+        during["client_contexts"] == before["client_contexts"] + 1 and
+        during["server_contexts"] == before["server_contexts"] + 1
+    )
+    check(
+        "open contexts retain bytes",
+        during["client_bytes"] > before["client_bytes"] and
+        during["server_bytes"] > before["server_bytes"]
+    )
+    check(
+        "buffer allocations do not go back",
+        during["buffer_allocations"] >= before["buffer_allocations"]
+    )
+
+    vc.clean()
+    vs.clean()
+    after = kerberos.contextStats()
+    del after["buffer_allocations"], before["buffer_allocations"]
+    check("cleaned contexts are released", after == before)
+
+    vc, vs = openContexts(service)
+    del vc, vs
+    after = kerberos.contextStats()
+    del after["buffer_allocations"]
+    check("collected contexts are released", after == before)
+
+
+
+def unwrapped(context, data, raw):
+    """
+    Unwrap data with unwrap_bytes(), or with unwrap() if raw is false, and
+    return the data, or the type of error raised.
+    """
+    try:
+        if raw:
+            return context.unwrap_bytes(data)
+        context.unwrap(base64.b64encode(data).decode())
+        return base64.b64decode(context.response or "")
+    except kerberos.KrbError as e:
+        return type(e)
+
+
+
+def testRawBytes(service):
+    """
+    Check that a handshake can be run on raw tokens with step_bytes(), and
+    that wrap_bytes() and unwrap_bytes() match the base64 calls.
+    """
+    vc = kerberos.GSSClientContext(service)
+    vs = kerberos.GSSServerContext(service)
+    try:
+        rc, token = vc.step_bytes(b"")
+    except kerberos.KrbError as e:
+        print("Could not start a handshake: %s" % (e.args[0],))
+        return
+    check(
+        "client step_bytes() returns a raw token",
+        isinstance(token, bytes) and len(token) > 0 and vc.response is None
+    )
+
+    try:
+        rc, reply = vs.step_bytes(bytearray(token))
+    except kerberos.KrbError as e:
+        print("Could not accept the token: %s" % (e.args[0],))
+        return
+    check(
+        "server step_bytes() returns a raw token",
+        rc == kerberos.AUTH_GSS_COMPLETE and isinstance(reply, bytes) and
+        vs.response is None
+    )
+    if reply:
+        rc, token = vc.step_bytes(memoryview(reply))
+    check(
+        "handshake on raw tokens completes",
+        rc == kerberos.AUTH_GSS_COMPLETE and vc.username == vs.username
+    )
+
+    payload = b"raw payload \x00\xff"
+    wrapped = vc.wrap_bytes(payload)
+    check(
+        "wrap_bytes() returns the message without base64",
+        isinstance(wrapped, bytes) and payload in wrapped
+    )
+    vc.wrap(base64.b64encode(payload).decode())
+    check(
+        "wrap() is base64 of the same message",
+        len(base64.b64decode(vc.response)) == len(wrapped)
+    )
+
+    check(
+        "unwrap_bytes() matches unwrap()",
+        unwrapped(vc, wrapped, True) == unwrapped(vc, wrapped, False)
+    )
+
+    vc.clean()
+    vs.clean()
+
+
+
+def testWrapInto(service):
+    """
+    Check that wrap_into() and unwrap_into() write what wrap_bytes() and
+    unwrap_bytes() return into a reusable buffer, and refuse buffers that
+    are too small or read-only.
+    """
+    try:
+        vc, vs = openContexts(service)
+    except kerberos.KrbError as e:
+        print("Could not complete a handshake: %s" % (e.args[0],))
+        return
+
+    payload = b"buffered payload"
+    buffer = bytearray(len(payload) + 256)
+    lengths = [vc.wrap_into(payload, buffer) for _ignore_i in range(2)]
+    wrapped = bytes(buffer[:lengths[1]])
+    check(
+        "wrap_into() writes the wrapped message",
+        lengths[0] == lengths[1] == len(vc.wrap_bytes(payload)) and
+        payload in wrapped
+    )
+
+    try:
+        vc.wrap_into(payload, bytearray(len(payload) // 2))
+        check("wrap_into() refuses a short buffer", False)
+    except ValueError:
+        check("wrap_into() refuses a short buffer", True)
+    try:
+        vc.wrap_into(payload, bytes(len(buffer)))
+        check("wrap_into() refuses a read-only buffer", False)
+    except TypeError:
+        check("wrap_into() refuses a read-only buffer", True)
+
+    expected = unwrapped(vc, wrapped, True)
+    try:
+        length = vc.unwrap_into(wrapped, memoryview(buffer))
+        result = bytes(buffer[:length])
+    except kerberos.KrbError as e:
+        result = type(e)
+    check("unwrap_into() matches unwrap_bytes()", result == expected)
+    if isinstance(expected, bytes) and expected:
+        try:
+            vc.unwrap_into(wrapped, bytearray(len(expected) - 1))
+            check("unwrap_into() refuses a short buffer", False)
+        except ValueError:
+            check("unwrap_into() refuses a short buffer", True)
+
+    vc.clean()
+    vs.clean()
+
+
+
+def raisesKrbError(call, *args):
+    """
+    Return whether call(*args) raises L{kerberos.KrbError}.
+    """
+    try:
+        call(*args)
+    except kerberos.KrbError:
+        return True
+    return False
+
+
+
+def testLazyNames(service):
+    """
+    Check that the names of a context are only looked up when first asked
+    for, are kept after that, and cannot be asked for once it is cleaned.
+    """
+    try:
+        vc, vs = openContexts(service)
+    except kerberos.KrbError as e:
+        print("Could not complete a handshake: %s" % (e.args[0],))
+        return
+
+    before = kerberos.contextStats()["server_bytes"]
+    username = vs.username
+    first = kerberos.contextStats()["server_bytes"]
+    check(
+        "user name looked up on first use",
+        isinstance(username, str) and first > before
+    )
+    check(
+        "user name kept",
+        vs.username == username and
+        kerberos.authGSSServerUserName(vs) == username and
+        kerberos.contextStats()["server_bytes"] == first
+    )
+    check("client and server agree on the user", vc.username == username)
+
+    # With no service name, the target is only known from the ticket
+    try:
+        vt = kerberos.GSSServerContext("")
+        vt.step(clientToken(service))
+    except kerberos.KrbError as e:
+        print("Skipping target name: %s" % (e.args[0],))
+    else:
+        before = kerberos.contextStats()["server_bytes"]
+        targetname = vt.targetname
+        check(
+            "target name looked up on first use",
+            isinstance(targetname, str) and
+            kerberos.contextStats()["server_bytes"] > before and
+            vt.targetname == targetname
+        )
+        vt.clean()
+
+    vc.clean()
+    vs.clean()
+    check(
+        "names after clean raise KrbError",
+        raisesKrbError(getattr, vs, "username") and
+        raisesKrbError(getattr, vs, "targetname") and
+        raisesKrbError(kerberos.authGSSServerUserName, vs) and
+        raisesKrbError(getattr, vc, "username")
+    )
+
+
+
+def testWorkerPoolArguments():
+    """
+    Check that WorkerPool refuses the string arguments the synchronous calls
+    refuse, rather than cutting them short at a NUL.
+    """
+    pool = kerberos.WorkerPool(threads=1)
+    calls = (
+        ("checkPassword", ("alice\0x", "pswd", "HTTP@h", "R")),
+        ("changePassword", ("alice", "old\0x", "new")),
+        ("getServerPrincipalDetails", ("HTTP", "host\0x")),
+        ("getServerPrincipalDetails", (b"HTTP", "host")),
+    )
+    for name, args in calls:
+        errors = []
+        for call in (getattr(kerberos, name), getattr(pool, name)):
+            try:
+                call(*args)
+                errors.append(None)
+            except (ValueError, TypeError) as e:
+                errors.append(type(e))
+            except kerberos.KrbError:
+                errors.append(None)
+        check(
+            "pool %s%r refused as synchronously" % (name, args),
+            errors[0] is not None and errors[0] == errors[1]
+        )
+    pool.close()
+
+
+
+def testAsyncPool():
+    """
+    Check that an AsyncWorkerPool keeps working across asyncio.run() calls,
+    and refuses a second loop while the first is still open.
+    """
+    pool = kerberos.AsyncWorkerPool(threads=2)
+
+    async def call():
+        try:
+            await pool.getServerPrincipalDetails("HTTP", "host.invalid")
+        except kerberos.KrbError:
+            pass
+        return True
+
+    for run in range(3):
+        try:
+            check("asyncio.run() #%d" % (run + 1,), asyncio.run(call()))
+        except Exception as e:
+            check("asyncio.run() #%d: %r" % (run + 1, e), False)
+
+    other = asyncio.new_event_loop()
+
+    async def outer():
+        await call()
+        try:
+            await asyncio.get_running_loop().run_in_executor(
+                None, other.run_until_complete, call()
+            )
+        except RuntimeError:
+            return True
+        return False
+
+    try:
+        check("second open loop refused", asyncio.run(outer()))
+    finally:
+        other.close()
+    check("rebinds after the loop closed", asyncio.run(call()))
+
+    async def embedded():
+        try:
+            await pool.getServerPrincipalDetails("HTTP", "host\0x")
+        except ValueError:
+            return True
+        return False
+
+    check("embedded NUL refused", asyncio.run(embedded()))
+    pool.close()
+
+
+
+def der(tag, body):
+    """
+    Encode one DER element.
+    """
+    if len(body) < 0x80:
+        length = bytes([len(body)])
+    else:
+        size = (len(body).bit_length() + 7) // 8
+        length = bytes([0x80 | size]) + len(body).to_bytes(size, "big")
+    return bytes([tag]) + length + body
+
+
+
+def apReq(components, realm, spnego=False):
+    """
+    Build a Kerberos AP-REQ token for the principal components@realm, as
+    components given as bytes, with a dummy ticket and authenticator.
+    """
+    krb5 = bytes.fromhex("06092a864886f712010202")
+    name = der(0x30, b"".join(der(0x1b, c) for c in components))
+    sname = der(0x30, der(0xa0, der(0x02, b"\x02")) + der(0xa1, name))
+    ticket = der(0x61, der(0x30,
+        der(0xa0, der(0x02, b"\x05")) + der(0xa1, der(0x1b, realm)) +
+        der(0xa2, sname) + der(0xa3, der(0x30, b"t" * 64))
+    ))
+    ap = der(0x6e, der(0x30,
+        der(0xa0, der(0x02, b"\x05")) + der(0xa1, der(0x02, b"\x0e")) +
+        der(0xa2, der(0x03, b"\x00" * 5)) + der(0xa3, ticket) +
+        der(0xa4, der(0x30, b"a" * 32))
+    ))
+    token = der(0x60, krb5 + b"\x01\x00" + ap)
+    if spnego:
+        init = der(0xa0, der(0x30,
+            der(0xa0, der(0x30, krb5)) + der(0xa2, der(0x04, token))
+        ))
+        token = der(0x60, bytes.fromhex("06062b0601050502") + init)
+    return token
+
+
+
+def testRoute():
+    """
+    Check that Acceptor.route() finds the principal of a ticket, and that
+    malformed tokens raise KrbError and nothing else.
+    """
+    acceptor = kerberos.Acceptor([
+        "HTTP/a.example.com@EXAMPLE.COM", "HTTP/b.example.com@EXAMPLE.COM",
+    ])
+
+    def routes(token):
+        try:
+            return acceptor.route(token)
+        except kerberos.KrbError:
+            return None
+        except Exception as e:
+            return e
+
+    good = apReq([b"HTTP", b"b.example.com"], b"EXAMPLE.COM")
+    check("bare AP-REQ", routes(good) == 1)
+    check(
+        "SPNEGO AP-REQ",
+        routes(apReq([b"HTTP", b"a.example.com"], b"EXAMPLE.COM", True)) == 0
+    )
+    check(
+        "unknown SPN",
+        routes(apReq([b"HTTP", b"c.example.com"], b"EXAMPLE.COM")) is None
+    )
+    check("empty token", routes(b"") is None)
+    check(
+        "every truncation",
+        all(routes(good[:i]) is None for i in range(len(good)))
+    )
+    for label, components in (
+        ("non-UTF-8 sname", [b"HTTP", b"\xff\xfe.example.com"]),
+        ("control characters in sname", [b"HTTP\x01", b"\x7f"]),
+    ):
+        check(label, routes(apReq(components, b"EXAMPLE.COM")) is None)
+
+    # The routed step reports the same failures as KrbError
+    try:
+        kerberos.Acceptor(["HTTP/a.example.com@EXAMPLE.COM"]).authenticate(
+            base64.b64encode(apReq([b"\xff"], b"EXAMPLE.COM")).decode()
+        )
+        check("routed step with non-UTF-8 sname", False)
+    except kerberos.KrbError as e:
+        check("routed step with non-UTF-8 sname", "\\xff" in str(e))
+    except Exception as e:
+        check("routed step with non-UTF-8 sname: %r" % (e,), False)
+
+
+
+def writeKeytab(path, kvno):
+    """
+    Write a keytab with one made-up key for HTTP/test.example.com.
+    """
+    def counted(data):
+        return struct.pack(">H", len(data)) + data
+
+    entry = (
+        struct.pack(">H", 2) + counted(b"EXAMPLE.COM") + counted(b"HTTP") +
+        counted(b"test.example.com") + struct.pack(">IIB", 1, 0, kvno) +
+        struct.pack(">H", 18) + counted(bytes(32)) + struct.pack(">I", kvno)
+    )
+    with open(path, "wb") as f:
+        f.write(b"\x05\x02" + struct.pack(">i", len(entry)) + entry)
+
+
+
+def testKeytabWatcher():
+    """
+    Check that a KeytabWatcher reloads a keytab replaced by rename, and one
+    reached through a symlink whose target is swapped the way Kubernetes
+    rotates mounted secrets.
+    """
+    def waitFor(watcher, reloads, seconds=5.0):
+        deadline = time.monotonic() + seconds
+        while watcher.reloads < reloads and time.monotonic() < deadline:
+            time.sleep(0.05)
+        return watcher.reloads >= reloads
+
+    directory = tempfile.mkdtemp()
+    try:
+        # Replaced by rename
+        path = os.path.join(directory, "krb5.keytab")
+        writeKeytab(path, 1)
+        with kerberos.KeytabWatcher(path, overlap=0) as watcher:
+            writeKeytab(path + ".new", 2)
+            os.rename(path + ".new", path)
+            check("reload after replace by rename", waitFor(watcher, 1))
+
+        # Swapped through a symlinked data directory
+        for name in ("..data_1", "..data_2"):
+            os.mkdir(os.path.join(directory, name))
+            writeKeytab(os.path.join(directory, name, "secret.keytab"), 3)
+        os.symlink("..data_1", os.path.join(directory, "..data"))
+        link = os.path.join(directory, "secret.keytab")
+        os.symlink(os.path.join("..data", "secret.keytab"), link)
+        with kerberos.KeytabWatcher(link, overlap=0) as watcher:
+            os.symlink("..data_2", os.path.join(directory, "..data_tmp"))
+            os.rename(
+                os.path.join(directory, "..data_tmp"),
+                os.path.join(directory, "..data")
+            )
+            check("reload after symlink swap", waitFor(watcher, 1))
+    except kerberos.KrbError as e:
+        check("keytab watcher: %s" % (e,), False)
+    finally:
+        kerberos.unloadKeytab()
+        for root, dirs, files in os.walk(directory, topdown=False):
+            for name in files + dirs:
+                path = os.path.join(root, name)
+                if os.path.islink(path) or not os.path.isdir(path):
+                    os.unlink(path)
+                else:
+                    os.rmdir(path)
+        os.rmdir(directory)
+
+
+
+def chunked(codec, data, splits):
+    """
+    Feed data to a new codec in the chunks between the split points, and
+    return everything it produced.
+    """
+    codec = codec()
+    output = b""
+    start = 0
+    for end in list(splits) + [len(data)]:
+        output += codec.update(data[start:end])
+        start = end
+    return output + codec.final()
+
+
+
+def testBase64():
+    """
+    Check Base64Encoder and Base64Decoder against the base64 module for
+    every point a few inputs can be split at, and that the decoder refuses
+    misplaced padding wherever the text is split.
+    """
+    inputs = (b"", b"a", b"ab", b"abc", b"abcd", bytes(range(256)))
+    for data in inputs:
+        text = base64.b64encode(data)
+        encoded = [
+            chunked(kerberos.Base64Encoder, data, (i,))
+            for i in range(len(data) + 1)
+        ]
+        encoded.append(
+            chunked(kerberos.Base64Encoder, data, range(1, len(data)))
+        )
+        check(
+            "encoder splits of %d bytes" % (len(data),),
+            all(e == text for e in encoded)
+        )
+        decoded = [
+            chunked(kerberos.Base64Decoder, text, (i,))
+            for i in range(len(text) + 1)
+        ]
+        decoded.append(
+            chunked(kerberos.Base64Decoder, text, range(1, len(text)))
+        )
+        check(
+            "decoder splits of %d bytes" % (len(data),),
+            all(d == data for d in decoded)
+        )
+
+    invalid = (
+        b"Q", b"QQ=", b"QUJD=", b"Q===", b"=QQQ", b"QQ=A", b"QQ==A",
+        b"QQ==QQ==", b"QU*D",
+    )
+    for text in invalid:
+        refused = 0
+        for i in range(len(text) + 1):
+            try:
+                chunked(kerberos.Base64Decoder, text, (i,))
+            except ValueError:
+                refused += 1
+        check(
+            "decoder refuses %r at every split" % (text,),
+            refused == len(text) + 1
+        )
+
+
+
+def clientToken(service):
+    """
+    Get the first token a client sends to service.
+    """
+    vc = kerberos.GSSClientContext(service)
+    try:
+        vc.step("")
+        return vc.response
+    finally:
+        vc.clean()
+
+
+
+def testMemoryReplayCache(service):
+    """
+    Check that the in-memory replay cache refuses a token used twice, and
+    one it cannot check, and still refuses a token seen before the window
+    changed or more than the clock skew ago.
+    """
+    check(
+        "default window is twice the clock skew",
+        kerberos.replayCacheStats()["window"] == 2 * 300
+    )
+
+    # Not a Kerberos AP-REQ, so there is no authenticator to record
+    untagged = base64.b64encode(b"NTLMSSP\x00\x01\x00\x00\x00").decode()
+    try:
+        kerberos.authGSSServerAuthenticate(service, untagged, rcache="memory")
+        check("token without an authenticator is refused", False)
+    except kerberos.KrbError:
+        check("token without an authenticator is refused", True)
+
+    try:
+        token = clientToken(service)
+        kerberos.authGSSServerAuthenticate(service, token, rcache="memory")
+    except kerberos.KrbError as e:
+        print("Skipping replays: no token accepted: %s" % (e.args[0],))
+        return
+
+    try:
+        kerberos.authGSSServerAuthenticate(service, token, rcache="memory")
+        check("second use of a token is refused", False)
+    except kerberos.KrbError:
+        check("second use of a token is refused", True)
+
+    window = kerberos.replayCacheStats()["window"]
+    try:
+        kerberos.setReplayCacheWindow(window * 2)
+        try:
+            kerberos.authGSSServerAuthenticate(
+                service, token, rcache="memory"
+            )
+            check("window change keeps the tokens seen", False)
+        except kerberos.KrbError:
+            check("window change keeps the tokens seen", True)
+
+        # A token stamped up to the skew ahead stays valid until up to twice
+        # the skew after it was accepted; scaled down to a skew of a second
+        skew = 1.0
+        kerberos.setReplayCacheWindow(2 * skew)
+        token = clientToken(service)
+        kerberos.authGSSServerAuthenticate(service, token, rcache="memory")
+        time.sleep(skew * 1.5)
+        try:
+            kerberos.authGSSServerAuthenticate(
+                service, token, rcache="memory"
+            )
+            check("token refused more than the skew later", False)
+        except kerberos.KrbError:
+            check("token refused more than the skew later", True)
+    finally:
+        kerberos.setReplayCacheWindow(window)
+
+
+
+def acceptInChildren(service, token, children=4):
+    """
+    Offer the same token to the shared replay cache from several forked
+    processes at once, and return how many of them accepted it.
+    """
+    r, w = os.pipe()
+    pids = []
+    for _ignore_i in range(children):
+        pid = os.fork()
+        if pid == 0:
+            os.close(r)
+            try:
+                kerberos.authGSSServerAuthenticate(
+                    service, token, rcache="shared"
+                )
+                os.write(w, b"1")
+            except BaseException:
+                os.write(w, b"0")
+            os._exit(0)
+        pids.append(pid)
+    os.close(w)
+    for pid in pids:
+        os.waitpid(pid, 0)
+    results = b""
+    while True:
+        data = os.read(r, 64)
+        if not data:
+            break
+        results += data
+    os.close(r)
+    return results.count(b"1")
+
+
+
+def testReplayCache(service):
+    """
+    Check that the replay cache daemon leaves paths that are not its own
+    sockets alone and keeps its socket private, and that a token replayed
+    in another process is caught through a shared segment and through a
+    daemon.
+    """
+    directory = tempfile.mkdtemp()
+    path = os.path.join(directory, "rcache.sock")
+    try:
+        with open(path, "w") as f:
+            f.write("not a socket")
+        try:
+            kerberos.ReplayCacheDaemon(path)
+            check("daemon refuses a path that is not a socket", False)
+        except kerberos.KrbError:
+            with open(path) as f:
+                check(
+                    "daemon refuses a path that is not a socket",
+                    f.read() == "not a socket"
+                )
+        os.unlink(path)
+
+        with kerberos.ReplayCacheDaemon(path):
+            mode = os.stat(path).st_mode & 0o777
+            check("daemon socket is private", mode == 0o600)
+            try:
+                kerberos.ReplayCacheDaemon(path)
+                check("second daemon on a live socket fails", False)
+            except kerberos.KrbError:
+                check("second daemon on a live socket fails", True)
+        check("daemon removes its socket", not os.path.exists(path))
+
+        try:
+            token = clientToken(service)
+        except kerberos.KrbError as e:
+            print("Skipping replays: no client token: %s" % (e.args[0],))
+            return
+
+        name = "/pykerberos-test-%d" % (os.getpid(),)
+        kerberos.attachReplayCache(name, slots=4096)
+        try:
+            check(
+                "replay caught across processes by a shared segment",
+                acceptInChildren(service, token) == 1
+            )
+        finally:
+            kerberos.detachReplayCache()
+            if os.path.exists("/dev/shm" + name):
+                os.unlink("/dev/shm" + name)
+
+        token = clientToken(service)
+        with kerberos.ReplayCacheDaemon(path, slots=4096):
+            kerberos.connectReplayCache(path)
+            try:
+                check(
+                    "replay caught across processes by a daemon",
+                    acceptInChildren(service, token) == 1
+                )
+            finally:
+                kerberos.detachReplayCache()
+    finally:
+        if os.path.exists(path):
+            os.unlink(path)
+        os.rmdir(directory)
+
 
 
 def testHTTP(host, port, use_ssl, service, mech):
@@ -253,16 +1217,16 @@ def testHTTP(host, port, use_ssl, service, mech):
             mech_oid = kerberos.GSS_MECH_OID_SPNEGO
 
         rc, vc = kerberos.authGSSClientInit(service=service, mech_oid=mech_oid)
-    except kerberos.GSSError, e:
-        print("Could not initialize GSSAPI: %s/%s" % (e[0][0], e[1][0]))
+    except kerberos.GSSError as e:
+        print("Could not initialize GSSAPI: %s/%s" % (e.args[0][0], e.args[1][0]))
         return
 
     try:
         kerberos.authGSSClientStep(vc, "")
-    except kerberos.GSSError, e:
+    except kerberos.GSSError as e:
         print(
             "Could not do GSSAPI step with continue: %s/%s"
-            % (e[0][0], e[1][0])
+            % (e.args[0][0], e.args[1][0])
         )
         return
 
@@ -276,7 +1240,7 @@ def testHTTP(host, port, use_ssl, service, mech):
         print("Second HTTP request to server failed")
         return
 
-    if response.status / 100 != 2:
+    if response.status // 100 != 2:
         print(
             "Second HTTP request did not result in a 2xx response: %d"
             % (response.status,)
@@ -303,18 +1267,18 @@ def testHTTP(host, port, use_ssl, service, mech):
 
     try:
         kerberos.authGSSClientStep(vc, splits[1])
-    except kerberos.GSSError, e:
+    except kerberos.GSSError as e:
         print(
             "Could not verify server www-authenticate header in second HTTP "
             "response: %s/%s"
-            % (e[0][0], e[1][0])
+            % (e.args[0][0], e.args[1][0])
         )
         return
 
     try:
         kerberos.authGSSClientClean(vc)
-    except kerberos.GSSError, e:
-        print("Could not clean-up GSSAPI: %s/%s" % (e[0][0], e[1][0]))
+    except kerberos.GSSError as e:
+        print("Could not clean-up GSSAPI: %s/%s" % (e.args[0][0], e.args[1][0]))
         return
 
     print("Authenticated successfully")